@@ -0,0 +1,592 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+
+#include <types.h>
+#include <klibc.h>
+#include <io.h>
+#include <kerrno.h>
+#include <kvmm.h>
+#include <pic.h>
+#include <apic.h>
+
+/* Local APIC registers */
+#define LAPIC_ID     0x020
+#define LAPIC_TPR    0x080
+#define LAPIC_EOI    0x0B0
+#define LAPIC_SVR    0x0F0
+#define LAPIC_ESR    0x280
+#define LAPIC_LINT0  0x350
+#define LAPIC_LINT1  0x360
+#define LAPIC_LVTERR 0x370
+
+#define LAPIC_SVR_ENABLE  (1 << 8)
+#define LAPIC_LVT_MASKED  (1 << 16)
+#define LAPIC_LVT_NMI     (4 << 8)
+
+#define MSR_APIC_BASE        0x1B
+#define MSR_APIC_BASE_ENABLE (1 << 11)
+
+#define CPUID_EDX_APIC (1 << 9)
+
+/* IOAPIC registers, accessed through IOREGSEL/IOWIN */
+#define IOAPIC_REGSEL 0x00
+#define IOAPIC_WIN    0x10
+#define IOAPIC_VER    0x01
+#define IOAPIC_REDTBL(pin) (0x10 + 2*(pin))
+
+#define IOAPIC_LOW_ACTIVE (1 << 13)
+#define IOAPIC_LEVEL      (1 << 15)
+#define IOAPIC_MASKED     (1 << 16)
+
+/* Polarity and trigger of the MADT overrides and MP interrupts, 0
+   when they conform to the bus */
+#define INTI_POLARITY_MASK 0x3
+#define INTI_POLARITY_HIGH 0x1
+#define INTI_POLARITY_LOW  0x3
+#define INTI_TRIGGER_MASK  0xC
+#define INTI_TRIGGER_EDGE  0x4
+#define INTI_TRIGGER_LEVEL 0xC
+
+#define NR_ISA_IRQS 16
+
+struct ioapic
+{
+  __u8 id;
+  __u32 paddr;
+  volatile __u32 *regs;
+  __u32 gsi_base;
+  __u32 nb_pins;
+};
+
+static struct
+{
+  bool enabled;
+  __u32 lapic_paddr;
+  volatile __u32 *lapic;
+
+  int nb_cpus;
+  __u8 cpu_ids[APIC_MAX_CPUS];
+
+  int nb_ioapics;
+  struct ioapic ioapics[APIC_MAX_IOAPICS];
+
+  /* The global system interrupt and the flags of each ISA IRQ */
+  __u32 isa_gsi[NR_ISA_IRQS];
+  __u16 isa_flags[NR_ISA_IRQS];
+
+  /* The IMCR routes the PIC output to the processor (MP table) */
+  bool has_imcr;
+} apic;
+
+
+static inline __u32 lapic_read(__u32 reg)
+{
+  return apic.lapic[reg / 4];
+}
+
+static inline void lapic_write(__u32 reg, __u32 value)
+{
+  apic.lapic[reg / 4] = value;
+}
+
+static inline __u32 ioapic_read(struct ioapic *io, __u32 reg)
+{
+  io->regs[IOAPIC_REGSEL / 4] = reg;
+  return io->regs[IOAPIC_WIN / 4];
+}
+
+static inline void ioapic_write(struct ioapic *io, __u32 reg, __u32 value)
+{
+  io->regs[IOAPIC_REGSEL / 4] = reg;
+  io->regs[IOAPIC_WIN / 4] = value;
+}
+
+
+static bool checksum_ok(const void *table, __u32 len)
+{
+  const __u8 *p = (const __u8*) table;
+  __u8 sum = 0;
+
+  while (len--)
+    sum += *p++;
+  return sum == 0;
+}
+
+
+/* Look for the signature on a 16 bytes boundary */
+static const void *scan_for(const char *sig, int sig_len,
+			    __u32 paddr, __u32 len)
+{
+  __u32 addr;
+
+  for (addr = paddr; addr + 16 <= paddr + len; addr += 16)
+    if (memcmp((const void*) addr, sig, sig_len) == 0)
+      return (const void*) addr;
+  return NULL;
+}
+
+
+/* The areas where the BIOS leaves its tables: the first kB of the
+   EBDA, the last kB of the base memory, and the BIOS ROM */
+static const void *bios_scan_for(const char *sig, int sig_len)
+{
+  __u32 ebda = (*(__u16*) 0x40E) << 4;
+  __u32 base_kb = *(__u16*) 0x413;
+  const void *found = NULL;
+
+  if (ebda)
+    found = scan_for(sig, sig_len, ebda, 1024);
+  if (! found && base_kb)
+    found = scan_for(sig, sig_len, base_kb * 1024 - 1024, 1024);
+  if (! found)
+    found = scan_for(sig, sig_len, 0xE0000, 0x20000);
+  return found;
+}
+
+
+static void apic_add_cpu(__u8 id)
+{
+  if (apic.nb_cpus < APIC_MAX_CPUS)
+    apic.cpu_ids[apic.nb_cpus++] = id;
+}
+
+
+static void apic_add_ioapic(__u8 id, __u32 paddr, __u32 gsi_base)
+{
+  struct ioapic *io;
+
+  if (apic.nb_ioapics >= APIC_MAX_IOAPICS)
+    return;
+
+  io = & apic.ioapics[apic.nb_ioapics++];
+  io->id = id;
+  io->paddr = paddr;
+  io->gsi_base = gsi_base;
+}
+
+
+/*
+ * ACPI: the MADT lists the processors, the IOAPICs, and the ISA IRQs
+ * not wired to the pin of the same number. The tables are read
+ * through the identity mapping of the kernel page directory.
+ */
+struct acpi_header
+{
+  char signature[4];
+  __u32 length;
+  __u8 revision;
+  __u8 checksum;
+  char oem[6];
+  char oem_table[8];
+  __u32 oem_revision;
+  __u32 creator_id;
+  __u32 creator_revision;
+} __attribute__((packed));
+
+struct acpi_rsdp
+{
+  char signature[8];
+  __u8 checksum;
+  char oem[6];
+  __u8 revision;
+  __u32 rsdt;
+} __attribute__((packed));
+
+#define MADT_LAPIC    0
+#define MADT_IOAPIC   1
+#define MADT_OVERRIDE 2
+
+static int madt_parse(void)
+{
+  const struct acpi_rsdp *rsdp;
+  const struct acpi_header *rsdt, *madt = NULL;
+  const __u8 *entry, *end;
+  int i, nb_tables;
+
+  rsdp = (const struct acpi_rsdp*) bios_scan_for("RSD PTR ", 8);
+  if (! rsdp || ! checksum_ok(rsdp, sizeof(struct acpi_rsdp)))
+    return -ENODEV;
+
+  rsdt = (const struct acpi_header*) rsdp->rsdt;
+  if (! rsdt || memcmp(rsdt->signature, "RSDT", 4) != 0
+      || ! checksum_ok(rsdt, rsdt->length))
+    return -ENODEV;
+
+  nb_tables = (rsdt->length - sizeof(struct acpi_header)) / 4;
+  for (i = 0; i < nb_tables && ! madt; i++)
+    {
+      const struct acpi_header *table
+	= (const struct acpi_header*) ((const __u32*) (rsdt + 1))[i];
+      if (memcmp(table->signature, "APIC", 4) == 0
+	  && checksum_ok(table, table->length))
+	madt = table;
+    }
+  if (! madt)
+    return -ENODEV;
+
+  /* After the header: the local APIC address and flags */
+  apic.lapic_paddr = *(const __u32*) (madt + 1);
+
+  entry = (const __u8*) (madt + 1) + 8;
+  end = (const __u8*) madt + madt->length;
+  for ( ; entry + 2 <= end && entry[1] >= 2; entry += entry[1])
+    {
+      switch (entry[0])
+	{
+	case MADT_LAPIC:
+	  /* Only the enabled processors */
+	  if (*(const __u32*) (entry + 4) & 1)
+	    apic_add_cpu(entry[3]);
+	  break;
+
+	case MADT_IOAPIC:
+	  apic_add_ioapic(entry[2], *(const __u32*) (entry + 4),
+			  *(const __u32*) (entry + 8));
+	  break;
+
+	case MADT_OVERRIDE:
+	  /* Bus 0 (ISA) */
+	  if (entry[2] == 0 && entry[3] < NR_ISA_IRQS)
+	    {
+	      apic.isa_gsi[entry[3]] = *(const __u32*) (entry + 4);
+	      apic.isa_flags[entry[3]] = *(const __u16*) (entry + 8);
+	    }
+	  break;
+	}
+    }
+
+  return OK;
+}
+
+
+/*
+ * Intel MultiProcessor specification 1.4: the same information in
+ * the MP configuration table, the ISA IRQs are listed per bus
+ */
+struct mp_floating
+{
+  char signature[4];
+  __u32 config;
+  __u8 length;
+  __u8 revision;
+  __u8 checksum;
+  __u8 features[5];
+} __attribute__((packed));
+
+struct mp_config
+{
+  char signature[4];
+  __u16 length;
+  __u8 revision;
+  __u8 checksum;
+  char oem[8];
+  char product[12];
+  __u32 oem_table;
+  __u16 oem_table_size;
+  __u16 nb_entries;
+  __u32 lapic;
+  __u16 ext_length;
+  __u8 ext_checksum;
+  __u8 reserved;
+} __attribute__((packed));
+
+#define MP_PROCESSOR 0
+#define MP_BUS       1
+#define MP_IOAPIC    2
+#define MP_IOINT     3
+#define MP_LINT      4
+
+#define MP_FEATURE2_IMCR (1 << 7)
+
+static int mp_parse(void)
+{
+  const struct mp_floating *mpf;
+  const struct mp_config *mpc;
+  const __u8 *entry;
+  bool bus_is_isa[256];
+  __u32 gsi_base = 0;
+  int i;
+
+  mpf = (const struct mp_floating*) bios_scan_for("_MP_", 4);
+  if (! mpf || ! checksum_ok(mpf, mpf->length * 16))
+    return -ENODEV;
+
+  /* The default configurations have no table: not supported */
+  if (mpf->features[0] || ! mpf->config)
+    return -ENODEV;
+
+  mpc = (const struct mp_config*) mpf->config;
+  if (memcmp(mpc->signature, "PCMP", 4) != 0
+      || ! checksum_ok(mpc, mpc->length))
+    return -ENODEV;
+
+  apic.lapic_paddr = mpc->lapic;
+  apic.has_imcr = (mpf->features[1] & MP_FEATURE2_IMCR) ? true : false;
+  memset(bus_is_isa, 0x0, sizeof(bus_is_isa));
+
+  /* The entries are sorted by type: the buses and the IOAPICs come
+     before the interrupts */
+  entry = (const __u8*) (mpc + 1);
+  for (i = 0; i < mpc->nb_entries; i++)
+    {
+      switch (entry[0])
+	{
+	case MP_PROCESSOR:
+	  if (entry[3] & 1)
+	    apic_add_cpu(entry[1]);
+	  entry += 20;
+	  break;
+
+	case MP_BUS:
+	  bus_is_isa[entry[1]] = (memcmp(entry + 2, "ISA", 3) == 0);
+	  entry += 8;
+	  break;
+
+	case MP_IOAPIC:
+	  if (entry[3] & 1)
+	    {
+	      apic_add_ioapic(entry[1], *(const __u32*) (entry + 4), gsi_base);
+	      /* The number of pins is only known from the IOAPIC */
+	      gsi_base += 24;
+	    }
+	  entry += 8;
+	  break;
+
+	case MP_IOINT:
+	  /* Type INT (vectored), from an ISA bus */
+	  if (entry[1] == 0 && bus_is_isa[entry[4]] && entry[5] < NR_ISA_IRQS)
+	    {
+	      int j;
+	      for (j = 0; j < apic.nb_ioapics; j++)
+		if (apic.ioapics[j].id == entry[6] || entry[6] == 0xFF)
+		  {
+		    apic.isa_gsi[entry[5]] = apic.ioapics[j].gsi_base + entry[7];
+		    apic.isa_flags[entry[5]] = *(const __u16*) (entry + 2);
+		    break;
+		  }
+	    }
+	  entry += 8;
+	  break;
+
+	case MP_LINT:
+	  entry += 8;
+	  break;
+
+	default:
+	  /* Unknown entry: its size is unknown too */
+	  return (apic.nb_ioapics > 0) ? OK : -ENODEV;
+	}
+    }
+
+  return OK;
+}
+
+
+static struct ioapic *ioapic_for_gsi(__u32 gsi, __u32 *pin)
+{
+  int i;
+
+  for (i = 0; i < apic.nb_ioapics; i++)
+    {
+      struct ioapic *io = & apic.ioapics[i];
+      if (gsi >= io->gsi_base && gsi < io->gsi_base + io->nb_pins)
+	{
+	  *pin = gsi - io->gsi_base;
+	  return io;
+	}
+    }
+  return NULL;
+}
+
+
+/* Same vectors as with the PICs, see init_pic() */
+static __u8 isa_vector(int irq)
+{
+  return (irq < 8) ? PIC_MASTER_VECTOR + irq : PIC_SLAVE_VECTOR + irq - 8;
+}
+
+
+static int ioapic_route(int irq, __u8 apic_id)
+{
+  struct ioapic *io;
+  __u32 pin, low;
+
+  io = ioapic_for_gsi(apic.isa_gsi[irq], & pin);
+  if (! io)
+    return -ENODEV;
+
+  /* ISA default: edge triggered, active high */
+  low = isa_vector(irq);
+  if ((apic.isa_flags[irq] & INTI_POLARITY_MASK) == INTI_POLARITY_LOW)
+    low |= IOAPIC_LOW_ACTIVE;
+  if ((apic.isa_flags[irq] & INTI_TRIGGER_MASK) == INTI_TRIGGER_LEVEL)
+    low |= IOAPIC_LEVEL;
+
+  /* Physical destination mode, fixed delivery */
+  ioapic_write(io, IOAPIC_REDTBL(pin), IOAPIC_MASKED);
+  ioapic_write(io, IOAPIC_REDTBL(pin) + 1, (__u32) apic_id << 24);
+  ioapic_write(io, IOAPIC_REDTBL(pin), low);
+  return OK;
+}
+
+
+static inline void rdmsr(__u32 msr, __u32 *low, __u32 *high)
+{
+  asm volatile("rdmsr" : "=a"(*low), "=d"(*high) : "c"(msr));
+}
+
+static inline void wrmsr(__u32 msr, __u32 low, __u32 high)
+{
+  asm volatile("wrmsr" :: "c"(msr), "a"(low), "d"(high));
+}
+
+
+int apic_subsystem_setup(void)
+{
+  __u32 eax, ebx, ecx, edx, low, high;
+  int i, irq;
+
+  asm volatile("cpuid"
+	       : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+	       : "a"(1));
+  if (! (edx & CPUID_EDX_APIC))
+    return -ENODEV;
+
+  for (irq = 0; irq < NR_ISA_IRQS; irq++)
+    apic.isa_gsi[irq] = irq;
+
+  if (madt_parse() != OK)
+    {
+      apic.nb_cpus = apic.nb_ioapics = 0;
+      if (mp_parse() != OK)
+	return -ENODEV;
+    }
+  if (! apic.nb_ioapics || ! apic.lapic_paddr)
+    return -ENODEV;
+
+  /* Enable the local APIC, in case the BIOS did not */
+  rdmsr(MSR_APIC_BASE, & low, & high);
+  wrmsr(MSR_APIC_BASE, low | MSR_APIC_BASE_ENABLE, high);
+
+  apic.lapic = (volatile __u32*) kvmm_map_io(apic.lapic_paddr, 0x400);
+  if (! apic.lapic)
+    return -ENOMEM;
+
+  for (i = 0; i < apic.nb_ioapics; i++)
+    {
+      struct ioapic *io = & apic.ioapics[i];
+      __u32 pin;
+
+      io->regs = (volatile __u32*) kvmm_map_io(io->paddr, 0x20);
+      if (! io->regs)
+	return -ENOMEM;
+
+      io->nb_pins = ((ioapic_read(io, IOAPIC_VER) >> 16) & 0xFF) + 1;
+      for (pin = 0; pin < io->nb_pins; pin++)
+	ioapic_write(io, IOAPIC_REDTBL(pin), IOAPIC_MASKED);
+    }
+
+  lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+  lapic_write(LAPIC_TPR, 0);
+  lapic_write(LAPIC_LINT0, LAPIC_LVT_MASKED);
+  lapic_write(LAPIC_LINT1, LAPIC_LVT_NMI);
+  lapic_write(LAPIC_LVTERR, LAPIC_LVT_MASKED);
+  lapic_write(LAPIC_ESR, 0);
+
+  /* Switch from the PICs to the IOAPIC */
+  pic_disable();
+  if (apic.has_imcr)
+    {
+      outb(0x22, 0x70);
+      outb(0x23, 0x01);
+    }
+
+  /* The line 2 is the cascade of the PICs */
+  for (irq = 0; irq < NR_ISA_IRQS; irq++)
+    if (irq != 2)
+      ioapic_route(irq, apic_cpu_id());
+
+  apic.enabled = true;
+
+  kprintf("kernel: %d CPU(s), %d IOAPIC(s), IRQs through the IOAPIC\n",
+	  apic.nb_cpus, apic.nb_ioapics);
+  return OK;
+}
+
+
+bool apic_enabled(void)
+{
+  return apic.enabled;
+}
+
+
+void apic_eoi(void)
+{
+  lapic_write(LAPIC_EOI, 0);
+}
+
+
+__u8 apic_cpu_id(void)
+{
+  return lapic_read(LAPIC_ID) >> 24;
+}
+
+
+int apic_set_irq_affinity(int irq, __u8 apic_id)
+{
+  int i;
+
+  if (! apic.enabled)
+    return -ENODEV;
+  if (irq < 0 || irq >= NR_ISA_IRQS || irq == 2)
+    return -EINVAL;
+
+  for (i = 0; i < apic.nb_cpus; i++)
+    if (apic.cpu_ids[i] == apic_id)
+      return ioapic_route(irq, apic_id);
+
+  return -EINVAL;
+}
+
+
+int apic_set_irq_mode(int irq, int mode)
+{
+  struct ioapic *io;
+  __u32 pin;
+
+  if (! apic.enabled)
+    return -ENODEV;
+  if (irq < 0 || irq >= NR_ISA_IRQS || irq == 2)
+    return -EINVAL;
+
+  io = ioapic_for_gsi(apic.isa_gsi[irq], & pin);
+  if (! io)
+    return -ENODEV;
+
+  /* What the firmware says about the line is right */
+  if ((apic.isa_flags[irq] & INTI_POLARITY_MASK) == 0)
+    apic.isa_flags[irq] |= (mode & APIC_IRQ_LOW_ACTIVE)
+      ? INTI_POLARITY_LOW : INTI_POLARITY_HIGH;
+  if ((apic.isa_flags[irq] & INTI_TRIGGER_MASK) == 0)
+    apic.isa_flags[irq] |= (mode & APIC_IRQ_LEVEL)
+      ? INTI_TRIGGER_LEVEL : INTI_TRIGGER_EDGE;
+
+  /* Same destination as before */
+  return ioapic_route(irq, ioapic_read(io, IOAPIC_REDTBL(pin) + 1) >> 24);
+}
@@ -5,8 +5,12 @@
 #include <kerrno.h>
 #include <debug.h>
 #include <kmalloc.h>
+#include <klibc.h>
+#include <interrupt.h>
+#include <time.h>
 #include <fs/devfs.h>
 #include <vfs.h>
+#include <uaccess.h>
 #include "fs/ext2/ext2_internal.h"
 
 int blockdev_wrap_read(open_file_descriptor *this,void* buf, __u32 count, __u64 offset);
@@ -41,6 +45,11 @@ struct blockdev_instance
   /** Major/minor for the device */
   struct fs_dev_id_t dev_id;
 
+  /** Name in devfs */
+  const char *name;
+
+  struct blockdev_stats stats;
+
   struct blockdev_operations * operations;
 
 
@@ -126,6 +135,9 @@ int blockdev_register_disk (const char* name,__u32     device_class,
   blockdev->parent_blockdev        = NULL;
   blockdev->index_of_first_block   = 0;
 
+  blockdev->name                   = name;
+  memset(& blockdev->stats, 0x0, sizeof(struct blockdev_stats));
+
   /* Prepare the blkcache related stuff */
   blockdev->operations             = blockdev_ops;
   blockdev->custom_data            = blockdev_instance_custom_data;
@@ -191,6 +203,9 @@ int blockdev_register_partition(const char* name,__u32 device_class,
   blockdev->index_of_first_block
     = parent_bd->index_of_first_block + index_of_first_block;
 
+  blockdev->name                   = name;
+  memset(& blockdev->stats, 0x0, sizeof(struct blockdev_stats));
+
   /* Prepare the blkcache related stuff */
   blockdev->operations             = parent_bd->operations;
   blockdev->custom_data            = parent_bd->custom_data;
@@ -229,45 +244,119 @@ int blockdev_release_instance(struct  blockdev_instance * blockdev)
   return OK;
 }
 
+static inline __u64 rdtsc(void)
+{
+  __u64 tsc;
+  asm volatile("rdtsc" : "=A"(tsc));
+  return tsc;
+}
+
+
+/**
+ * Transfer one block through the driver, and account it on the
+ * device and on the disk of a partition
+ */
+static int blockdev_do_io(struct blockdev_instance * blockdev, int dir,
+			  void * buf, __u64 block_id)
+{
+  struct blockdev_instance * bd;
+  __u64 start, cycles;
+  __u32 flags;
+  int retval, bucket = 0;
+
+  disable_IRQs(flags);
+  for (bd = blockdev; bd; bd = bd->parent_blockdev)
+    bd->stats.in_flight ++;
+  restore_IRQs(flags);
+
+  start = rdtsc();
+  if (dir == BLOCKDEV_READ)
+    retval = blockdev->operations->read_block(blockdev->custom_data,
+					      buf, block_id);
+  else
+    retval = blockdev->operations->write_block(blockdev->custom_data,
+					       buf, block_id);
+  cycles = rdtsc() - start;
+
+  while (bucket < BLOCKDEV_LATENCY_BUCKETS - 1 && (cycles >> (bucket + 10)))
+    bucket++;
+
+  disable_IRQs(flags);
+  for (bd = blockdev; bd; bd = bd->parent_blockdev)
+    {
+      bd->stats.in_flight --;
+      bd->stats.ios[dir] ++;
+      bd->stats.service_cycles[dir] += cycles;
+      bd->stats.latency[dir][bucket] ++;
+      if (OK != retval)
+	bd->stats.errors ++;
+    }
+  restore_IRQs(flags);
+
+  return retval;
+}
+
+
+static void blockdev_account_request(struct blockdev_instance * blockdev,
+				     int dir, __u32 bytes, __u64 start)
+{
+  struct blockdev_instance * bd;
+  __u64 cycles = rdtsc() - start;
+  __u32 flags;
+
+  disable_IRQs(flags);
+  for (bd = blockdev; bd; bd = bd->parent_blockdev)
+    {
+      bd->stats.requests[dir] ++;
+      bd->stats.bytes[dir] += bytes;
+      bd->stats.request_cycles[dir] += cycles;
+    }
+  restore_IRQs(flags);
+}
+
+
+static void blockdev_account_rmw(struct blockdev_instance * blockdev)
+{
+  struct blockdev_instance * bd;
+  __u32 flags;
+
+  disable_IRQs(flags);
+  for (bd = blockdev; bd; bd = bd->parent_blockdev)
+    bd->stats.rmw ++;
+  restore_IRQs(flags);
+}
+
+
+/**
+ * Read *len bytes of the device at the given offset. The whole blocks
+ * are read directly into the destination buffer: only the partial
+ * blocks at both ends go through a bounce buffer
+ */
 static int blockdev_generic_read(struct blockdev_instance * blockdev,
 		       __u64 offset_in_device,
 		       __u32 buff_addr,
 		       __u32 * /* in/out */len)
 {
-  int rdbytes = 0;
-
-
+  __u32 rdbytes = 0;
+  __u32 block_data = (__u32)NULL;
+  int retval = OK;
+  __u64 start = rdtsc();
 
   while (rdbytes < *len)
     {
-       
-
-      int retval;
-     __u32 offset_in_block, wrbytes;
+      __u32 offset_in_block, wrbytes;
       /* Get the block at the current offset */
       __u64 block_id
 	= offset_in_device / blockdev->block_size;
 
-
       /* reaching the end of the device ? */
       if (block_id >= blockdev->number_of_blocks)
 	break;
 
-      wrbytes = *len - rdbytes;
-
-     
       /* Translating this block index into an offset inside the
 	 disk */
       block_id += blockdev->index_of_first_block;
 
-      __u32 block_data = kmalloc(blockdev->block_size ,0);
-
-      if (OK != blockdev->operations->read_block(blockdev->custom_data,
-				block_data ,block_id ))
-     debug("blockdev op");
-      
-
-      /* Copy the data to user */
       offset_in_block
 	= offset_in_device % blockdev->block_size;
       wrbytes
@@ -275,16 +364,40 @@ static int blockdev_generic_read(struct blockdev_instance * blockdev,
       if (*len - rdbytes < wrbytes)
 	wrbytes = *len - rdbytes;
 
-      memcpy(buff_addr + rdbytes ,block_data + offset_in_block,wrbytes);
-      
-	  rdbytes          += wrbytes;
-	  offset_in_device += wrbytes;
-	
-   
+      /* Whole block: let the driver transfer it in place */
+      if (wrbytes == blockdev->block_size)
+	{
+	  if (OK != blockdev_do_io(blockdev, BLOCKDEV_READ,
+				   (void*)(buff_addr + rdbytes), block_id))
+	    { retval = -EIO; break; }
+	}
+      else
+	{
+	  if (! block_data)
+	    {
+	      block_data = kmalloc(blockdev->block_size, 0);
+	      if (! block_data)
+		{ retval = -ENOMEM; break; }
+	    }
+
+	  if (OK != blockdev_do_io(blockdev, BLOCKDEV_READ,
+				   (void*)block_data, block_id))
+	    { retval = -EIO; break; }
+
+	  memcpy((void*)(buff_addr + rdbytes),
+		 (void*)(block_data + offset_in_block), wrbytes);
+	}
+
+      rdbytes          += wrbytes;
+      offset_in_device += wrbytes;
     }
 
+  if (block_data)
+    kfree(block_data);
+
   *len = rdbytes;
-  return OK;
+  blockdev_account_request(blockdev, BLOCKDEV_READ, rdbytes, start);
+  return retval;
 }
 
 int blockdev_kernel_read(struct blockdev_instance * blockdev,
@@ -321,6 +434,11 @@ int blockdev_wrap_read(open_file_descriptor *this,void* buf, __u32 count, __u64
   return retval;
 }
 
+/**
+ * Write *len bytes to the device at the given offset. As for reads,
+ * the whole blocks are transferred directly from the source buffer;
+ * the partial blocks are read, modified and written back
+ */
 static int
 blockdev_generic_write(struct blockdev_instance * blockdev,
 		       __u64 offset_in_device,
@@ -328,11 +446,12 @@ blockdev_generic_write(struct blockdev_instance * blockdev,
 		       __u32 * /* in/out */len)
 {
   __u32 wrbytes = 0;
+  __u32 block_data = (__u32)NULL;
+  int retval = OK;
+  __u64 start = rdtsc();
 
   while (wrbytes < *len)
     {
-    
-      int retval;
       __u32 offset_in_block, usrbytes;
 
       /* Get the block at the current file offset */
@@ -343,8 +462,6 @@ blockdev_generic_write(struct blockdev_instance * blockdev,
       if (block_id >= blockdev->number_of_blocks)
 	break;
 
-      usrbytes = *len - wrbytes;
-
       /* Translating this block index into an offset inside the
 	 disk */
       block_id += blockdev->index_of_first_block;
@@ -357,23 +474,45 @@ blockdev_generic_write(struct blockdev_instance * blockdev,
       if (*len - wrbytes < usrbytes)
 	usrbytes = *len - wrbytes;
 
-       __u32 block_data = kmalloc(blockdev->block_size ,0);
-       
-
-       memcpy(block_data + offset_in_block , buff_addr ,usrbytes);
-
-      if (OK != blockdev->operations->write_block(blockdev->custom_data,
-				block_data ,block_id ))
-     debug("blockdev op");
-     
-
-	  wrbytes          += usrbytes;
-	  offset_in_device += usrbytes;
-	
+      if (usrbytes == blockdev->block_size)
+	{
+	  if (OK != blockdev_do_io(blockdev, BLOCKDEV_WRITE,
+				   (void*)(buff_addr + wrbytes), block_id))
+	    { retval = -EIO; break; }
+	}
+      else
+	{
+	  if (! block_data)
+	    {
+	      block_data = kmalloc(blockdev->block_size, 0);
+	      if (! block_data)
+		{ retval = -ENOMEM; break; }
+	    }
+
+	  /* Keep the rest of the block */
+	  blockdev_account_rmw(blockdev);
+	  if (OK != blockdev_do_io(blockdev, BLOCKDEV_READ,
+				   (void*)block_data, block_id))
+	    { retval = -EIO; break; }
+
+	  memcpy((void*)(block_data + offset_in_block),
+		 (void*)(buff_addr + wrbytes), usrbytes);
+
+	  if (OK != blockdev_do_io(blockdev, BLOCKDEV_WRITE,
+				   (void*)block_data, block_id))
+	    { retval = -EIO; break; }
+	}
+
+      wrbytes          += usrbytes;
+      offset_in_device += usrbytes;
     }
 
+  if (block_data)
+    kfree(block_data);
+
   *len = wrbytes;
-  return OK;
+  blockdev_account_request(blockdev, BLOCKDEV_WRITE, wrbytes, start);
+  return retval;
 }
 
 
@@ -395,3 +534,160 @@ int blockdev_wrap_write(open_file_descriptor *this,void* buf, __u32 count, __u64
 
 
 
+
+
+int blockdev_get_stats(__u32 device_class, __u32 device_instance,
+		       struct blockdev_stats *stats)
+{
+  struct blockdev_instance * blockdev;
+  __u32 flags;
+
+  blockdev = lookup_blockdev_instance(device_class, device_instance);
+  if (NULL == blockdev)
+    return -ENOENT;
+
+  disable_IRQs(flags);
+  memcpy(stats, & blockdev->stats, sizeof(struct blockdev_stats));
+  restore_IRQs(flags);
+  return OK;
+}
+
+
+/*
+ * /dev/diskstats. The durations are converted to milliseconds with
+ * the processor frequency, measured against the clock ticks since
+ * boot.
+ */
+#define DISKSTATS_MAX_SIZE 8192
+
+static __u64 diskstats_tsc0;
+static __u32 diskstats_ticks0;
+
+/* n / d, when the quotient fits on 32 bits */
+static __u32 div64_32(__u64 n, __u32 d)
+{
+  __u32 q, r;
+
+  if (! d || (__u32) (n >> 32) >= d)
+    return 0xffffffff;
+
+  asm("divl %4" : "=a"(q), "=d"(r)
+      : "a"((__u32) n), "d"((__u32) (n >> 32)), "rm"(d));
+  return q;
+}
+
+static __u32 cycles_to_ms(__u64 cycles, __u32 cycles_per_ms)
+{
+  return cycles_per_ms ? div64_32(cycles, cycles_per_ms) : 0;
+}
+
+static int diskstats_format(char *buf, int size)
+{
+  struct blockdev_instance * bd;
+  struct blockdev_stats st;
+  __u32 ticks, cycles_per_ms = 0;
+  __u64 service, request;
+  int len, nb, dir, i;
+
+  ticks = clock_ticks - diskstats_ticks0;
+  if (ticks >= CLOCK_HZ)
+    cycles_per_ms = div64_32((rdtsc() - diskstats_tsc0) * CLOCK_HZ,
+			     ticks * 1000);
+
+  len = snprintf(buf, size, "dev rd_req rd_ios rd_kB rd_ms"
+		 " wr_req wr_ios wr_kB wr_ms rmw errors in_flight"
+		 " service_ms queue_ms\n");
+
+  list_foreach (registered_blockdev_instances, bd, nb)
+    {
+      if (len >= size)
+	break;
+
+      blockdev_get_stats(bd->dev_id.device_class,
+			 bd->dev_id.device_instance, & st);
+
+      service = st.service_cycles[BLOCKDEV_READ]
+	+ st.service_cycles[BLOCKDEV_WRITE];
+      request = st.request_cycles[BLOCKDEV_READ]
+	+ st.request_cycles[BLOCKDEV_WRITE];
+
+      len += snprintf(buf + len, size - len,
+		      "%s %u %u %u %u %u %u %u %u %u %u %u %u %u\n",
+		      bd->name,
+		      st.requests[BLOCKDEV_READ], st.ios[BLOCKDEV_READ],
+		      (__u32) (st.bytes[BLOCKDEV_READ] >> 10),
+		      cycles_to_ms(st.request_cycles[BLOCKDEV_READ],
+				   cycles_per_ms),
+		      st.requests[BLOCKDEV_WRITE], st.ios[BLOCKDEV_WRITE],
+		      (__u32) (st.bytes[BLOCKDEV_WRITE] >> 10),
+		      cycles_to_ms(st.request_cycles[BLOCKDEV_WRITE],
+				   cycles_per_ms),
+		      st.rmw, st.errors, st.in_flight,
+		      cycles_to_ms(service, cycles_per_ms),
+		      cycles_to_ms((request > service) ? request - service : 0,
+				   cycles_per_ms));
+
+      /* Latency histograms: upper bound of the bucket in kcycles */
+      for (dir = BLOCKDEV_READ; dir <= BLOCKDEV_WRITE; dir++)
+	{
+	  if (! st.ios[dir] || len >= size)
+	    continue;
+
+	  len += snprintf(buf + len, size - len, "%s %s latency(kcycles)",
+			  bd->name, (dir == BLOCKDEV_READ) ? "rd" : "wr");
+	  for (i = 0; i < BLOCKDEV_LATENCY_BUCKETS && len < size; i++)
+	    if (st.latency[dir][i])
+	      len += snprintf(buf + len, size - len, " <%u:%u",
+			      1 << i, st.latency[dir][i]);
+	  if (len < size)
+	    len += snprintf(buf + len, size - len, "\n");
+	}
+    }
+
+  return (len < size) ? len : size;
+}
+
+static int diskstats_read(open_file_descriptor *ofd, void *buf, __u32 count)
+{
+  char *text;
+  int len, ret = 0;
+
+  text = (char*) kmalloc(DISKSTATS_MAX_SIZE, 0);
+  if (! text)
+    return -ENOMEM;
+
+  len = diskstats_format(text, DISKSTATS_MAX_SIZE);
+  if (ofd->current_octet < (__u32) len)
+    {
+      ret = len - ofd->current_octet;
+      if ((__u32) ret > count)
+	ret = count;
+      ret = copy_to_buffer(buf, text + ofd->current_octet, ret);
+      if (ret > 0)
+	ofd->current_octet += ret;
+      else if (count > 0)
+	ret = -EFAULT;
+    }
+
+  kfree((__u32) text);
+  return ret;
+}
+
+static chardev_interfaces diskstats_ops = {
+	.read = diskstats_read,
+	.write = NULL,
+	.ioctl = NULL,
+	.open = NULL,
+	.close = NULL
+};
+
+static struct fs_dev_id_t diskstats_dev_id;
+
+int blockdev_stats_setup(void)
+{
+  diskstats_tsc0 = rdtsc();
+  diskstats_ticks0 = clock_ticks;
+
+  return devfs_register_chardev("diskstats", & diskstats_ops,
+				& diskstats_dev_id);
+}
@@ -0,0 +1,283 @@
+/* Copyright (C) 2007 akernelloader TEAM
+    akaloaderadmin@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA. 
+ */
+
+/* aklz4: build a compressed image for akernelloader.
+
+   aklz4 kernel.elf kernel.lz4     Compress the PT_LOAD segments of a
+                                   32-bit ELF kernel
+   aklz4 -m module module.lz4      Compress a raw module file
+
+   The format is described in akernelloader/prototypes/lz4_ak.h. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <elf.h>
+
+#define AK_LZ4_HOST
+#include "akernelloader/prototypes/lz4_ak.h"
+
+#define MULTIBOOT_HEADER_MAGIC  0x1BADB002
+#define MULTIBOOT_SEARCH        8192
+
+#define HASH_LOG  16
+#define MAX_SEGMENTS 32
+
+static unsigned int read32(const unsigned char *p)
+{
+  unsigned int v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static unsigned int lz4_hash(const unsigned char *p)
+{
+  return (read32(p) * 2654435761U) >> (32 - HASH_LOG);
+}
+
+static unsigned char *put_length(unsigned char *op, unsigned int len)
+{
+  for (; len >= 255; len -= 255)
+    *op++ = 255;
+  *op++ = len;
+  return op;
+}
+
+static unsigned char *put_sequence(unsigned char *op,
+                                   const unsigned char *lit,
+                                   unsigned int litlen,
+                                   unsigned int offset,
+                                   unsigned int mlen)
+{
+  unsigned char *token = op++;
+
+  *token = (litlen >= 15 ? 15 : litlen) << 4;
+  if (litlen >= 15)
+    op = put_length(op, litlen - 15);
+  memcpy(op, lit, litlen);
+  op += litlen;
+
+  /* Last literals */
+  if (mlen == 0)
+    return op;
+
+  *op++ = offset & 0xff;
+  *op++ = offset >> 8;
+
+  mlen -= LZ4_MINMATCH;
+  *token |= (mlen >= 15 ? 15 : mlen);
+  if (mlen >= 15)
+    op = put_length(op, mlen - 15);
+
+  return op;
+}
+
+/* Greedy LZ4 block compression. dst must hold at least
+   n + n / 255 + 16 bytes. Return the compressed size.  */
+static unsigned int lz4_compress(const unsigned char *src, unsigned int n,
+                                 unsigned char *dst)
+{
+  static int table[1 << HASH_LOG];
+  unsigned int ip = 0, anchor = 0, ref, h, mlen;
+  unsigned char *op = dst;
+
+  memset(table, 0xff, sizeof(table));
+
+  if (n >= LZ4_MFLIMIT + 1)
+    while (ip < n - LZ4_MFLIMIT)
+      {
+        h = lz4_hash(src + ip);
+        ref = table[h];
+        table[h] = ip;
+
+        if (ref == (unsigned int) -1 || ip - ref > 65535
+            || read32(src + ref) != read32(src + ip))
+          {
+            ip++;
+            continue;
+          }
+
+        mlen = LZ4_MINMATCH;
+        while (ip + mlen < n - LZ4_LASTLITERALS
+               && src[ref + mlen] == src[ip + mlen])
+          mlen++;
+
+        op = put_sequence(op, src + anchor, ip - anchor, ip - ref, mlen);
+        ip += mlen;
+        anchor = ip;
+      }
+
+  op = put_sequence(op, src + anchor, n - anchor, 0, 0);
+  return op - dst;
+}
+
+static unsigned char *read_file(const char *name, unsigned int *size)
+{
+  FILE *f = fopen(name, "rb");
+  unsigned char *data;
+  long len;
+
+  if (f == NULL)
+    {
+      printf(" Error : Can not read the file < %s >\n", name);
+      exit(1);
+    }
+
+  fseek(f, 0, SEEK_END);
+  len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  data = malloc(len + 1);
+  if (data == NULL || fread(data, 1, len, f) != (size_t) len)
+    {
+      printf(" Error : Can not read the file < %s >\n", name);
+      exit(1);
+    }
+  fclose(f);
+
+  *size = len;
+  return data;
+}
+
+struct segment
+{
+  unsigned int addr, memsz, filesz;
+  const unsigned char *data;
+};
+
+int main(int argc, char **argv)
+{
+  struct segment segs[MAX_SEGMENTS];
+  struct ak_lz4_header hdr;
+  struct ak_lz4_segment desc[MAX_SEGMENTS];
+  unsigned char *file, *comp;
+  unsigned int size, nseg = 0, i, off, in = 0;
+  int module = 0;
+  FILE *out;
+
+  if (argc == 4 && strcmp(argv[1], "-m") == 0)
+    {
+      module = 1;
+      argv++;
+    }
+  else if (argc != 3)
+    {
+      printf("usage: %s [-m] <input> <output.lz4>\n", argv[0]);
+      return 1;
+    }
+
+  file = read_file(argv[1], &size);
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = AK_LZ4_MAGIC;
+
+  if (module)
+    {
+      segs[0].addr = 0;
+      segs[0].memsz = segs[0].filesz = size;
+      segs[0].data = file;
+      nseg = 1;
+    }
+  else
+    {
+      Elf32_Ehdr *ehdr = (Elf32_Ehdr *) file;
+      Elf32_Phdr *phdr;
+
+      if (size < sizeof(*ehdr) || memcmp(ehdr->e_ident, ELFMAG, SELFMAG)
+          || ehdr->e_ident[EI_CLASS] != ELFCLASS32)
+        {
+          printf(" Error : %s is not a 32-bit ELF file\n", argv[1]);
+          return 1;
+        }
+
+      hdr.entry = ehdr->e_entry;
+
+      for (i = 0; i < ehdr->e_phnum; i++)
+        {
+          phdr = (Elf32_Phdr *) (file + ehdr->e_phoff + i * ehdr->e_phentsize);
+          if (phdr->p_type != PT_LOAD || phdr->p_memsz == 0)
+            continue;
+          if (nseg == MAX_SEGMENTS)
+            {
+              printf(" Error : too many segments\n");
+              return 1;
+            }
+          segs[nseg].addr = phdr->p_vaddr;
+          segs[nseg].memsz = phdr->p_memsz;
+          segs[nseg].filesz = phdr->p_filesz;
+          segs[nseg].data = file + phdr->p_offset;
+          nseg++;
+        }
+
+      /* Keep the multiboot header visible to the loader */
+      for (i = 0; i + 12 <= size && i < MULTIBOOT_SEARCH; i += 4)
+        if (read32(file + i) == MULTIBOOT_HEADER_MAGIC
+            && read32(file + i) + read32(file + i + 4)
+               + read32(file + i + 8) == 0)
+          {
+            memcpy(hdr.mb_header, file + i,
+                   (size - i < AK_LZ4_MB_HEADER) ? size - i : AK_LZ4_MB_HEADER);
+            break;
+          }
+    }
+
+  hdr.nb_segments = nseg;
+  off = sizeof(hdr) + nseg * sizeof(struct ak_lz4_segment);
+
+  out = fopen(argv[2], "wb");
+  if (out == NULL)
+    {
+      printf(" Error : Can not write to file < %s >\n", argv[2]);
+      return 1;
+    }
+  fseek(out, off, SEEK_SET);
+
+  for (i = 0; i < nseg; i++)
+    {
+      comp = malloc(segs[i].filesz + segs[i].filesz / 255 + 16);
+      desc[i].addr = segs[i].addr;
+      desc[i].memsz = segs[i].memsz;
+      desc[i].filesz = segs[i].filesz;
+      desc[i].offset = off;
+      desc[i].compsz = lz4_compress(segs[i].data, segs[i].filesz, comp);
+
+      /* Store the segments that do not compress */
+      if (desc[i].compsz >= segs[i].filesz)
+        {
+          desc[i].compsz = segs[i].filesz;
+          fwrite(segs[i].data, 1, segs[i].filesz, out);
+        }
+      else
+        fwrite(comp, 1, desc[i].compsz, out);
+
+      printf(" segment 0x%08x: %u -> %u bytes (memsz %u)\n", desc[i].addr,
+             desc[i].filesz, desc[i].compsz, desc[i].memsz);
+      in += segs[i].filesz;
+      off += desc[i].compsz;
+      free(comp);
+    }
+
+  hdr.image_size = off;
+  fseek(out, 0, SEEK_SET);
+  fwrite(&hdr, 1, sizeof(hdr), out);
+  fwrite(desc, sizeof(struct ak_lz4_segment), nseg, out);
+  fclose(out);
+
+  printf(" [OK]  %s: %u bytes of segments, image %u bytes\n", argv[2], in, off);
+  return 0;
+}
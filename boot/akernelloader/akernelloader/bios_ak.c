@@ -20,6 +20,11 @@
 #include <bios_ak.h>
 #include <types_ak.h>
 
+ /* The parameters of the last drive queried: INT 13h AH=08h is only
+    issued once per drive instead of before every read.  */
+static struct drv_parameters cached_parameters;
+static int cached_drive = -1;
+
  /* if error occurs, then return the error number. 
     Otherwise, return 0.  */
 int bios_disk_ak(int rw, int drive, uint64 sector, int nsec, int segment)
@@ -27,10 +32,6 @@ int bios_disk_ak(int rw, int drive, uint64 sector, int nsec, int segment)
   int error;
   struct drv_parameters parameters;
 
-                 get_parameters (driver_bios , &parameters);
-
-
-  
       dap.length = sizeof (dap);
       dap.block = sector;
       dap.blocks = nsec;
@@ -42,21 +43,39 @@ int bios_disk_ak(int rw, int drive, uint64 sector, int nsec, int segment)
       if(error){
 
       int cylinder_offset, head_offset, sector_offset;
-      int head;
+      int head, count;
       
        unsigned sector_chs = (unsigned) sector;
 
+      error = get_parameters (drive, &parameters);
+      if (error)
+        return error;
+
+      /* The CHS interface cannot cross a track boundary: transfer
+	 the request one track at most at a time.  */
+      while (nsec > 0)
+	{
       /* sector_offset is counted from one, while HEAD_OFFSET and
 	 cylinder_offset are counted from zero.  */
       sector_offset = sector_chs % parameters.sectors + 1;
       head = sector_chs / parameters.sectors;
       head_offset = head % parameters.heads;
       cylinder_offset = head / parameters.heads;
-      
+
+      count = parameters.sectors - sector_offset + 1;
+      if (count > nsec)
+        count = nsec;
 
       error = bios_rw_chs_ak ( rw, drive,
 			       cylinder_offset, head_offset, sector_offset,
-			       nsec, segment);
+			       count, segment);
+      if (error)
+        return error;
+
+      sector_chs += count;
+      nsec -= count;
+      segment += (count * SECTOR_SIZE) >> 4;
+	}
     }
 
   return error;
@@ -68,6 +87,11 @@ int get_parameters (int drive, struct drv_parameters *parameters)
 {
   int err;
 
+      if (drive == cached_drive)
+	{
+	  *parameters = cached_parameters;
+	  return 0;
+	}
 
       err = get_drive_param_ak (drive,
 				   &parameters->cylinders,
@@ -81,7 +105,9 @@ int get_parameters (int drive, struct drv_parameters *parameters)
 				 * parameters->heads
 				 * parameters->sectors);
       parameters->sector_size = SECTOR_SIZE;
-    
+
+      cached_parameters = *parameters;
+      cached_drive = drive;
 
   return 0;
 }
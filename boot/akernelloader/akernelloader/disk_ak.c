@@ -27,38 +27,96 @@
 
 #include <partition_ak.h>
 
+/* Read nbyte bytes from the given sector. The sectors are read by
+   groups filling the low memory bounce buffer, with one BIOS call per
+   group.  */
 int media_read_ak(uint64 sector,  void *buffer, size_t nbyte)
 {
- 
-
-  uint32 i;
   void *bufaddr = (void *) AK_BUFFER_ADDRESS  ;
-  uint32 sector_count = nbyte / 512 ;
-  uint32 remainder = nbyte % 512 ;
- 
- for (i=0;i<sector_count;i++)
+  uint32 nsec, len;
+
+  while (nbyte > 0)
     {
-        if(sector_count == 0)
-        break;
-          
-           if(bios_disk_ak( BIOS_READ, driver_bios , sector , 1 , AK_BUFFERSEG) != 0 ) 
-              return 0 ;       
-           memmove_akel (buffer, bufaddr, 512);
-                  
-        sector ++;
-        buffer += 512;
-    }
+      nsec = (nbyte + SECTOR_SIZE - 1) / SECTOR_SIZE;
+      if (nsec > AK_BUFFER_SECTORS)
+        nsec = AK_BUFFER_SECTORS;
 
-   if(remainder){
-  
-     if(bios_disk_ak( BIOS_READ, driver_bios , sector, 1 , AK_BUFFERSEG) != 0 ) 
-              return 0 ;        
-           memmove_akel (buffer, bufaddr, remainder);
-   }
+      if(bios_disk_ak( BIOS_READ, driver_bios , sector , nsec , AK_BUFFERSEG) != 0 ) 
+        return 0 ;
+
+      len = nsec * SECTOR_SIZE;
+      if (len > nbyte)
+        len = nbyte;
+      memmove_akel (buffer, bufaddr, len);
+
+      sector += nsec;
+      buffer += len;
+      nbyte -= len;
+    }
 
    return 1 ;
 }
 
+/* LRU cache of the small reads (file system metadata, directories,
+   FAT sectors), kept below the file system buffers.  */
+#define DISK_CACHE_ADDRESS 0x60000
+#define DISK_CACHE_ENTRIES 8
+#define DISK_CACHE_SECTORS 8
+
+struct disk_cache_entry
+{
+  int drive;
+  uint64 sector;
+  uint32 nsec;      /* 0 for a free entry */
+  uint32 stamp;     /* Time of last use */
+};
+
+static struct disk_cache_entry disk_cache[DISK_CACHE_ENTRIES];
+static uint32 disk_cache_clock;
+
+/* Return the address of nsec sectors starting at the given sector,
+   read from the disk unless they are still cached. The data remains
+   valid until the next call.  */
+void *media_cache_read_ak(uint64 sector, uint32 nsec)
+{
+  struct disk_cache_entry *entry, *victim = &disk_cache[0];
+  void *data;
+  int i;
+
+  if (nsec == 0 || nsec > DISK_CACHE_SECTORS)
+    return NULL;
+
+  for (i = 0; i < DISK_CACHE_ENTRIES; i++)
+    {
+      entry = &disk_cache[i];
+
+      if (entry->nsec >= nsec && entry->sector == sector
+          && entry->drive == driver_bios)
+        {
+          entry->stamp = ++disk_cache_clock;
+          return (void *) (DISK_CACHE_ADDRESS
+                           + i * DISK_CACHE_SECTORS * SECTOR_SIZE);
+        }
+
+      if (entry->stamp < victim->stamp)
+        victim = entry;
+    }
+
+  /* Replace the least recently used entry */
+  data = (void *) (DISK_CACHE_ADDRESS
+                   + (victim - disk_cache) * DISK_CACHE_SECTORS * SECTOR_SIZE);
+  victim->nsec = 0;
+  if (media_read_ak(sector, data, nsec * SECTOR_SIZE) == 0)
+    return NULL;
+
+  victim->drive = driver_bios;
+  victim->sector = sector;
+  victim->nsec = nsec;
+  victim->stamp = ++disk_cache_clock;
+
+  return data;
+}
+
 int supported_fs(int type)
 {
     switch (type)
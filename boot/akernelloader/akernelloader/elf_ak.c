@@ -47,4 +47,24 @@ void load_elf(void* mem_addr,__u32  *entry){
   
 }
 
+/* End of the memory occupied by the loaded segments, BSS included */
+__u32 elf_image_end(void* mem_addr){
 
+    Elf32_Ehdr *elf = (Elf32_Ehdr *) mem_addr;
+    Elf32_Phdr *elf_phdr;
+    __u32 end = 0;
+    int i ;
+
+    for (i = 0; i < elf->e_phnum; ++i)  
+    {  
+        elf_phdr = (Elf32_Phdr *) (elf->e_phoff + i * sizeof(*elf_phdr) + mem_addr);  
+
+        if (elf_phdr->p_type != PT_LOAD)  
+            break;  
+
+        if (elf_phdr->p_vaddr + elf_phdr->p_memsz > end)
+            end = elf_phdr->p_vaddr + elf_phdr->p_memsz;
+    }  
+
+    return end;
+}
@@ -25,17 +25,28 @@
 
 struct fs_data _fs;
 
-void
-get_block (unsigned long bnum, unsigned char *block)
+/* Return the cached copy of block bnum, NULL on read error. It
+   remains valid until the next access to the disk cache.  */
+static unsigned char *
+get_cached_block (unsigned long bnum)
 {
-    
-    
+        unsigned char *data;
         uint64 to_seek = bnum;
         to_seek = (to_seek * BLOCKSIZE) / 512  ; 
         to_seek += partition.start;
-         if(media_read_ak( to_seek , block, BLOCKSIZE )  == 0)
+        data = media_cache_read_ak( to_seek , BLOCKSIZE / 512 );
+        if(data == NULL)
             printf_ak("EXT2 READ ERROR..\nlba:%i\nBlk number:%i\n",to_seek,bnum);
-       
+        return data;
+}
+
+void
+get_block (unsigned long bnum, unsigned char *block)
+{
+        unsigned char *data = get_cached_block (bnum);
+
+        if (data != NULL)
+            memmove_akel (block, data, BLOCKSIZE);
 }
 
 int 
@@ -114,97 +125,84 @@ parse_pathname (const char path[], char names[MAX_DIRS][MAX_DIRNAME])
     return (n); 
 }
 
-int
-get_data_block ( struct ext2_inode *inode, 
-      int n, /* requested file data block */
-      unsigned char *block) 
+/* Read entry n of the block of block numbers bnum */
+static unsigned int
+get_block_entry (unsigned int bnum, unsigned int n)
 {
+    unsigned int *p;
 
-struct fs_data *fs = &_fs;
-
-    unsigned char ind_block[4096]; 
-    unsigned char dind_block[4096] ;
-    unsigned char tind_block[4096] ;
-
-    unsigned int size; /* size of file in blocks */
-    unsigned int *p1, *p2, *p3;  
-
- int ClustByteShift = fs->sb->s_log_block_size + 10;
-
- int PtrsPerBlock1 = 1 << (ClustByteShift - 2);
- int PtrsPerBlock2 = 1 << ((ClustByteShift - 2) * 2);
- int PtrsPerBlock3 = 1 << ((ClustByteShift - 2) * 3);
+    if (bnum == 0)
+        return 0;
 
+    p = (unsigned int *) get_cached_block (bnum);
+    if (p == NULL)
+        return 0;
 
+    return p[n];
+}
 
-if (inode->i_size == 0)
-        size = 0; 
-    else 
-        size = 1 + ( (inode->i_size - 1) / BLOCKSIZE );
+/* Return the disk block holding file data block n, 0 for a hole or
+   on error. The indirect blocks come from the disk cache, so walking
+   a file sequentially reads each of them only once.  */
+static unsigned int
+ext2_bmap ( struct ext2_inode *inode, unsigned int n )
+{
+struct fs_data *fs = &_fs;
 
-    if (size  == 0) 
-        return -1; 
+ int ClustByteShift = fs->sb->s_log_block_size + 10;
 
-    if ( (n < 0)  || (n >=size)) 
-         return -1; 
+ unsigned int PtrsPerBlock1 = 1 << (ClustByteShift - 2);
+ unsigned int PtrsPerBlock2 = 1 << ((ClustByteShift - 2) * 2);
+ unsigned int bnum;
 
   /* direct blocks */
-        if (n < EXT2_NDIR_BLOCKS) {
-                 // direct blocks
-          get_block (inode->i_block[n], block);
-          return 0; 
-       } 
+        if (n < EXT2_NDIR_BLOCKS)
+          return inode->i_block[n];
     
         /* indirect blocks */
         n -= EXT2_NDIR_BLOCKS;
-        if (n < PtrsPerBlock1) {
-           get_block ( inode->i_block[EXT2_IND_BLOCK], ind_block);
-               p1 = (unsigned int *) &ind_block;
-               get_block (p1[n], block);
-               return 0;
-        }
+        if (n < PtrsPerBlock1)
+           return get_block_entry (inode->i_block[EXT2_IND_BLOCK], n);
        
         /* double indirect blocks */
         n -= PtrsPerBlock1;
         if (n < PtrsPerBlock2) {
-             get_block (inode->i_block[EXT2_DIND_BLOCK], dind_block);
-                 p2 = (unsigned int *) &dind_block;
-           
-
-               get_block ( p2[n / PtrsPerBlock1] , ind_block);
-               p1 = (unsigned int *) &ind_block;
-               get_block ( p1[n % PtrsPerBlock1] , block);
-            
-           return 0;
-            
+           bnum = get_block_entry (inode->i_block[EXT2_DIND_BLOCK],
+                                   n / PtrsPerBlock1);
+           return get_block_entry (bnum, n % PtrsPerBlock1);
         }
        
-             /* triple indirect block */
-         n -= PtrsPerBlock2;
-        if (n < PtrsPerBlock3) {
+        /* triple indirect block */
+        n -= PtrsPerBlock2;
+        bnum = get_block_entry (inode->i_block[EXT2_TIND_BLOCK],
+                                n / PtrsPerBlock2);
+        bnum = get_block_entry (bnum, (n / PtrsPerBlock1) % PtrsPerBlock1);
+        return get_block_entry (bnum, n % PtrsPerBlock1);
+}
 
-                 get_block (inode->i_block[EXT2_TIND_BLOCK], tind_block);
-                 p3 = (unsigned int *) &tind_block;
-           
-                 get_block (p3[n/ PtrsPerBlock2], dind_block);
-                 p2 = (unsigned int *) &dind_block;
+int
+get_data_block ( struct ext2_inode *inode, 
+      int n, /* requested file data block */
+      unsigned char *block) 
+{
+    unsigned int size; /* size of file in blocks */
+    unsigned int bnum;
 
-           
-             get_block (p2[n % PtrsPerBlock2], ind_block);
-                 p1 = (unsigned int *) &ind_block;
+if (inode->i_size == 0)
+        size = 0; 
+    else 
+        size = 1 + ( (inode->i_size - 1) / BLOCKSIZE );
 
-            get_block (p1[n % PtrsPerBlock1], block);
-    
-            return 0;
-        }
-       
-       
-        /* File too big, can not handle */
-        printf_ak("ext2 ERROR, file too big\n");
-         
-    return -1; 
+    if ( (n < 0)  || (n >=size)) 
+         return -1; 
 
+    bnum = ext2_bmap (inode, n);
+    if (bnum == 0)
+        memset_akel (block, 0, BLOCKSIZE);
+    else
+        get_block (bnum, block);
 
+    return 0; 
 }
 
 int find_dir_entry(struct ext2_inode *dir_inode, char *name, 
@@ -388,90 +386,49 @@ struct FILE* ext2_fopen(const char *pathname){
    file->inode = (struct ext2_inode *)INODE_P ;
    file->f_pos = 0 ;
    file->filelength = file->inode->i_size;
+   file_extents_init(file, BLOCKSIZE);
 
           return file;
         
 
 }
 
-int ext2_fread(unsigned char * buffer, int size, int length, void *f )
+/* Decode the next run of contiguous blocks of the file */
+static int ext2_next_extent(FILE *file, struct file_extent *ext)
 {
-       FILE *file = (FILE *)f;
-       int bytesRead = 0; 
-       int nbyte = size * length;
-       unsigned char *block = (unsigned char *)DATA_ADDR;
-       __u32 ret;
-           
-
-       int blk_to_read , remainder ; 
-       int i = 0 ; 
-    
-    if (file->inode->i_size == 0) 
-        return 0; 
-
-
-  // Limit to file size
-    if( (file->f_pos + nbyte) > file->inode->i_size )
-         nbyte = file->inode->i_size - file->f_pos;
-
-    blk_to_read = (nbyte + file->f_pos) / BLOCKSIZE;
-
-    uint32 offset = file->f_pos % BLOCKSIZE ;
-if(file->f_pos < BLOCKSIZE  )
-    offset = file->f_pos ;
-    unsigned int plus = BLOCKSIZE  - offset ; 
-    
-     remainder =  nbyte % BLOCKSIZE;
-     remainder -= offset; 
- //first block
- int first  = 1;
-
-// Utilize it to indicate the initial offset
-i =  file->f_pos / BLOCKSIZE;
-   while(i < blk_to_read) {
-
-            
-        ret = get_data_block ( file->inode, i, block); 
-        if (ret == -1) {
-            printf_ak ("can not get data block %i \n", i); 
-            return 0; 
-        }
-             
-       
-                    if(first && file->f_pos){
-                   get_data_block ( file->inode, i, block);
-                   memmove_akel (buffer, block + offset, plus); 
-                   buffer += plus;
-                   bytesRead  += plus;
-                   first = 0;
-
-                 }else{
-                   memmove_akel (buffer, block, BLOCKSIZE); 
-                   buffer += BLOCKSIZE;
-                   bytesRead  += BLOCKSIZE ;
-                  }
-
-               i++;   
-              
+    unsigned int size, n, bnum, next;
+    uint64 lba;
+
+    size = (file->filelength + BLOCKSIZE - 1) / BLOCKSIZE;
+    n = file->decoded;
+    if (n >= size)
+        return 0;
+
+    bnum = ext2_bmap (file->inode, n);
+    ext->count = 1;
+    while (n + ext->count < size)
+    {
+        next = ext2_bmap (file->inode, n + ext->count);
+        if (bnum == 0 ? (next != 0) : (next != bnum + ext->count))
+            break;
+        ext->count++;
     }
 
+    if (bnum == 0)
+        ext->lba = 0;
+    else
+    {
+        lba = bnum;
+        ext->lba = (lba * BLOCKSIZE) / 512 + partition.start;
+    }
 
-           if (first && file->f_pos ){
-                  get_data_block ( file->inode, i, block);
-                  memmove_akel (buffer, block + plus  ,remainder);             
-                  buffer += remainder;
-                  bytesRead  += remainder;
-            }
+    return 1;
+}
 
-        if(remainder){
-           get_data_block ( file->inode, i, block);
-           memmove_akel (buffer, block, remainder);
-             bytesRead += remainder ;
-                  
-       }
-         
-    file->f_pos += bytesRead ;
-    return bytesRead ;
+int ext2_fread(unsigned char * buffer, int size, int length, void *f )
+{
+    return file_extents_read((FILE *)f, buffer, size * length,
+                             ext2_next_extent);
 }
 
 
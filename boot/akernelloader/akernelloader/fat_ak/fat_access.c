@@ -78,6 +78,8 @@ int fatfs_init(struct fatfs *fs, struct fat_info_ak *fatinfo )
     fs->reserved_sectors  = fatinfo->reserved_sectors;
 
     fs->lba_begin = fatinfo->lba_begin;
+    fs->chain.start_cluster = FAT32_INVALID_CLUSTER;
+    fs->currentsector.address = FAT32_INVALID_CLUSTER;
     fs->fat_begin_lba = fs->lba_begin + fatinfo->reserved_sectors;
 
     // Root directory region start  
@@ -126,16 +128,36 @@ int fatfs_sector_reader(struct fatfs *fs, uint32 start_cluster, uint32 offset, u
     uint32 lba;
 
     
-        // Set start of cluster chain to initial value
-        cluster_chain = start_cluster;
-
         // Find parameters
         cluster_to_read = offset / fs->sectors_per_cluster;      
         sector_to_read = offset - (cluster_to_read*fs->sectors_per_cluster);
 
+        // Resume from the last cluster looked up in the same chain, so
+        // that reading a directory sector after sector is linear
+        if (fs->chain.start_cluster == start_cluster
+            && fs->chain.index <= cluster_to_read
+            && fs->chain.cluster != FAT32_LAST_CLUSTER)
+        {
+            i = fs->chain.index;
+            cluster_chain = fs->chain.cluster;
+        }
+        else
+        {
+            i = 0;
+            cluster_chain = start_cluster;
+        }
+
         // Follow chain to find cluster to read
-        for (i=0; i<cluster_to_read; i++)
+        for (; i<cluster_to_read; i++)
+        {
             cluster_chain = fatfs_find_next_cluster(fs, cluster_chain);
+            if (cluster_chain == FAT32_LAST_CLUSTER)
+                break;
+        }
+
+        fs->chain.start_cluster = start_cluster;
+        fs->chain.index = i;
+        fs->chain.cluster = cluster_chain;
 
         // If end of cluster chain then return false
         if (cluster_chain == FAT32_LAST_CLUSTER) 
@@ -113,6 +113,7 @@ struct FILE* fat_fopen(const char *path)
             file->filelength = FAT_HTONL(sfEntry.FileSize);
             file->startcluster = ((FAT_HTONS((uint32)sfEntry.FstClusHI))<<16) + FAT_HTONS(sfEntry.FstClusLO);
             file->f_pos = 0;
+            file_extents_init(file, _fs.cluster_size);
             return file;
         }
 
@@ -120,105 +121,38 @@ struct FILE* fat_fopen(const char *path)
     return NULL;
 }
 
-int fat_fread(unsigned char * buffer, int size, int length, void *f )
+/* Decode the next run of contiguous clusters of the file: the chain
+   is walked once, whatever the number of reads. */
+static int fat_next_extent(FILE *file, struct file_extent *ext)
 {
- 
-  uint32 Cluster = 0;
-  uint32 lba;
-  int  first = 1 ;
-  uint32  clustercount = 0, skeep = 0 ;
-
-  unsigned char *block  = (unsigned char *) FS_BUFFER ;
+    uint32 cluster, next;
 
-  int nbyte = size * length;
-  int bytesRead = 0; 
+    // Restart from the beginning of the chain
+    if (file->decoded == 0)
+        file->cursor = file->startcluster;
 
-  FILE *file = (FILE *)f;
- 
-   
- 
-    if (buffer==NULL || file==NULL)
-        return -1;
- 
-   // Nothing to be done
-    if (!nbyte )
+    cluster = file->cursor;
+    if (cluster < 2 || cluster == FAT32_LAST_CLUSTER)
         return 0;
- 
-  // Limit to file size
-    if( (file->f_pos + nbyte) > file->filelength )
-        nbyte = file->filelength - file->f_pos;
-
-  uint32 cluster_to_read  = nbyte / _fs.cluster_size ;
-  
 
+    ext->lba = fatfs_lba_of_cluster(&_fs, cluster);
+    ext->count = 1;
 
-  uint32 offset = file->f_pos % _fs.cluster_size ;
-if(file->f_pos < _fs.cluster_size )
-    offset = file->f_pos ;
-  int plus = _fs.cluster_size - offset ;
-
- uint32 remainder = nbyte % _fs.cluster_size ;
-      
- 
-
-
-  Cluster = file->startcluster;
+    next = fatfs_find_next_cluster(&_fs, cluster);
+    while (next == cluster + ext->count)
+    {
+        ext->count++;
+        next = fatfs_find_next_cluster(&_fs, next);
+    }
 
-        // Advance until we are at the correct location
-    while ((clustercount++ < (file->f_pos / _fs.cluster_size) ))
-         Cluster = fatfs_find_next_cluster(&_fs,Cluster);
-        
-   
+    file->cursor = next;
+    return 1;
+}
 
-  
-  while( Cluster!= 0x0ffffff){
- 
-  lba = fatfs_lba_of_cluster(&_fs, Cluster) ;
-       
-       
-    
-       if ( (bytesRead / _fs.cluster_size) == cluster_to_read  ){
-          if(remainder){
-
-              if (first && file->f_pos){
-
-        media_read_ak(lba, block , _fs.cluster_size);
-               
-                memmove_akel (buffer, block + offset, remainder); 
-                buffer += remainder ;
-                bytesRead += remainder ; 
-                first = 0;
-                } else {
-          
-                 media_read_ak(lba, buffer, remainder );
-                 bytesRead += remainder ;
-                }
-
-          }
-          file->f_pos += bytesRead ;
-          return bytesRead ;
-         }
-
-       
-             if (first && file->f_pos){
-
-        media_read_ak(lba, block , _fs.cluster_size);
-               
-                memmove_akel (buffer, block + offset, plus); 
-                buffer += plus ;
-                bytesRead += plus ;
-                first = 0;
-           }else{
-                media_read_ak(lba,buffer, _fs.cluster_size);
-                buffer += _fs.cluster_size ;
-                bytesRead += _fs.cluster_size  ;
-               }
-     
-      Cluster = fatfs_find_next_cluster(&_fs,Cluster);
- 
-   }
-      file->f_pos += bytesRead ;
-      return bytesRead ;
+int fat_fread(unsigned char * buffer, int size, int length, void *f )
+{
+    return file_extents_read((FILE *)f, buffer, size * length,
+                             fat_next_extent);
 }
 
 
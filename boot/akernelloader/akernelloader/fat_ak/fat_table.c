@@ -26,7 +26,7 @@
 uint32 fatfs_find_next_cluster(struct fatfs *fs, uint32 current_cluster)
 {
 
-  unsigned char FATBuffer[512];
+  unsigned char *FATBuffer;
   uint32 FAT_sector_offset, position;
   uint32 nextcluster;
   
@@ -41,7 +41,9 @@ uint32 fatfs_find_next_cluster(struct fatfs *fs, uint32 current_cluster)
         FAT_sector_offset = current_cluster / 128;
 
 
- if (!media_read_ak(fs->fat_begin_lba + FAT_sector_offset , FATBuffer ,512))
+ // Walking a chain reads the same FAT sector over and over: keep it cached
+ FATBuffer = media_cache_read_ak(fs->fat_begin_lba + FAT_sector_offset, 1);
+ if (FATBuffer == NULL)
           return (FAT32_LAST_CLUSTER);
 
         // Find 32 bit entry of current sector relating to cluster number 
@@ -54,8 +56,8 @@ uint32 fatfs_find_next_cluster(struct fatfs *fs, uint32 current_cluster)
         // Mask out MS 4 bits (its 28bit addressing)
         nextcluster = nextcluster & 0x0FFFFFFF;         
 
-        // If 0x0FFFFFFF then end of chain found
-        if (nextcluster==0x0FFFFFFF) 
+        // If 0x0FFFFFF8 to 0x0FFFFFFF then end of chain found
+        if (nextcluster>=0x0FFFFFF8) 
                 return (FAT32_LAST_CLUSTER); 
         else 
         // Else return next cluster
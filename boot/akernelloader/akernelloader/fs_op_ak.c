@@ -23,6 +23,9 @@
 #include <fs_ak.h>
 #include <ext2/ext2fs_ak.h>
 #include <fat/fat_fs.h>
+#include <bios_ak.h>
+#include <disk_ak.h>
+#include <string_ak.h>
 
 
 int init_file_op(int fs_type){
@@ -83,8 +86,8 @@ int fseek_ak( void *f, long offset, int origin )
     {
         file->f_pos= (uint32)offset;
 
-        if (file->f_pos > file->inode->i_size)
-            file->f_pos = file->inode->i_size;
+        if (file->f_pos > file->filelength)
+            file->f_pos = file->filelength;
 
         res = 0;
     }
@@ -95,8 +98,8 @@ int fseek_ak( void *f, long offset, int origin )
         {
             file->f_pos += offset;
 
-            if (file->f_pos > file->inode->i_size)
-                file->f_pos = file->inode->i_size;
+            if (file->f_pos > file->filelength)
+                file->f_pos = file->filelength;
         }
         // Negative shift
         else
@@ -115,7 +118,7 @@ int fseek_ak( void *f, long offset, int origin )
     }
     else if (origin == SEEK_END)
     {
-        file->f_pos = file->inode->i_size;
+        file->f_pos = file->filelength;
         res = 0;
     }
     else
@@ -125,7 +128,121 @@ int fseek_ak( void *f, long offset, int origin )
 }
 
 
+void file_extents_init(FILE *file, uint32 block_size)
+{
+    file->block_size = block_size;
+    file->decoded = 0;
+    file->cursor = 0;
+    file->nb_extents = 0;
+}
 
+/* Find the extent holding the given logical block, decoding the
+   layout of the file forward as needed. Only the last
+   FILE_MAX_EXTENTS extents are kept: going back before them restarts
+   the decoding from the beginning of the file. */
+static int file_extents_map(FILE *file, uint32 block,
+                            struct file_extent *ext,
+                            next_extent_t next_extent)
+{
+    struct file_extent *e;
+    uint32 i;
 
+    while (1)
+    {
+        for (i = 0; i < file->nb_extents; i++)
+        {
+            e = &file->extents[i];
+            if (block >= e->block && block < e->block + e->count)
+            {
+                *ext = *e;
+                return 1;
+            }
+        }
 
- 
+        if (block < file->decoded)
+        {
+            file->decoded = 0;
+            file->nb_extents = 0;
+        }
+
+        if (file->nb_extents == FILE_MAX_EXTENTS)
+            file->nb_extents = 0;
+
+        e = &file->extents[file->nb_extents];
+        if (!next_extent(file, e) || e->count == 0)
+            return 0;
+
+        e->block = file->decoded;
+        file->decoded += e->count;
+        file->nb_extents++;
+    }
+}
+
+/* Read nbyte bytes of the file at its current position. The runs of
+   whole sectors are read straight into the buffer, as many sectors at
+   a time as the extents allow; only partial sectors go through the
+   disk cache. */
+int file_extents_read(FILE *file, unsigned char *buffer, int nbyte,
+                      next_extent_t next_extent)
+{
+    struct file_extent ext;
+    uint32 block, offset, avail, len;
+    uint64 sector;
+    unsigned char *data;
+    int bytesRead = 0;
+
+    if (buffer == NULL || file == NULL || nbyte <= 0)
+        return 0;
+
+    // Limit to file size
+    if (file->f_pos >= file->filelength)
+        return 0;
+    if ((uint32) nbyte > file->filelength - file->f_pos)
+        nbyte = file->filelength - file->f_pos;
+
+    while (nbyte > 0)
+    {
+        block = file->f_pos / file->block_size;
+        offset = file->f_pos % file->block_size;
+
+        if (!file_extents_map(file, block, &ext, next_extent))
+            break;
+
+        // Bytes contiguous on the disk from the current position
+        avail = (ext.block + ext.count - block) * file->block_size - offset;
+        len = ((uint32) nbyte < avail) ? (uint32) nbyte : avail;
+
+        if (ext.lba == 0)
+            memset_akel(buffer, 0, len);
+        else
+        {
+            sector = ext.lba;
+            sector += (block - ext.block) * (file->block_size / SECTOR_SIZE)
+                      + offset / SECTOR_SIZE;
+            offset %= SECTOR_SIZE;
+
+            if (offset || len < SECTOR_SIZE)
+            {
+                data = media_cache_read_ak(sector, 1);
+                if (data == NULL)
+                    break;
+                if (len > SECTOR_SIZE - offset)
+                    len = SECTOR_SIZE - offset;
+                memmove_akel(buffer, data + offset, len);
+            }
+            else
+            {
+                len -= len % SECTOR_SIZE;
+                if (media_read_ak(sector, buffer, len) == 0)
+                    break;
+            }
+        }
+
+        buffer += len;
+        nbyte -= len;
+        bytesRead += len;
+        file->f_pos += len;
+    }
+
+    return bytesRead;
+}
@@ -0,0 +1,156 @@
+/*  Akernelloader TEAM
+    akaloaderadmin@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA. 
+ */
+
+
+#include <string_ak.h>
+#include <stdio_ak.h>
+#include <lz4_ak.h>
+
+/* Decompress an LZ4 block of srcsz bytes into dst.
+   Return the number of bytes produced, -1 if the block is corrupt or
+   does not fit in dstsz bytes.  */
+int lz4_decompress_ak(const unsigned char *src, int srcsz,
+                      unsigned char *dst, int dstsz)
+{
+  const unsigned char *ip = src;
+  const unsigned char *iend = src + srcsz;
+  unsigned char *op = dst;
+  unsigned char *oend = dst + dstsz;
+  const unsigned char *match;
+  unsigned int token, len, offset, b;
+
+  while (ip < iend)
+    {
+      token = *ip++;
+
+      /* Literals */
+      len = token >> 4;
+      if (len == 15)
+        do
+          {
+            if (ip >= iend)
+              return -1;
+            b = *ip++;
+            len += b;
+          }
+        while (b == 255);
+
+      if (len > (unsigned int) (iend - ip) || len > (unsigned int) (oend - op))
+        return -1;
+
+      for (; len >= 4; len -= 4, op += 4, ip += 4)
+        *(__u32 *) op = *(const __u32 *) ip;
+      while (len-- > 0)
+        *op++ = *ip++;
+
+      /* The last sequence has no match */
+      if (ip >= iend)
+        break;
+
+      if (iend - ip < 2)
+        return -1;
+      offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      if (offset == 0 || offset > (unsigned int) (op - dst))
+        return -1;
+      match = op - offset;
+
+      len = token & 15;
+      if (len == 15)
+        do
+          {
+            if (ip >= iend)
+              return -1;
+            b = *ip++;
+            len += b;
+          }
+        while (b == 255);
+      len += LZ4_MINMATCH;
+
+      if (len > (unsigned int) (oend - op))
+        return -1;
+
+      /* Words can be copied as long as they do not overlap the
+         output: runs of a short pattern are copied per byte */
+      if (offset >= 4)
+        for (; len >= 4; len -= 4, op += 4, match += 4)
+          *(__u32 *) op = *(const __u32 *) match;
+      while (len-- > 0)
+        *op++ = *match++;
+    }
+
+  return op - dst;
+}
+
+int IS_LZ4_IMAGE(void *address)
+{
+  struct ak_lz4_header *hdr = (struct ak_lz4_header *) address;
+
+  return (hdr->magic == AK_LZ4_MAGIC);
+}
+
+/* End of the memory the image occupies once loaded at base. The image
+   file itself has to be read above it, since it is expanded in
+   place.  */
+__u32 lz4_image_end(void *image, __u32 base)
+{
+  struct ak_lz4_header *hdr = (struct ak_lz4_header *) image;
+  struct ak_lz4_segment *seg = AK_LZ4_SEGMENTS(hdr);
+  __u32 end = base, i;
+
+  for (i = 0; i < hdr->nb_segments; i++)
+    if (base + seg[i].addr + seg[i].memsz > end)
+      end = base + seg[i].addr + seg[i].memsz;
+
+  return end;
+}
+
+/* Expand every segment of the image to base + its load address.
+   Return 1 on success, 0 if a segment is corrupt.  */
+int load_lz4_image(void *image, __u32 base, __u32 *entry)
+{
+  struct ak_lz4_header *hdr = (struct ak_lz4_header *) image;
+  struct ak_lz4_segment *seg = AK_LZ4_SEGMENTS(hdr);
+  unsigned char *dst;
+  __u32 i;
+
+  for (i = 0; i < hdr->nb_segments; i++)
+    {
+      dst = (unsigned char *) (base + seg[i].addr);
+
+      if (seg[i].compsz == seg[i].filesz)
+        /* Stored: it did not compress */
+        memmove_akel(dst, (unsigned char *) image + seg[i].offset,
+                     seg[i].filesz);
+      else if (lz4_decompress_ak((unsigned char *) image + seg[i].offset,
+                                 seg[i].compsz, dst, seg[i].filesz)
+               != (int) seg[i].filesz)
+        {
+          printf_ak("LZ4: segment %i is corrupt\n", i);
+          return 0;
+        }
+
+      memset_akel(dst + seg[i].filesz, 0, seg[i].memsz - seg[i].filesz);
+    }
+
+  if (hdr->entry)
+    *entry = hdr->entry;
+
+  return 1;
+}
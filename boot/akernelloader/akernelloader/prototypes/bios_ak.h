@@ -25,6 +25,9 @@
 
 #define AK_BUFFER_ADDRESS 0x70000
 #define AK_BUFFERSEG   0x7000
+/* Number of sectors the bounce buffer holds: it ends where the menu
+   buffer (MENU_BUF) starts */
+#define AK_BUFFER_SECTORS 64
 
 #define SECTOR_SIZE 512
 
@@ -24,5 +24,6 @@
 #include <types_ak.h>
 
 int media_read_ak(uint64 sector, void *buffer, size_t nbyte);
+void *media_cache_read_ak(uint64 sector, uint32 nsec);
 
 #endif
@@ -67,6 +67,7 @@ typedef struct
 
 int IS_ELF(void* address);
 void load_elf(void* mem_addr,__u32 *entry);
+__u32 elf_image_end(void* mem_addr);
 
 #endif /* End elf_ak.h */
 
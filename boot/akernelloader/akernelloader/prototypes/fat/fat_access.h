@@ -98,6 +98,14 @@ struct fatfs
 
     // Working buffer
     struct fat_buffer        currentsector;
+
+    // Last position looked up by fatfs_sector_reader()
+    struct
+    {
+        uint32 start_cluster;
+        uint32 index;
+        uint32 cluster;
+    } chain;
     
     
 };
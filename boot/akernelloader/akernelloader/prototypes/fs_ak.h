@@ -41,6 +41,17 @@
 
 #define FATFS_MAX_LONG_FILENAME         260
 
+/* Number of extents of a file decoded at the same time */
+#define FILE_MAX_EXTENTS                32
+
+/* A run of contiguous blocks of a file on the disk */
+struct file_extent
+{
+    uint32 block;     /* First logical block of the run */
+    uint32 lba;       /* Its first sector, 0 for a hole */
+    uint32 count;     /* Number of blocks */
+} __attribute__ ((packed));
+
 typedef struct FILE
 {
     /* FAT */
@@ -63,7 +74,13 @@ typedef struct FILE
       /*EXT2 ... 3*/
 
  struct ext2_inode *inode ;
- 
+
+    /* Block layout of the file, decoded once while reading it */
+    uint32                  block_size;
+    uint32                  decoded;      /* Logical blocks decoded so far */
+    uint32                  cursor;       /* Where the file system resumes decoding */
+    uint32                  nb_extents;
+    struct file_extent      extents[FILE_MAX_EXTENTS];
 
 
 } __attribute__ ((packed)) FILE;
@@ -85,4 +102,13 @@ int fread_ak(unsigned char * buffer, int size, int length, void *f );
 void fclose_ak( void *f );
 int fseek_ak( void *f, long offset, int origin );
 
+/* Decode the extent of the file starting at logical block
+   file->decoded (0: restart from the beginning of the file). Fill
+   lba and count and return 1, or return 0 at the end of the file. */
+typedef int (*next_extent_t)(FILE *file, struct file_extent *ext);
+
+void file_extents_init(FILE *file, uint32 block_size);
+int file_extents_read(FILE *file, unsigned char *buffer, int nbyte,
+                      next_extent_t next_extent);
+
 #endif
@@ -0,0 +1,78 @@
+/*  Akernelloader TEAM
+    akaloaderadmin@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA. 
+ */
+
+
+#ifndef _LZ4_AK_H_
+#define _LZ4_AK_H_
+
+/* Compressed image format, produced by the aklz4 tool from a kernel
+   ELF file or from a raw module file. This header is shared with the
+   tool, so it does not depend on types_ak.h.
+
+   The image starts with a struct ak_lz4_header followed by
+   nb_segments struct ak_lz4_segment. The data of each segment is an
+   LZ4 block (raw format, no frame) at the given offset in the image,
+   decompressed straight to its load address.  */
+
+#define AK_LZ4_MAGIC        0x345a4b41   /* "AKZ4" */
+
+/* Bytes of the multiboot header copied in the image header, so that
+   the multiboot probe of the loader still finds it */
+#define AK_LZ4_MB_HEADER    32
+
+struct ak_lz4_header
+{
+  unsigned int magic;
+  unsigned int entry;           /* ELF entry point, 0 for a module */
+  unsigned int nb_segments;
+  unsigned int image_size;      /* Size of the whole image file */
+  unsigned char mb_header[AK_LZ4_MB_HEADER];
+} __attribute__ ((packed));
+
+struct ak_lz4_segment
+{
+  unsigned int addr;            /* Load address (offset for a module) */
+  unsigned int memsz;           /* Size in memory, the end is zeroed */
+  unsigned int filesz;          /* Size once decompressed */
+  unsigned int offset;          /* Offset of the LZ4 block in the image */
+  unsigned int compsz;          /* Size of the LZ4 block */
+} __attribute__ ((packed));
+
+#define AK_LZ4_SEGMENTS(hdr) \
+  ((struct ak_lz4_segment *) ((unsigned char *) (hdr) + sizeof (struct ak_lz4_header)))
+
+/* LZ4 block format constants */
+#define LZ4_MINMATCH        4
+#define LZ4_LASTLITERALS    5
+#define LZ4_MFLIMIT         12
+
+#ifndef AK_LZ4_HOST
+
+#include <types_ak.h>
+
+/* lz4_ak.c */
+int lz4_decompress_ak(const unsigned char *src, int srcsz,
+                      unsigned char *dst, int dstsz);
+int IS_LZ4_IMAGE(void *address);
+__u32 lz4_image_end(void *image, __u32 base);
+int load_lz4_image(void *image, __u32 base, __u32 *entry);
+
+#endif
+
+#endif /* End lz4_ak.h */
@@ -21,6 +21,7 @@
 #include <bios_ak.h>
 #include <multiboot_ak.h>
 #include <elf_ak.h>
+#include <lz4_ak.h>
 #include <disk_ak.h>
 #include <os_ak/linux_ak.h>
 #include <os_ak/freebsd.h>
@@ -68,6 +69,27 @@ int multiboot_probe_ak(void* kernel_address, __u32 *mb_offset)
 
 
 
+/* Read the kernel file. A compressed image is expanded in place, so
+   it is read above the memory its segments will occupy, instead of
+   at kernel_address.  */
+static void *read_kernel_image(void *kernel_address, const char *kernel_path,
+                               __u32 kernel_size)
+{
+  __u32 image_addr = (__u32) kernel_address;
+  FILE *fd;
+
+  if (IS_LZ4_IMAGE(boot_header)
+      && lz4_image_end(boot_header, 0) > image_addr)
+    image_addr = (lz4_image_end(boot_header, 0) + 0xFFF) & 0xFFFFF000;
+
+  fd = fopen_ak(kernel_path);
+  fread_ak((void*)image_addr , kernel_size , 1, fd);
+  fs_op_ak.close(fd);
+
+  return (void *) image_addr;
+}
+
+
 int start_kernel_ak(void* kernel_address, const char * kernel_path ){
 
 
@@ -77,6 +99,8 @@ __u32  entry , mb_offset,mem_tmp  ;
 int bread ;
 
 __u32 kernel_size;
+__u32 kernel_end = 0;
+void *image;
 
 
 struct linux_kernel_header *linux_h;
@@ -118,20 +142,21 @@ struct linux_kernel_header *linux_h;
             load_linux( kernel_size, kernel_path);
             return 1;
             }
-          fd = fopen_ak(kernel_path);
-          fread_ak((void*)kernel_address , kernel_size , 1, fd);
+          image = read_kernel_image(kernel_address, kernel_path, kernel_size);
            
-           if(IS_ELF(kernel_address)){
+           if(IS_ELF(image)){
            printf_ak("\nIS ELF ...\nStarting kernel ...\n"); 
-           load_elf(kernel_address,&entry);
+           load_elf(image,&entry);
+           goto *(entry); 
+         }else if(IS_LZ4_IMAGE(image) && load_lz4_image(image, 0, &entry)){
+           printf_ak("\nIS LZ4 image ...\nStarting kernel ...\n"); 
            goto *(entry); 
          }else goto *(kernel_address);
 
 
   }
        
-   fd = fopen_ak(kernel_path);
-  int read = fread_ak((void*)kernel_address , kernel_size , 1, fd);
+  image = read_kernel_image(kernel_address, kernel_path, kernel_size);
 
 
       /* Pointer to multiboot header */
@@ -141,15 +166,24 @@ struct linux_kernel_header *linux_h;
          /* Record execution entry point */
          entry = hdr_ak->entry_addr;
 
-       if(IS_ELF(kernel_address))  
-           load_elf(kernel_address,&entry);
+       if(IS_ELF(image)){
+           load_elf(image,&entry);
+           /* Modules go past the BSS of the kernel */
+           kernel_end = elf_image_end(image);
+           }
+       else if(IS_LZ4_IMAGE(image)){
+           if(!load_lz4_image(image, 0, &entry))
+               return 0;
+           /* Modules go past the compressed image */
+           kernel_end = (__u32) image + kernel_size;
+           }
          
         int i;
         for(i=0;i < MULTIBOOT_MODULE_NUM;i++){
               if( strlen_akel (module_path[i]) == 0)
                   break;
               if(i == 0)
-                mod_cur_addr = entry + kernel_size ;
+                mod_cur_addr = kernel_end ? kernel_end : entry + kernel_size ;
  
               
 
@@ -172,8 +206,10 @@ int mb_load_module (char *module)
 
    fd = fopen_ak(module);
   
-   if(fd == NULL)
-       printf_ak("\n Can not open module file ...\n");
+   if(fd == NULL){
+       printf_ak("\n Can not open module file %s ...\n", module);
+       return 0;
+     }
  
   len = len = fread_ak( mod_cur_addr,fd->filelength, 1, fd );
   if (! len)
@@ -182,6 +218,23 @@ int mb_load_module (char *module)
       return 0;
     }
 
+  /* Compressed module: move the image above the memory it expands
+     to, then expand it at mod_cur_addr */
+  if (IS_LZ4_IMAGE((void *) mod_cur_addr))
+    {
+      __u32 image = (lz4_image_end((void *) mod_cur_addr, mod_cur_addr)
+                     + 0xFFF) & 0xFFFFF000;
+      __u32 entry;
+
+      memmove_akel((void *) image, (void *) mod_cur_addr, len);
+      if (!load_lz4_image((void *) image, mod_cur_addr, &entry))
+        {
+          fs_op_ak.close(fd);
+          return 0;
+        }
+      len = lz4_image_end((void *) image, mod_cur_addr) - mod_cur_addr;
+    }
+
   printf_ak("   [Multiboot-module @ 0x%x, 0x%x bytes]\n", mod_cur_addr, len);
 
   /* these two simply need to be set if any modules are loaded at all */
@@ -190,6 +243,8 @@ int mb_load_module (char *module)
   module_list[mbinfo.mods_count].mod_start = mod_cur_addr;
   mod_cur_addr += len;
   module_list[mbinfo.mods_count].mod_end = mod_cur_addr;
+  /* The kernel finds the module by its path */
+  module_list[mbinfo.mods_count].cmdline = (__u32) module;
   module_list[mbinfo.mods_count].pad = 0;
 
   /* increment number of modules included */
@@ -1,6 +1,7 @@
 
 #include <types.h>
 #include <kerrno.h>
+#include <uaccess.h>
 
 struct cpu_state {
 
@@ -20,19 +21,23 @@ struct cpu_state {
   __u32 ecx; 
   __u32 eax;
 
-  /* Flags */
-  __u32 eflags;
-  /* Code segment:offset */
+  /* Code segment:offset and flags, pushed by the processor */
   __u32 eip;
   __u32 cs;
-  /* Optional stack contents */
-  __u32 return_addr;
-  __u32 param[0];
+  __u32 eflags;
+  /* User stack, when coming from user mode */
+  __u32 user_esp;
+  __u32 user_ss;
 
 } __attribute__((packed));
 
 
-inline int syscall_get3args(const struct cpu_state *user_ctxt,
+/*
+ * The arguments are passed in registers: %ebx, %ecx, %edx, %esi, %edi
+ * and %ebp, in this order
+ */
+
+int syscall_get3args(const struct cpu_state *user_ctxt,
 			       /* out */unsigned int *arg1,
 			       /* out */unsigned int *arg2,
 			       /* out */unsigned int *arg3)
@@ -46,8 +51,8 @@ inline int syscall_get3args(const struct cpu_state *user_ctxt,
 int syscall_get1arg(const struct  cpu_state *user_ctxt,
 			      /* out */unsigned int *arg1)
 {
-  unsigned int unused;
-  return syscall_get3args(user_ctxt, arg1, & unused, & unused);
+  *arg1 = user_ctxt->ebx;
+  return 0;
 }
 
 
@@ -55,8 +60,9 @@ int syscall_get2args(const struct cpu_state *user_ctxt,
 			       /* out */unsigned int *arg1,
 			       /* out */unsigned int *arg2)
 {
-  unsigned int unused;
-  return syscall_get3args(user_ctxt, arg1, arg2, & unused);
+  *arg1 = user_ctxt->ebx;
+  *arg2 = user_ctxt->ecx;
+  return 0;
 }
 
 int syscall_get4args(const struct cpu_state *user_ctxt,
@@ -65,61 +71,49 @@ int syscall_get4args(const struct cpu_state *user_ctxt,
 			       /* out */unsigned int *arg3,
 			       /* out */unsigned int *arg4)
 {
-  __u32 uaddr_other_args;
-  __u32 other_args[2];
-  int    retval;
-
-  /* Retrieve the 3 arguments. The last one is an array containing the
-     remaining arguments */
-  retval = syscall_get3args(user_ctxt, arg1, arg2,
-				(unsigned int *)& uaddr_other_args);
-  if (OK != retval)
-    return retval;
-  
-   /* Copy the array containing the remaining arguments from user
-     space */
-  memcpy((unsigned int)other_args,
-				(unsigned int)uaddr_other_args,
-				sizeof(other_args));
-
-  *arg3 = other_args[0];
-  *arg4 = other_args[1];
-  return OK;
+  syscall_get3args(user_ctxt, arg1, arg2, arg3);
+  *arg4 = user_ctxt->esi;
+  return 0;
+}
+
+
+int syscall_get5args(const struct cpu_state *user_ctxt,
+			       /* out */unsigned int *arg1,
+			       /* out */unsigned int *arg2,
+			       /* out */unsigned int *arg3,
+			       /* out */unsigned int *arg4,
+			       /* out */unsigned int *arg5)
+{
+  syscall_get4args(user_ctxt, arg1, arg2, arg3, arg4);
+  *arg5 = user_ctxt->edi;
+  return 0;
 }
 
 
-int syscall_get7args(const struct cpu_state *user_ctxt,
+int syscall_get6args(const struct cpu_state *user_ctxt,
 			       /* out */unsigned int *arg1,
 			       /* out */unsigned int *arg2,
 			       /* out */unsigned int *arg3,
 			       /* out */unsigned int *arg4,
 			       /* out */unsigned int *arg5,
-			       /* out */unsigned int *arg6,
-			       /* out */unsigned int *arg7)
+			       /* out */unsigned int *arg6)
 {
-  __u32  uaddr_other_args;
-  unsigned int other_args[5];
-  int    retval;
-
-  /* Retrieve the 3 arguments. The last one is an array containing the
-     remaining arguments */
-  retval = syscall_get3args(user_ctxt, arg1, arg2,
-				(unsigned int *)& uaddr_other_args);
-  if (OK != retval)
-    return retval;
-  
-  /* Copy the array containing the remaining arguments from user
-     space */
-  memcpy((unsigned int)other_args,
-				(unsigned int)uaddr_other_args,
-				sizeof(other_args));
-
-
-  *arg3 = other_args[0];
-  *arg4 = other_args[1];
-  *arg5 = other_args[2];
-  *arg6 = other_args[3];
-  *arg7 = other_args[4];
-  return OK;
+  syscall_get5args(user_ctxt, arg1, arg2, arg3, arg4, arg5);
+  *arg6 = user_ctxt->ebp;
+  return 0;
 }
 
+
+int syscall_sysenter_frame(struct cpu_state *user_ctxt)
+{
+  __u32 user_words[2];
+
+  /* The user stub pushed its return address, then the 6th argument */
+  if (copy_from_user(user_words, user_ctxt->user_esp, sizeof(user_words))
+      != sizeof(user_words))
+    return -EFAULT;
+
+  user_ctxt->eip = user_words[0];
+  user_ctxt->ebp = user_words[1];
+  return OK;
+}
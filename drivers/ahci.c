@@ -0,0 +1,744 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+
+#include <types.h>
+#include <klibc.h>
+#include <kmalloc.h>
+#include <kerrno.h>
+#include <debug.h>
+#include <interrupt.h>
+#include <physmem.h>
+#include <kvmm.h>
+#include <kwaitq.h>
+#include <process.h>
+#include <schedule.h>
+#include <time.h>
+#include <irq.h>
+#include <apic.h>
+#include <block_dev.h>
+#include <partition.h>
+#include <ahci.h>
+#include "pci.h"
+
+/**
+ * @file ahci.c
+ *
+ * Each port of the controller has a list of 32 command slots in
+ * memory. A command is issued by setting the bit of its slot in the
+ * PxCI register (and in PxSACT for the NCQ commands), and the
+ * controller clears it once the command completed, raising an IRQ.
+ *
+ * The block layer transfers one block at a time and waits for it: the
+ * queue of a disk is filled by the processes reading or writing it
+ * concurrently, each one sleeping on its own slot. With NCQ, the disk
+ * reorders the queued commands itself.
+ *
+ * Until the processes exist (partition detection at boot), or when
+ * the controller has no usable IRQ line, the completion is polled.
+ * Once the processes exist, the IRQs are let in and the other
+ * processes run between two polls.
+ *
+ * http://www.intel.com/content/www/us/en/io/serial-ata/ahci.html
+ */
+
+/** AHCI major */
+#define BLOCKDEV_AHCI_MAJOR           2
+
+#define AHCI_BLK_SIZE                 512
+
+#define AHCI_MAX_HBAS                 2
+#define AHCI_MAX_PORTS                32
+#define AHCI_MAX_SLOTS                32
+
+#define AHCI_MINOR(disk)              ((disk)*16)
+
+/* A polled command fails after this many polls, or this many ticks */
+#define AHCI_POLL_SPINS               50000000
+#define AHCI_POLL_TIMEOUT             (5 * CLOCK_HZ)
+
+/* Generic host control registers */
+#define HBA_CAP                       0x00
+#define         HBA_CAP_NCS(cap)      ((((cap) >> 8) & 0x1f) + 1)
+#define         HBA_CAP_SNCQ          (1 << 30)
+#define HBA_GHC                       0x04
+#define         HBA_GHC_IE            (1 << 1)
+#define         HBA_GHC_AE            (1 << 31)
+#define HBA_IS                        0x08
+#define HBA_PI                        0x0C
+
+/* Port registers */
+#define HBA_PORT(n)                   (0x100 + (n)*0x80)
+#define HBA_SIZE                      HBA_PORT(AHCI_MAX_PORTS)
+
+#define PORT_CLB                      0x00
+#define PORT_CLBU                     0x04
+#define PORT_FB                       0x08
+#define PORT_FBU                      0x0C
+#define PORT_IS                       0x10
+#define PORT_IE                       0x14
+#define         PORT_INT_DHRS         (1 << 0)  /* D2H register FIS */
+#define         PORT_INT_PSS          (1 << 1)  /* PIO setup FIS */
+#define         PORT_INT_SDBS         (1 << 3)  /* set device bits (NCQ) */
+#define         PORT_INT_IFS          (1 << 27)
+#define         PORT_INT_HBDS         (1 << 28)
+#define         PORT_INT_HBFS         (1 << 29)
+#define         PORT_INT_TFES         (1 << 30) /* task file error */
+#define         PORT_INT_ERROR        (PORT_INT_IFS | PORT_INT_HBDS \
+				       | PORT_INT_HBFS | PORT_INT_TFES)
+#define PORT_CMD                      0x18
+#define         PORT_CMD_ST           (1 << 0)
+#define         PORT_CMD_FRE          (1 << 4)
+#define         PORT_CMD_FR           (1 << 14)
+#define         PORT_CMD_CR           (1 << 15)
+#define PORT_TFD                      0x20
+#define PORT_SIG                      0x24
+#define         PORT_SIG_ATA          0x00000101
+#define PORT_SSTS                     0x28
+#define         PORT_SSTS_DET_PRESENT 3
+#define PORT_SERR                     0x30
+#define PORT_SACT                     0x34
+#define PORT_CI                       0x38
+
+#define ATA_S_ERROR                   0x01
+#define ATA_S_DRQ                     0x08
+#define ATA_S_BSY                     0x80
+
+#define ATA_C_IDENTIFY                0xec
+#define ATA_C_READ_DMA_EXT            0x25
+#define ATA_C_WRITE_DMA_EXT           0x35
+#define ATA_C_READ_FPDMA_QUEUED       0x60
+#define ATA_C_WRITE_FPDMA_QUEUED      0x61
+
+#define FIS_TYPE_REG_H2D              0x27
+
+/** Command header: one per slot in the command list */
+struct ahci_cmd_header
+{
+  __u16 flags;       /* FIS length in dwords, write bit */
+  __u16 prdtl;       /* number of PRD entries */
+  __u32 prdbc;       /* bytes transferred */
+  __u32 ctba;
+  __u32 ctbau;
+  __u32 reserved[4];
+} __attribute__((packed));
+
+#define CMD_HEADER_WRITE              (1 << 6)
+
+/** Physical region descriptor: one buffer of the command */
+struct ahci_prd
+{
+  __u32 dba;
+  __u32 dbau;
+  __u32 reserved;
+  __u32 dbc;         /* byte count - 1, interrupt bit */
+} __attribute__((packed));
+
+/** Command table: the FIS to send, then the PRD table */
+struct ahci_cmd_table
+{
+  __u8 cfis[64];
+  __u8 acmd[16];
+  __u8 reserved[48];
+  struct ahci_prd prdt[1];
+} __attribute__((packed));
+
+/* Size of a command table in its page: they must be 128 bytes aligned */
+#define CMD_TABLE_SIZE                256
+
+struct ahci_hba;
+struct ahci_port
+{
+  int id;
+  int disk;          /* index of the disk among the AHCI ones */
+  struct ahci_hba *hba;
+  volatile __u32 *regs;
+
+  /* DMA memory: identity mapped physical pages */
+  struct ahci_cmd_header *cmd_list;
+  __u8 *fis;
+  struct ahci_cmd_table *cmd_table[AHCI_MAX_SLOTS];
+  __u8 *bounce[AHCI_MAX_SLOTS];
+
+  bool ncq;
+  int depth;
+  __u64 blocks;
+
+  /* Slots owned by a request, issued to the controller, and completed
+     but not yet collected by their owner */
+  __u32 busy;
+  __u32 issued;
+  __u32 done;
+  int status[AHCI_MAX_SLOTS];
+
+  struct kwaitq slot_wait;
+  struct kwaitq done_wait;
+};
+
+struct ahci_hba
+{
+  volatile __u32 *regs;
+  int irq;
+  bool use_irq;
+  struct ahci_port *ports[AHCI_MAX_PORTS];
+};
+
+static struct ahci_hba *ahci_hbas[AHCI_MAX_HBAS];
+static int ahci_nb_hbas;
+static int ahci_nb_disks;
+
+
+static inline __u32 port_read(struct ahci_port *port, __u32 reg)
+{
+  return port->regs[reg / 4];
+}
+
+static inline void port_write(struct ahci_port *port, __u32 reg, __u32 value)
+{
+  port->regs[reg / 4] = value;
+}
+
+
+/* Busy-wait until (reg & mask) == value, about one second at most */
+static int port_wait(struct ahci_port *port, __u32 reg,
+		     __u32 mask, __u32 value)
+{
+  int i;
+
+  for (i = 0; i < 10000000; i++)
+    if ((port_read(port, reg) & mask) == value)
+      return OK;
+  return -EIO;
+}
+
+
+/* The processes cannot sleep before the first one is set up */
+static inline bool ahci_can_sleep(struct ahci_port *port)
+{
+  return port->hba->use_irq && current != NULL;
+}
+
+
+static int ahci_port_stop(struct ahci_port *port)
+{
+  port_write(port, PORT_CMD, port_read(port, PORT_CMD) & ~PORT_CMD_ST);
+  if (port_wait(port, PORT_CMD, PORT_CMD_CR, 0) != OK)
+    return -EIO;
+
+  port_write(port, PORT_CMD, port_read(port, PORT_CMD) & ~PORT_CMD_FRE);
+  return port_wait(port, PORT_CMD, PORT_CMD_FR, 0);
+}
+
+
+static int ahci_port_start(struct ahci_port *port)
+{
+  port_write(port, PORT_SERR, 0xffffffff);
+  port_write(port, PORT_IS, 0xffffffff);
+
+  port_write(port, PORT_CMD, port_read(port, PORT_CMD) | PORT_CMD_FRE);
+  if (port_wait(port, PORT_TFD, ATA_S_BSY | ATA_S_DRQ, 0) != OK)
+    return -EIO;
+
+  port_write(port, PORT_CMD, port_read(port, PORT_CMD) | PORT_CMD_ST);
+  return OK;
+}
+
+
+/*
+ * Complete the commands whose slot the controller released. After an
+ * error, the port stops processing its queue: all the commands in
+ * flight fail, and the port is restarted. Called with the IRQs
+ * disabled.
+ */
+static void ahci_port_intr(struct ahci_port *port)
+{
+  __u32 is, pending, completed;
+  int slot;
+
+  is = port_read(port, PORT_IS);
+  port_write(port, PORT_IS, is);
+
+  if (is & PORT_INT_ERROR)
+    {
+      debug("ahci: port %d error, IS=%x TFD=%x\n", port->id, is,
+	    port_read(port, PORT_TFD));
+      for (slot = 0; slot < AHCI_MAX_SLOTS; slot++)
+	if (port->issued & (1 << slot))
+	  port->status[slot] = -EIO;
+      port->done |= port->issued;
+      port->issued = 0;
+
+      ahci_port_stop(port);
+      ahci_port_start(port);
+    }
+  else
+    {
+      pending = port_read(port, PORT_CI) | port_read(port, PORT_SACT);
+      completed = port->issued & ~pending;
+      for (slot = 0; slot < AHCI_MAX_SLOTS; slot++)
+	if (completed & (1 << slot))
+	  port->status[slot] = OK;
+      port->done |= completed;
+      port->issued &= ~completed;
+    }
+
+  if (port->done)
+    kwaitq_wakeup(& port->done_wait, MAXPID, OK);
+}
+
+
+static void ahci_irq(int irq)
+{
+  int i, n;
+
+  for (i = 0; i < ahci_nb_hbas; i++)
+    {
+      struct ahci_hba *hba = ahci_hbas[i];
+      __u32 is;
+
+      if (hba->irq != irq)
+	continue;
+
+      is = hba->regs[HBA_IS / 4];
+      for (n = 0; n < AHCI_MAX_PORTS; n++)
+	if ((is & (1 << n)) && hba->ports[n])
+	  ahci_port_intr(hba->ports[n]);
+      hba->regs[HBA_IS / 4] = is;
+    }
+}
+
+
+/*
+ * Collect the completions without IRQ, then let the IRQs in and the
+ * other processes run until the next poll. Called with the IRQs
+ * disabled, flags being what disable_IRQs() saved
+ */
+static void ahci_poll(struct ahci_port *port, __u32 flags)
+{
+  ahci_port_intr(port);
+
+  if (current != NULL)
+    {
+      restore_IRQs(flags);
+      schedule();
+      disable_IRQs(flags);
+    }
+}
+
+
+/* Reserve a free slot, waiting for one when the queue is full */
+static int ahci_get_slot(struct ahci_port *port)
+{
+  __u32 flags;
+  int slot;
+
+  disable_IRQs(flags);
+  while (1)
+    {
+      for (slot = 0; slot < port->depth; slot++)
+	if (! (port->busy & (1 << slot)))
+	  {
+	    port->busy |= 1 << slot;
+	    restore_IRQs(flags);
+	    return slot;
+	  }
+
+      if (ahci_can_sleep(port))
+	kwaitq_wait(& port->slot_wait);
+      else
+	ahci_poll(port, flags);
+    }
+}
+
+
+static void ahci_put_slot(struct ahci_port *port, int slot)
+{
+  __u32 flags;
+
+  disable_IRQs(flags);
+  port->busy &= ~(1 << slot);
+  if (ahci_can_sleep(port))
+    kwaitq_wakeup(& port->slot_wait, 1, OK);
+  restore_IRQs(flags);
+}
+
+
+/* Issue the command prepared in the slot, and wait for its completion */
+static int ahci_exec(struct ahci_port *port, int slot, bool queued)
+{
+  __u32 flags, start = clock_ticks;
+  int ret, spins = 0;
+
+  disable_IRQs(flags);
+  port->issued |= 1 << slot;
+  if (queued)
+    port_write(port, PORT_SACT, 1 << slot);
+  port_write(port, PORT_CI, 1 << slot);
+
+  while (! (port->done & (1 << slot)))
+    {
+      if (ahci_can_sleep(port))
+	kwaitq_wait(& port->done_wait);
+      else if (++spins < AHCI_POLL_SPINS
+	       && clock_ticks - start < AHCI_POLL_TIMEOUT)
+	ahci_poll(port, flags);
+      else
+	{
+	  /* No answer: give up the whole queue */
+	  debug("ahci: port %d timeout\n", port->id);
+	  port->status[slot] = -EIO;
+	  port->issued &= ~(1 << slot);
+	  break;
+	}
+    }
+
+  ret = port->status[slot];
+  port->done &= ~(1 << slot);
+  restore_IRQs(flags);
+
+  return ret;
+}
+
+
+/* H2D register FIS, command header and PRD for a transfer of len
+   bytes through the bounce buffer of the slot */
+static void ahci_setup_cmd(struct ahci_port *port, int slot, __u8 command,
+			   __u64 lba, __u16 count, bool iswrite)
+{
+  struct ahci_cmd_header *hdr = & port->cmd_list[slot];
+  struct ahci_cmd_table *tbl = port->cmd_table[slot];
+  __u8 *fis = tbl->cfis;
+
+  memset(tbl, 0x0, sizeof(struct ahci_cmd_table));
+
+  fis[0] = FIS_TYPE_REG_H2D;
+  fis[1] = 0x80;               /* command, not control */
+  fis[2] = command;
+  fis[4] = lba & 0xff;
+  fis[5] = (lba >> 8) & 0xff;
+  fis[6] = (lba >> 16) & 0xff;
+  fis[7] = 0x40;               /* LBA */
+  fis[8] = (lba >> 24) & 0xff;
+  fis[9] = (lba >> 32) & 0xff;
+  fis[10] = (lba >> 40) & 0xff;
+
+  if (command == ATA_C_READ_FPDMA_QUEUED
+      || command == ATA_C_WRITE_FPDMA_QUEUED)
+    {
+      /* The count goes in the features, the tag in the count */
+      fis[3] = count & 0xff;
+      fis[11] = count >> 8;
+      fis[12] = slot << 3;
+    }
+  else
+    {
+      fis[12] = count & 0xff;
+      fis[13] = count >> 8;
+    }
+
+  tbl->prdt[0].dba = (__u32) port->bounce[slot];
+  tbl->prdt[0].dbc = (count ? count * AHCI_BLK_SIZE : AHCI_BLK_SIZE) - 1;
+
+  hdr->flags = 5 | (iswrite ? CMD_HEADER_WRITE : 0);   /* 5 dwords */
+  hdr->prdtl = 1;
+  hdr->prdbc = 0;
+}
+
+
+static int ahci_io_operation(struct ahci_port *port, void *buf,
+			     __u64 block, bool iswrite)
+{
+  __u8 command;
+  int slot, ret;
+
+  if (block >= port->blocks)
+    return -EINVAL;
+
+  slot = ahci_get_slot(port);
+
+  if (port->ncq)
+    command = iswrite ? ATA_C_WRITE_FPDMA_QUEUED : ATA_C_READ_FPDMA_QUEUED;
+  else
+    command = iswrite ? ATA_C_WRITE_DMA_EXT : ATA_C_READ_DMA_EXT;
+
+  /* The buffer may be anywhere (user space, kmalloc): the controller
+     transfers from/to the bounce buffer of the slot */
+  if (iswrite)
+    memcpy(port->bounce[slot], buf, AHCI_BLK_SIZE);
+
+  ahci_setup_cmd(port, slot, command, block, 1, iswrite);
+  ret = ahci_exec(port, slot, port->ncq);
+
+  if (ret == OK && ! iswrite)
+    memcpy(buf, port->bounce[slot], AHCI_BLK_SIZE);
+
+  ahci_put_slot(port, slot);
+  return ret;
+}
+
+
+static int ahci_read_device(void *blkdev_instance, void* dest_buf,
+			    __u64 block_offset)
+{
+  return ahci_io_operation((struct ahci_port *) blkdev_instance,
+			   dest_buf, block_offset, false);
+}
+
+
+static int ahci_write_device(void *blkdev_instance, void* src_buf,
+			     __u64 block_offset)
+{
+  return ahci_io_operation((struct ahci_port *) blkdev_instance,
+			   src_buf, block_offset, true);
+}
+
+
+static struct blockdev_operations ahci_ops = {
+  .read_block  = ahci_read_device,
+  .write_block = ahci_write_device,
+  .ioctl       = NULL
+};
+
+
+/* IDENTIFY DEVICE: capacity and queue depth of the disk */
+static int ahci_identify(struct ahci_port *port)
+{
+  __u16 *info;
+  int slot, ret;
+
+  slot = ahci_get_slot(port);
+  ahci_setup_cmd(port, slot, ATA_C_IDENTIFY, 0, 0, false);
+  port->cmd_table[slot]->cfis[7] = 0;
+  ret = ahci_exec(port, slot, false);
+  info = (__u16*) port->bounce[slot];
+
+  if (ret == OK)
+    {
+      /* 48 bits addressing */
+      if (info[83] & (1 << 10))
+	port->blocks = ((__u64) info[103] << 48) | ((__u64) info[102] << 32)
+	  | ((__u32) info[101] << 16) | info[100];
+      else
+	port->blocks = ((__u32) info[61] << 16) | info[60];
+
+      /* NCQ: queue depth - 1 in word 75 */
+      if (port->ncq && (info[76] & (1 << 8)))
+	{
+	  int disk_depth = (info[75] & 0x1f) + 1;
+	  if (disk_depth < port->depth)
+	    port->depth = disk_depth;
+	}
+      else
+	{
+	  port->ncq = false;
+	  port->depth = 1;
+	}
+    }
+
+  ahci_put_slot(port, slot);
+  return ret;
+}
+
+
+/* Command list (1 kB), received FIS (256 B), command tables, bounce
+   buffers: all in physical pages, also their kernel address */
+static int ahci_port_alloc(struct ahci_port *port, int nb_slots)
+{
+  __u32 page = 0;
+  int slot;
+
+  page = physmem_ref_physpage_new(false);
+  if (! page)
+    return -ENOMEM;
+  memset((void*) page, 0x0, PAGE_SIZE);
+  port->cmd_list = (struct ahci_cmd_header*) page;
+  port->fis = (__u8*) page + 1024;
+
+  for (slot = 0; slot < nb_slots; slot++)
+    {
+      if (slot % (PAGE_SIZE / CMD_TABLE_SIZE) == 0)
+	{
+	  page = physmem_ref_physpage_new(false);
+	  if (! page)
+	    return -ENOMEM;
+	}
+      port->cmd_table[slot] = (struct ahci_cmd_table*)
+	(page + (slot % (PAGE_SIZE / CMD_TABLE_SIZE)) * CMD_TABLE_SIZE);
+      port->cmd_list[slot].ctba = (__u32) port->cmd_table[slot];
+    }
+
+  for (slot = 0; slot < nb_slots; slot++)
+    {
+      if (slot % (PAGE_SIZE / AHCI_BLK_SIZE) == 0)
+	{
+	  page = physmem_ref_physpage_new(false);
+	  if (! page)
+	    return -ENOMEM;
+	}
+      port->bounce[slot] = (__u8*)
+	(page + (slot % (PAGE_SIZE / AHCI_BLK_SIZE)) * AHCI_BLK_SIZE);
+    }
+
+  return OK;
+}
+
+
+static int ahci_port_setup(struct ahci_hba *hba, int n)
+{
+  struct ahci_port *port;
+  __u32 cap = hba->regs[HBA_CAP / 4];
+  volatile __u32 *regs = hba->regs + HBA_PORT(n) / 4;
+  char *name;
+  int ret;
+
+  /* A SATA disk, with the link up */
+  if ((regs[PORT_SSTS / 4] & 0xf) != PORT_SSTS_DET_PRESENT
+      || regs[PORT_SIG / 4] != PORT_SIG_ATA)
+    return -ENODEV;
+
+  port = (struct ahci_port*) kmalloc(sizeof(struct ahci_port), 0);
+  if (! port)
+    return -ENOMEM;
+  memset(port, 0x0, sizeof(struct ahci_port));
+
+  port->id = n;
+  port->hba = hba;
+  port->regs = regs;
+  port->depth = HBA_CAP_NCS(cap);
+  port->ncq = (cap & HBA_CAP_SNCQ) ? true : false;
+  kwaitq_init(& port->slot_wait, "ahci-slot");
+  kwaitq_init(& port->done_wait, "ahci-done");
+
+  if (ahci_port_stop(port) != OK)
+    {
+      kfree((__u32) port);
+      return -EIO;
+    }
+
+  /* The pages are not given back on error: the port is unusable */
+  ret = ahci_port_alloc(port, port->depth);
+  if (ret != OK)
+    return ret;
+
+  port_write(port, PORT_CLB, (__u32) port->cmd_list);
+  port_write(port, PORT_CLBU, 0);
+  port_write(port, PORT_FB, (__u32) port->fis);
+  port_write(port, PORT_FBU, 0);
+
+  if (ahci_port_start(port) != OK)
+    return -EIO;
+
+  port_write(port, PORT_IE, PORT_INT_DHRS | PORT_INT_PSS
+	     | PORT_INT_SDBS | PORT_INT_ERROR);
+  hba->ports[n] = port;
+
+  ret = ahci_identify(port);
+  if (ret != OK)
+    {
+      hba->ports[n] = NULL;
+      return ret;
+    }
+
+  /* devfs keeps the name */
+  name = (char*) kmalloc(8, 0);
+  if (! name)
+    return -ENOMEM;
+
+  port->disk = ahci_nb_disks++;
+  snprintf(name, 8, "sd%c", 'a' + port->disk);
+  kprintf("%s: SATA disk %lu Mb, %s, queue depth %d\n", name,
+	  (__u32) (port->blocks * AHCI_BLK_SIZE >> 20),
+	  port->ncq ? "NCQ" : "no NCQ", port->depth);
+
+  ret = blockdev_register_disk(name, BLOCKDEV_AHCI_MAJOR,
+			       AHCI_MINOR(port->disk), AHCI_BLK_SIZE,
+			       port->blocks, 128, &ahci_ops, port);
+  if (ret != OK)
+    {
+      kprintf("Warning: could not register disk %s \n", name);
+      return ret;
+    }
+
+  ret = part_detect(BLOCKDEV_AHCI_MAJOR, AHCI_MINOR(port->disk),
+		    AHCI_BLK_SIZE, name);
+  if (ret != OK)
+    debug("Warning could not detect partitions (%d)>\n", ret);
+
+  return OK;
+}
+
+
+int ahci_pci_attach(__u8 bus, __u8 device, __u8 func, __u8 irq)
+{
+  struct ahci_hba *hba;
+  __u32 abar, pi;
+  __u16 cmd;
+  int n;
+
+  if (ahci_nb_hbas >= AHCI_MAX_HBAS)
+    return -ENOMEM;
+
+  abar = pci_config_read(bus, device, func, PCI_BAR5, 4) & ~0xf;
+  if (! abar)
+    return -ENODEV;
+
+  /* Memory space and bus master (DMA) */
+  cmd = pci_config_read(bus, device, func, PCI_COMMAND, 2);
+  pci_config_write(bus, device, func, PCI_COMMAND,
+		   cmd | PCI_CMD_MMIO | PCI_CMD_BUSMASTER, 2);
+
+  hba = (struct ahci_hba*) kmalloc(sizeof(struct ahci_hba), 0);
+  if (! hba)
+    return -ENOMEM;
+  memset(hba, 0x0, sizeof(struct ahci_hba));
+
+  hba->regs = (volatile __u32*) kvmm_map_io(abar, HBA_SIZE);
+  if (! hba->regs)
+    {
+      kfree((__u32) hba);
+      return -ENOMEM;
+    }
+
+  hba->regs[HBA_GHC / 4] |= HBA_GHC_AE;
+  hba->irq = irq;
+  ahci_hbas[ahci_nb_hbas++] = hba;
+
+  pi = hba->regs[HBA_PI / 4];
+  hba->regs[HBA_IS / 4] = 0xffffffff;
+
+  /* The line may be shared with another AHCI controller, which
+     already registered ahci_irq(). Through the IOAPIC, it is a level
+     triggered, active low PCI line */
+  if (irq < NR_IRQS
+      && (! apic_enabled()
+	  || apic_set_irq_mode(irq, APIC_IRQ_LEVEL | APIC_IRQ_LOW_ACTIVE) == OK))
+    {
+      hba->use_irq = (irq_register(irq, ahci_irq) == OK);
+      for (n = 0; n < ahci_nb_hbas - 1; n++)
+	if (ahci_hbas[n]->irq == irq && ahci_hbas[n]->use_irq)
+	  hba->use_irq = true;
+    }
+  if (hba->use_irq)
+    hba->regs[HBA_GHC / 4] |= HBA_GHC_IE;
+
+  for (n = 0; n < AHCI_MAX_PORTS; n++)
+    if (pi & (1 << n))
+      ahci_port_setup(hba, n);
+
+  return OK;
+}
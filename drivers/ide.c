@@ -497,7 +497,7 @@ static int ide_io_operation (struct ide_device *dev,
     }
     
 /* Make sure nobody is using the same controller at the same time */
-   kmutex_lock (& dev->ctrl->mutex, NULL);
+   kmutex_lock (& dev->ctrl->mutex);
       
 /* Select device */
   outb(dev->ctrl->ioaddr + ATA_DRIVE,ATA_D_SET  | devselect );
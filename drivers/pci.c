@@ -21,6 +21,9 @@
 #include <klibc.h>
 #include "pci.h"
 #include <kmalloc.h>
+#include <ahci.h>
+#include <virtio.h>
+#include <virtio_blk.h>
 
 //! A structure to write to the PCI configuration register.
 //! It represents a location on the PCI bus.
@@ -165,9 +168,24 @@ __u16 bus;
                             kprintf("\t Multimedia Controller Audio");
                         }
 
+                        if (PCIdev->classID == 0x01 && PCIdev->subclassID == 0x06) // SATA Controller
+                        {
+                            kprintf("\t SATA Controller");
+                        }
+
                        
                    
                         kputchar('\n');
+
+                        if (PCIdev->classID == 0x01 && PCIdev->subclassID == 0x06
+                            && PCIdev->interfaceID == 0x01) // AHCI
+                            ahci_pci_attach(PCIdev->bus, PCIdev->device,
+                                            PCIdev->func, PCIdev->irq);
+
+                        if (PCIdev->vendorID == VIRTIO_PCI_VENDOR
+                            && PCIdev->deviceID == VIRTIO_BLK_PCI_DEVICE)
+                            virtio_blk_pci_attach(PCIdev->bus, PCIdev->device,
+                                                  PCIdev->func, PCIdev->irq);
                  kfree((__u32) PCIdev);
 
                         counter++;
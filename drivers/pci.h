@@ -46,6 +46,8 @@
 #define PCI_CAPLIST     0x34
 #define PCI_IRQLINE     0x3C
 
+#define BIT(n) (1 << (n))
+
 #define PCI_CMD_IO        BIT(0)
 #define PCI_CMD_MMIO      BIT(1)
 #define PCI_CMD_BUSMASTER BIT(2)
@@ -84,6 +86,9 @@ typedef struct
 } pciDev_t;
 
 
+__u32 pci_config_read(__u8 bus, __u8 dev, __u8 func, __u8 reg, __u32 length);
+void pci_config_write(__u8 bus, __u8 dev, __u8 func, __u8 reg, __u32 val, __u32 length);
+
 
 
 
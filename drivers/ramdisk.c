@@ -0,0 +1,208 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+
+#include <types.h>
+#include <klibc.h>
+#include <kmalloc.h>
+#include <kerrno.h>
+#include <debug.h>
+#include <physmem.h>
+#include <mm.h>
+#include <kvmm.h>
+#include <block_dev.h>
+#include <partition.h>
+#include <ramdisk.h>
+
+/** RAM disk major */
+#define BLOCKDEV_RAMDISK_MAJOR        4
+
+#define RAMDISK_MAX_DISKS             8
+
+#define RAMDISK_MINOR(disk)           ((disk)*16)
+
+struct ramdisk
+{
+  __u32 data;      /* kernel address of the contents */
+  __u64 blocks;
+};
+
+static int ramdisk_nb_disks;
+
+
+static int ramdisk_read_device(void *blkdev_instance, void* dest_buf,
+			       __u64 block_offset)
+{
+  struct ramdisk *rd = (struct ramdisk *) blkdev_instance;
+
+  if (block_offset >= rd->blocks)
+    return -EINVAL;
+
+  memcpy(dest_buf,
+	 (void*) (rd->data + (__u32) block_offset * RAMDISK_BLK_SIZE),
+	 RAMDISK_BLK_SIZE);
+  return OK;
+}
+
+
+static int ramdisk_write_device(void *blkdev_instance, void* src_buf,
+				__u64 block_offset)
+{
+  struct ramdisk *rd = (struct ramdisk *) blkdev_instance;
+
+  if (block_offset >= rd->blocks)
+    return -EINVAL;
+
+  memcpy((void*) (rd->data + (__u32) block_offset * RAMDISK_BLK_SIZE),
+	 src_buf, RAMDISK_BLK_SIZE);
+  return OK;
+}
+
+
+static struct blockdev_operations ramdisk_ops = {
+  .read_block  = ramdisk_read_device,
+  .write_block = ramdisk_write_device,
+  .ioctl       = NULL
+};
+
+
+int ramdisk_create(__u32 size_kb, const void *image, __u32 image_size)
+{
+  struct ramdisk *rd;
+  __u32 size, nb_pages, offset;
+  char *name;
+  int ret;
+
+  if (ramdisk_nb_disks >= RAMDISK_MAX_DISKS)
+    return -ENOMEM;
+
+  size = size_kb * 1024;
+  if (size < image_size)
+    size = image_size;
+  nb_pages = PAGE_ALIGN_SUP(size) / PAGE_SIZE;
+  if (! nb_pages)
+    return -EINVAL;
+
+  rd = (struct ramdisk*) kmalloc(sizeof(struct ramdisk), 0);
+  if (! rd)
+    return -ENOMEM;
+
+  /* In the kernel space: the same in all the address spaces */
+  rd->data = kvmm_alloc(nb_pages, KVMM_MAP);
+  if (! rd->data)
+    {
+      kfree((__u32) rd);
+      return -ENOMEM;
+    }
+  rd->blocks = (nb_pages * PAGE_SIZE) / RAMDISK_BLK_SIZE;
+
+  if (image)
+    memcpy((void*) rd->data, image, image_size);
+  /* Most of the rest is not read soon: keep it out of the caches */
+  memset((void*) (rd->data + image_size), 0x0,
+	 PAGE_ALIGN_SUP(image_size) - image_size);
+  for (offset = PAGE_ALIGN_SUP(image_size) ; offset < nb_pages * PAGE_SIZE ;
+       offset += PAGE_SIZE)
+    memzero_page_nocache((void*) (rd->data + offset));
+
+  /* devfs keeps the name */
+  name = (char*) kmalloc(8, 0);
+  if (! name)
+    {
+      kvmm_free(rd->data);
+      kfree((__u32) rd);
+      return -ENOMEM;
+    }
+  snprintf(name, 8, "ram%d", ramdisk_nb_disks);
+
+  ret = blockdev_register_disk(name, BLOCKDEV_RAMDISK_MAJOR,
+			       RAMDISK_MINOR(ramdisk_nb_disks),
+			       RAMDISK_BLK_SIZE, rd->blocks,
+			       0, &ramdisk_ops, rd);
+  if (ret != OK)
+    {
+      kprintf("Warning: could not register disk %s \n", name);
+      kfree((__u32) name);
+      kvmm_free(rd->data);
+      kfree((__u32) rd);
+      return ret;
+    }
+
+  kprintf("%s: RAM disk %d kB%s\n", name, (nb_pages * PAGE_SIZE) >> 10,
+	  image ? ", preloaded" : "");
+
+  /* Only an image can have partitions */
+  if (image)
+    {
+      ret = part_detect(BLOCKDEV_RAMDISK_MAJOR,
+			RAMDISK_MINOR(ramdisk_nb_disks), RAMDISK_BLK_SIZE,
+			name);
+      if (ret != OK)
+	debug("Warning could not detect partitions (%d)>\n", ret);
+    }
+
+  ramdisk_nb_disks++;
+  return OK;
+}
+
+
+/* Start of the next word of the command line, and its length */
+static const char *next_word(const char *s, int *len)
+{
+  while (*s == ' ')
+    s++;
+  for (*len = 0; s[*len] && s[*len] != ' '; (*len)++)
+    ;
+  return s;
+}
+
+
+__u32 ramdisk_cmdline_size(const char *cmdline)
+{
+  const char *word;
+  __u32 size;
+  int len, i;
+
+  for (word = next_word(cmdline, & len); len;
+       word = next_word(word + len, & len))
+    {
+      if (len <= 8 || memcmp(word, "ramdisk=", 8) != 0)
+	continue;
+
+      size = 0;
+      for (i = 8; i < len && word[i] >= '0' && word[i] <= '9'; i++)
+	size = size * 10 + word[i] - '0';
+      return size;
+    }
+
+  return 0;
+}
+
+
+bool ramdisk_cmdline_is_image(const char *cmdline)
+{
+  const char *word;
+  int len;
+
+  for (word = next_word(cmdline, & len); len;
+       word = next_word(word + len, & len))
+    if (len == 7 && memcmp(word, "ramdisk", 7) == 0)
+      return true;
+
+  return false;
+}
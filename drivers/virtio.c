@@ -0,0 +1,163 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+
+#include <types.h>
+#include <io.h>
+#include <klibc.h>
+#include <kerrno.h>
+#include <kmalloc.h>
+#include <virtio.h>
+
+/*
+ * The host runs on other processors: its view of the rings must be
+ * up to date before the indexes move (x86: only the compiler and the
+ * store buffer reorder)
+ */
+#define mb()  asm volatile("lock; addl $0,0(%%esp)" ::: "memory")
+#define wmb() asm volatile("" ::: "memory")
+#define rmb() asm volatile("" ::: "memory")
+
+
+void virtio_pci_reset(__u16 io_base)
+{
+  outb(io_base + VIRTIO_PCI_STATUS, 0);
+  outb(io_base + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+  outb(io_base + VIRTIO_PCI_STATUS,
+       VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+}
+
+
+int virtqueue_setup(struct virtqueue *vq, __u16 io_base, __u16 index,
+		    void *mem, __u32 mem_size)
+{
+  __u16 num;
+  int i;
+
+  outw(io_base + VIRTIO_PCI_QUEUE_SEL, index);
+  num = inw(io_base + VIRTIO_PCI_QUEUE_NUM);
+  if (num == 0)
+    return -ENODEV;
+
+  /* The legacy interface imposes the size of the queue */
+  if (VRING_SIZE(num) > mem_size)
+    return -ENOSPC;
+
+  vq->cookies = (void**) kmalloc(num * sizeof(void*), 0);
+  if (! vq->cookies)
+    return -ENOMEM;
+
+  vq->io_base = io_base;
+  vq->index = index;
+  vq->num = num;
+  vq->desc = (struct vring_desc*) mem;
+  vq->avail = (struct vring_avail*) ((__u32) mem + 16*num);
+  vq->used = (struct vring_used*)
+    ALIGN_SUP((__u32) & vq->avail->ring[num + 1], VIRTIO_PCI_VRING_ALIGN);
+
+  for (i = 0; i < num - 1; i++)
+    vq->desc[i].next = i + 1;
+  vq->free_head = 0;
+  vq->num_free = num;
+  vq->num_added = 0;
+  vq->last_used_idx = 0;
+
+  outl(io_base + VIRTIO_PCI_QUEUE_PFN, (__u32) mem / VIRTIO_PCI_VRING_ALIGN);
+  return OK;
+}
+
+
+int virtqueue_add(struct virtqueue *vq, const struct virtqueue_buf *bufs,
+		  int nb_out, int nb_in, void *cookie)
+{
+  __u16 head, i, last = 0;
+  int n;
+
+  if (nb_out + nb_in > vq->num_free)
+    return -ENOSPC;
+
+  head = i = vq->free_head;
+  for (n = 0; n < nb_out + nb_in; n++)
+    {
+      vq->desc[i].addr = (__u32) bufs[n].addr;
+      vq->desc[i].len = bufs[n].len;
+      vq->desc[i].flags = VRING_DESC_F_NEXT
+	| ((n >= nb_out) ? VRING_DESC_F_WRITE : 0);
+      last = i;
+      i = vq->desc[i].next;
+    }
+  vq->desc[last].flags &= ~VRING_DESC_F_NEXT;
+
+  vq->free_head = i;
+  vq->num_free -= nb_out + nb_in;
+  vq->cookies[head] = cookie;
+
+  vq->avail->ring[(vq->avail->idx + vq->num_added) % vq->num] = head;
+  vq->num_added++;
+  return OK;
+}
+
+
+void virtqueue_kick(struct virtqueue *vq)
+{
+  if (! vq->num_added)
+    return;
+
+  /* The descriptors and the ring entries before the index */
+  wmb();
+  vq->avail->idx += vq->num_added;
+  vq->num_added = 0;
+
+  /* The index before the flags of the device */
+  mb();
+  if (! (vq->used->flags & VRING_USED_F_NO_NOTIFY))
+    outw(vq->io_base + VIRTIO_PCI_QUEUE_NOTIFY, vq->index);
+}
+
+
+void *virtqueue_get_used(struct virtqueue *vq, __u32 *len)
+{
+  struct vring_used_elem *elem;
+  void *cookie;
+  __u16 i;
+
+  if (vq->last_used_idx == vq->used->idx)
+    return NULL;
+
+  /* The entry after the index */
+  rmb();
+  elem = & vq->used->ring[vq->last_used_idx % vq->num];
+  vq->last_used_idx++;
+
+  if (len)
+    *len = elem->len;
+  cookie = vq->cookies[elem->id];
+
+  /* Give back the chain of descriptors */
+  i = elem->id;
+  vq->num_free++;
+  while (vq->desc[i].flags & VRING_DESC_F_NEXT)
+    {
+      i = vq->desc[i].next;
+      vq->num_free++;
+    }
+  vq->desc[i].next = vq->free_head;
+  vq->free_head = elem->id;
+
+  return cookie;
+}
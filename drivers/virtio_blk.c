@@ -0,0 +1,454 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+
+#include <types.h>
+#include <io.h>
+#include <klibc.h>
+#include <kmalloc.h>
+#include <kerrno.h>
+#include <debug.h>
+#include <interrupt.h>
+#include <physmem.h>
+#include <kwaitq.h>
+#include <process.h>
+#include <schedule.h>
+#include <time.h>
+#include <irq.h>
+#include <apic.h>
+#include <block_dev.h>
+#include <partition.h>
+#include <virtio.h>
+#include <virtio_blk.h>
+#include "pci.h"
+
+/**
+ * @file virtio_blk.c
+ *
+ * A request is a chain of three buffers: the header (type, sector),
+ * the data, and the status byte written back by the host. Each
+ * process reading or writing a block adds its request to the ring
+ * and sleeps until the IRQ handler collects it from the used ring.
+ *
+ * The host does not want to be notified while it processes the ring
+ * (VRING_USED_F_NO_NOTIFY): the requests added meanwhile are taken
+ * in the same batch, without any I/O port access.
+ *
+ * Without IRQ, the used ring is polled: once the processes exist, the
+ * IRQs are let in and the other processes run between two polls.
+ */
+
+/** virtio-blk major */
+#define BLOCKDEV_VIRTIO_BLK_MAJOR     3
+
+#define VIRTIO_BLK_SECTOR_SIZE        512
+
+#define VIRTIO_BLK_MAX_DEVS           4
+/** Requests in flight per device: 3 descriptors each */
+#define VIRTIO_BLK_MAX_REQS           32
+
+#define VIRTIO_BLK_MINOR(disk)        ((disk)*16)
+
+/* A polled request fails after this many polls, or this many ticks */
+#define VIRTIO_BLK_POLL_SPINS         50000000
+#define VIRTIO_BLK_POLL_TIMEOUT       (5 * CLOCK_HZ)
+
+/* Device configuration */
+#define VIRTIO_BLK_CONFIG_CAPACITY    (VIRTIO_PCI_CONFIG + 0)
+
+/* Features */
+#define VIRTIO_BLK_F_RO               (1 << 5)
+
+#define VIRTIO_BLK_T_IN               0
+#define VIRTIO_BLK_T_OUT              1
+
+#define VIRTIO_BLK_S_OK               0
+
+/*
+ * The legacy interface needs the rings in contiguous memory, and the
+ * page allocator gives one page at a time: keep them in the kernel
+ * image (identity mapped). Enough for the 256 entries of QEMU.
+ */
+#define VIRTIO_BLK_VRING_MEM          (3 * 4096)
+
+static __u8 virtio_blk_vrings[VIRTIO_BLK_MAX_DEVS][VIRTIO_BLK_VRING_MEM]
+  __attribute__((aligned(4096)));
+
+struct virtio_blk_req
+{
+  /* Read by the host */
+  struct
+  {
+    __u32 type;
+    __u32 ioprio;
+    __u64 sector;
+  } __attribute__((packed)) hdr;
+  __u8 data[VIRTIO_BLK_SECTOR_SIZE];
+
+  /* Written by the host */
+  __u8 status;
+
+  bool done;
+};
+
+struct virtio_blk
+{
+  __u16 io_base;
+  int irq;
+  bool use_irq;
+  bool read_only;
+  int disk;
+  __u64 blocks;
+
+  struct virtqueue vq;
+
+  /* Requests in physical pages, and the ones in use */
+  struct virtio_blk_req *reqs[VIRTIO_BLK_MAX_REQS];
+  __u32 busy;
+
+  struct kwaitq req_wait;
+  struct kwaitq done_wait;
+};
+
+static struct virtio_blk *virtio_blk_devs[VIRTIO_BLK_MAX_DEVS];
+static int virtio_blk_nb_devs;
+
+
+/* The processes cannot sleep before the first one is set up */
+static inline bool virtio_blk_can_sleep(struct virtio_blk *vblk)
+{
+  return vblk->use_irq && current != NULL;
+}
+
+
+/* Collect the completed requests. Called with the IRQs disabled. */
+static void virtio_blk_complete(struct virtio_blk *vblk)
+{
+  struct virtio_blk_req *req;
+  bool any = false;
+
+  while ((req = virtqueue_get_used(& vblk->vq, NULL)) != NULL)
+    {
+      req->done = true;
+      any = true;
+    }
+
+  if (any)
+    kwaitq_wakeup(& vblk->done_wait, MAXPID, OK);
+}
+
+
+static void virtio_blk_irq(int irq)
+{
+  int i;
+
+  for (i = 0; i < virtio_blk_nb_devs; i++)
+    {
+      struct virtio_blk *vblk = virtio_blk_devs[i];
+
+      /* Reading the ISR acknowledges the interrupt */
+      if (vblk->irq == irq && (inb(vblk->io_base + VIRTIO_PCI_ISR) & 1))
+	virtio_blk_complete(vblk);
+    }
+}
+
+
+/*
+ * Collect the completed requests without IRQ, then let the IRQs in
+ * and the other processes run until the next poll. Called with the
+ * IRQs disabled, flags being what disable_IRQs() saved
+ */
+static void virtio_blk_poll(struct virtio_blk *vblk, __u32 flags)
+{
+  virtio_blk_complete(vblk);
+
+  if (current != NULL)
+    {
+      restore_IRQs(flags);
+      schedule();
+      disable_IRQs(flags);
+    }
+}
+
+
+static int virtio_blk_get_req(struct virtio_blk *vblk)
+{
+  __u32 flags;
+  int i;
+
+  disable_IRQs(flags);
+  while (1)
+    {
+      for (i = 0; i < VIRTIO_BLK_MAX_REQS; i++)
+	if (vblk->reqs[i] && ! (vblk->busy & (1 << i)))
+	  {
+	    vblk->busy |= 1 << i;
+	    restore_IRQs(flags);
+	    return i;
+	  }
+
+      if (virtio_blk_can_sleep(vblk))
+	kwaitq_wait(& vblk->req_wait);
+      else
+	virtio_blk_poll(vblk, flags);
+    }
+}
+
+
+static void virtio_blk_put_req(struct virtio_blk *vblk, int i)
+{
+  __u32 flags;
+
+  disable_IRQs(flags);
+  vblk->busy &= ~(1 << i);
+  if (virtio_blk_can_sleep(vblk))
+    kwaitq_wakeup(& vblk->req_wait, 1, OK);
+  restore_IRQs(flags);
+}
+
+
+static int virtio_blk_io_operation(struct virtio_blk *vblk, void *buf,
+				   __u64 block, bool iswrite)
+{
+  struct virtio_blk_req *req;
+  struct virtqueue_buf bufs[3];
+  __u32 flags, start;
+  int i, ret, spins = 0;
+
+  if (block >= vblk->blocks)
+    return -EINVAL;
+  if (iswrite && vblk->read_only)
+    return -EROFS;
+
+  i = virtio_blk_get_req(vblk);
+  req = vblk->reqs[i];
+
+  req->hdr.type = iswrite ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+  req->hdr.ioprio = 0;
+  req->hdr.sector = block;
+  req->status = 0xff;
+  req->done = false;
+
+  /* The buffer may be anywhere (user space, kmalloc): the host
+     transfers from/to the one of the request */
+  if (iswrite)
+    memcpy(req->data, buf, VIRTIO_BLK_SECTOR_SIZE);
+
+  bufs[0].addr = & req->hdr;
+  bufs[0].len = sizeof(req->hdr);
+  bufs[1].addr = req->data;
+  bufs[1].len = VIRTIO_BLK_SECTOR_SIZE;
+  bufs[2].addr = & req->status;
+  bufs[2].len = 1;
+
+  disable_IRQs(flags);
+
+  /* 3 descriptors per request: the ring cannot be full */
+  virtqueue_add(& vblk->vq, bufs, iswrite ? 2 : 1, iswrite ? 1 : 2, req);
+  virtqueue_kick(& vblk->vq);
+
+  start = clock_ticks;
+  while (! req->done)
+    {
+      if (virtio_blk_can_sleep(vblk))
+	kwaitq_wait(& vblk->done_wait);
+      else if (++spins < VIRTIO_BLK_POLL_SPINS
+	       && clock_ticks - start < VIRTIO_BLK_POLL_TIMEOUT)
+	virtio_blk_poll(vblk, flags);
+      else
+	break;
+    }
+
+  restore_IRQs(flags);
+
+  /* The host may still use the request: it is never given back */
+  if (! req->done)
+    {
+      debug("virtio-blk: vd%c timeout\n", 'a' + vblk->disk);
+      return -EIO;
+    }
+
+  if (req->status == VIRTIO_BLK_S_OK)
+    {
+      if (! iswrite)
+	memcpy(buf, req->data, VIRTIO_BLK_SECTOR_SIZE);
+      ret = OK;
+    }
+  else
+    ret = -EIO;
+
+  virtio_blk_put_req(vblk, i);
+  return ret;
+}
+
+
+static int virtio_blk_read_device(void *blkdev_instance, void* dest_buf,
+				  __u64 block_offset)
+{
+  return virtio_blk_io_operation((struct virtio_blk *) blkdev_instance,
+				 dest_buf, block_offset, false);
+}
+
+
+static int virtio_blk_write_device(void *blkdev_instance, void* src_buf,
+				   __u64 block_offset)
+{
+  return virtio_blk_io_operation((struct virtio_blk *) blkdev_instance,
+				 src_buf, block_offset, true);
+}
+
+
+static struct blockdev_operations virtio_blk_ops = {
+  .read_block  = virtio_blk_read_device,
+  .write_block = virtio_blk_write_device,
+  .ioctl       = NULL
+};
+
+
+/* The requests do not cross a page: the host sees them contiguous */
+static int virtio_blk_alloc_reqs(struct virtio_blk *vblk, int nb_reqs)
+{
+  int per_page = PAGE_SIZE / sizeof(struct virtio_blk_req);
+  __u32 page = 0;
+  int i;
+
+  for (i = 0; i < nb_reqs; i++)
+    {
+      if (i % per_page == 0)
+	{
+	  page = physmem_ref_physpage_new(false);
+	  if (! page)
+	    return (i > 0) ? OK : -ENOMEM;
+	}
+      vblk->reqs[i] = (struct virtio_blk_req*)
+	(page + (i % per_page) * sizeof(struct virtio_blk_req));
+    }
+
+  return OK;
+}
+
+
+int virtio_blk_pci_attach(__u8 bus, __u8 device, __u8 func, __u8 irq)
+{
+  struct virtio_blk *vblk;
+  __u32 bar0, features;
+  __u16 cmd;
+  char *name;
+  int ret, nb_reqs;
+
+  if (virtio_blk_nb_devs >= VIRTIO_BLK_MAX_DEVS)
+    return -ENOMEM;
+
+  /* Legacy interface: I/O space */
+  bar0 = pci_config_read(bus, device, func, PCI_BAR0, 4);
+  if (! (bar0 & 1))
+    return -ENODEV;
+
+  cmd = pci_config_read(bus, device, func, PCI_COMMAND, 2);
+  pci_config_write(bus, device, func, PCI_COMMAND,
+		   cmd | PCI_CMD_IO | PCI_CMD_BUSMASTER, 2);
+
+  vblk = (struct virtio_blk*) kmalloc(sizeof(struct virtio_blk), 0);
+  if (! vblk)
+    return -ENOMEM;
+  memset(vblk, 0x0, sizeof(struct virtio_blk));
+
+  vblk->io_base = bar0 & ~0x3;
+  vblk->irq = irq;
+  kwaitq_init(& vblk->req_wait, "vblk-req");
+  kwaitq_init(& vblk->done_wait, "vblk-done");
+
+  virtio_pci_reset(vblk->io_base);
+
+  /* No optional feature used */
+  features = inl(vblk->io_base + VIRTIO_PCI_HOST_FEATURES);
+  vblk->read_only = (features & VIRTIO_BLK_F_RO) ? true : false;
+  outl(vblk->io_base + VIRTIO_PCI_GUEST_FEATURES, 0);
+
+  ret = virtqueue_setup(& vblk->vq, vblk->io_base, 0,
+			virtio_blk_vrings[virtio_blk_nb_devs],
+			VIRTIO_BLK_VRING_MEM);
+  nb_reqs = vblk->vq.num / 3;
+  if (nb_reqs > VIRTIO_BLK_MAX_REQS)
+    nb_reqs = VIRTIO_BLK_MAX_REQS;
+  if (ret == OK)
+    ret = (nb_reqs > 0) ? virtio_blk_alloc_reqs(vblk, nb_reqs) : -ENOSPC;
+  if (ret != OK)
+    {
+      kprintf("virtio-blk: cannot set up the queue (%d)\n", ret);
+
+      /* The reset makes the device forget the ring, which the next
+	 device gets */
+      outb(vblk->io_base + VIRTIO_PCI_STATUS, 0);
+      outb(vblk->io_base + VIRTIO_PCI_STATUS, VIRTIO_STATUS_FAILED);
+      if (vblk->vq.cookies)
+	kfree((__u32) vblk->vq.cookies);
+      kfree((__u32) vblk);
+      return ret;
+    }
+
+  vblk->blocks = inl(vblk->io_base + VIRTIO_BLK_CONFIG_CAPACITY)
+    | ((__u64) inl(vblk->io_base + VIRTIO_BLK_CONFIG_CAPACITY + 4) << 32);
+
+  virtio_blk_devs[virtio_blk_nb_devs++] = vblk;
+
+  /* The line may be shared with another virtio-blk device. Through
+     the IOAPIC, it is a level triggered, active low PCI line */
+  if (irq < NR_IRQS
+      && (! apic_enabled()
+	  || apic_set_irq_mode(irq, APIC_IRQ_LEVEL | APIC_IRQ_LOW_ACTIVE) == OK))
+    {
+      int i;
+
+      vblk->use_irq = (irq_register(irq, virtio_blk_irq) == OK);
+      for (i = 0; i < virtio_blk_nb_devs - 1; i++)
+	if (virtio_blk_devs[i]->irq == irq && virtio_blk_devs[i]->use_irq)
+	  vblk->use_irq = true;
+    }
+
+  outb(vblk->io_base + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACKNOWLEDGE
+       | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+
+  /* devfs keeps the name */
+  name = (char*) kmalloc(8, 0);
+  if (! name)
+    return -ENOMEM;
+
+  vblk->disk = virtio_blk_nb_devs - 1;
+  snprintf(name, 8, "vd%c", 'a' + vblk->disk);
+  kprintf("%s: virtio disk %lu Mb, %d entries ring%s\n", name,
+	  (__u32) (vblk->blocks * VIRTIO_BLK_SECTOR_SIZE >> 20),
+	  vblk->vq.num, vblk->read_only ? ", read-only" : "");
+
+  ret = blockdev_register_disk(name, BLOCKDEV_VIRTIO_BLK_MAJOR,
+			       VIRTIO_BLK_MINOR(vblk->disk),
+			       VIRTIO_BLK_SECTOR_SIZE, vblk->blocks,
+			       128, &virtio_blk_ops, vblk);
+  if (ret != OK)
+    {
+      kprintf("Warning: could not register disk %s \n", name);
+      return ret;
+    }
+
+  ret = part_detect(BLOCKDEV_VIRTIO_BLK_MAJOR, VIRTIO_BLK_MINOR(vblk->disk),
+		    VIRTIO_BLK_SECTOR_SIZE, name);
+  if (ret != OK)
+    debug("Warning could not detect partitions (%d)>\n", ret);
+
+  return OK;
+}
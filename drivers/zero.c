@@ -155,8 +155,8 @@ static int zero_no_page(struct uvmm_arena * arena,
       ppage_paddr = lookup_anonymous_physpage(zero_resource, required_page_id);
       if (NULL != (void*)ppage_paddr)
 	{
-	  retval = paging_map(PAGE_ALIGN_INF(uaddr),ppage_paddr,
-				  true);
+	  retval = paging_map_prot(PAGE_ALIGN_INF(uaddr),ppage_paddr,
+				   true, arena_prot);
 
 	  return retval;
 	}
@@ -182,7 +182,7 @@ static int zero_no_page(struct uvmm_arena * arena,
 	  return retval;
 	}
       
-      memset((void*)PAGE_ALIGN_INF(uaddr), 0x0, PAGE_SIZE);
+      memzero_page((void*)PAGE_ALIGN_INF(uaddr));
 
       /* For shared mappings, add the page in the list of shared
 	 mapped pages */
@@ -197,8 +197,8 @@ static int zero_no_page(struct uvmm_arena * arena,
                 
       /* Map-in the zero page in READ ONLY whatever the access_rights
 	 or the type (shared/private) of the arena to activate COW */
-      retval = paging_map(PAGE_ALIGN_INF(uaddr),zero_page,
-			      true );
+      retval = paging_map_prot(PAGE_ALIGN_INF(uaddr),zero_page,
+			       true, P_READ);
 
        
 
@@ -8,6 +8,10 @@
 #include <syscall.h>
 #include <kfcntl.h>
 #include <kstat.h>
+#include <kerrno.h>
+#include <list.h>
+#include <vfs.h>
+#include <zero.h>
 
 #define PT_NULL		0		/**< Unused element */
 #define	PT_LOAD		1		/**< Loadable segment */
@@ -61,143 +65,7 @@ typedef unsigned long Elf32_Word;
   } __attribute__((packed)) Elf32_Phdr_t;
 
 
-/**
- * Symbol marking the start of the userprogs table, as setup by the
- * ld script in the userland/ directory
- */
-extern char _userprogs_table;
-
-
-/**
- * Structure of a mapped resource for an ELF32 program (ie a portion
- * of the kernel space)
- */
-struct elf32_mapped_program
-{
-  __u32 vaddr;
-  __u32  size;
-  int ref_cnt;
-
-  struct uvmm_mapped_resource mr;
-};
-
-
-/** Called after the virtual region has been inserted inside its
-    address space */
-static void elf32prog_ref(struct uvmm_arena * arena)
-{
-  struct elf32_mapped_program * elf32prog_resource;
-  elf32prog_resource = (struct elf32_mapped_program*) uvmm_get_mapped_resource_of_arena(arena)->custom_data;
-  
-  elf32prog_resource->ref_cnt ++;
-}
-
-
-/** Called when the virtual region is removed from its address
-    space */
-static void elf32prog_unref(struct uvmm_arena * arena)
-{
-  struct elf32_mapped_program * elf32prog_resource;
-  elf32prog_resource
-    = (struct elf32_mapped_program*)
-      uvmm_get_mapped_resource_of_arena(arena)->custom_data;
-  
-  elf32prog_resource->ref_cnt --;
-  if( 0 >= elf32prog_resource->ref_cnt) debug();
-
-  /* Free the resource if it becomes unused */
-  if (elf32prog_resource->ref_cnt == 0)
-    kfree((__u32)elf32prog_resource);
-}
-
-
-/** Called when a legitimate page fault is occuring in the arena */
-static int elf32prog_no_page(struct uvmm_arena * arena,
-				   __u32 uaddr,
-				   bool write_access)
-{
-  struct elf32_mapped_program * elf32prog_resource;
-  int     retval = 0;
-  __u32   ppage_paddr;
-  __u32   upage_uaddr = PAGE_ALIGN_INF(uaddr);
-  __u64 offset_in_prog;
-  __u32    size_to_copy;
-
-  flush_tlb_all();
- 
-  elf32prog_resource
-    = (struct elf32_mapped_program*)
-      uvmm_get_mapped_resource_of_arena(arena)->custom_data;
-
-  /* Compute the offset in program of the page, and the size to copy
-     in user space */
-  offset_in_prog = upage_uaddr - uvmm_get_start_of_arena(arena) + uvmm_get_offset_in_resource(arena) ;
-  size_to_copy = PAGE_SIZE;
-
-  if (offset_in_prog + size_to_copy > elf32prog_resource->size)
-    size_to_copy = elf32prog_resource->size - offset_in_prog;
-
-      /* Allocate a new page that contains the code/data of the
-	 program */
-      ppage_paddr = physmem_ref_physpage_new(false);
-      if (! ppage_paddr)
-	return -3;
-      
-      /* Map it in user space, in read/write mode for the kernel to copy
-	 the data in the page */
-      retval = paging_map(upage_uaddr,ppage_paddr,
-			      true);
-
-      if(0 != retval) debug();
-
-      physmem_unref_physpage(ppage_paddr);
-      
-      /* Copy the program in it */
-      memcpy((void*)upage_uaddr,
-	     (void*)elf32prog_resource->vaddr + offset_in_prog,
-	     size_to_copy);
-
-     if (size_to_copy < PAGE_SIZE){;
-	memset((void*)(uaddr + size_to_copy), 0x0,
-	       PAGE_SIZE - size_to_copy);
-      } 
-
-                 
-  return retval;
-}
-
-
-static struct uvmm_arena_ops elf32prog_ops = (struct uvmm_arena_ops)
-{
-  .ref     = elf32prog_ref,
-  .unref   = elf32prog_unref,
-  .no_page = elf32prog_no_page,
-  .unmap   = NULL /* ignored */
-};
-
-
-static __u32 elf32prog_mmap(struct uvmm_arena * arena)
-{
-  return uvmm_set_ops_of_arena(arena, &elf32prog_ops);
-}
-
-
-/*
- * Local functions
- */
-
-
-/**
- * Function to locate the given user program image in the kernel memory
- */
-static struct userprog_entry * lookup_userprog(const char *name);
-
-
-__u32 binfmt_elf32_map(struct  uvmm_as * dest_as,
-				 const char * progname)
-{
-  int i;
-
+/* ELF header constants, as given by the ELF specifications */
 /* e_ident value */
 #define ELFMAG0 0x7f
 #define ELFMAG1 'E'
@@ -247,64 +115,27 @@ __u32 binfmt_elf32_map(struct  uvmm_as * dest_as,
 #define EV_NONE    0 /* invalid version */
 #define EV_CURRENT 1 /* current version */
 
-
-/* Reserved segment types p_type */
-#define PT_NULL    0
-#define PT_LOAD    1
-#define PT_DYNAMIC 2
-#define PT_INTERP  3
-#define PT_NOTE    4
-#define PT_SHLIB   5
-#define PT_PHDR    6
-#define PT_LOPROC  0x70000000
-#define PT_HIPROC  0x7fffffff
-
 /* p_flags */
 #define PF_X       1
 #define PF_W       2
 #define PF_R       4
 
 
-  Elf32_Ehdr_t *elf_hdr;
-  Elf32_Phdr_t *elf_phdrs;
-
-  struct elf32_mapped_program * mapped_prog;
-  __u32 prog_top_user_address = 0;
-
-  int fd = -1;
-  fd =  sys_open( progname , O_RDWR );
-
-struct stat st_buf;
-
-sys_stat(progname, &st_buf,NULL );
-
- long prog_size = st_buf.st_size;
-
-
-  __u32 prog_bottom_vaddr = kmalloc(prog_size,0);
-  sys_read(fd, prog_bottom_vaddr , prog_size );
-
-  elf_hdr = (Elf32_Ehdr_t*) prog_bottom_vaddr ;
-
-
-  mapped_prog
-    = (struct elf32_mapped_program*)
-      kmalloc(sizeof(struct elf32_mapped_program), 0);
-  if (! mapped_prog)
-    return -3;
+/** Read count bytes of the file at the given offset */
+static int elf32prog_read(open_file_descriptor * ofd, __u32 offset,
+			  void * buf, __u32 count)
+{
+  if (0 != ofd->f_ops->seek(ofd, offset, SEEK_SET))
+    return -ENOEXEC;
+  if (ofd->f_ops->read(ofd, buf, count) != (int)count)
+    return -ENOEXEC;
+  return OK;
+}
 
 
-  /* Initialize mapped resource */
-  memset(mapped_prog, 0x0, sizeof(*mapped_prog));
-  mapped_prog->mr.custom_data = mapped_prog;
-  mapped_prog->mr.mmap        = elf32prog_mmap;
-  mapped_prog->mr.allowed_access_rights
-    = (__u32 ) (P_READ
-    | P_WRITE
-    | P_USER );
-  mapped_prog->vaddr          = prog_bottom_vaddr;
-  mapped_prog->size           = prog_size ;
-  
+/** Check that the header describes a program we can run */
+static int elf32prog_check(Elf32_Ehdr_t * elf_hdr)
+{
   /* Macro to check expected values for some fields in the ELF header */
 #define ELF_CHECK(hdr,field,expected_value) \
   ({ if ((hdr)->field != (expected_value)) \
@@ -313,7 +144,7 @@ sys_stat(progname, &st_buf,NULL );
 			 #field, \
 			(unsigned)(expected_value), \
 			(unsigned)(hdr)->field); \
-       return 0; \
+       return -ENOEXEC; \
      } \
   })
 
@@ -325,68 +156,152 @@ sys_stat(progname, &st_buf,NULL );
   ELF_CHECK(elf_hdr, e_ident[EI_DATA], ELFDATA2LSB);
   ELF_CHECK(elf_hdr, e_type, ET_EXEC);
   ELF_CHECK(elf_hdr, e_version, EV_CURRENT);
+  ELF_CHECK(elf_hdr, e_phentsize, sizeof(Elf32_Phdr_t));
+
+  /* The program header table is allocated from its size in the file */
+  if (elf_hdr->e_phnum == 0
+      || elf_hdr->e_phnum * sizeof(Elf32_Phdr_t) > PAGE_SIZE)
+    {
+      debug("ELF prog : bad number of program headers %u\n",
+	    (unsigned) elf_hdr->e_phnum);
+      return -ENOEXEC;
+    }
+
+  return OK;
+}
+
+
+/**
+ * Map the program in the given address space, which must be the
+ * current one. The segments are private mappings of the program file:
+ * their pages come from the page cache, and are thus shared by all the
+ * processes running the program until they get written.
+ *
+ * @return The entry point of the program, NULL on error
+ */
+__u32 binfmt_elf32_map(struct  uvmm_as * dest_as,
+				 const char * progname)
+{
+  int i;
+  Elf32_Ehdr_t elf_hdr;
+  Elf32_Phdr_t *elf_phdrs = NULL;
+  open_file_descriptor * ofd;
+  __u32 prog_top_user_address = 0;
+  int nb_mapped = 0;
 
-  /* Get the begining of the program header table */
-  elf_phdrs = (Elf32_Phdr_t*) (prog_bottom_vaddr + elf_hdr->e_phoff);
+  ofd = vfs_open(progname, O_RDONLY);
+  if (! ofd)
+    return (__u32)NULL;
 
-  /* Map the program segment in R/W mode. To make things clean, we
-     should iterate over the sections, not the program header */
-  for (i = 0 ; i  < elf_hdr->e_phnum ; i++)
+  if (! ofd->f_ops->mmap)
     {
+      debug("ELF: %s cannot be mapped", progname);
+      goto bad_prog;
+    }
+
+  if ( (OK != elf32prog_read(ofd, 0, &elf_hdr, sizeof(elf_hdr)))
+       || (OK != elf32prog_check(&elf_hdr)) )
+    goto bad_prog;
+
+  elf_phdrs = (Elf32_Phdr_t*)
+    kmalloc(elf_hdr.e_phnum * sizeof(Elf32_Phdr_t), 0);
+  if (! elf_phdrs)
+    goto bad_prog;
+
+  if (OK != elf32prog_read(ofd, elf_hdr.e_phoff, elf_phdrs,
+			   elf_hdr.e_phnum * sizeof(Elf32_Phdr_t)))
+    goto bad_prog;
+
+  /* Map the program segments. To make things clean, we should
+     iterate over the sections, not the program header */
+  for (i = 0 ; i  < elf_hdr.e_phnum ; i++)
+    {
+      Elf32_Phdr_t * elf_phdr = & elf_phdrs[i];
       __u32 prot_flags;
-      __u32 uaddr;
+      __u32 uaddr, zero_uaddr, file_size, mem_size;
 
       /* Ignore the empty program headers that are not marked "LOAD" */
-      if (elf_phdrs[i].p_type != PT_LOAD)
+      if (elf_phdr->p_type != PT_LOAD)
 	{
-	  if (elf_phdrs[i].p_memsz != 0)
+	  if (elf_phdr->p_memsz != 0)
 	    {
 	      debug("ELF: non-empty non-LOAD segments not supported yet");
 	    }
 	  continue;
 	}
       
-      if (elf_phdrs[i].p_vaddr < USER_OFFSET)
+      if (elf_phdr->p_vaddr < USER_OFFSET)
 	{
 	  debug("User program has an incorrect address");
 	}
 
-      prot_flags = 0;
-      if (elf_phdrs[i].p_flags & P_READ)
+      prot_flags = P_USER;
+      if (elf_phdr->p_flags & (PF_R | PF_X))
 	prot_flags |= P_READ;
-      if (elf_phdrs[i].p_flags & P_WRITE)
+      if (elf_phdr->p_flags & PF_W)
 	prot_flags |= P_WRITE;
-      if (elf_phdrs[i].p_flags & P_USER)
-	prot_flags |= P_USER;
 
-      uaddr = elf_phdrs[i].p_vaddr;
+      uaddr = elf_phdr->p_vaddr;
       if( ! IS_PAGE_ALIGNED(uaddr)) debug();
 
-  
+      file_size = PAGE_ALIGN_SUP(elf_phdr->p_filesz);
+      mem_size  = PAGE_ALIGN_SUP(elf_phdr->p_memsz);
+
       /* First of all: map the region of the phdr which is also
 	 covered by the file */
-       if(0 != uvmm_map(dest_as, &uaddr,
-					   PAGE_ALIGN_SUP(elf_phdrs[i].p_filesz),
-					   prot_flags,
-					   NULL,
-					   & mapped_prog->mr,
-					   elf_phdrs[i].p_offset)){ debug();}
-         
-    
-      /* Then map the remaining by a zero resource */
-      uaddr += PAGE_ALIGN_SUP(elf_phdrs[i].p_filesz);
+      if (file_size > 0)
+	{
+	  if (0 != ofd->f_ops->mmap(ofd, dest_as, &uaddr,
+				    file_size,
+				    prot_flags,
+				    /* PRIVATE */ 0,
+				    elf_phdr->p_offset))
+	    { debug(); continue; }
+	  nb_mapped ++;
+	}
+
+      /* The end of the last page of the file belongs to the .bss
+	 (or to nothing). Resetting it gives the process its private
+	 copy of the page */
+      if ( (elf_phdr->p_filesz < file_size)
+	   && (elf_phdr->p_memsz > elf_phdr->p_filesz) )
+	{
+	  if (prot_flags & P_WRITE)
+	    memset((void*)(elf_phdr->p_vaddr + elf_phdr->p_filesz), 0x0,
+		   file_size - elf_phdr->p_filesz);
+	  else
+	    debug("ELF: .bss in a read-only segment");
+	}
+
+      /* Then map the remaining (.bss) by a zero resource */
+      zero_uaddr = elf_phdr->p_vaddr + file_size;
+      if (mem_size > file_size)
+	if (0 != dev_zero_map(dest_as, &zero_uaddr, mem_size - file_size,
+			      prot_flags, /* PRIVATE */ 0)) { debug(); }
 
       if (prog_top_user_address
-	  < uaddr + PAGE_ALIGN_SUP(elf_phdrs[i].p_memsz))
+	  < elf_phdr->p_vaddr + mem_size)
 	prog_top_user_address
-	  = uaddr + PAGE_ALIGN_SUP(elf_phdrs[i].p_memsz);
+	  = elf_phdr->p_vaddr + mem_size;
     }
 
-  /* Now prepare the heap */
-  uvmm_init_heap(dest_as, prog_top_user_address);
+  kfree((__u32)elf_phdrs);
 
-  return elf_hdr->e_entry;
-}
+  /* The arenas keep the page cache of the file: it can be closed */
+  vfs_close(ofd);
+
+  /* Nothing mapped from the file: something went wrong */
+  if (nb_mapped == 0)
+    return (__u32)NULL;
 
+  /* Now prepare the heap */
+  uvmm_init_heap(dest_as, prog_top_user_address);
 
+  return elf_hdr.e_entry;
 
+ bad_prog:
+  if (elf_phdrs)
+    kfree((__u32)elf_phdrs);
+  vfs_close(ofd);
+  return (__u32)NULL;
+}
@@ -0,0 +1,196 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+
+#include <types.h>
+#include <klibc.h>
+#include <process.h>
+#include <kvmm_slab.h>
+#include <interrupt.h>
+#include <debug.h>
+#include <syscall.h>
+#include <fpu.h>
+
+#define CR0_MP  (1 << 1)
+#define CR0_EM  (1 << 2)
+#define CR0_TS  (1 << 3)
+#define CR4_OSFXSR     (1 << 9)
+#define CR4_OSXMMEXCPT (1 << 10)
+
+#define CPUID_EDX_FXSR (1 << 24)
+#define CPUID_EDX_SSE  (1 << 25)
+
+/* Default value of MXCSR: all the SSE exceptions masked */
+#define MXCSR_DEFAULT  0x1F80
+
+/** The process whose state is in the FPU registers */
+static struct process *fpu_owner;
+
+static struct kslab_cache *cache_of_fpu_state;
+
+static bool fpu_has_fxsr;
+static bool fpu_has_sse;
+
+
+static inline void fpu_set_ts(void)
+{
+  __u32 cr0;
+
+  asm volatile("mov %%cr0, %0" : "=r"(cr0));
+  asm volatile("mov %0, %%cr0" :: "r"(cr0 | CR0_TS));
+}
+
+
+static inline void fpu_save(struct fpu_state *state)
+{
+  if (fpu_has_fxsr)
+    asm volatile("fxsave %0" : "=m"(*state));
+  else
+    asm volatile("fnsave %0; fwait" : "=m"(*state));
+}
+
+
+static inline void fpu_restore(struct fpu_state *state)
+{
+  if (fpu_has_fxsr)
+    asm volatile("fxrstor %0" :: "m"(*state));
+  else
+    asm volatile("frstor %0" :: "m"(*state));
+}
+
+
+void fpu_subsystem_setup(void)
+{
+  __u32 eax, ebx, ecx, edx, cr0, cr4;
+
+  asm volatile("cpuid"
+	       : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+	       : "a"(1));
+  fpu_has_fxsr = (edx & CPUID_EDX_FXSR) ? true : false;
+  fpu_has_sse = fpu_has_fxsr && (edx & CPUID_EDX_SSE);
+
+  cache_of_fpu_state = kvmm_cache_create("FPU states",
+					 sizeof(struct fpu_state),
+					 1, 0, KSLAB_CREATE_MAP);
+  if (! cache_of_fpu_state)
+    {
+      debug();
+      return;
+    }
+
+  /* Use the FPU (no emulation), and let FWAIT trap too */
+  asm volatile("mov %%cr0, %0" : "=r"(cr0));
+  cr0 = (cr0 & ~CR0_EM) | CR0_MP | CR0_TS;
+  asm volatile("mov %0, %%cr0" :: "r"(cr0));
+
+  if (fpu_has_sse)
+    {
+      asm volatile("mov %%cr4, %0" : "=r"(cr4));
+      cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+      asm volatile("mov %0, %%cr4" :: "r"(cr4));
+    }
+}
+
+
+void fpu_switch(struct process *next)
+{
+  if (next == fpu_owner)
+    asm volatile("clts");
+  else
+    fpu_set_ts();
+}
+
+
+void fpu_release(struct process *proc)
+{
+  __u32 flags;
+
+  disable_IRQs(flags);
+  if (fpu_owner == proc)
+    {
+      fpu_owner = NULL;
+      fpu_set_ts();
+    }
+  restore_IRQs(flags);
+
+  if (proc->fpu)
+    {
+      kvmm_cache_free((__u32) proc->fpu);
+      proc->fpu = NULL;
+    }
+}
+
+
+void isr_fpu_unavailable(void)
+{
+  asm volatile("clts");
+
+  if (fpu_owner == current)
+    return;
+
+  if (fpu_owner)
+    fpu_save(fpu_owner->fpu);
+
+  fpu_owner = NULL;
+
+  if (current->fpu)
+    fpu_restore(current->fpu);
+  else
+    {
+      current->fpu = (struct fpu_state*)
+	kvmm_cache_alloc(cache_of_fpu_state, 0);
+      if (! current->fpu)
+	{
+	  /* The instruction would trap again */
+	  kprintf("fpu: no save area for process %d, killed\n", current->pid);
+	  fpu_set_ts();
+	  sys_exit();
+	}
+
+      /* First use: a clean state */
+      asm volatile("fninit");
+      if (fpu_has_sse)
+	{
+	  __u32 mxcsr = MXCSR_DEFAULT;
+	  asm volatile("ldmxcsr %0" :: "m"(mxcsr));
+	}
+    }
+
+  fpu_owner = current;
+}
+
+
+void kernel_fpu_begin(__u32 *flags)
+{
+  disable_IRQs(*flags);
+  asm volatile("clts");
+
+  /* The owner will get its registers back at its next #NM */
+  if (fpu_owner)
+    {
+      fpu_save(fpu_owner->fpu);
+      fpu_owner = NULL;
+    }
+}
+
+
+void kernel_fpu_end(__u32 flags)
+{
+  fpu_set_ts();
+  restore_IRQs(flags);
+}
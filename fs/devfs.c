@@ -160,6 +160,7 @@ static dentry_t* devfs_lookup(struct _fs_instance_t *instance, struct _dentry_t*
 		inode->i_count = 0;
 		inode->i_instance = instance;
 		inode->i_fops = kmalloc(sizeof(open_file_operations_t),0);
+		memset(inode->i_fops, 0, sizeof(open_file_operations_t));
 		inode->i_fs_specific = (blkdev_interfaces*)(drentry->di);
                 inode->dev_id = (struct fs_dev_id_t*)(drentry->dev_id);
 		switch(drentry->type) {
@@ -19,10 +19,14 @@
 
 #include <fs/ext2.h>
 #include <kmalloc.h>
+#include <klibc.h>
+#include <pagecache.h>
 
 #include "ext2_internal.h"
 
-static file_system_t ext2_fs = {.name="EXT2", .unique_inode=1, .mount=mount_EXT2, .umount=umount_EXT2};
+static int sync_EXT2(fs_instance_t *instance);
+
+static file_system_t ext2_fs = {.name="EXT2", .unique_inode=1, .mount=mount_EXT2, .umount=umount_EXT2, .sync=sync_EXT2};
 
 static int ceil(float n) {
   return (n == (int)n) ? n : (int)(n+(n>=0));
@@ -43,16 +47,26 @@ static void read_group_desc_table(ext2_fs_instance_t *node) {
 	node->read_data(node->super.device, node->group_desc_table, sizeof(struct ext2_group_desc) * node->n_groups, b * (1024 << node->superblock.s_log_block_size));
 
 
-        node->group_desc_table_internal = kmalloc(sizeof(struct ext2_group_desc) * node->n_groups ,0);
+	// The bitmaps stay in memory, they fill one block each.
+	__u32 block_size = 1024 << node->superblock.s_log_block_size;
+	node->group_desc_table_internal = (struct ext2_group_desc_internal*) kmalloc(sizeof(struct ext2_group_desc_internal) * node->n_groups ,0);
+	node->n_dirty = 0;
+	memset(node->prealloc, 0, sizeof(node->prealloc));
+	node->prealloc_next = 0;
+	memset(node->dir_cache, 0, sizeof(node->dir_cache));
+	node->dir_cache_next = 0;
+	memset(node->dirty_inodes, 0, sizeof(node->dirty_inodes));
+	node->dirty_inodes_next = 0;
 	int i;
 	for (i = 0; i < node->n_groups; i++) {
-		node->group_desc_table_internal[i].inode_bitmap = kmalloc(node->superblock.s_inodes_per_group / 8,0);
-		int addr_bitmap = node->group_desc_table[i].bg_inode_bitmap;
-		node->read_data(node->super.device, node->group_desc_table_internal[i].inode_bitmap, node->superblock.s_inodes_per_group / 8, addr_bitmap * (1024 << node->superblock.s_log_block_size));
+		struct ext2_group_desc_internal *gdi = &node->group_desc_table_internal[i];
 
-		
+		gdi->inode_bitmap = (__u8*) kmalloc(block_size,0);
+		node->read_data(node->super.device, gdi->inode_bitmap, block_size, (__u64) node->group_desc_table[i].bg_inode_bitmap * block_size);
+		gdi->block_bitmap = (__u8*) kmalloc(block_size,0);
+		node->read_data(node->super.device, gdi->block_bitmap, block_size, (__u64) node->group_desc_table[i].bg_block_bitmap * block_size);
+		gdi->dirty = 0;
 	}
-	
 }
 
 static void show_info(ext2_fs_instance_t *node) {
@@ -88,6 +102,7 @@ fs_instance_t* mount_EXT2(open_file_descriptor* ofd) {
 	//node->super.stat = ext2_stat;
 	node->super.stat = NULL;
 	node->super.device = ofd;
+	kmutex_init(&node->lock, "ext2");
  
   node->read_data(node->super.device, &(node->superblock), sizeof(struct ext2_super_block), 1024);
    show_info(node);
@@ -103,7 +118,41 @@ fs_instance_t* mount_EXT2(open_file_descriptor* ofd) {
 	return (fs_instance_t*)node;
 }
 
+/*
+ * Write back the sizes and the bitmaps kept in memory.
+ */
+static int sync_EXT2(fs_instance_t *node) {
+	ext2_fs_instance_t *instance = (ext2_fs_instance_t*)node;
+
+	kmutex_lock(&instance->lock);
+	ext2_flush_inodes(instance, 0);
+	ext2_sync_bitmaps(instance);
+	kmutex_unlock(&instance->lock);
+	return 0;
+}
+
 void umount_EXT2(fs_instance_t *node) {
+	ext2_fs_instance_t *instance = (ext2_fs_instance_t*)node;
+	int i;
+
+	// The dirty pages of its files come first, then their inodes.
+	pagecache_sync_all();
+	// Its cached pages must not be found by a later instance. This
+	// also waits for the write-backs still using its inodes.
+	pagecache_invalidate_host(instance);
+	kmutex_lock(&instance->lock);
+	ext2_flush_inodes(instance, 0);
+	ext2_discard_prealloc(instance, 0);
+	ext2_invalidate_dir_cache(instance, 0);
+	ext2_sync_bitmaps(instance);
+	kmutex_unlock(&instance->lock);
+	kmutex_dispose(&instance->lock);
+	for (i = 0; i < instance->n_groups; i++) {
+		kfree((__u32) instance->group_desc_table_internal[i].inode_bitmap);
+		kfree((__u32) instance->group_desc_table_internal[i].block_bitmap);
+	}
+	kfree((__u32) instance->group_desc_table_internal);
+	kfree((__u32) instance->group_desc_table);
 	kfree(node);
 }
 
@@ -26,19 +26,264 @@
 #include <kerrno.h>
 
 #include <fs/ext2.h>
+#include <pagecache.h>
+#include <physmem.h>
+#include <filemap.h>
+#include <kstat.h>
+#include <uaccess.h>
+
+/*
+ * Page cache of the regular files: the pages are read and written back
+ * in whole-page units by way of the block map of the inode,
+ * contiguous blocks being transferred in a single request. The blocks
+ * written by write() are only allocated when their pages are written
+ * back, all the blocks of a run of pages at once.
+ */
+
+/** Read the blocks of the given page of the file */
+static int ext2_readpage(struct pagecache_mapping *mapping, __u32 index, void *page) {
+        ext2_fs_instance_t *instance = (ext2_fs_instance_t*) pagecache_get_host(mapping);
+        __u32 block_size = 1024 << instance->superblock.s_log_block_size;
+        __u32 blocks_per_page = PAGE_SIZE / block_size;
+        __u32 first_blk = index * blocks_per_page;
+        __u32 i, run_start = 0, run_len = 0, run_blk = 0;
+        __u32 nb_blk;
+        struct ext2_inode *einode;
+
+        /* The block map must not change while the blocks are read */
+        kmutex_lock(&instance->lock);
+        einode = read_inode(instance, pagecache_get_ino(mapping));
+        if (einode == NULL) {
+                kmutex_unlock(&instance->lock);
+                return -ENOENT;
+        }
+
+        /* Number of blocks of the page inside the file */
+        if (einode->i_size <= first_blk * block_size) {
+                nb_blk = 0;
+        } else {
+                nb_blk = (einode->i_size - first_blk * block_size + block_size - 1) / block_size;
+                if (nb_blk > blocks_per_page) {
+                        nb_blk = blocks_per_page;
+                }
+        }
+
+        memset(page, 0, PAGE_SIZE);
+
+        for (i = 0; i <= nb_blk; i++) {
+                __u32 blk = (i < nb_blk) ? ext2_bmap(instance, einode, first_blk + i) : 0;
+
+                /* Extend the current run of contiguous blocks */
+                if (blk && run_len > 0 && blk == run_blk + run_len) {
+                        run_len++;
+                        continue;
+                }
+
+                /* Otherwise transfer it, and start a new one */
+                if (run_len > 0) {
+                        __u64 addr = (__u64) run_blk * block_size;
+                        instance->read_data(instance->super.device, (char*)page + run_start * block_size, run_len * block_size, addr);
+                }
+
+                run_start = i;
+                run_blk = blk;
+                run_len = blk ? 1 : 0;
+        }
+
+        /* The end of the last block is beyond the end of file */
+        if (einode->i_size < (index + 1) * PAGE_SIZE
+                        && einode->i_size > index * PAGE_SIZE) {
+                __u32 in_page = einode->i_size - index * PAGE_SIZE;
+                memset((char*)page + in_page, 0, PAGE_SIZE - in_page);
+        }
+
+        kfree((__u32)einode);
+        kmutex_unlock(&instance->lock);
+        return 0;
+}
+
+/**
+ * Write back consecutive pages of the file. Their holes are allocated
+ * first, together, and the runs of contiguous blocks in contiguous
+ * memory are written in a single request, across the pages.
+ */
+static int ext2_writepages(struct pagecache_mapping *mapping, __u32 index, __u32 nb_pages, const void **pages) {
+        ext2_fs_instance_t *instance = (ext2_fs_instance_t*) pagecache_get_host(mapping);
+        int ino = pagecache_get_ino(mapping);
+        __u32 block_size = 1024 << instance->superblock.s_log_block_size;
+        __u32 blocks_per_page = PAGE_SIZE / block_size;
+        __u32 first_blk = index * blocks_per_page;
+        __u32 i, blk, nb_blk, run_blk = 0, run_len = 0;
+        const char *run_buf = NULL;
+        bool allocated = false;
+        int ret = 0;
+        struct ext2_inode *einode;
+
+        /* The inode is read, completed and written back as a whole, and
+           its blocks must not be freed while they are written */
+        kmutex_lock(&instance->lock);
+        einode = read_inode(instance, ino);
+        if (einode == NULL) {
+                kmutex_unlock(&instance->lock);
+                return -ENOENT;
+        }
+
+        /* Number of blocks of the pages inside the file */
+        if (einode->i_size <= first_blk * block_size) {
+                nb_blk = 0;
+        } else {
+                nb_blk = (einode->i_size - first_blk * block_size + block_size - 1) / block_size;
+                if (nb_blk > nb_pages * blocks_per_page) {
+                        nb_blk = nb_pages * blocks_per_page;
+                }
+        }
+
+        /* Delayed allocation: the blocks still to write are reserved with the first one */
+        for (i = 0; i < nb_blk; i++) {
+                if (ext2_bmap(instance, einode, first_blk + i) == 0) {
+                        /* set_block_inode_data() stops at the simple indirect blocks */
+                        if (first_blk + i >= EXT2_NDIR_BLOCKS + block_size / 4) {
+                                ret = -EFBIG;
+                                nb_blk = i;
+                                break;
+                        }
+                        blk = ext2_alloc_data_block(instance, ino, einode, first_blk + i, nb_blk - i);
+                        if (blk == 0) {
+                                ret = -ENOSPC;
+                                nb_blk = i;
+                                break;
+                        }
+                        set_block_inode_data(instance, einode, first_blk + i, blk);
+                        allocated = true;
+                }
+        }
+        if (allocated) {
+                write_inode(instance, ino, einode);
+        }
+
+        for (i = 0; i <= nb_blk; i++) {
+                const char *buf = NULL;
+
+                blk = 0;
+                if (i < nb_blk) {
+                        blk = ext2_bmap(instance, einode, first_blk + i);
+                        buf = (const char*) pages[i / blocks_per_page] + (i % blocks_per_page) * block_size;
+                }
+
+                /* Extend the current run of contiguous blocks */
+                if (blk && run_len > 0 && blk == run_blk + run_len && buf == run_buf + run_len * block_size) {
+                        run_len++;
+                        continue;
+                }
+
+                /* Otherwise write it, and start a new one */
+                if (run_len > 0) {
+                        if (instance->write_data(instance->super.device, run_buf, run_len * block_size, (__u64) run_blk * block_size) < 0) {
+                                ret = -EIO;
+                        }
+                }
+
+                run_buf = buf;
+                run_blk = blk;
+                run_len = blk ? 1 : 0;
+        }
+
+        kfree((__u32)einode);
+        kmutex_unlock(&instance->lock);
+        return ret;
+}
+
+/**
+ * The blocks of the dirty pages are only allocated when they are
+ * written back, and each page may need all its blocks and an indirect
+ * block. When the free blocks could run short of that, write()
+ * allocates the blocks of its page itself, up to the end of the file
+ * or of the write, to report -ENOSPC instead of the flusher.
+ */
+static int ext2_reserve_page(ext2_fs_instance_t *instance, int ino, __u32 index, __u32 end) {
+        __u32 block_size = 1024 << instance->superblock.s_log_block_size;
+        __u32 blocks_per_page = PAGE_SIZE / block_size;
+        __u32 first_blk = index * blocks_per_page;
+        __u32 i, blk, nb_blk;
+        bool allocated = false;
+        int ret = 0;
+        struct ext2_inode *einode;
+
+        /* Same as the write-back: the inode is read, completed and
+           written back as a whole */
+        kmutex_lock(&instance->lock);
+        if (instance->superblock.s_free_blocks_count > (pagecache_get_nr_dirty() + 1) * (blocks_per_page + 1)) {
+                kmutex_unlock(&instance->lock);
+                return 0;
+        }
+
+        einode = read_inode(instance, ino);
+        if (einode == NULL) {
+                kmutex_unlock(&instance->lock);
+                return -ENOENT;
+        }
+        if (einode->i_size > end) {
+                end = einode->i_size;
+        }
+        nb_blk = (end - first_blk * block_size + block_size - 1) / block_size;
+        if (nb_blk > blocks_per_page) {
+                nb_blk = blocks_per_page;
+        }
+
+        for (i = 0; i < nb_blk; i++) {
+                if (ext2_bmap(instance, einode, first_blk + i) == 0) {
+                        blk = ext2_alloc_data_block(instance, ino, einode, first_blk + i, nb_blk - i);
+                        if (blk == 0) {
+                                ret = -ENOSPC;
+                                break;
+                        }
+                        set_block_inode_data(instance, einode, first_blk + i, blk);
+                        allocated = true;
+                }
+        }
+        if (allocated) {
+                write_inode(instance, ino, einode);
+        }
+
+        kfree((__u32)einode);
+        kmutex_unlock(&instance->lock);
+        return ret;
+}
+
+static int ext2_writepage(struct pagecache_mapping *mapping, __u32 index, const void *page) {
+        return ext2_writepages(mapping, index, 1, &page);
+}
+
+static struct pagecache_ops ext2_pagecache_ops = {
+        .readpage = ext2_readpage,
+        .writepage = ext2_writepage,
+        .writepages = ext2_writepages
+};
+
+static struct pagecache_mapping *ext2_get_mapping(ext2_fs_instance_t *instance, int inode) {
+        return pagecache_ref_mapping(instance, inode, &ext2_pagecache_ops);
+}
 
 int ext2_rename(inode_t *old_dir, dentry_t *old_dentry, inode_t *new_dir, dentry_t *new_dentry) {
+        ext2_fs_instance_t *instance = (ext2_fs_instance_t*)old_dir->i_instance;
+
+        kmutex_lock(&instance->lock);
         // Remove inode from parent dir.
         remove_dir_entry((ext2_fs_instance_t*)old_dir->i_instance, old_dir->i_ino, old_dentry->d_name);
 
         add_dir_entry((ext2_fs_instance_t*)new_dir->i_instance, new_dir->i_ino, new_dentry->d_name, EXT2_FT_REG_FILE, old_dentry->d_inode->i_ino); //XXX
+        kmutex_unlock(&instance->lock);
 
         return 0;
 }
 
 int ext2_rmdir(inode_t *dir, dentry_t *dentry) {
         if (S_ISDIR(dentry->d_inode->i_mode)) {
-                remove_dir_entry((ext2_fs_instance_t*)dir->i_instance, dir->i_ino, dentry->d_name);
+                ext2_fs_instance_t *instance = (ext2_fs_instance_t*)dir->i_instance;
+
+                kmutex_lock(&instance->lock);
+                remove_dir_entry(instance, dir->i_ino, dentry->d_name);
+                kmutex_unlock(&instance->lock);
                 return 0;
         } else {
                 return -ENOTDIR;
@@ -48,8 +293,14 @@ int ext2_rmdir(inode_t *dir, dentry_t *dentry) {
 }
 
 int ext2_setattr(inode_t *inode, file_attributes_t *attr) {
+        ext2_fs_instance_t *instance = (ext2_fs_instance_t*)inode->i_instance;
         struct stat s;
-        if (getattr_inode((ext2_fs_instance_t*)inode->i_instance, inode->i_ino, &s) == 0) {
+        int ret;
+
+        kmutex_lock(&instance->lock);
+        ret = getattr_inode(instance, inode->i_ino, &s);
+        kmutex_unlock(&instance->lock);
+        if (ret == 0) {
                 if (attr->mask & ATTR_UID) {
                         s.st_uid = attr->stbuf.st_uid;
                 }
@@ -68,17 +319,24 @@ int ext2_setattr(inode_t *inode, file_attributes_t *attr) {
                 if (attr->mask & ATTR_CTIME) {
                         s.st_ctime = attr->stbuf.st_ctime;
                 }
+                // It locks the instance itself.
                 if (attr->mask & ATTR_SIZE && attr->ia_size != inode->i_size) {
                         ext2_truncate(inode, attr->ia_size);
                 }
-                setattr_inode((ext2_fs_instance_t*)inode->i_instance, inode->i_ino, &s);
+                kmutex_lock(&instance->lock);
+                setattr_inode(instance, inode->i_ino, &s);
+                kmutex_unlock(&instance->lock);
                 return 0;
         }
         return -1;
 }
 
 int ext2_unlink(inode_t *dir, dentry_t *dentry) {
-        remove_dir_entry((ext2_fs_instance_t*)dir->i_instance, dir->i_ino, dentry->d_name);
+        ext2_fs_instance_t *instance = (ext2_fs_instance_t*)dir->i_instance;
+
+        kmutex_lock(&instance->lock);
+        remove_dir_entry(instance, dir->i_ino, dentry->d_name);
+        kmutex_unlock(&instance->lock);
         // TODO: nlink--
         return 0;
 }
@@ -193,7 +451,9 @@ int ext2_write(open_file_descriptor * ofd, const void *buf, size_t size) {
         int inode = ofd->inode->i_ino;
         if (inode >= 0) {
                 ext2_fs_instance_t *instance = (ext2_fs_instance_t*) ofd->fs_instance;
+                kmutex_lock(&instance->lock);
                 struct ext2_inode *einode = read_inode(instance, inode);
+                kmutex_unlock(&instance->lock);
                 if (einode != NULL) {
 
                         unsigned int offset;
@@ -204,46 +464,92 @@ int ext2_write(open_file_descriptor * ofd, const void *buf, size_t size) {
                         }
 
                         int count = 0;
+                        __u32 i_size = einode->i_size;
+                        kfree((__u32)einode);
+
+                        // set_block_inode_data() stops at the simple indirect blocks.
+                        __u32 block_size = 1024 << instance->superblock.s_log_block_size;
+                        __u32 max_size = (EXT2_NDIR_BLOCKS + block_size / 4) * block_size;
+                        if (offset >= max_size && size > 0) {
+                                return -EFBIG;
+                        }
+                        if (size > max_size - offset) {
+                                size = max_size - offset;
+                        }
 
-                        __u32 n_blk = 0;
-                        int off = offset;
-                        while (off >= (1024 << instance->superblock.s_log_block_size)) {
-                                if (get_data_block (instance,einode, n_blk) == 0) {
-                                        int addr = alloc_block(instance);
-                                        set_block_inode_data(instance, einode, n_blk, addr);
-                                }
-
-                                off -= 1024 << instance->superblock.s_log_block_size;
-                                n_blk++;
+                        // Copy the data in the page cache, it is written back later.
+                        struct pagecache_mapping *mapping = ext2_get_mapping(instance, inode);
+                        if (mapping == NULL) {
+                                return -ENOMEM;
                         }
 
                         while (size > 0) {
-                                __u32 addr = get_data_block (instance,einode, n_blk);
+                                __u32 index = (offset + count) >> PAGE_SHIFT;
+                                __u32 in_page = (offset + count) & PAGE_MASK;
+                                size_t size2 = PAGE_SIZE - in_page;
+                                if (size2 > size) {
+                                        size2 = size;
+                                }
 
-                                if (addr == 0) {
-                                        addr = alloc_block(instance);
-                                        set_block_inode_data(instance, einode, n_blk, addr);
-                                        addr *= (1024 << instance->superblock.s_log_block_size);
+                                // Partially overwritten pages must be read first.
+                                __u32 page = pagecache_ref_page(mapping, index, size2 != PAGE_SIZE);
+                                if (page == 0) {
+                                        break;
                                 }
-                                addr += off;
 
-                                size_t size2 = (1024 << instance->superblock.s_log_block_size) - off;
-                                off = 0;
-                                if (size2 > size) {
-                                        size2 = size;
+                                int ret = ext2_reserve_page(instance, inode, index, offset + count + size2);
+                                if (ret < 0) {
+                                        physmem_unref_physpage(page);
+                                        if (count == 0) {
+                                                pagecache_unref_mapping(mapping);
+                                                return ret;
+                                        }
+                                        break;
+                                }
+
+                                int copied = copy_from_buffer((char*)page + in_page, ((char*)buf) + count, size2);
+                                physmem_unref_physpage(page);
+                                if (copied < 0) {
+                                        copied = 0;
+                                }
+                                // A page not read first only holds zeros after the copied bytes.
+                                if ((size_t) copied < size2 && size2 == PAGE_SIZE && pagecache_discard_page(mapping, index) == 0) {
+                                        copied = 0;
+                                }
+                                if (copied > 0) {
+                                        pagecache_set_dirty(mapping, index);
+                                }
+                                count += copied;
+                                if ((size_t) copied < size2) {
+                                        if (count == 0) {
+                                                pagecache_unref_mapping(mapping);
+                                                return -EFAULT;
+                                        }
+                                        break;
                                 }
 
-                                instance->write_data(instance->super.device, ((char*)buf) + count, size2, addr);
                                 size -= size2;
-                                count += size2;
-                                n_blk++;
                         }
-
-                        einode->i_size = max(einode->i_size, offset + count);
+                        pagecache_unref_mapping(mapping);
+
+                        // The blocks and the inode are written with the pages.
+                        // Another write may have grown the file further meanwhile.
+                        if (offset + count > i_size) {
+                                kmutex_lock(&instance->lock);
+                                einode = read_inode(instance, inode);
+                                if (einode != NULL && offset + count > einode->i_size) {
+                                        ext2_set_size(instance, inode, offset + count);
+                                        ofd->inode->i_size = offset + count;
+                                }
+                                kmutex_unlock(&instance->lock);
+                                if (einode != NULL) {
+                                        kfree((__u32)einode);
+                                }
+                        }
         //              struct timeval tv;
         //              gettimeofday(&tv, NULL);
         //              einode.i_mtime = tv.tv_sec;
-                        write_inode(instance, inode, einode);
+                        ofd->current_octet = offset + count;
                         return count;          
                 } else {
                         return -ENOENT;
@@ -265,52 +571,64 @@ int ext2_read(open_file_descriptor * ofd, void * buf, size_t size) {
         int inode = ofd->inode->i_ino;
         if (inode >= 0) {
                 ext2_fs_instance_t *instance = (ext2_fs_instance_t*) ofd->fs_instance;
-                off_t offset = ofd->current_octet;
+                __u32 offset = ofd->current_octet;
                 int count = 0;
-                struct ext2_inode *einode = read_inode(instance, inode);
-               
+                struct ext2_inode *einode;
+                __u32 i_size;
 
+                kmutex_lock(&instance->lock);
+                einode = read_inode(instance, inode);
+                kmutex_unlock(&instance->lock);
+                if (einode == NULL) {
+                        return -ENOENT;
+                }
+                i_size = einode->i_size;
+                kfree((__u32)einode);
 
-                if (offset >= einode->i_size) {
+                if (offset >= i_size) {
                         return 0;
                 }
 
-                if (size + offset > einode->i_size) {
-                        size = einode->i_size - offset;
+                if (size + offset > i_size) {
+                        size = i_size - offset;
                 }
-               
 
-                int n_blk = 0;
-                while (offset >= (unsigned int)(1024 << instance->superblock.s_log_block_size)) {
-                        n_blk++;
-                        offset -= (1024 << instance->superblock.s_log_block_size);
+                struct pagecache_mapping *mapping = ext2_get_mapping(instance, inode);
+                if (mapping == NULL) {
+                        return -ENOMEM;
                 }
-                //int n_blk = offset / (1024 << instance->superblock.s_log_block_size);
-                //offset %= (1024 << instance->superblock.s_log_block_size);
-                //
+
                 while (size > 0) {
+                        __u32 in_page = offset & PAGE_MASK;
+                        size_t size2 = PAGE_SIZE - in_page;
 
+                        if (size2 > size) {
+                                size2 = size;
+                        }
 
-                        __u32 addr = get_data_block (instance,einode, n_blk);
-                        if (addr == 0)
+                        __u32 page = pagecache_ref_page(mapping, offset >> PAGE_SHIFT, true);
+                        if (page == 0)
                               break;
-                       
-                        n_blk++;
-
-                        size_t size2 = (1024 << instance->superblock.s_log_block_size) - offset;
 
-                        if (size2 > size) {
-                                size2 = size;
+                        int copied = copy_to_buffer(((char*)buf) + count, (char*)page + in_page, size2);
+                        physmem_unref_physpage(page);
+                        if (copied < 0) {
+                                copied = 0;
+                        }
+                        count += copied;
+                        if ((size_t) copied < size2) {
+                                if (count == 0) {
+                                        pagecache_unref_mapping(mapping);
+                                        return -EFAULT;
+                                }
+                                break;
                         }
-                       
-                        instance->read_data(instance->super.device, ((char*)buf) + count, size2, addr + offset);
 
                         size -= size2;
-                        count += size2;
-                        offset = 0;
+                        offset += size2;
                 }
+                pagecache_unref_mapping(mapping);
 
-               
                 ofd->current_octet += count;
                 return count;
         } else {
@@ -320,11 +638,16 @@ int ext2_read(open_file_descriptor * ofd, void * buf, size_t size) {
 
 
 int ext2_mknod(inode_t *dir, dentry_t *dentry, mode_t mode, dev_t dev) {
-        int ino =  mknod_inode((ext2_fs_instance_t*)dir->i_instance, dir->i_ino, dentry->d_name, mode, dev);
+        ext2_fs_instance_t *instance = (ext2_fs_instance_t*)dir->i_instance;
+
+        kmutex_lock(&instance->lock);
+        int ino =  mknod_inode(instance, dir->i_ino, dentry->d_name, mode, dev);
         if (ino == 0) {
+                kmutex_unlock(&instance->lock);
                 return -ENOTDIR; //XXX
         }
-        struct ext2_inode *einode = read_inode((ext2_fs_instance_t*)dir->i_instance, ino);
+        struct ext2_inode *einode = read_inode(instance, ino);
+        kmutex_unlock(&instance->lock);
 
         dentry->d_inode = (inode_t*)kmalloc(sizeof(inode_t),0);
         ext2inode_2_inode(dentry->d_inode, dir->i_instance, ino, einode);
@@ -337,6 +660,8 @@ int ext2_truncate(inode_t *inode, off_t off) {
 
         __u32 size = off;
         ext2_fs_instance_t *instance = (ext2_fs_instance_t*)inode->i_instance;
+
+        kmutex_lock(&instance->lock);
         struct ext2_inode *einode = read_inode(instance, inode->i_ino);
         if (einode) {
 
@@ -362,17 +687,29 @@ int ext2_truncate(inode_t *inode, off_t off) {
                 } else {
                        
                         while (off > 0) {
-                                set_block_inode_data(instance, einode, n_blk, alloc_block(instance));
+                                set_block_inode_data(instance, einode, n_blk, ext2_alloc_data_block(instance, inode->i_ino, einode, n_blk, 1));
                                 n_blk++;
                                 off -= 1024 << instance->superblock.s_log_block_size;
                         }
                 }
 
+                // Replaces the size pending, which write_inode() then drops.
                 einode->i_size = size;
+                ext2_set_size(instance, inode->i_ino, size);
                 write_inode(instance, inode->i_ino, einode);
                 ext2inode_2_inode(inode, inode->i_instance, inode->i_ino, einode);
+                kfree((__u32)einode);
+                // The pages may be waited for, the write-back locks the instance.
+                kmutex_unlock(&instance->lock);
+
+                struct pagecache_mapping *mapping = ext2_get_mapping(instance, inode->i_ino);
+                if (mapping != NULL) {
+                        pagecache_truncate(mapping, size);
+                        pagecache_unref_mapping(mapping);
+                }
                 return 0;
         }
+        kmutex_unlock(&instance->lock);
         return -ENOENT;
 }
 
@@ -382,8 +719,9 @@ dentry_t *ext2_getroot(struct _fs_instance_t *instance) {
 
 dentry_t* ext2_lookup(struct _fs_instance_t *instance, struct _dentry_t* dentry, const char * name) {
         int flags = 0; // XXX
+        struct kmutex *lock = &((ext2_fs_instance_t*)instance)->lock;
 
-
+        kmutex_lock(lock);
         int inode = getinode_from_name((ext2_fs_instance_t*)instance, dentry->d_inode->i_ino, name);
 
 
@@ -392,13 +730,16 @@ dentry_t* ext2_lookup(struct _fs_instance_t *instance, struct _dentry_t* dentry,
                 //inode = ext2_mknod2((ext2_fs_instance_t*)instance, name, 00644 | 0x8000, 0); //FIXME!
         } else if (inode <= 0) {
 
+                kmutex_unlock(lock);
                 return NULL;
         } else if (flags & O_EXCL && flags & O_CREAT) {
+                kmutex_unlock(lock);
                 return NULL;
         }
        
 
         struct ext2_inode *einode = read_inode((ext2_fs_instance_t*)instance, inode);
+        kmutex_unlock(lock);
 
 
         dentry_t *d =(dentry_t*) kmalloc(sizeof(dentry_t),0);
@@ -419,9 +760,63 @@ int ext2_close(open_file_descriptor *ofd) {
         if (ofd == NULL) {
                 return -1;
         }
-        kfree((__u32)ofd);
+
+        // The data is written back later, by the flusher or fsync().
+        if ((ofd->flags & O_ACCMODE) != O_RDONLY) {
+                ext2_fs_instance_t *instance = (ext2_fs_instance_t*) ofd->fs_instance;
+
+                kmutex_lock(&instance->lock);
+                ext2_discard_prealloc(instance, ofd->inode->i_ino);
+                kmutex_unlock(&instance->lock);
+        }
         return 0;
 }
 
+int ext2_fsync(open_file_descriptor *ofd, int datasync) {
+        ext2_fs_instance_t *instance = (ext2_fs_instance_t*) ofd->fs_instance;
+        struct pagecache_mapping *mapping;
+        int ret = 0;
+
+        if (ofd->inode == NULL) {
+                return -EBADF;
+        }
+
+        mapping = ext2_get_mapping(instance, ofd->inode->i_ino);
+        if (mapping != NULL) {
+                ret = pagecache_sync(mapping);
+                pagecache_unref_mapping(mapping);
+        }
+
+        // The size is needed to read the data back, the bitmaps are not.
+        kmutex_lock(&instance->lock);
+        ext2_flush_inodes(instance, ofd->inode->i_ino);
+        if (!datasync) {
+                ext2_sync_bitmaps(instance);
+        }
+        kmutex_unlock(&instance->lock);
+        return ret;
+}
+
+int ext2_mmap(open_file_descriptor *ofd, struct uvmm_as *as, __u32 *uaddr, __u32 size, __u32 access_rights, __u32 flags, __u64 offset) {
+        struct pagecache_mapping *mapping;
+        int ret;
+
+        if (ofd == NULL || ofd->inode == NULL) {
+                return -EBADF;
+        }
+        if (!S_ISREG(ofd->inode->i_mode)) {
+                return -ENODEV;
+        }
 
+        // The arenas are backed by the page cache of the file.
+        mapping = ext2_get_mapping((ext2_fs_instance_t*) ofd->fs_instance, ofd->inode->i_ino);
+        if (mapping == NULL) {
+                return -ENOMEM;
+        }
 
+        ret = filemap_map(as, uaddr, size, access_rights, flags, mapping, offset);
+        if (ret != 0) {
+                pagecache_unref_mapping(mapping);
+        }
+        return ret;
+}
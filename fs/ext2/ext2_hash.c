@@ -0,0 +1,198 @@
+/**
+ * @file ext2_hash.c
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ * Hashes of the names in the directory index (htree), as computed by
+ * the ext3/ext4 drivers of Linux and by e2fsprogs.
+ */
+
+#include <klibc.h>
+
+#include "ext2_internal.h"
+
+#define ROL32(x, s)	(((x) << (s)) | ((x) >> (32 - (s))))
+
+#define TEA_DELTA	0x9E3779B9
+
+static void tea_transform(__u32 buf[4], const __u32 in[4]) {
+	__u32 sum = 0;
+	__u32 b0 = buf[0], b1 = buf[1];
+	__u32 a = in[0], b = in[1], c = in[2], d = in[3];
+	int n = 16;
+
+	do {
+		sum += TEA_DELTA;
+		b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+		b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+	} while (--n);
+
+	buf[0] += b0;
+	buf[1] += b1;
+}
+
+/* The basic MD4 functions: selection, majority, parity */
+#define F(x, y, z)	((z) ^ ((x) & ((y) ^ (z))))
+#define G(x, y, z)	(((x) & (y)) + (((x) ^ (y)) & (z)))
+#define H(x, y, z)	((x) ^ (y) ^ (z))
+
+#define ROUND(f, a, b, c, d, x, s)	(a += f(b, c, d) + (x), a = ROL32(a, s))
+#define K1	0
+#define K2	013240474631U
+#define K3	015666365641U
+
+/* MD4 with only 8 words of input and the rounds cut */
+static void half_md4_transform(__u32 buf[4], const __u32 in[8]) {
+	__u32 a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+	ROUND(F, a, b, c, d, in[0] + K1, 3);
+	ROUND(F, d, a, b, c, in[1] + K1, 7);
+	ROUND(F, c, d, a, b, in[2] + K1, 11);
+	ROUND(F, b, c, d, a, in[3] + K1, 19);
+	ROUND(F, a, b, c, d, in[4] + K1, 3);
+	ROUND(F, d, a, b, c, in[5] + K1, 7);
+	ROUND(F, c, d, a, b, in[6] + K1, 11);
+	ROUND(F, b, c, d, a, in[7] + K1, 19);
+
+	ROUND(G, a, b, c, d, in[1] + K2, 3);
+	ROUND(G, d, a, b, c, in[3] + K2, 5);
+	ROUND(G, c, d, a, b, in[5] + K2, 9);
+	ROUND(G, b, c, d, a, in[7] + K2, 13);
+	ROUND(G, a, b, c, d, in[0] + K2, 3);
+	ROUND(G, d, a, b, c, in[2] + K2, 5);
+	ROUND(G, c, d, a, b, in[4] + K2, 9);
+	ROUND(G, b, c, d, a, in[6] + K2, 13);
+
+	ROUND(H, a, b, c, d, in[3] + K3, 3);
+	ROUND(H, d, a, b, c, in[7] + K3, 9);
+	ROUND(H, c, d, a, b, in[2] + K3, 11);
+	ROUND(H, b, c, d, a, in[6] + K3, 15);
+	ROUND(H, a, b, c, d, in[1] + K3, 3);
+	ROUND(H, d, a, b, c, in[5] + K3, 9);
+	ROUND(H, c, d, a, b, in[0] + K3, 11);
+	ROUND(H, b, c, d, a, in[4] + K3, 15);
+
+	buf[0] += a;
+	buf[1] += b;
+	buf[2] += c;
+	buf[3] += d;
+}
+
+/* The hash of the first versions of the index */
+static __u32 dx_hack_hash(const char *name, int len, bool is_unsigned) {
+	__u32 hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+	int c;
+
+	while (len--) {
+		c = is_unsigned ? (int) *(const unsigned char *) name : (int) *(const signed char *) name;
+		name++;
+		hash = hash1 + (hash0 ^ (c * 7152373));
+		if (hash & 0x80000000) {
+			hash -= 0x7fffffff;
+		}
+		hash1 = hash0;
+		hash0 = hash;
+	}
+	return hash0 << 1;
+}
+
+/* Fill num words from the name, padded with its length */
+static void str2hashbuf(const char *msg, int len, __u32 *buf, int num, bool is_unsigned) {
+	__u32 pad, val;
+	int i, c;
+
+	pad = (__u32) len | ((__u32) len << 8);
+	pad |= pad << 16;
+
+	val = pad;
+	if (len > num * 4) {
+		len = num * 4;
+	}
+	for (i = 0; i < len; i++) {
+		c = is_unsigned ? (int) ((const unsigned char *) msg)[i] : (int) ((const signed char *) msg)[i];
+		val = c + (val << 8);
+		if ((i % 4) == 3) {
+			*buf++ = val;
+			val = pad;
+			num--;
+		}
+	}
+	if (--num >= 0) {
+		*buf++ = val;
+	}
+	while (--num >= 0) {
+		*buf++ = pad;
+	}
+}
+
+__u32 ext2_dirhash(const char *name, int len, int version, const __u32 *seed) {
+	__u32 buf[4], in[8], hash;
+	bool is_unsigned = false;
+	int i;
+
+	buf[0] = 0x67452301;
+	buf[1] = 0xefcdab89;
+	buf[2] = 0x98badcfe;
+	buf[3] = 0x10325476;
+
+	// A null seed means the default one.
+	if (seed != NULL) {
+		for (i = 0; i < 4; i++) {
+			if (seed[i]) {
+				memcpy(buf, seed, sizeof(buf));
+				break;
+			}
+		}
+	}
+
+	switch (version) {
+		case EXT2_DX_HASH_LEGACY_UNSIGNED:
+			is_unsigned = true;
+		case EXT2_DX_HASH_LEGACY:
+			hash = dx_hack_hash(name, len, is_unsigned);
+			break;
+		case EXT2_DX_HASH_HALF_MD4_UNSIGNED:
+			is_unsigned = true;
+		case EXT2_DX_HASH_HALF_MD4:
+			while (len > 0) {
+				str2hashbuf(name, len, in, 8, is_unsigned);
+				half_md4_transform(buf, in);
+				len -= 32;
+				name += 32;
+			}
+			hash = buf[1];
+			break;
+		case EXT2_DX_HASH_TEA_UNSIGNED:
+			is_unsigned = true;
+		case EXT2_DX_HASH_TEA:
+			while (len > 0) {
+				str2hashbuf(name, len, in, 4, is_unsigned);
+				tea_transform(buf, in);
+				len -= 16;
+				name += 16;
+			}
+			hash = buf[0];
+			break;
+		default:
+			return 0;
+	}
+
+	// The low bit marks the collisions in the index, and the last
+	// value is kept for the end of the directory.
+	hash &= ~1;
+	if (hash == 0xfffffffe) {
+		hash = 0xfffffffc;
+	}
+	return hash;
+}
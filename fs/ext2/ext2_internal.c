@@ -26,10 +26,10 @@
 #include <time.h>
 #include <debug.h>
 
-struct _open_file_operations_t ext2fs_fops = {.write = ext2_write, .read = ext2_read, .seek = ext2_seek, .ioctl = NULL, .open = NULL, .close = ext2_close, .readdir = NULL};
+struct _open_file_operations_t ext2fs_fops = {.write = ext2_write, .read = ext2_read, .seek = ext2_seek, .ioctl = NULL, .open = NULL, .close = ext2_close, .readdir = NULL, .mmap = ext2_mmap, .fsync = ext2_fsync};
 
 static __u32 addr_inode_data(ext2_fs_instance_t *instance, int inode, int n_blk);
-static __u32 alloc_block(ext2_fs_instance_t *instance);
+static __u32 alloc_block(ext2_fs_instance_t *instance, __u32 goal);
 struct ext2_inode* read_inode(ext2_fs_instance_t *instance, int inum);
 #define max(a,b) ((a) > (b) ? (a) : (b))
 
@@ -43,27 +43,65 @@ get_block (ext2_fs_instance_t *instance,unsigned long bnum, unsigned char *block
         instance->read_data(instance->super.device, block,block_size ,to_seek);
 }
 
+/**
+ * Return the number of the block holding the file data block n, 0
+ * for a hole
+ */
+static __u32 ext2_bmap(ext2_fs_instance_t *instance, struct ext2_inode *inode,
+		       __u32 n)
+{
+    __u32 block_size = (1024 << instance->superblock.s_log_block_size);
+    __u32 ptrs_per_block = block_size / sizeof(__u32);
+    __u32 blk, div;
+    __u32 *table;
+    int level;
+
+    /* direct blocks */
+    if (n < EXT2_NDIR_BLOCKS)
+        return inode->i_block[n];
+
+    /* indirect blocks */
+    n -= EXT2_NDIR_BLOCKS;
+    if (n < ptrs_per_block) {
+        blk = inode->i_block[EXT2_IND_BLOCK];
+        level = 1;
+    } else {
+        /* double indirect blocks */
+        n -= ptrs_per_block;
+        if (n < ptrs_per_block * ptrs_per_block) {
+            blk = inode->i_block[EXT2_DIND_BLOCK];
+            level = 2;
+        } else {
+            /* triple indirect blocks */
+            n -= ptrs_per_block * ptrs_per_block;
+            blk = inode->i_block[EXT2_TIND_BLOCK];
+            level = 3;
+        }
+    }
+
+    table = (__u32 *)kmalloc(block_size,0);
+    if (table == NULL)
+        return 0;
+
+    while (blk && level > 0) {
+        div = (level == 3) ? ptrs_per_block * ptrs_per_block
+            : (level == 2) ? ptrs_per_block : 1;
+        get_block (instance, blk, (unsigned char *)table);
+        blk = table[(n / div) % ptrs_per_block];
+        level--;
+    }
+
+    kfree((__u32)table);
+    return blk;
+}
+
 __u32 get_data_block ( ext2_fs_instance_t *instance, struct ext2_inode *inode, 
       int n /* requested file data block */) 
 {
-    __u32 addr;
     __u32 block_size = (1024 << instance->superblock.s_log_block_size);
-    unsigned char *ind_block  = (unsigned char *)kmalloc(block_size,0); 
-    unsigned char *dind_block = (unsigned char *)kmalloc(block_size,0); 
-    unsigned char *tind_block = (unsigned char *)kmalloc(block_size,0); 
-
     unsigned int size; /* size of file in blocks */
-    unsigned int *p1, *p2, *p3;  
-
- int ClustByteShift = instance->superblock.s_log_block_size + 10;
-
- int PtrsPerBlock1 = 1 << (ClustByteShift - 2);
- int PtrsPerBlock2 = 1 << ((ClustByteShift - 2) * 2);
- int PtrsPerBlock3 = 1 << ((ClustByteShift - 2) * 3);
-
 
-
-if (inode->i_size == 0)
+    if (inode->i_size == 0)
         size = 0; 
     else 
         size = 1 + ( (inode->i_size - 1) / block_size );
@@ -74,146 +112,300 @@ if (inode->i_size == 0)
     if ( (n < 0)  || (n >=size)) 
          return -1; 
 
-  /* direct blocks */
-        if (n < EXT2_NDIR_BLOCKS) {
-                 // direct blocks
-          addr = inode->i_block[n];
-          return addr * block_size ;
-       } 
-    
-        /* indirect blocks */
-        n -= EXT2_NDIR_BLOCKS;
-        if (n < PtrsPerBlock1) {
-           get_block (instance, inode->i_block[EXT2_IND_BLOCK], ind_block);
-               p1 = (unsigned int *) &ind_block;
-               addr = p1[n];
-               return addr * block_size ;
-        }
-       
-        /* double indirect blocks */
-        n -= PtrsPerBlock1;
-        if (n < PtrsPerBlock2) {
-             get_block (instance,inode->i_block[EXT2_DIND_BLOCK], dind_block);
-                 p2 = (unsigned int *) &dind_block;
-           
-
-               get_block ( instance,p2[n / PtrsPerBlock1] , ind_block);
-               p1 = (unsigned int *) &ind_block;
-               addr = p1[n % PtrsPerBlock1] ;
-            
-           return addr * block_size ;
-            
-        }
-       
-             /* triple indirect block */
-         n -= PtrsPerBlock2;
-        if (n < PtrsPerBlock3) {
-
-                 get_block (instance,inode->i_block[EXT2_TIND_BLOCK], tind_block);
-                 p3 = (unsigned int *) &tind_block;
-           
-                 get_block (instance,p3[n/ PtrsPerBlock2], dind_block);
-                 p2 = (unsigned int *) &dind_block;
-
-           
-             get_block (instance,p2[n % PtrsPerBlock2], ind_block);
-                 p1 = (unsigned int *) &ind_block;
-
-            addr = p1[n % PtrsPerBlock1];
-    
-            return addr * block_size ;
-        }
-       
-       
-        /* File too big, can not handle */
-        kprintf("ext2 ERROR, file too big\n");
-         
-    return -1; 
+    return ext2_bmap(instance, inode, n) * block_size;
+}
+
 
+/**
+ * Look for a name in a directory block, return its inode or 0.
+ */
+static __u32 ext2_search_dir_block(const __u8 *block, __u32 block_size, const char *name, int len) {
+	__u32 off = 0;
 
+	while (off + 8 <= block_size) {
+		struct ext2_directory *dep = (struct ext2_directory*) (block + off);
+		if (dep->rec_len < 8 || off + dep->rec_len > block_size) {
+			break;
+		}
+		if (dep->inode && dep->name_len == len && memcmp(dep->name, name, len) == 0) {
+			return dep->inode;
+		}
+		off += dep->rec_len;
+	}
+	return 0;
 }
 
-int find_dir_entry(ext2_fs_instance_t *instance,struct ext2_inode *dir_inode, const char *name, 
-           struct ext2_directory *diren)
-{
-        
-    struct ext2_directory  *dep; 
-        int i, count; 
-        char entry_name[256];
-        __u32 block_addr ;
- __u32 block_size = (1024 << instance->superblock.s_log_block_size);
-
-    unsigned char *block =(unsigned char*) kmalloc(block_size,0);
-    int logical; 
-    
+/**
+ * Look for a name in all the blocks of a directory.
+ */
+static int ext2_search_dir(ext2_fs_instance_t *instance, struct ext2_inode *dir_inode, const char *name, int len, __u8 *block) {
+	__u32 block_size = 1024 << instance->superblock.s_log_block_size;
+	__u32 n, blk, ino;
+
+	for (n = 0; n * block_size < dir_inode->i_size; n++) {
+		blk = ext2_bmap(instance, dir_inode, n);
+		if (blk == 0) {
+			continue;
+		}
+		get_block(instance, blk, block);
+		ino = ext2_search_dir_block(block, block_size, name, len);
+		if (ino) {
+			return ino;
+		}
+	}
+	return -ENOENT;
+}
 
-    logical  = 0; 
-       block_addr = get_data_block (instance,dir_inode, logical);
-       instance->read_data(instance->super.device, block,block_size ,block_addr);
+/**
+ * Look for a name through the htree index of a directory: the index
+ * blocks give the leaf block holding the hash of the name. Return
+ * -EINVAL if the directory has no usable index.
+ */
+static int ext2_dx_lookup(ext2_fs_instance_t *instance, struct ext2_inode *dir_inode, const char *name, int len, __u8 *block) {
+	__u32 block_size = 1024 << instance->superblock.s_log_block_size;
+	struct ext2_dx_root_info *info;
+	struct ext2_dx_countlimit *cl;
+	struct ext2_dx_entry *entries, *at, *p, *q;
+	__u32 hash, blk, ino, count;
+	int version, levels, ret = -ENOENT;
+	__u8 *leaf;
+
+	if (!(instance->superblock.s_feature_compat & EXT2_FEATURE_COMPAT_DIR_INDEX)
+			|| !(dir_inode->i_flags & EXT2_INDEX_FL)) {
+		return -EINVAL;
+	}
 
-        i = 0;
-    count = 0; 
-         
-        while (1) {
-        dep = (struct  ext2_directory*) (block + i);
+	// The root follows the entries "." (12 bytes) and ".." (12 bytes).
+	blk = ext2_bmap(instance, dir_inode, 0);
+	if (blk == 0) {
+		return -EINVAL;
+	}
+	get_block(instance, blk, block);
+	info = (struct ext2_dx_root_info*) (block + 24);
+	if (info->reserved_zero != 0 || info->info_length < 8 || info->indirect_levels >= EXT2_DX_MAX_LEVELS) {
+		return -EINVAL;
+	}
 
-                memmove(entry_name, dep->name, dep->name_len);
-                entry_name[dep->name_len] = '\0';
+	version = info->hash_version;
+	if (version <= EXT2_DX_HASH_TEA && (instance->superblock.s_flags & EXT2_FLAGS_UNSIGNED_HASH)) {
+		version += EXT2_DX_HASH_LEGACY_UNSIGNED;
+	}
+	hash = ext2_dirhash(name, len, version, instance->superblock.s_hash_seed);
+
+	entries = (struct ext2_dx_entry*) (block + 24 + info->info_length);
+	levels = info->indirect_levels;
+	for (;;) {
+		cl = (struct ext2_dx_countlimit*) entries;
+		count = cl->count;
+		if (count == 0 || count > cl->limit || (__u8*) (entries + count) > block + block_size) {
+			return -EINVAL;
+		}
 
+		// Last entry with a hash lower or equal (the first one has none).
+		p = entries + 1;
+		q = entries + count - 1;
+		while (p <= q) {
+			struct ext2_dx_entry *m = p + (q - p) / 2;
+			if (m->hash > hash) {
+				q = m - 1;
+			} else {
+				p = m + 1;
+			}
+		}
+		at = p - 1;
 
-                if (strcmp(entry_name, name)  == 0) {
-            memmove( (void *) diren, (void *) dep, 
-                 sizeof (struct ext2_directory));
-                        return (0); 
+		if (levels-- == 0) {
+			break;
+		}
+		// The index blocks start with an empty entry of 8 bytes.
+		blk = ext2_bmap(instance, dir_inode, at->block & 0x00ffffff);
+		if (blk == 0) {
+			return -EINVAL;
+		}
+		get_block(instance, blk, block);
+		entries = (struct ext2_dx_entry*) (block + 8);
+	}
 
-        }
-                i += dep->rec_len;
-        count += dep->rec_len;
-
-        if (count >= dir_inode->i_size) 
-            break; 
-        
-                if (i >= block_size) {
-            i = i % block_size; 
-            logical++; 
-            block_addr = get_data_block (instance,dir_inode, logical);
-            instance->read_data(instance->super.device, block,block_size ,block_addr);
-        }
-        }
-        return (-1);
+	leaf = (__u8*) kmalloc(block_size, 0);
+	if (leaf == NULL) {
+		return -ENOMEM;
+	}
+
+	// The names with the same hash may continue in the next leaves.
+	do {
+		blk = ext2_bmap(instance, dir_inode, at->block & 0x00ffffff);
+		if (blk == 0) {
+			break;
+		}
+		get_block(instance, blk, leaf);
+		ino = ext2_search_dir_block(leaf, block_size, name, len);
+		if (ino) {
+			ret = ino;
+			break;
+		}
+		at++;
+	} while (at < entries + count && (at->hash & ~1) == hash);
+
+	kfree((__u32) leaf);
+	return ret;
 }
 
+static __u32 ext2_dir_cache_bucket(const char *name, int len) {
+	return (ext2_dirhash(name, len, EXT2_DX_HASH_LEGACY, NULL) >> 1) % EXT2_DIR_HASH_BUCKETS;
+}
 
-static struct directories_t * readdir_inode(ext2_fs_instance_t *instance, int inode,const char *name) {
-	struct directories_t * dir_result = (struct directories_t*)kmalloc(sizeof(struct directories_t),0);
+static void ext2_free_dir_cache(struct ext2_dir_cache *cache) {
+	struct ext2_dir_cache_entry *e, *next;
+	int i;
 
-        struct ext2_directory  dep;
-	struct ext2_inode* dir_inode = read_inode(instance, inode) ;
-        
-          find_dir_entry(instance, dir_inode,name, &dep);
+	for (i = 0; i < EXT2_DIR_HASH_BUCKETS; i++) {
+		for (e = cache->buckets[i]; e != NULL; e = next) {
+			next = e->next;
+			kfree((__u32) e);
+		}
+	}
+	kfree((__u32) cache->buckets);
+	cache->buckets = NULL;
+	cache->ino = 0;
+}
 
-	dir_result->dir = &dep;
-	dir_result->next = NULL;
+void ext2_invalidate_dir_cache(ext2_fs_instance_t *instance, int ino) {
+	int i;
+	for (i = 0; i < EXT2_DIR_CACHE_SIZE; i++) {
+		if (instance->dir_cache[i].ino && (ino == 0 || instance->dir_cache[i].ino == ino)) {
+			ext2_free_dir_cache(&instance->dir_cache[i]);
+		}
+	}
+}
 
-	
+/**
+ * Hash all the names of a directory in memory, NULL if there is not
+ * enough memory.
+ */
+static struct ext2_dir_cache *ext2_build_dir_cache(ext2_fs_instance_t *instance, int ino, struct ext2_inode *dir_inode, __u8 *block) {
+	__u32 block_size = 1024 << instance->superblock.s_log_block_size;
+	struct ext2_dir_cache *cache = NULL;
+	__u32 n, blk, off, h;
+	int i;
 
-	return dir_result;
+	for (i = 0; i < EXT2_DIR_CACHE_SIZE; i++) {
+		if (instance->dir_cache[i].ino == 0) {
+			cache = &instance->dir_cache[i];
+			break;
+		}
+	}
+	if (cache == NULL) {
+		cache = &instance->dir_cache[instance->dir_cache_next];
+		instance->dir_cache_next = (instance->dir_cache_next + 1) % EXT2_DIR_CACHE_SIZE;
+		ext2_free_dir_cache(cache);
+	}
+
+	cache->buckets = (struct ext2_dir_cache_entry**) kmalloc(EXT2_DIR_HASH_BUCKETS * sizeof(struct ext2_dir_cache_entry*), 0);
+	if (cache->buckets == NULL) {
+		return NULL;
+	}
+	memset(cache->buckets, 0, EXT2_DIR_HASH_BUCKETS * sizeof(struct ext2_dir_cache_entry*));
+	cache->ino = ino;
+
+	for (n = 0; n * block_size < dir_inode->i_size; n++) {
+		blk = ext2_bmap(instance, dir_inode, n);
+		if (blk == 0) {
+			continue;
+		}
+		get_block(instance, blk, block);
+
+		for (off = 0; off + 8 <= block_size; off += ((struct ext2_directory*) (block + off))->rec_len) {
+			struct ext2_directory *dep = (struct ext2_directory*) (block + off);
+			struct ext2_dir_cache_entry *e;
+
+			if (dep->rec_len < 8 || off + dep->rec_len > block_size) {
+				break;
+			}
+			if (dep->inode == 0) {
+				continue;
+			}
+
+			e = (struct ext2_dir_cache_entry*) kmalloc(sizeof(struct ext2_dir_cache_entry) + dep->name_len, 0);
+			if (e == NULL) {
+				ext2_free_dir_cache(cache);
+				return NULL;
+			}
+			e->inode = dep->inode;
+			e->name_len = dep->name_len;
+			memcpy(e->name, dep->name, dep->name_len);
+			h = ext2_dir_cache_bucket(e->name, e->name_len);
+			e->next = cache->buckets[h];
+			cache->buckets[h] = e;
+		}
+	}
+	return cache;
 }
 
-int getinode_from_name(ext2_fs_instance_t *instance, int inode, const char *name) {
-	struct directories_t *dirs = readdir_inode(instance, inode,name);
-	struct directories_t *aux = dirs;
-        aux->dir->name[aux->dir->name_len] = '\0';
+/**
+ * Look for a name in the in-memory hash of the directory, built on the
+ * first lookup.
+ */
+static int ext2_cached_lookup(ext2_fs_instance_t *instance, int ino, struct ext2_inode *dir_inode, const char *name, int len, __u8 *block) {
+	struct ext2_dir_cache *cache = NULL;
+	struct ext2_dir_cache_entry *e;
+	int i;
 
-	while (aux != NULL) {
-		if (strcmp(name, aux->dir->name) == 0) {
-			return aux->dir->inode;
+	for (i = 0; i < EXT2_DIR_CACHE_SIZE; i++) {
+		if (instance->dir_cache[i].ino == ino) {
+			cache = &instance->dir_cache[i];
+			break;
+		}
+	}
+	if (cache == NULL) {
+		cache = ext2_build_dir_cache(instance, ino, dir_inode, block);
+		if (cache == NULL) {
+			return ext2_search_dir(instance, dir_inode, name, len, block);
 		}
-		aux = aux->next;
 	}
 
-	return -ENOTDIR;
+	for (e = cache->buckets[ext2_dir_cache_bucket(name, len)]; e != NULL; e = e->next) {
+		if (e->name_len == len && memcmp(e->name, name, len) == 0) {
+			return e->inode;
+		}
+	}
+	return -ENOENT;
 }
+
+/**
+ * Inode of a name in a directory: through its htree index, else
+ * through the in-memory hash of its names.
+ */
+int getinode_from_name(ext2_fs_instance_t *instance, int inode, const char *name) {
+	__u32 block_size = 1024 << instance->superblock.s_log_block_size;
+	int len = strlen(name);
+	struct ext2_inode *dir_inode;
+	__u8 *block;
+	int ino;
+
+	if (len > 255) {
+		return -ENAMETOOLONG;
+	}
+
+	dir_inode = read_inode(instance, inode);
+	if (dir_inode == NULL) {
+		return -ENOENT;
+	}
+	block = (__u8*) kmalloc(block_size, 0);
+	if (block == NULL) {
+		kfree((__u32) dir_inode);
+		return -ENOMEM;
+	}
+
+	ino = ext2_dx_lookup(instance, dir_inode, name, len, block);
+	if (ino == -EINVAL) {
+		ino = ext2_cached_lookup(instance, inode, dir_inode, name, len, block);
+	}
+
+	kfree((__u32) block);
+	kfree((__u32) dir_inode);
+	return ino;
+}
+
 struct ext2_inode* read_inode(ext2_fs_instance_t *instance, int inum) {
 
     int group; 
@@ -247,6 +439,14 @@ struct ext2_inode* read_inode(ext2_fs_instance_t *instance, int inum) {
                 n = sizeof (struct ext2_inode);
 
         memmove( (void*) buf_inode, (void *) p, n); 
+        kfree((__u32) block);
+
+        // The size grown by write() is not written yet.
+        for (n = 0; n < EXT2_DIRTY_INODES; n++) {
+                if (instance->dirty_inodes[n].ino == inum) {
+                        buf_inode->i_size = instance->dirty_inodes[n].i_size;
+                }
+        }
 
 
     return  buf_inode ; 
@@ -276,19 +476,73 @@ static int write_inode(ext2_fs_instance_t *instance, int inum, struct ext2_inode
 		
 		// update hardware
 		instance->write_data(instance->super.device, einode, sizeof(struct ext2_inode), bnum * block_size + offset );
+
+		// Only the size written is not pending anymore: write() may
+		// have grown the file while the inode was read and written.
+		int i;
+		for (i = 0; i < EXT2_DIRTY_INODES; i++) {
+			if (instance->dirty_inodes[i].ino == inum && instance->dirty_inodes[i].i_size == einode->i_size) {
+				instance->dirty_inodes[i].ino = 0;
+			}
+		}
 		
 		return 0;
 	}
 	return -ENOENT;
 }
 
+void ext2_flush_inodes(ext2_fs_instance_t *instance, int ino) {
+	int i;
+	for (i = 0; i < EXT2_DIRTY_INODES; i++) {
+		int inum = instance->dirty_inodes[i].ino;
+		if (inum && (ino == 0 || inum == ino)) {
+			// read_inode() returns the new size, write_inode() drops it.
+			struct ext2_inode *einode = read_inode(instance, inum);
+			if (einode != NULL) {
+				write_inode(instance, inum, einode);
+				kfree((__u32) einode);
+			} else {
+				instance->dirty_inodes[i].ino = 0;
+			}
+		}
+	}
+}
+
+/**
+ * Record the new size of a file, written to its inode later.
+ */
+static void ext2_set_size(ext2_fs_instance_t *instance, int ino, __u32 size) {
+	struct ext2_dirty_inode *d = NULL;
+	int i;
+
+	for (i = 0; i < EXT2_DIRTY_INODES; i++) {
+		if (instance->dirty_inodes[i].ino == ino) {
+			instance->dirty_inodes[i].i_size = size;
+			return;
+		}
+		if (d == NULL && instance->dirty_inodes[i].ino == 0) {
+			d = &instance->dirty_inodes[i];
+		}
+	}
+	if (d == NULL) {
+		d = &instance->dirty_inodes[instance->dirty_inodes_next];
+		instance->dirty_inodes_next = (instance->dirty_inodes_next + 1) % EXT2_DIRTY_INODES;
+		// Again if its file grew while it was written.
+		while (d->ino != 0) {
+			ext2_flush_inodes(instance, d->ino);
+		}
+	}
+	d->ino = ino;
+	d->i_size = size;
+}
+
 static void set_block_inode_data(ext2_fs_instance_t *instance, struct ext2_inode *einode, int blk_n, __u32 blk) {
 	if (blk_n < 12) { // Direct
 		einode->i_block[blk_n] = blk;
 		//write_inode(instance, einode->, einode); //XXX !!!!!
 	} else if (blk_n < 12 + (1024 << instance->superblock.s_log_block_size) / 4) { // Indirect
 		if (einode->i_block[12] == 0) {
-			einode->i_block[12] = alloc_block(instance);
+			einode->i_block[12] = alloc_block(instance, blk);
 			//write_inode(instance, einode->, einode); //XXX !!!!!
 		}
 		int j = blk_n - 12; 
@@ -343,22 +597,122 @@ static void setattr_inode(ext2_fs_instance_t *instance, int inode, struct stat *
 	}
 }
 
-static __u32 alloc_block(ext2_fs_instance_t *instance) {
+/**
+ * Index of the first clear bit of a bitmap from start, -1 if all the
+ * nbits bits are set. The bitmap is scanned a 32-bit word at a time.
+ */
+static int ext2_find_zero_bit(const __u32 *bitmap, __u32 nbits, __u32 start) {
+	__u32 i, word, bit;
+
+	for (i = start / 32; i * 32 < nbits; i++) {
+		word = bitmap[i];
+		if (i == start / 32) {
+			word |= (1 << (start % 32)) - 1;
+		}
+		if (word != 0xFFFFFFFF) {
+			asm("bsfl %1, %0" : "=r"(bit) : "r"(~word));
+			bit += i * 32;
+			return (bit < nbits) ? (int)bit : -1;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Number of blocks in a group, the last one may be shorter.
+ */
+static __u32 ext2_group_blocks(ext2_fs_instance_t *instance, int group) {
+	__u32 first = instance->superblock.s_first_data_block + group * instance->superblock.s_blocks_per_group;
+
+	if (instance->superblock.s_blocks_count - first < instance->superblock.s_blocks_per_group) {
+		return instance->superblock.s_blocks_count - first;
+	}
+	return instance->superblock.s_blocks_per_group;
+}
+
+void ext2_sync_bitmaps(ext2_fs_instance_t *instance) {
+	__u32 block_size = 1024 << instance->superblock.s_log_block_size;
 	int i;
+
+	if (instance->n_dirty == 0) {
+		return;
+	}
+
 	for (i = 0; i < instance->n_groups; i++) {
+		struct ext2_group_desc_internal *gdi = &instance->group_desc_table_internal[i];
+
+		if (gdi->dirty & EXT2_BLOCK_BITMAP_DIRTY) {
+			instance->write_data(instance->super.device, gdi->block_bitmap, block_size, (__u64) instance->group_desc_table[i].bg_block_bitmap * block_size);
+		}
+		if (gdi->dirty & EXT2_INODE_BITMAP_DIRTY) {
+			instance->write_data(instance->super.device, gdi->inode_bitmap, block_size, (__u64) instance->group_desc_table[i].bg_inode_bitmap * block_size);
+		}
+		gdi->dirty = 0;
+	}
+
+	// The free counts.
+	instance->write_data(instance->super.device, instance->group_desc_table, sizeof(struct ext2_group_desc) * instance->n_groups, (__u64) (instance->superblock.s_first_data_block + 1) * block_size);
+	instance->write_data(instance->super.device, &instance->superblock, sizeof(struct ext2_super_block), 1024);
+
+	instance->n_dirty = 0;
+}
+
+static void ext2_bitmap_dirty(ext2_fs_instance_t *instance, int group, int which) {
+	instance->group_desc_table_internal[group].dirty |= which;
+	if (++instance->n_dirty >= EXT2_BITMAP_FLUSH_BATCH) {
+		ext2_sync_bitmaps(instance);
+	}
+}
+
+/**
+ * Mark a free block used, return -1 if it is not free.
+ */
+static int ext2_claim_block(ext2_fs_instance_t *instance, __u32 blk) {
+	if (blk < instance->superblock.s_first_data_block || blk >= instance->superblock.s_blocks_count) {
+		return -1;
+	}
+
+	int i = (blk - instance->superblock.s_first_data_block) / instance->superblock.s_blocks_per_group;
+	int ib = (blk - instance->superblock.s_first_data_block) % instance->superblock.s_blocks_per_group;
+	__u8 *block_bitmap = instance->group_desc_table_internal[i].block_bitmap;
+
+	if (block_bitmap[ib / 8] & (1 << (ib % 8))) {
+		return -1;
+	}
+	block_bitmap[ib / 8] |= (1 << (ib % 8));
+	instance->group_desc_table[i].bg_free_blocks_count--;
+	instance->superblock.s_free_blocks_count--;
+	ext2_bitmap_dirty(instance, i, EXT2_BLOCK_BITMAP_DIRTY);
+	return 0;
+}
+
+/**
+ * Allocate the first free block from goal: the rest of its group, the
+ * next groups, and at last the beginning of its group. Called with the
+ * instance locked.
+ */
+static __u32 alloc_block(ext2_fs_instance_t *instance, __u32 goal) {
+	__u32 first = instance->superblock.s_first_data_block;
+	int g0, n, ib;
+	__u32 start;
+
+	if (goal < first || goal >= instance->superblock.s_blocks_count) {
+		goal = first;
+	}
+	g0 = (goal - first) / instance->superblock.s_blocks_per_group;
+	start = (goal - first) % instance->superblock.s_blocks_per_group;
+
+	for (n = 0; n <= instance->n_groups; n++) {
+		int i = (g0 + n) % instance->n_groups;
 		if (instance->group_desc_table[i].bg_free_blocks_count) {
-			// TODO: decrement bg_free_blocks_count
-			__u32 addr_bitmap = instance->group_desc_table[i].bg_block_bitmap;
-			__u8 *block_bitmap = (__u8*) kmalloc(1024 << instance->superblock.s_log_block_size,0);
-			instance->read_data(instance->super.device, block_bitmap, (1024 << instance->superblock.s_log_block_size), addr_bitmap * (1024 << instance->superblock.s_log_block_size));
-
-			__u32 ib;
-			for (ib = 0; ib < instance->superblock.s_blocks_per_group; ib++) {
-				if ((block_bitmap[ib/8] & (1 << (ib % 8))) == 0) {
-					block_bitmap[ib/8] |= (1 << (ib % 8));
-					instance->write_data(instance->super.device, &(block_bitmap[ib/8]), sizeof(__u8), addr_bitmap * (1024 << instance->superblock.s_log_block_size) + ib / 8);
-					return ib + i * instance->superblock.s_blocks_per_group;
+			ib = ext2_find_zero_bit((__u32*) instance->group_desc_table_internal[i].block_bitmap, ext2_group_blocks(instance, i), (n == 0) ? start : 0);
+			while (ib >= 0) {
+				__u32 blk = first + i * instance->superblock.s_blocks_per_group + ib;
+				if (ext2_claim_block(instance, blk) == 0) {
+					return blk;
 				}
+				// Taken since it was found: search further.
+				ib = ext2_find_zero_bit((__u32*) instance->group_desc_table_internal[i].block_bitmap, ext2_group_blocks(instance, i), ib + 1);
 			}
 		}
 	}
@@ -366,37 +720,45 @@ static __u32 alloc_block(ext2_fs_instance_t *instance) {
 }
 
 static int alloc_inode(ext2_fs_instance_t *instance, struct ext2_inode *inode) {
-	int i;
+	int i, ib;
 	for (i = 0; i < instance->n_groups; i++) {
 		if (instance->group_desc_table[i].bg_free_inodes_count) {
 			__u8 *inode_bitmap = instance->group_desc_table_internal[i].inode_bitmap;
 
-			// TODO: decrement bg_free_inodes_count
-			__u32 addr_bitmap = instance->group_desc_table[i].bg_inode_bitmap;
-			__u32 addr_table = instance->group_desc_table[i].bg_inode_table;
-
-			__u32 ib;
-			for (ib = 0; ib < instance->superblock.s_inodes_per_group; ib++) {
+			ib = ext2_find_zero_bit((__u32*) inode_bitmap, instance->superblock.s_inodes_per_group, 0);
+			if (ib >= 0) {
 				int inode_n = i * instance->superblock.s_inodes_per_group + ib + 1;
-				if ((inode_bitmap[ib/8] & (1 << (ib % 8))) == 0) {
-					instance->write_data(instance->super.device, inode, sizeof(struct ext2_inode), addr_table * (1024 << instance->superblock.s_log_block_size) + sizeof(struct ext2_inode) * ib);
-					inode_bitmap[ib/8] |= (1 << (ib % 8));
-					instance->write_data(instance->super.device, &(inode_bitmap[ib/8]), sizeof(__u8), addr_bitmap * (1024 << instance->superblock.s_log_block_size) + ib / 8);
-					return inode_n;
+				write_inode(instance, inode_n, inode);
+				inode_bitmap[ib / 8] |= (1 << (ib % 8));
+				instance->group_desc_table[i].bg_free_inodes_count--;
+				instance->superblock.s_free_inodes_count--;
+				if ((inode->i_mode & 0xF000) == EXT2_S_IFDIR) {
+					instance->group_desc_table[i].bg_used_dirs_count++;
 				}
+				ext2_bitmap_dirty(instance, i, EXT2_INODE_BITMAP_DIRTY);
+				return inode_n;
 			}
 		}
 	}
 	return 0;
 }
 
+/**
+ * First block of the group of an inode, where its blocks are searched
+ * first.
+ */
+static __u32 ext2_inode_goal(ext2_fs_instance_t *instance, int ino) {
+	int group = (ino - 1) / instance->superblock.s_inodes_per_group;
+	return instance->superblock.s_first_data_block + group * instance->superblock.s_blocks_per_group;
+}
+
 static int alloc_block_inode(ext2_fs_instance_t *instance, int inode) {
 	struct ext2_inode *einode = read_inode(instance, inode);
 	if (einode) {
 		int i = 0;
 		while (einode->i_block[i] > 0 && i < 12) i++;
 		if (i < 12) {
-			einode->i_block[i] = alloc_block(instance);
+			einode->i_block[i] = alloc_block(instance, (i > 0) ? einode->i_block[i - 1] + 1 : ext2_inode_goal(instance, inode));
 			write_inode(instance, inode, einode);
 			return einode->i_block[i];
 		}
@@ -405,16 +767,21 @@ static int alloc_block_inode(ext2_fs_instance_t *instance, int inode) {
 }
 
 static void free_block(ext2_fs_instance_t *instance, __u32 blk) {
-	int i = blk / instance->superblock.s_blocks_per_group;
-	int ib = blk - instance->superblock.s_blocks_per_group * i; 
-	__u32 addr_bitmap = instance->group_desc_table[i].bg_block_bitmap;
+	if (blk < instance->superblock.s_first_data_block || blk >= instance->superblock.s_blocks_count) {
+		return;
+	}
+	blk -= instance->superblock.s_first_data_block;
 
-	__u8 block_bitmap;
-	instance->read_data(instance->super.device, &(block_bitmap), sizeof(__u8), addr_bitmap * (1024 << instance->superblock.s_log_block_size) + ib / 8);
-	block_bitmap &= ~(1 << (ib % 8));
-	instance->write_data(instance->super.device, &(block_bitmap), sizeof(__u8), addr_bitmap * (1024 << instance->superblock.s_log_block_size) + ib / 8);
-	
-	// TODO: increment bg_free_blocks_count
+	int i = blk / instance->superblock.s_blocks_per_group;
+	int ib = blk % instance->superblock.s_blocks_per_group;
+	__u8 *block_bitmap = instance->group_desc_table_internal[i].block_bitmap;
+
+	if (block_bitmap[ib / 8] & (1 << (ib % 8))) {
+		block_bitmap[ib / 8] &= ~(1 << (ib % 8));
+		instance->group_desc_table[i].bg_free_blocks_count++;
+		instance->superblock.s_free_blocks_count++;
+		ext2_bitmap_dirty(instance, i, EXT2_BLOCK_BITMAP_DIRTY);
+	}
 }
 
 #if 0
@@ -430,7 +797,108 @@ static void free_inode(ext2_fs_instance_t *instance, int inode) {
 }
 #endif
 
+static struct ext2_prealloc *ext2_find_prealloc(ext2_fs_instance_t *instance, int ino) {
+	int i;
+	for (i = 0; i < EXT2_PREALLOC_WINDOWS; i++) {
+		if (instance->prealloc[i].ino == ino) {
+			return &instance->prealloc[i];
+		}
+	}
+	return NULL;
+}
+
+static void ext2_release_window(ext2_fs_instance_t *instance, struct ext2_prealloc *w) {
+	while (w->count > 0) {
+		free_block(instance, w->start++);
+		w->count--;
+	}
+	w->ino = 0;
+}
+
+void ext2_discard_prealloc(ext2_fs_instance_t *instance, int ino) {
+	int i;
+	for (i = 0; i < EXT2_PREALLOC_WINDOWS; i++) {
+		if (instance->prealloc[i].ino && (ino == 0 || instance->prealloc[i].ino == ino)) {
+			ext2_release_window(instance, &instance->prealloc[i]);
+		}
+	}
+}
+
+/**
+ * Allocate the block n of a file: right after its block n-1, or else
+ * in the group of its inode. The blocks following a new allocation
+ * are reserved for the next writes of the file: the count blocks
+ * needed from n, and at least EXT2_PREALLOC_BLOCKS.
+ */
+static __u32 ext2_alloc_data_block(ext2_fs_instance_t *instance, int ino, struct ext2_inode *einode, __u32 n, __u32 count) {
+	__u32 prev = (n > 0) ? ext2_bmap(instance, einode, n - 1) : 0;
+	__u32 goal = prev ? prev + 1 : ext2_inode_goal(instance, ino);
+	struct ext2_prealloc *w = ext2_find_prealloc(instance, ino);
+	__u32 blk, k;
+
+	if (w != NULL) {
+		if (w->start == goal) {
+			blk = w->start++;
+			if (--w->count == 0) {
+				w->ino = 0;
+			}
+			return blk;
+		}
+		// The file is not written sequentially.
+		ext2_release_window(instance, w);
+	}
+
+	blk = alloc_block(instance, goal);
+	if (blk == 0) {
+		return 0;
+	}
+
+	if (count < EXT2_PREALLOC_BLOCKS) {
+		count = EXT2_PREALLOC_BLOCKS;
+	}
+	for (k = 1; k < count; k++) {
+		if (ext2_claim_block(instance, blk + k) != 0) {
+			break;
+		}
+	}
+	if (k > 1) {
+		w = ext2_find_prealloc(instance, 0);
+		if (w == NULL) {
+			w = &instance->prealloc[instance->prealloc_next];
+			instance->prealloc_next = (instance->prealloc_next + 1) % EXT2_PREALLOC_WINDOWS;
+			ext2_release_window(instance, w);
+		}
+		w->ino = ino;
+		w->start = blk + 1;
+		w->count = k - 1;
+	}
+	return blk;
+}
+
+/**
+ * A directory is changed: its names are hashed again on the next lookup,
+ * and its index, not updated, is dropped. The blocks of an indexed
+ * directory are valid linear directory blocks.
+ */
+static void ext2_dir_modified(ext2_fs_instance_t *instance, int inode) {
+	struct ext2_inode *einode;
+
+	ext2_invalidate_dir_cache(instance, inode);
+
+	einode = read_inode(instance, inode);
+	if (einode == NULL) {
+		return;
+	}
+	if (einode->i_flags & EXT2_INDEX_FL) {
+		einode->i_flags &= ~EXT2_INDEX_FL;
+		write_inode(instance, inode, einode);
+	}
+	kfree((__u32) einode);
+}
+
 static void add_dir_entry(ext2_fs_instance_t *instance, int inode, const char *name, int type, int n_inode) {
+	ext2_dir_modified(instance, inode);
+
 	__u32 addr_debut = addr_inode_data(instance, inode, 0);
 
 	if (addr_debut == 0) {
@@ -464,6 +932,8 @@ static void add_dir_entry(ext2_fs_instance_t *instance, int inode, const char *n
 }
 
 static void remove_dir_entry(ext2_fs_instance_t *instance, int inode, const char *name) {
+	ext2_dir_modified(instance, inode);
+
 	int addr_debut = addr_inode_data(instance, inode, 0);
 
 	if (addr_debut == 0) {
@@ -504,6 +974,8 @@ static void remove_dir_entry(ext2_fs_instance_t *instance, int inode, const char
 }
 
 static void init_dir(ext2_fs_instance_t *instance, int inode, int parent_inode) {
+	ext2_invalidate_dir_cache(instance, inode);
+
 	__u32 addr = addr_inode_data(instance, inode, 0);
 
 	if (addr == 0) {
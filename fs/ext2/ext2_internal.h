@@ -30,6 +30,7 @@
 #include <fs/devfs.h>
 #include <vfs.h>
 #include <kdirent.h>
+#include <ksynch.h>
 
 
 #define EXT2_NDIR_BLOCKS                12
@@ -110,7 +111,15 @@ struct ext2_super_block {
     __u16    s_reserved_word_pad;
     __le32    s_default_mount_opts;
      __le32    s_first_meta_bg;     /* First metablock block group */
-    __u32    s_reserved[190];    /* Padding to the end of the block */
+    __le32    s_mkfs_time;        /* When the filesystem was created */
+    __le32    s_jnl_blocks[17];    /* Backup of the journal inode */
+    __le32    s_blocks_count_hi;    /* Blocks count (high 32 bits) */
+    __le32    s_r_blocks_count_hi;    /* Reserved blocks count (high 32 bits) */
+    __le32    s_free_blocks_count_hi;    /* Free blocks count (high 32 bits) */
+    __le16    s_min_extra_isize;    /* All inodes have at least # bytes */
+    __le16    s_want_extra_isize;    /* New inodes should reserve # bytes */
+    __le32    s_flags;        /* Miscellaneous flags */
+    __u32    s_reserved[167];    /* Padding to the end of the block */
 };
 
 
@@ -120,6 +129,13 @@ struct ext2_super_block {
 #define EXT2_OS_FREEBSD		3 /* Freebsd */
 #define EXT2_OS_LITES		4 /* Lites */
 
+/*
+ * Feature and flags used by the directory index
+ */
+#define EXT2_FEATURE_COMPAT_DIR_INDEX	0x0020	/**< Directories may have an htree index */
+#define EXT2_FLAGS_UNSIGNED_HASH	0x0002	/**< Names hashed as unsigned chars */
+#define EXT2_INDEX_FL			0x00001000	/**< Hash-indexed directory (i_flags) */
+
 /*
  * Revision levels
  */
@@ -141,8 +157,44 @@ struct ext2_group_desc {
 };
 
 
+#define EXT2_INODE_BITMAP_DIRTY	0x1	/**< Inode bitmap not written yet. */
+#define EXT2_BLOCK_BITMAP_DIRTY	0x2	/**< Block bitmap not written yet. */
+
+/** Number of allocations and frees before the bitmaps are written back. */
+#define EXT2_BITMAP_FLUSH_BATCH	64
+
+/** Blocks reserved ahead of the writes of a file. */
+#define EXT2_PREALLOC_BLOCKS	8
+/** Files with a preallocation window at the same time. */
+#define EXT2_PREALLOC_WINDOWS	8
+
+/**
+ * Free blocks reserved for the next blocks of a file, so that
+ * sequential writes get contiguous blocks. They are marked used in
+ * the bitmap until they are allocated or released.
+ */
+struct ext2_prealloc {
+	int ino; /**< Inode owning the window, 0 if unused. */
+	__u32 start; /**< First reserved block. */
+	__u32 count; /**< Number of reserved blocks. */
+};
+
+/** Inodes with a size not written back at the same time. */
+#define EXT2_DIRTY_INODES	16
+
+/**
+ * Size of a file grown by write(), written to its inode with its
+ * blocks at write-back. read_inode() returns this size.
+ */
+struct ext2_dirty_inode {
+	int ino; /**< Inode, 0 if unused. */
+	__u32 i_size; /**< Size of the file. */
+};
+
 struct ext2_group_desc_internal {
 	__u8 *inode_bitmap; /**< Inode bitmap. */	
+	__u8 *block_bitmap; /**< Block bitmap. */
+	int dirty; /**< Bitmaps to write back (EXT2_*_BITMAP_DIRTY). */
 };
 
 /**
@@ -194,6 +246,64 @@ struct directories_t {
 	struct directories_t *next; 
 };
 
+// -- directory index (htree) --
+#define EXT2_DX_HASH_LEGACY		0
+#define EXT2_DX_HASH_HALF_MD4		1
+#define EXT2_DX_HASH_TEA		2
+#define EXT2_DX_HASH_LEGACY_UNSIGNED	3
+#define EXT2_DX_HASH_HALF_MD4_UNSIGNED	4
+#define EXT2_DX_HASH_TEA_UNSIGNED	5
+
+/** Deepest index handled (ext3 writes at most 2 levels). */
+#define EXT2_DX_MAX_LEVELS		3
+
+/**
+ * Header of the index in the block 0 of an indexed directory, after
+ * the entries "." and "..".
+ */
+struct ext2_dx_root_info {
+	__u32	reserved_zero;
+	__u8	hash_version;	/**< EXT2_DX_HASH_* */
+	__u8	info_length;	/**< Size of this header (8) */
+	__u8	indirect_levels;	/**< Levels of index blocks below the root */
+	__u8	unused_flags;
+};
+
+/**
+ * Entry of an index block: the names hashed from hash are in the
+ * block "block" of the directory. The first entry gives the limit and
+ * the count of entries in place of its hash.
+ */
+struct ext2_dx_entry {
+	__u32	hash;
+	__u32	block;
+};
+
+struct ext2_dx_countlimit {
+	__u16	limit;
+	__u16	count;
+};
+
+/** Buckets of the in-memory name hash of a directory. */
+#define EXT2_DIR_HASH_BUCKETS	256
+/** Directories with an in-memory name hash at the same time. */
+#define EXT2_DIR_CACHE_SIZE	8
+
+struct ext2_dir_cache_entry {
+	struct ext2_dir_cache_entry *next; /**< Next name in the bucket. */
+	__u32 inode; /**< Inode of the name. */
+	__u8 name_len; /**< Length of the name. */
+	char name[]; /**< The name, without '\0'. */
+};
+
+/**
+ * Names of a directory without an index, built on its first lookup.
+ */
+struct ext2_dir_cache {
+	int ino; /**< Inode of the directory, 0 if unused. */
+	struct ext2_dir_cache_entry **buckets; /**< EXT2_DIR_HASH_BUCKETS buckets. */
+};
+
 // -- file format --
 #define EXT2_S_IFSOCK	0xC000	/**< socket */
 #define EXT2_S_IFLNK	0xA000	/**< symbolic link */
@@ -228,12 +338,53 @@ typedef struct _ext2_fs_instance_t {
 	int n_groups;   /**< Number of entries in the group desc table. */
 	blkdev_read_t read_data; /**< Function to read data. */
 	blkdev_write_t write_data; /**< Function to write data. */
-	struct ext2_group_desc_internal *group_desc_table_internal; /**< Copy of inodes (only, for now?) */
+	struct ext2_group_desc_internal *group_desc_table_internal; /**< Copy of the bitmaps. */
+	int n_dirty; /**< Allocations and frees not written back yet. */
+	struct ext2_prealloc prealloc[EXT2_PREALLOC_WINDOWS]; /**< Preallocation windows. */
+	int prealloc_next; /**< Next window to take back when all are used. */
+	struct ext2_dir_cache dir_cache[EXT2_DIR_CACHE_SIZE]; /**< Name hashes of directories. */
+	int dir_cache_next; /**< Next name hash to drop when all are used. */
+	struct ext2_dirty_inode dirty_inodes[EXT2_DIRTY_INODES]; /**< Sizes not written back yet. */
+	int dirty_inodes_next; /**< Next size to write back when all are used. */
+	struct kmutex lock; /**< Held to change the metadata: bitmaps, inodes, windows, sizes and name hashes. */
 } ext2_fs_instance_t;
 
 
 void umount_EXT2(fs_instance_t *instance);
 
+/*
+ * The functions below are called with the instance locked. The page
+ * cache functions that may wait for a write-back (sync, truncate,
+ * invalidation, page misses) must be called with it unlocked: the
+ * write-back locks it.
+ */
+
+/**
+ * Write back the dirty bitmaps, the group descriptors and the superblock.
+ */
+void ext2_sync_bitmaps(ext2_fs_instance_t *instance);
+
+/**
+ * Release the blocks preallocated for an inode, for all of them if ino is 0.
+ */
+void ext2_discard_prealloc(ext2_fs_instance_t *instance, int ino);
+
+/**
+ * Write back the size of an inode, of all of them if ino is 0.
+ */
+void ext2_flush_inodes(ext2_fs_instance_t *instance, int ino);
+
+/**
+ * Drop the in-memory name hash of a directory, of all of them if ino is 0.
+ */
+void ext2_invalidate_dir_cache(ext2_fs_instance_t *instance, int ino);
+
+/**
+ * Hash of a name for the directory index (EXT2_DX_HASH_* version),
+ * seed is s_hash_seed of the superblock.
+ */
+__u32 ext2_dirhash(const char *name, int len, int version, const __u32 *seed);
+
 
 int ext2_read(open_file_descriptor * ofd, void * buf, size_t size);
 
@@ -243,6 +394,11 @@ int ext2_write (open_file_descriptor * ofd, const void *buf, size_t size);
 
 int ext2_close(open_file_descriptor *ofd);
 
+int ext2_fsync(open_file_descriptor *ofd, int datasync);
+
+
+int ext2_mmap(open_file_descriptor *ofd, struct uvmm_as *as, __u32 *uaddr, __u32 size, __u32 access_rights, __u32 flags, __u64 offset);
+
 
 //int ext2_readdir(open_file_descriptor * ofd, char * entries, size_t size);
 
@@ -0,0 +1,188 @@
+/**
+ * @file initramfs.c
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ *
+ * Unpack the "newc" cpio archive loaded by the boot loader as a
+ * multiboot module in a RAM file system.
+ */
+
+#include <fs/initramfs.h>
+#include <vfs.h>
+#include <klibc.h>
+#include <kmalloc.h>
+#include <kerrno.h>
+#include <kfcntl.h>
+#include <kstat.h>
+#include <debug.h>
+
+#define CPIO_NEWC_MAGIC "070701"
+#define CPIO_TRAILER "TRAILER!!!"
+
+/** The header of an entry: 13 fields of 8 hexadecimal digits */
+struct cpio_newc_header {
+	char c_magic[6];
+	char c_ino[8];
+	char c_mode[8];
+	char c_uid[8];
+	char c_gid[8];
+	char c_nlink[8];
+	char c_mtime[8];
+	char c_filesize[8];
+	char c_devmajor[8];
+	char c_devminor[8];
+	char c_rdevmajor[8];
+	char c_rdevminor[8];
+	char c_namesize[8];
+	char c_check[8];
+} __attribute__((packed));
+
+/** The header + name and the data are each padded to 4 bytes */
+#define CPIO_ALIGN(x) (((x) + 3) & ~3)
+
+static int cpio_field(const char *field, __u32 *value) {
+	int i;
+
+	*value = 0;
+	for (i = 0; i < 8; i++) {
+		char c = field[i];
+		*value <<= 4;
+		if (c >= '0' && c <= '9') {
+			*value |= c - '0';
+		} else if (c >= 'a' && c <= 'f') {
+			*value |= c - 'a' + 10;
+		} else if (c >= 'A' && c <= 'F') {
+			*value |= c - 'A' + 10;
+		} else {
+			return -EINVAL;
+		}
+	}
+	return 0;
+}
+
+static int cpio_check_magic(const char *magic) {
+	int i;
+
+	for (i = 0; i < 6; i++) {
+		if (magic[i] != CPIO_NEWC_MAGIC[i]) {
+			return -EINVAL;
+		}
+	}
+	return 0;
+}
+
+static int cpio_create_file(const char *path, __u32 mode, const char *data, __u32 size) {
+	open_file_descriptor *ofd = vfs_open(path, O_CREAT | O_RDWR);
+	int ret = 0;
+
+	if (ofd == NULL) {
+		return -ENOENT;
+	}
+	if (ofd->f_ops->write == NULL) {
+		vfs_close(ofd);
+		return -EINVAL;
+	}
+
+	while (size > 0) {
+		int count = ofd->f_ops->write(ofd, data, size);
+		if (count <= 0) {
+			ret = count ? count : -EIO;
+			break;
+		}
+		data += count;
+		size -= count;
+	}
+
+	vfs_close(ofd);
+	vfs_chmod(path, mode & 07777);
+	return ret;
+}
+
+int initramfs_unpack(const char *root, const void *data, size_t size) {
+	const char *archive = (const char*) data;
+	size_t root_len = strlen(root);
+	__u32 offset = 0;
+	int nb_entries = 0;
+
+	while (offset + sizeof(struct cpio_newc_header) <= size) {
+		const struct cpio_newc_header *hdr = (const struct cpio_newc_header*) (archive + offset);
+		__u32 mode, filesize, namesize;
+		const char *name, *file_data;
+		char *path;
+		int ret = 0;
+
+		if (cpio_check_magic(hdr->c_magic)
+		    || cpio_field(hdr->c_mode, &mode)
+		    || cpio_field(hdr->c_filesize, &filesize)
+		    || cpio_field(hdr->c_namesize, &namesize)) {
+			debug("initramfs: bad header at offset %d", offset);
+			return -EINVAL;
+		}
+
+		name = archive + offset + sizeof(struct cpio_newc_header);
+		file_data = archive + CPIO_ALIGN(offset + sizeof(struct cpio_newc_header) + namesize);
+		if (namesize == 0 || (__u32)(file_data - archive) + filesize > size
+		    || name[namesize - 1] != '\0') {
+			debug("initramfs: truncated entry at offset %d", offset);
+			return -EINVAL;
+		}
+		offset = CPIO_ALIGN((__u32)(file_data - archive) + filesize);
+
+		if (strcmp(name, CPIO_TRAILER) == 0) {
+			break;
+		}
+
+		// "./boot/prog" and "boot/prog" both go to <root>/boot/prog.
+		while (name[0] == '.' && name[1] == '/') {
+			name += 2;
+		}
+		while (name[0] == '/') {
+			name++;
+		}
+		if (name[0] == '\0' || strcmp(name, ".") == 0) {
+			continue;
+		}
+
+		path = (char*) kmalloc(root_len + strlen(name) + 2, 0);
+		if (path == NULL) {
+			return -ENOMEM;
+		}
+		strcpy(path, root);
+		path[root_len] = '/';
+		strcpy(path + root_len + 1, name);
+
+		if (S_ISDIR(mode)) {
+			ret = vfs_mkdir(path, mode & 07777);
+			if (ret == -EEXIST) {
+				ret = 0;
+			}
+		} else if (S_ISREG(mode)) {
+			ret = cpio_create_file(path, mode, file_data, filesize);
+		} else {
+			debug("initramfs: %s skipped (mode 0x%x)", path, mode);
+			kfree((__u32) path);
+			continue;
+		}
+
+		if (ret < 0) {
+			debug("initramfs: cannot create %s (%d)", path, ret);
+		} else {
+			nb_entries++;
+		}
+		kfree((__u32) path);
+	}
+
+	return nb_entries;
+}
@@ -0,0 +1,594 @@
+/**
+ * @file tmpfs.c
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ *
+ * Temporary File System: the tree is kept in kernel memory, and the
+ * data of the regular files in their page cache (see pagecache.h),
+ * which has no backing store. A file removed while still open is
+ * released upon its last close.
+ */
+
+#include <fs/tmpfs.h>
+#include <klibc.h>
+#include <kmalloc.h>
+#include <kerrno.h>
+#include <kdirent.h>
+#include <kfcntl.h>
+#include <kstat.h>
+#include <list.h>
+#include <pagecache.h>
+#include <physmem.h>
+#include <filemap.h>
+#include <debug.h>
+#include <uaccess.h>
+
+/** A file or a directory of the tree */
+struct tmpfs_node {
+	inode_t inode;
+	dentry_t dentry; /**< d_pdentry is the dentry of the parent */
+
+	struct tmpfs_node *parent;
+	struct tmpfs_node *children; /**< Directories only */
+	struct tmpfs_node *prev, *next; /**< In the children of the parent */
+
+	struct pagecache_mapping *mapping; /**< Regular files only */
+};
+
+typedef struct {
+	fs_instance_t super;
+	struct tmpfs_node *root;
+	unsigned long next_ino;
+} tmpfs_instance_t;
+
+static fs_instance_t* mount_tmpfs(open_file_descriptor *ofd);
+static void umount_tmpfs(fs_instance_t *instance);
+static file_system_t tmp_fs = {.name="TMPFS", .unique_inode=1, .mount=mount_tmpfs, .umount=umount_tmpfs};
+
+static int tmpfs_read(open_file_descriptor *ofd, void *buf, size_t size);
+static int tmpfs_write(open_file_descriptor *ofd, const void *buf, size_t size);
+static int tmpfs_seek(open_file_descriptor *ofd, long offset, int whence);
+static int tmpfs_readdir(open_file_descriptor *ofd, char *entries, int size);
+static int tmpfs_mmap(open_file_descriptor *ofd, struct uvmm_as *as, __u32 *uaddr, __u32 size, __u32 access_rights, __u32 flags, __u64 offset);
+static int tmpfs_close(open_file_descriptor *ofd);
+
+static struct _open_file_operations_t tmpfs_file_fops = {.write = tmpfs_write, .read = tmpfs_read, .seek = tmpfs_seek, .ioctl = NULL, .open = NULL, .close = tmpfs_close, .readdir = NULL, .mmap = tmpfs_mmap};
+static struct _open_file_operations_t tmpfs_dir_fops = {.write = NULL, .read = NULL, .seek = NULL, .ioctl = NULL, .open = NULL, .close = tmpfs_close, .readdir = tmpfs_readdir, .mmap = NULL};
+
+/* Nothing to read the pages from: a new page is a hole */
+static int tmpfs_readpage(struct pagecache_mapping *mapping __attribute__((unused)), __u32 index __attribute__((unused)), void *page) {
+	memzero_page(page);
+	return OK;
+}
+
+static struct pagecache_ops tmpfs_pagecache_ops = {.readpage = tmpfs_readpage, .writepage = NULL};
+
+
+/* Take the node out of its directory */
+static void tmpfs_detach(struct tmpfs_node *node) {
+	struct tmpfs_node *parent = node->parent;
+
+	list_delete(parent->children, node);
+	if (S_ISDIR(node->inode.i_mode)) {
+		parent->inode.i_nlink--;
+	}
+	node->parent = NULL;
+	node->dentry.d_pdentry = NULL;
+}
+
+static void tmpfs_attach(struct tmpfs_node *node, struct tmpfs_node *parent) {
+	list_add_tail(parent->children, node);
+	if (S_ISDIR(node->inode.i_mode)) {
+		parent->inode.i_nlink++;
+	}
+	node->parent = parent;
+	node->dentry.d_pdentry = &parent->dentry;
+}
+
+/* Free a removed node once nobody has it open: its pages go back to physmem */
+static void tmpfs_release(struct tmpfs_node *node) {
+	if (node->inode.i_nlink > 0 || node->inode.i_count > 0) {
+		return;
+	}
+
+	if (node->mapping != NULL) {
+		pagecache_truncate(node->mapping, 0);
+		pagecache_unref_mapping(node->mapping);
+	}
+	kfree((__u32) node->dentry.d_name);
+	kfree((__u32) node);
+}
+
+static struct tmpfs_node* tmpfs_new_node(tmpfs_instance_t *instance, struct tmpfs_node *parent, const char *name, mode_t mode) {
+	struct tmpfs_node *node = (struct tmpfs_node*) kmalloc(sizeof(struct tmpfs_node), 0);
+	if (node == NULL) {
+		return NULL;
+	}
+	memset(node, 0, sizeof(struct tmpfs_node));
+
+	node->inode.i_ino = instance->next_ino++;
+	node->inode.i_mode = mode;
+	node->inode.i_nlink = S_ISDIR(mode) ? 2 : 1;
+	node->inode.i_instance = &instance->super;
+	node->inode.i_fs_specific = node;
+
+	if (S_ISDIR(mode)) {
+		node->inode.i_fops = &tmpfs_dir_fops;
+	} else {
+		node->inode.i_fops = &tmpfs_file_fops;
+		node->mapping = pagecache_ref_mapping(instance, node->inode.i_ino, &tmpfs_pagecache_ops);
+		if (node->mapping == NULL) {
+			kfree((__u32) node);
+			return NULL;
+		}
+	}
+
+	node->dentry.d_name = strdup(name);
+	node->dentry.d_inode = &node->inode;
+	if (parent != NULL) {
+		tmpfs_attach(node, parent);
+	}
+
+	return node;
+}
+
+static struct tmpfs_node* tmpfs_find_child(struct tmpfs_node *dir, const char *name) {
+	struct tmpfs_node *child;
+	int nb_elts;
+
+	list_foreach(dir->children, child, nb_elts) {
+		if (strcmp(child->dentry.d_name, name) == 0) {
+			return child;
+		}
+	}
+	return NULL;
+}
+
+static dentry_t* tmpfs_getroot(struct _fs_instance_t *instance) {
+	return &((tmpfs_instance_t*) instance)->root->dentry;
+}
+
+static dentry_t* tmpfs_lookup(struct _fs_instance_t *instance __attribute__((unused)), struct _dentry_t* dentry, const char * name) {
+	struct tmpfs_node *dir = dentry->d_inode->i_fs_specific;
+	struct tmpfs_node *node;
+
+	if (!S_ISDIR(dir->inode.i_mode)) {
+		return NULL;
+	}
+
+	node = tmpfs_find_child(dir, name);
+	return node ? &node->dentry : NULL;
+}
+
+static int tmpfs_create(inode_t *dir, dentry_t *dentry, mode_t mode) {
+	struct tmpfs_node *parent = dir->i_fs_specific;
+	struct tmpfs_node *node;
+
+	if (!S_ISDIR(parent->inode.i_mode)) {
+		return -ENOTDIR;
+	}
+	if (tmpfs_find_child(parent, dentry->d_name) != NULL) {
+		return -EEXIST;
+	}
+
+	node = tmpfs_new_node((tmpfs_instance_t*) dir->i_instance, parent, dentry->d_name, mode);
+	if (node == NULL) {
+		return -ENOMEM;
+	}
+
+	dentry->d_inode = &node->inode;
+	return 0;
+}
+
+static int tmpfs_mknod(inode_t *dir, dentry_t *dentry, mode_t mode, dev_t dev __attribute__((unused))) {
+	// vfs_open(O_CREAT) gives no mode: a regular file.
+	if ((mode & S_IFMT) == 0) {
+		mode |= S_IFREG;
+	}
+	if ((mode & 0777) == 0) {
+		mode |= 0644;
+	}
+	return tmpfs_create(dir, dentry, mode);
+}
+
+static int tmpfs_mkdir(inode_t *dir, dentry_t *dentry, mode_t mode) {
+	return tmpfs_create(dir, dentry, S_IFDIR | (mode & 07777));
+}
+
+static int tmpfs_unlink(inode_t *dir, dentry_t *dentry) {
+	struct tmpfs_node *node;
+
+	// The lookup of a missing name leaves the dentry of the directory.
+	if (dentry == NULL || dentry->d_inode == NULL || dentry->d_inode == dir) {
+		return -ENOENT;
+	}
+	node = dentry->d_inode->i_fs_specific;
+	if (S_ISDIR(node->inode.i_mode)) {
+		return -EISDIR;
+	}
+
+	tmpfs_detach(node);
+	node->inode.i_nlink = 0;
+	tmpfs_release(node);
+	return 0;
+}
+
+static int tmpfs_rmdir(inode_t *dir, dentry_t *dentry) {
+	struct tmpfs_node *node;
+
+	if (dentry == NULL || dentry->d_inode == NULL || dentry->d_inode == dir) {
+		return -ENOENT;
+	}
+	node = dentry->d_inode->i_fs_specific;
+	if (!S_ISDIR(node->inode.i_mode)) {
+		return -ENOTDIR;
+	}
+	if (node->parent == NULL) {
+		return -EBUSY;
+	}
+	if (!list_is_empty(node->children)) {
+		return -ENOTEMPTY;
+	}
+
+	tmpfs_detach(node);
+	node->inode.i_nlink = 0;
+	tmpfs_release(node);
+	return 0;
+}
+
+static int tmpfs_rename(inode_t *old_dir, dentry_t *old_dentry, inode_t *new_dir, dentry_t *new_dentry) {
+	struct tmpfs_node *node, *parent, *target, *aux;
+	char *name;
+
+	if (old_dentry == NULL || old_dentry->d_inode == NULL || old_dentry->d_inode == old_dir) {
+		return -ENOENT;
+	}
+	if (new_dir->i_instance != old_dir->i_instance) {
+		return -EINVAL;
+	}
+	node = old_dentry->d_inode->i_fs_specific;
+	parent = new_dir->i_fs_specific;
+	if (!S_ISDIR(parent->inode.i_mode)) {
+		return -ENOTDIR;
+	}
+
+	// A directory cannot be moved below itself.
+	for (aux = parent; aux != NULL; aux = aux->parent) {
+		if (aux == node) {
+			return -EINVAL;
+		}
+	}
+
+	target = tmpfs_find_child(parent, new_dentry->d_name);
+	if (target == node) {
+		return 0;
+	}
+	if (target != NULL) {
+		if (S_ISDIR(target->inode.i_mode) != S_ISDIR(node->inode.i_mode)) {
+			return S_ISDIR(target->inode.i_mode) ? -EISDIR : -ENOTDIR;
+		}
+		if (S_ISDIR(target->inode.i_mode) && !list_is_empty(target->children)) {
+			return -ENOTEMPTY;
+		}
+	}
+
+	name = strdup(new_dentry->d_name);
+	if (name == NULL) {
+		return -ENOMEM;
+	}
+
+	// The new name replaces the file that had it.
+	if (target != NULL) {
+		tmpfs_detach(target);
+		target->inode.i_nlink = 0;
+		tmpfs_release(target);
+	}
+
+	tmpfs_detach(node);
+	kfree((__u32) node->dentry.d_name);
+	node->dentry.d_name = name;
+	tmpfs_attach(node, parent);
+
+	new_dentry->d_inode = &node->inode;
+	return 0;
+}
+
+static int tmpfs_truncate(inode_t *inode, off_t size) {
+	struct tmpfs_node *node = inode->i_fs_specific;
+
+	if (!S_ISREG(inode->i_mode)) {
+		return -EISDIR;
+	}
+	if (size < 0) {
+		return -EINVAL;
+	}
+
+	// The pages beyond the new end go back to physmem, a larger size
+	// is a hole.
+	pagecache_truncate(node->mapping, size);
+	inode->i_size = size;
+	return 0;
+}
+
+static int tmpfs_setattr(inode_t *inode, file_attributes_t *attr) {
+	if (attr->mask & ATTR_SIZE) {
+		int ret = tmpfs_truncate(inode, attr->ia_size);
+		if (ret != 0) {
+			return ret;
+		}
+	}
+	if (attr->mask & ATTR_MODE) {
+		inode->i_mode = (inode->i_mode & S_IFMT) | (attr->stbuf.st_mode & 07777);
+	}
+	if (attr->mask & ATTR_UID) {
+		inode->i_uid = attr->stbuf.st_uid;
+	}
+	if (attr->mask & ATTR_GID) {
+		inode->i_gid = attr->stbuf.st_gid;
+	}
+	if (attr->mask & ATTR_ATIME) {
+		inode->i_atime = attr->stbuf.st_atime;
+	}
+	if (attr->mask & ATTR_MTIME) {
+		inode->i_mtime = attr->stbuf.st_mtime;
+	}
+	if (attr->mask & ATTR_CTIME) {
+		inode->i_ctime = attr->stbuf.st_ctime;
+	}
+	return 0;
+}
+
+static int tmpfs_read(open_file_descriptor *ofd, void *buf, size_t size) {
+	struct tmpfs_node *node = ofd->inode->i_fs_specific;
+	__u32 offset = ofd->current_octet;
+	int count = 0;
+
+	if ((ofd->flags & O_ACCMODE) == O_WRONLY) {
+		return 0;
+	}
+	if (offset >= (__u32) node->inode.i_size) {
+		return 0;
+	}
+	if (size + offset > (__u32) node->inode.i_size) {
+		size = node->inode.i_size - offset;
+	}
+
+	while (size > 0) {
+		__u32 in_page = offset & PAGE_MASK;
+		size_t size2 = PAGE_SIZE - in_page;
+
+		if (size2 > size) {
+			size2 = size;
+		}
+
+		__u32 page = pagecache_ref_page(node->mapping, offset >> PAGE_SHIFT, true);
+		if (page == 0) {
+			break;
+		}
+
+		int copied = copy_to_buffer(((char*)buf) + count, (char*)page + in_page, size2);
+		physmem_unref_physpage(page);
+		if (copied < 0) {
+			copied = 0;
+		}
+		count += copied;
+		if ((size_t) copied < size2) {
+			if (count == 0) {
+				return -EFAULT;
+			}
+			break;
+		}
+
+		size -= size2;
+		offset += size2;
+	}
+
+	ofd->current_octet += count;
+	return count;
+}
+
+static int tmpfs_write(open_file_descriptor *ofd, const void *buf, size_t size) {
+	struct tmpfs_node *node = ofd->inode->i_fs_specific;
+	__u32 offset;
+	int count = 0;
+
+	if ((ofd->flags & O_ACCMODE) == O_RDONLY) {
+		return 0;
+	}
+
+	if (ofd->flags & O_APPEND) {
+		offset = node->inode.i_size;
+	} else {
+		offset = ofd->current_octet;
+	}
+
+	while (size > 0) {
+		__u32 index = (offset + count) >> PAGE_SHIFT;
+		__u32 in_page = (offset + count) & PAGE_MASK;
+		size_t size2 = PAGE_SIZE - in_page;
+
+		if (size2 > size) {
+			size2 = size;
+		}
+
+		// The page holds the only copy of the data: always read it.
+		__u32 page = pagecache_ref_page(node->mapping, index, true);
+		if (page == 0) {
+			break;
+		}
+
+		int copied = copy_from_buffer((char*)page + in_page, ((char*)buf) + count, size2);
+		pagecache_set_dirty(node->mapping, index);
+		physmem_unref_physpage(page);
+		if (copied < 0) {
+			copied = 0;
+		}
+		count += copied;
+		if ((size_t) copied < size2) {
+			if (count == 0) {
+				return -EFAULT;
+			}
+			break;
+		}
+
+		size -= size2;
+	}
+
+	if (count == 0 && size > 0) {
+		return -ENOMEM;
+	}
+
+	if (offset + count > (__u32) node->inode.i_size) {
+		node->inode.i_size = offset + count;
+	}
+	ofd->current_octet = offset + count;
+	return count;
+}
+
+static int tmpfs_seek(open_file_descriptor *ofd, long offset, int whence) {
+	__u32 i_size = ofd->inode->i_size;
+
+	switch (whence) {
+	case SEEK_SET:
+		if ((__u32)offset > i_size) {
+			return -1;
+		}
+		ofd->current_octet = offset;
+		break;
+	case SEEK_CUR:
+		if (ofd->current_octet + (__u32)offset > i_size) {
+			return -1;
+		}
+		ofd->current_octet += offset;
+		break;
+	case SEEK_END:
+		if ((__u32)offset > i_size) {
+			return -1;
+		}
+		ofd->current_octet = i_size - offset;
+		break;
+	}
+
+	return 0;
+}
+
+static int tmpfs_readdir(open_file_descriptor *ofd, char *entries, int size) {
+	struct tmpfs_node *dir = ofd->inode->i_fs_specific;
+	struct tmpfs_node *child;
+	int count = 0;
+	__u32 c = 0;
+	int nb_elts;
+
+	list_foreach(dir->children, child, nb_elts) {
+		if (c++ < ofd->current_octet) {
+			continue;
+		}
+
+		struct dirent *d = (struct dirent *)(entries + count);
+		int reclen = sizeof(d->d_ino) + sizeof(d->d_reclen) + sizeof(d->d_type) + strlen(child->dentry.d_name) + 1;
+		if (count + reclen > size) {
+			break;
+		}
+		d->d_ino = child->inode.i_ino;
+		d->d_reclen = reclen;
+		d->d_type = S_ISDIR(child->inode.i_mode) ? DT_DIR : DT_REG;
+		strcpy(d->d_name, child->dentry.d_name);
+		count += reclen;
+		ofd->current_octet++;
+	}
+
+	return count;
+}
+
+static int tmpfs_mmap(open_file_descriptor *ofd, struct uvmm_as *as, __u32 *uaddr, __u32 size, __u32 access_rights, __u32 flags, __u64 offset) {
+	struct tmpfs_node *node;
+	int ret;
+
+	if (ofd == NULL || ofd->inode == NULL) {
+		return -EBADF;
+	}
+	node = ofd->inode->i_fs_specific;
+
+	// The arenas get their own reference on the cache of the file.
+	pagecache_ref_mapping(ofd->fs_instance, node->inode.i_ino, &tmpfs_pagecache_ops);
+	ret = filemap_map(as, uaddr, size, access_rights, flags, node->mapping, offset);
+	if (ret != 0) {
+		pagecache_unref_mapping(node->mapping);
+	}
+	return ret;
+}
+
+static int tmpfs_close(open_file_descriptor *ofd) {
+	if (ofd == NULL) {
+		return -1;
+	}
+
+	// Last close of a removed file.
+	tmpfs_release(ofd->inode->i_fs_specific);
+	return 0;
+}
+
+static fs_instance_t* mount_tmpfs(open_file_descriptor *ofd __attribute__((unused))) {
+	tmpfs_instance_t *instance = (tmpfs_instance_t*) kmalloc(sizeof(tmpfs_instance_t), 0);
+	if (instance == NULL) {
+		return NULL;
+	}
+	memset(instance, 0, sizeof(tmpfs_instance_t));
+
+	instance->super.fs = &tmp_fs;
+	instance->super.getroot = tmpfs_getroot;
+	instance->super.lookup = tmpfs_lookup;
+	instance->super.mknod = tmpfs_mknod;
+	instance->super.mkdir = tmpfs_mkdir;
+	instance->super.unlink = tmpfs_unlink;
+	instance->super.rmdir = tmpfs_rmdir;
+	instance->super.rename = tmpfs_rename;
+	instance->super.truncate = tmpfs_truncate;
+	instance->super.setattr = tmpfs_setattr;
+	instance->super.stat = NULL;
+
+	instance->next_ino = 1;
+	instance->root = tmpfs_new_node(instance, NULL, "", S_IFDIR | 00755);
+
+	return (fs_instance_t*) instance;
+}
+
+/* Remove the whole tree, giving its pages back */
+static void tmpfs_destroy(struct tmpfs_node *node) {
+	while (!list_is_empty(node->children)) {
+		struct tmpfs_node *child = list_get_head(node->children);
+		tmpfs_destroy(child);
+	}
+
+	if (node->parent != NULL) {
+		tmpfs_detach(node);
+	}
+	node->inode.i_nlink = 0;
+	tmpfs_release(node);
+}
+
+static void umount_tmpfs(fs_instance_t *instance) {
+	tmpfs_destroy(((tmpfs_instance_t*) instance)->root);
+	// The pages of the files still open go too.
+	pagecache_invalidate_host(instance);
+	kfree((__u32) instance);
+}
+
+/*
+ * Register this FS.
+ */
+void tmpfs_init() {
+	vfs_register_fs(&tmp_fs);
+}
@@ -68,6 +68,12 @@ void init_gdt(void)
 
         init_gdt_desc((__u32) & default_tss, 0x67, 0xE9, 0x00, &kgdt[7]);	/* tss */
 
+	/* SYSENTER/SYSEXIT segments, see SYSENTER_KERNEL_CS */
+	init_gdt_desc(0x0, 0xFFFFF, 0x9B, 0x0D, &kgdt[8]);	/* code */
+	init_gdt_desc(0x0, 0xFFFFF, 0x93, 0x0D, &kgdt[9]);	/* data */
+	init_gdt_desc(0x0, 0xFFFFF, 0xFF, 0x0D, &kgdt[10]);	/* ucode */
+	init_gdt_desc(0x0, 0xFFFFF, 0xF3, 0x0D, &kgdt[11]);	/* udata */
+
 	/* initialization of the structure to GDTR */
 	kgdtr.limite = GDTSIZE * 8;
 	kgdtr.base = GDTBASE;
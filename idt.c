@@ -21,10 +21,13 @@
 #include <types.h>
 #include <idt.h>
 #include <klibc.h>
+#include <apic.h>
 
 void _asm_default_int(void);
-void _asm_irq_0(void);
+extern __u32 _asm_irq_table[];
 void _asm_exc_PF(void);
+void _asm_exc_NM(void);
+void _asm_spurious(void);
 void _asm_syscalls(void);
 
  /*
@@ -54,8 +57,15 @@ void init_idt(void)
 	for (i = 0; i < IDTSIZE; i++) 
 	init_idt_desc(0x08, (__u32) _asm_default_int, INTGATE, &kidt[i]);
 
-        init_idt_desc(0x08, (__u32) _asm_irq_0, INTGATE, &kidt[32]);
+	/* IRQs: see init_pic() */
+	for (i = 0; i < 8; i++) {
+		init_idt_desc(0x08, _asm_irq_table[i], INTGATE, &kidt[0x20 + i]);
+		init_idt_desc(0x08, _asm_irq_table[8 + i], INTGATE, &kidt[0x70 + i]);
+	}
+	init_idt_desc(0x08, (__u32) _asm_spurious, INTGATE,
+		      &kidt[APIC_SPURIOUS_VECTOR]);
         init_idt_desc(0x08, (__u32) _asm_exc_PF, INTGATE, &kidt[14]);     /* #PF */
+        init_idt_desc(0x08, (__u32) _asm_exc_NM, INTGATE, &kidt[7]);      /* #NM */
         /* 0x30 */
         init_idt_desc(0x08, (__u32) _asm_syscalls, TRAPGATE, &kidt[128]); 
 
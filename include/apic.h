@@ -0,0 +1,73 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+#ifndef _APIC_H_
+#define _APIC_H_
+
+#include <types.h>
+
+/**
+ * @file apic.h
+ *
+ * Local APIC and IOAPIC. The configuration is discovered from the
+ * ACPI MADT, or else from the Intel MP table. When there is none, or
+ * the processor has no local APIC, the IRQs stay on the 8259 PICs.
+ *
+ * The ISA IRQs keep the vectors they have with the PICs, so the IDT
+ * does not change. They are delivered to the boot processor, unless
+ * moved with apic_set_irq_affinity().
+ */
+
+/** Spurious interrupts of the local APIC: no EOI for them */
+#define APIC_SPURIOUS_VECTOR 0xEF
+
+#define APIC_MAX_CPUS    16
+#define APIC_MAX_IOAPICS 4
+
+/**
+ * Route the ISA IRQs through the IOAPIC, and mask the PICs
+ *
+ * @return -ENODEV when the PICs remain in use
+ */
+int apic_subsystem_setup(void);
+
+/** TRUE when the IRQs go through the IOAPIC */
+bool apic_enabled(void);
+
+void apic_eoi(void);
+
+/** APIC ID of the processor running this code */
+__u8 apic_cpu_id(void);
+
+/** Deliver the ISA IRQ to the processor with the given APIC ID */
+int apic_set_irq_affinity(int irq, __u8 apic_id);
+
+/* Trigger mode and polarity of a line, for apic_set_irq_mode() */
+#define APIC_IRQ_LEVEL      (1 << 0)
+#define APIC_IRQ_LOW_ACTIVE (1 << 1)
+
+/**
+ * Set the trigger mode and the polarity of a line used by a PCI
+ * device (level triggered, active low for a PCI INTx line). The
+ * settings given by the firmware for the line win over these.
+ *
+ * @return -ENODEV when the IRQs go through the 8259 PICs
+ */
+int apic_set_irq_mode(int irq, int mode);
+
+#endif
@@ -34,6 +34,43 @@ int blockdev_register_disk (const char* name,__u32     device_class,
 
 
 
+/*
+ * Statistics of each disk and partition (a partition counts in its
+ * disk too). The block layer splits each request into one driver
+ * call per block: the time spent outside of the driver calls is the
+ * queueing (waiting for a partial block, bounce buffer...).
+ */
+#define BLOCKDEV_READ  0
+#define BLOCKDEV_WRITE 1
+
+/** Histogram of the duration of the driver calls, in processor
+    cycles: bucket 0 counts the durations below 1024 cycles, bucket n
+    those below 1024 << n */
+#define BLOCKDEV_LATENCY_BUCKETS 24
+
+struct blockdev_stats
+{
+  /* Indexed by BLOCKDEV_READ/BLOCKDEV_WRITE */
+  __u32 requests[2];         /* reads/writes of the device */
+  __u32 ios[2];              /* blocks transferred by the driver */
+  __u64 bytes[2];            /* bytes asked by the requests */
+  __u64 request_cycles[2];   /* duration of the requests */
+  __u64 service_cycles[2];   /* time spent in the driver */
+  __u32 latency[2][BLOCKDEV_LATENCY_BUCKETS];
+
+  /** Writes of a partial block: read, modified, written back */
+  __u32 rmw;
+  __u32 errors;
+  __u32 in_flight;
+};
+
+/** @return -ENOENT when there is no such device */
+int blockdev_get_stats(__u32 device_class, __u32 device_instance,
+		       struct blockdev_stats *stats);
+
+/** Register /dev/diskstats: the statistics of all the devices, as text */
+int blockdev_stats_setup(void);
+
 #endif
 
 
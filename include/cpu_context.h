@@ -10,7 +10,11 @@
 struct cpu_state;
 
 
-inline int syscall_get3args(const struct cpu_state *user_ctxt,
+/**
+ * Retrieve the arguments of the system call from the registers of the
+ * user context (%ebx, %ecx, %edx, %esi, %edi, %ebp)
+ */
+int syscall_get3args(const struct cpu_state *user_ctxt,
 			       unsigned int *arg1,
 			       unsigned int *arg2,
 			       unsigned int *arg3);
@@ -22,6 +26,33 @@ int syscall_get2args(const struct cpu_state *user_ctxt,
 			       unsigned int *arg1,
 			       unsigned int *arg2);
 
-#endif
+int syscall_get4args(const struct cpu_state *user_ctxt,
+			       unsigned int *arg1,
+			       unsigned int *arg2,
+			       unsigned int *arg3,
+			       unsigned int *arg4);
+
+int syscall_get5args(const struct cpu_state *user_ctxt,
+			       unsigned int *arg1,
+			       unsigned int *arg2,
+			       unsigned int *arg3,
+			       unsigned int *arg4,
+			       unsigned int *arg5);
 
+int syscall_get6args(const struct cpu_state *user_ctxt,
+			       unsigned int *arg1,
+			       unsigned int *arg2,
+			       unsigned int *arg3,
+			       unsigned int *arg4,
+			       unsigned int *arg5,
+			       unsigned int *arg6);
 
+/**
+ * Complete the context saved by the SYSENTER entry: the user return
+ * address and the 6th argument are read from the user stack (%ebp)
+ *
+ * @return -EFAULT if the user stack is not accessible
+ */
+int syscall_sysenter_frame(struct cpu_state *user_ctxt);
+
+#endif
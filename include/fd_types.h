@@ -14,6 +14,7 @@
 struct _open_file_descriptor;
 struct _fs_instance_t;
 struct _dentry_t;
+struct uvmm_as;
 
 
 struct _open_file_operations_t {
@@ -32,6 +33,12 @@ struct _open_file_operations_t {
 
 	int (*readdir) (struct _open_file_descriptor*, char*, int);
 
+	/** Map the file in the given address space (see uvmm_map()) */
+	int (*mmap) (struct _open_file_descriptor*, struct uvmm_as *, __u32 *, __u32, __u32, __u32, __u64);
+
+	/** Write back the file, only what is needed to read its data back if datasync */
+	int (*fsync) (struct _open_file_descriptor*, int datasync);
+
 } open_file_operations_t;
 
 
@@ -0,0 +1,54 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+#ifndef _FILEMAP_H_
+#define _FILEMAP_H_
+
+/**
+ * Mapping of regular files in user space. The arenas mapping a file
+ * are backed by the pages of its page cache:
+ *  - MAP_SHARED arenas map the pages of the cache themselves, so that
+ *    the modifications are seen by read() and by the other processes,
+ *    and are written back to the file
+ *  - private arenas map the pages of the cache read-only, and get
+ *    their own copy of a page upon the first write access to it (COW)
+ */
+
+#include <types.h>
+#include <uvmm.h>
+#include <pagecache.h>
+
+
+/**
+ * Map the part of the file cached by 'mapping' starting at offset
+ * 'offset' in the given address space. The parameters are those of
+ * uvmm_map().
+ *
+ * @note Upon success, the reference of the caller on the mapping is
+ * transferred to the new arena. It is released when the last arena
+ * mapping the file goes away.
+ */
+int filemap_map(struct uvmm_as * dest_as,
+		__u32 *uaddr,
+		__u32 size,
+		__u32 access_rights,
+		__u32 flags,
+		struct pagecache_mapping * mapping,
+		__u64 offset);
+
+#endif /* _FILEMAP_H_ */
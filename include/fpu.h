@@ -0,0 +1,63 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+#ifndef _FPU_H_
+#define _FPU_H_
+
+#include <types.h>
+
+/**
+ * @file fpu.h
+ *
+ * Lazy switching of the x87/MMX/SSE registers. The registers belong
+ * to one process at a time (the owner): when another process gets
+ * the CPU, CR0.TS is set, and its first FPU/SSE instruction traps
+ * (#NM). Only then the registers are saved in the save area of the
+ * owner, and loaded from the save area of the current process. The
+ * save areas are allocated at the first use of the FPU.
+ */
+
+struct process;
+
+/** The FXSAVE format (FNSAVE uses the first 108 bytes) */
+struct fpu_state
+{
+  __u8 regs[512];
+} __attribute__((aligned(16)));
+
+void fpu_subsystem_setup(void);
+
+/** Called by schedule() when next gets the CPU */
+void fpu_switch(struct process *next);
+
+/** Release the save area of an exiting process */
+void fpu_release(struct process *proc);
+
+/** The #NM exception handler */
+void isr_fpu_unavailable(void);
+
+/**
+ * Make the FPU/SSE registers available to the kernel, between these
+ * two calls: the state of the owner is saved first. The IRQs are
+ * disabled in between, so the section must be short and must not
+ * block, nor be nested.
+ */
+void kernel_fpu_begin(__u32 *flags);
+void kernel_fpu_end(__u32 flags);
+
+#endif
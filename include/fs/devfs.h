@@ -51,12 +51,10 @@ typedef struct {
 	void * custom_data;
 } blkdev_interfaces;
 
-#ifdef DEVFS_C  
+struct fs_dev_id_t;
+
 extern int devfs_register_blkdev( const char* name, blkdev_interfaces* di, struct fs_dev_id_t *dev_id);
 extern int devfs_register_chardev(const char* name, chardev_interfaces* di, struct fs_dev_id_t *dev_id);
-#else
-
-#endif
 
 
 
@@ -0,0 +1,41 @@
+/**
+ * @file fs/initramfs.h
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ *
+ * @section DESCRIPTION
+ *
+ * @brief Unpacking of the initramfs image given by the boot loader.
+ */
+
+#ifndef _INITRAMFS_H_
+#define _INITRAMFS_H_
+
+#include <types.h>
+
+/**
+ * Extract the cpio archive ("newc" format, as built by
+ * `find . | cpio -o -H newc`) found at [data, data + size) under the
+ * directory 'root' (eg. "/initrd"). Directories and regular files are
+ * created, the other entries are skipped.
+ *
+ * @return The number of entries created, or a negative error code
+ * when the archive is corrupted
+ */
+int initramfs_unpack(const char *root, const void *data, size_t size);
+
+#endif
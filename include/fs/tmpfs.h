@@ -0,0 +1,35 @@
+/**
+ * @file fs/tmpfs.h
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/copyleft/gpl.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ *
+ * @section DESCRIPTION
+ *
+ * @brief File system kept in RAM only. The data of the files live in
+ * their page cache, which is never written back anywhere: the pages
+ * come from physmem and go back to it on truncate and unlink.
+ */
+
+#ifndef _TMPFS_H_
+#define _TMPFS_H_
+
+#include <vfs.h>
+
+
+void tmpfs_init();
+
+#endif
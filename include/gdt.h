@@ -33,6 +33,15 @@
 #define USER_DATA_SEG	4 /* User data segment.   */
 #define NUM_SEGS	5 /* Number of segments.  */
 
+/*
+ * SYSENTER loads CS from the MSR and SS from the next descriptor,
+ * SYSEXIT loads the 3rd and 4th ones: these 4 flat segments mirror
+ * kcode, kdata, ucode and udata in the order the processor expects
+ */
+#define SYSENTER_KERNEL_CS	0x40
+#define SYSENTER_USER_CS	(0x50 | 3)
+#define SYSENTER_USER_SS	(0x58 | 3)
+
 
 /* Segment descriptor */
 struct gdtdesc {
@@ -0,0 +1,78 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+#ifndef _IRQ_H_
+#define _IRQ_H_
+
+#include <types.h>
+
+/**
+ * @file irq.h
+ *
+ * The hardware interrupts (IRQ lines of the PICs). A handler runs
+ * with the IRQs disabled: it should only do the urgent part of the
+ * work (the top half), and leave the rest to a softirq or a tasklet
+ * (softirq.h), which run with the IRQs enabled when the last IRQ
+ * returns.
+ */
+
+#define NR_IRQS 16
+
+#define IRQ_TIMER 0
+
+typedef void (*irq_handler_t)(int irq);
+
+/** @return -EBUSY when the line already has a handler */
+int irq_register(int irq, irq_handler_t handler);
+int irq_unregister(int irq);
+
+/**
+ * Deliver the IRQ to the processor with the given local APIC ID
+ *
+ * @return -ENODEV when the IRQs go through the 8259 PICs
+ */
+int irq_set_affinity(int irq, __u8 apic_id);
+
+/** Called by the IRQ entry of init.S */
+void do_irq(int irq);
+
+/**
+ * Ask for a call to schedule() at the exit of the current IRQ, when
+ * it does not interrupt another IRQ or a softirq
+ */
+void irq_set_need_resched(void);
+
+/*
+ * Statistics: number of IRQs of each line, and histogram of the
+ * duration of their handler, in processor cycles: bucket 0 counts
+ * the durations below 128 cycles, bucket n those below 128 << n
+ */
+#define IRQ_LATENCY_BUCKETS 16
+
+struct irq_stats
+{
+  __u32 count;
+  __u32 latency[IRQ_LATENCY_BUCKETS];
+};
+
+const struct irq_stats *irq_get_stats(int irq);
+
+/** Print the statistics of the lines that got IRQs */
+void irq_dump_stats(void);
+
+#endif
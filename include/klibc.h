@@ -26,13 +26,37 @@
 void *memset (void * s, int c, int n);
 void *memmove(void *, const void *, int);
 void *memcpy(void *dst0, const void *src0, register unsigned int size);
+int memcmp(const void *s1, const void *s2, size_t n);
+
+/** Processor feature bit of cpuid(1): SSE2 support */
+#define CPUID_EDX_SSE2 (1 << 26)
+
+/** Detect the processor features used by the functions below */
+void klibc_setup();
+
+/**
+ * Clear/copy a whole page (PAGE_SIZE bytes, 4-byte aligned), about to
+ * be used
+ */
+void memzero_page(void *page);
+void memcpy_page(void *dst, const void *src);
+
+/**
+ * Clear a page that is not used soon (bulk clearing) with
+ * non-temporal stores when the processor supports them: it does not
+ * evict useful data from the caches
+ */
+void memzero_page_nocache(void *page);
+
 char *strcpy(char *dest, const char *src);
+char *strzcpy(char *dst, const char *src, int len);
 int strcmp(const char *, const char *);
 size_t strlen(const char* s);
 char *strdup (const char *s);
 char *strchrnul(const char *s, int c);
 void itoa (char *buf, int base, int d);
 void kprintf (const char *format, ...);
+int snprintf(char *buff, __u32 len, const char *format, ...);
 
 #endif
 
@@ -53,4 +53,23 @@ struct kmutex
 };
 
 
+int ksema_init(struct ksema *sema, const char *name, int initial_value);
+int ksema_dispose(struct ksema *sema);
+int ksema_down(struct ksema *sema);
+int ksema_trydown(struct ksema *sema);
+int ksema_up(struct ksema *sema);
+
+int kmutex_init(struct kmutex *mutex, const char *name);
+int kmutex_dispose(struct kmutex *mutex);
+
+/** Take the mutex, waiting for it if needed. -EBUSY if we own it */
+int kmutex_lock(struct kmutex *mutex);
+
+/** Take the mutex if nobody owns it, -EBUSY otherwise */
+int kmutex_trylock(struct kmutex *mutex);
+
+bool kmutex_owned_by_me(struct kmutex const* mutex);
+int kmutex_unlock(struct kmutex *mutex);
+
+
 #endif
@@ -0,0 +1,47 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+#ifndef _KTHREAD_H_
+#define _KTHREAD_H_
+
+#include <types.h>
+
+/**
+ * @file kthread.h
+ *
+ * Kernel threads: processes of the process table that only run
+ * kernel code, on their own kernel stack and in the kernel address
+ * space. They are scheduled like the user processes.
+ */
+
+typedef void (*kthread_func_t)(void *arg);
+
+/**
+ * Create a kernel thread running func(arg), ready to run
+ *
+ * @return The pid of the thread, or a negative error code
+ */
+int kthread_create(kthread_func_t func, void *arg);
+
+/**
+ * Terminate the current kernel thread. Also called when its function
+ * returns.
+ */
+void kthread_exit(void) __attribute__((noreturn));
+
+#endif
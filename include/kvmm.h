@@ -68,6 +68,15 @@ __u32 kvmm_alloc(__u32 nb_pages,__u32 flags);
  */
 int kvmm_free(__u32 vaddr);
 
+/**
+ * Map the registers of a device (size bytes at physical address
+ * paddr) uncached in the kernel space, shared by all the address
+ * spaces. The mapping is never released.
+ *
+ * @return The virtual address of paddr, NULL on error
+ */
+__u32 kvmm_map_io(__u32 paddr, __u32 size);
+
 
 /**
  * @return TRUE when vaddr is covered by any (used) kernel range
@@ -72,4 +72,27 @@ struct kwaitq_entry
   struct kwaitq_entry *prev_entry_for_process, *next_entry_for_process;  
 };
 
+
+int kwaitq_init(struct kwaitq *kwq, const char *name);
+
+int kwaitq_dispose(struct kwaitq *kwq);
+
+bool kwaitq_is_empty(const struct kwaitq *kwq);
+
+/**
+ * Block the current process until kwaitq_wakeup() is called on kwq
+ *
+ * @return The wakeup_status given to kwaitq_wakeup(), -EINTR when
+ * the process was woken up by another way
+ */
+int kwaitq_wait(struct kwaitq *kwq);
+
+/**
+ * Wake up (make ready) up to nb_process processes waiting in kwq, in
+ * FIFO order. Can be called from interrupt handlers.
+ */
+int kwaitq_wakeup(struct kwaitq *kwq,
+		  unsigned int nb_process,
+		  int wakeup_status);
+
 #endif
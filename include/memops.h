@@ -0,0 +1,259 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+#ifndef _MEMOPS_H_
+#define _MEMOPS_H_
+
+/**
+ * The x86 string primitives behind memcpy()/memset()/memmove() and
+ * the page clear/copy functions of klibc.c.
+ *
+ * The bulk of the data is moved 32 bits at a time with the rep
+ * movsl/stosl instructions, after a few bytes to align the
+ * destination. The *_page_nt functions use the SSE2 non-temporal
+ * store movnti, which bypasses the caches: it only works on the
+ * general purpose registers, so that no FPU/SSE state is touched. It
+ * is up to the caller to check that the processor supports SSE2.
+ * They are much slower than rep stosl/movsl when the page is used
+ * right after, and only pay off on pages nobody reads soon.
+ *
+ * @note This file does not depend on any other kernel header, so that
+ * the functions can be benchmarked on the host (tools/membench.c).
+ */
+
+/** Size of the areas handled by the *_page functions */
+#define MEMOPS_PAGE_SIZE 4096
+
+/** Below this size, the data is moved byte per byte: starting a rep
+    instruction costs about as much as 32 iterations of the loop */
+#define MEMOPS_SMALL_SIZE 32
+
+/** Minimum distance between overlapping areas to move them by
+    forward chunks */
+#define MEMOPS_MOVE_CHUNK 256
+
+
+/** Byte loop, cheaper than the string instructions for small sizes */
+static inline void *memops_copy_small(void *dst, const void *src,
+				      unsigned int n)
+{
+  char *d = (char*)dst;
+  const char *s = (const char*)src;
+
+  while (n--)
+    *d++ = *s++;
+  return dst;
+}
+
+
+static inline void *memops_copy(void *dst, const void *src, unsigned int n)
+{
+  unsigned int head, words, tail;
+  unsigned long d0, d1, d2;
+
+  if (n < MEMOPS_SMALL_SIZE)
+    return memops_copy_small(dst, src, n);
+
+  /* Source and destination can't be both aligned: the word moves
+     would be slower than the (microcoded) byte moves */
+  if (((unsigned long)dst ^ (unsigned long)src) & 3)
+    {
+      asm volatile("rep; movsb"
+		   : "=&c"(d0), "=&D"(d1), "=&S"(d2)
+		   : "0"((unsigned long)n), "1"(dst), "2"(src)
+		   : "memory");
+      return dst;
+    }
+
+  /* Align the destination (and thus the source) on 32 bits. Each rep
+     instruction costs tens of cycles to start, even for nothing: the
+     few bytes at both ends are moved by the byte loop */
+  head  = (- (unsigned long)dst) & 3;
+  words = (n - head) >> 2;
+  tail  = (n - head) & 3;
+
+  memops_copy_small(dst, src, head);
+  asm volatile("rep; movsl"
+	       : "=&c"(d0), "=&D"(d1), "=&S"(d2)
+	       : "0"((unsigned long)words), "1"((char*)dst + head),
+		 "2"((const char*)src + head)
+	       : "memory");
+  memops_copy_small((char*)dst + n - tail, (const char*)src + n - tail, tail);
+
+  return dst;
+}
+
+
+static inline void *memops_set(void *dst, int c, unsigned int n)
+{
+  unsigned int head, words, tail;
+  unsigned int pattern = (c & 0xff) * 0x01010101;
+  unsigned char *d = (unsigned char*)dst;
+  unsigned long d0, d1;
+
+  if (n < MEMOPS_SMALL_SIZE)
+    {
+      while (n--)
+	*d++ = (unsigned char)c;
+      return dst;
+    }
+
+  head  = (- (unsigned long)dst) & 3;
+  words = (n - head) >> 2;
+  tail  = (n - head) & 3;
+
+  /* As for the copies: a single rep instruction, for the words */
+  while (head--)
+    *d++ = (unsigned char)c;
+  asm volatile("rep; stosl"
+	       : "=&c"(d0), "=&D"(d1)
+	       : "a"(pattern), "0"((unsigned long)words), "1"(d)
+	       : "memory");
+  d += words << 2;
+  while (tail--)
+    *d++ = (unsigned char)c;
+
+  return dst;
+}
+
+
+/**
+ * Copy from the end, for overlapping areas with dst above src. Each
+ * word is read before the previous (upper) one is written, which is
+ * safe whatever the distance between the areas
+ */
+static inline void *memops_copy_backward(void *dst, const void *src,
+					 unsigned int n)
+{
+  char *d = (char*)dst + n;
+  const char *s = (const char*)src + n;
+  unsigned long d0, d1, d2;
+
+  /* The odd bytes of the end first */
+  while (n & 3)
+    {
+      *--d = *--s;
+      n--;
+    }
+
+  if (n == 0)
+    return dst;
+
+  /* Then the words, downwards. The string instructions are not used:
+     they are very slow with the direction flag set */
+  asm volatile("1:\n\t"
+	       "sub $4, %2\n\t"
+	       "sub $4, %1\n\t"
+	       "movl (%2), %%eax\n\t"
+	       "movl %%eax, (%1)\n\t"
+	       "decl %k0\n\t"
+	       "jnz 1b"
+	       : "=&r"(d0), "=&r"(d1), "=&r"(d2)
+	       : "0"((unsigned long)(n >> 2)), "1"(d), "2"(s)
+	       : "eax", "memory");
+
+  return dst;
+}
+
+
+/**
+ * Copy between possibly overlapping areas. When the destination is
+ * above the source, the copy goes from the end by chunks no larger
+ * than the distance between them, so that each chunk is copied
+ * forward; close areas are copied downwards word per word
+ */
+static inline void *memops_move(void *dst, const void *src, unsigned int n)
+{
+  unsigned long dist = (char*)dst - (const char*)src;
+
+  if ( ((char*)dst <= (const char*)src) || (dist >= n) )
+    return memops_copy(dst, src, n);
+
+  if (dist < MEMOPS_MOVE_CHUNK)
+    return memops_copy_backward(dst, src, n);
+
+  while (n > dist)
+    {
+      n -= dist;
+      memops_copy((char*)dst + n, (const char*)src + n, dist);
+    }
+  memops_copy(dst, src, n);
+
+  return dst;
+}
+
+
+/** Reset a 4-byte aligned page without polluting the caches */
+static inline void memops_zero_page_nt(void *page)
+{
+  unsigned long d0, d1;
+
+  asm volatile("xorl %%eax, %%eax\n"
+	       "1:\n\t"
+	       "movnti %%eax,   (%0)\n\t"
+	       "movnti %%eax,  4(%0)\n\t"
+	       "movnti %%eax,  8(%0)\n\t"
+	       "movnti %%eax, 12(%0)\n\t"
+	       "movnti %%eax, 16(%0)\n\t"
+	       "movnti %%eax, 20(%0)\n\t"
+	       "movnti %%eax, 24(%0)\n\t"
+	       "movnti %%eax, 28(%0)\n\t"
+	       "add $32, %0\n\t"
+	       "decl %k1\n\t"
+	       "jnz 1b\n\t"
+	       /* Make the stores visible before the page is used */
+	       "sfence"
+	       : "=&r"(d0), "=&r"(d1)
+	       : "0"(page), "1"((unsigned long)(MEMOPS_PAGE_SIZE / 32))
+	       : "eax", "memory");
+}
+
+
+/** Copy a 4-byte aligned page, the destination bypassing the caches */
+static inline void memops_copy_page_nt(void *dst, const void *src)
+{
+  unsigned long d0, d1, d2;
+
+  asm volatile("1:\n\t"
+	       "movl   (%1), %%eax\n\t"
+	       "movl  4(%1), %%edx\n\t"
+	       "movnti %%eax,   (%0)\n\t"
+	       "movnti %%edx,  4(%0)\n\t"
+	       "movl  8(%1), %%eax\n\t"
+	       "movl 12(%1), %%edx\n\t"
+	       "movnti %%eax,  8(%0)\n\t"
+	       "movnti %%edx, 12(%0)\n\t"
+	       "movl 16(%1), %%eax\n\t"
+	       "movl 20(%1), %%edx\n\t"
+	       "movnti %%eax, 16(%0)\n\t"
+	       "movnti %%edx, 20(%0)\n\t"
+	       "movl 24(%1), %%eax\n\t"
+	       "movl 28(%1), %%edx\n\t"
+	       "movnti %%eax, 24(%0)\n\t"
+	       "movnti %%edx, 28(%0)\n\t"
+	       "add $32, %0\n\t"
+	       "add $32, %1\n\t"
+	       "decl %k2\n\t"
+	       "jnz 1b\n\t"
+	       "sfence"
+	       : "=&r"(d0), "=&r"(d1), "=&r"(d2)
+	       : "0"(dst), "1"(src), "2"((unsigned long)(MEMOPS_PAGE_SIZE / 32))
+	       : "eax", "edx", "memory");
+}
+
+#endif /* _MEMOPS_H_ */
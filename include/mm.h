@@ -30,6 +30,7 @@ __u32 *page_directory ;
 
 #define	PAGING_FLAG 	0x80000000	/* CR0 - bit 31 */
 #define PSE_FLAG	0x00000010	/* CR4 - bit 4  */
+#define WP_FLAG 	0x00010000	/* CR0 - bit 16 */
 
 // Page present flag.
 #define P_PRESENT       0x01
@@ -43,6 +44,8 @@ __u32 *page_directory ;
 #define P_ACCESSED      0x20
 // Page dirty flag (the page has been written).
 #define P_DIRTY         0x40
+// Page not cached (PCD | PWT): memory-mapped device registers.
+#define P_NOCACHE       0x18
 
 
 #define USER_OFFSET  (0x40000000)   /* 1GB (must be 4MB-aligned) */
@@ -104,7 +107,29 @@ extern  __u32 zero_page;
 void paging_init();
 
 __u32 paging_map(__u32 virtual, __u32 physical, bool user);
+
+/**
+ * Same as paging_map(), but the page is only made writable when
+ * P_WRITE is set in prot. Read-only user pages are the base of the
+ * copy-on-write scheme: see paging_try_resolve_COW()
+ */
+__u32 paging_map_prot(__u32 virtual, __u32 physical, bool user, __u32 prot);
+
+/**
+ * Called by the page fault handler on a write access to a present
+ * read-only page of a writable arena. When the underlying physical
+ * page is not shared anymore, it is simply made writable again,
+ * otherwise it is duplicated into a new private page.
+ */
+int paging_try_resolve_COW(__u32 uaddr);
 __u32 paging_unmap(__u32 virtual);
+
+/**
+ * Tell whether the page mapped at the given address of the current
+ * address space has been written to since it was mapped (ie the
+ * processor set the dirty bit of its PTE)
+ */
+bool paging_is_dirty(__u32 vaddr);
 __u32 paging_virtual_to_physical(__u32* page_directory, __u32 virtual);
 __u32*  paging_get_current_PD();
 __u32 paging_load_PD(__u32  pd);
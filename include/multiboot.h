@@ -227,6 +227,7 @@ extern unsigned int stack_size;
        /* padding to take it to 16 bytes (must be zero) */
        __u32 pad;
      };
+     typedef struct multiboot_mod_list multiboot_module_t;
      
      
 struct multiboot_info mbinfo;
@@ -0,0 +1,173 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+#ifndef _PAGECACHE_H_
+#define _PAGECACHE_H_
+
+/**
+ * The page cache keeps the data of the files in physical pages,
+ * indexed by (file, offset). A file is identified by its file system
+ * instance and its inode number, and its pages are stored in a radix
+ * tree indexed by the page number in the file.
+ *
+ * The same pages back the read()/write() system calls and the
+ * memory-mapped files. The pages of the cache are kept in a global
+ * LRU list: the least recently used pages that are not mapped in user
+ * space are released under physical memory pressure.
+ */
+
+#include <types.h>
+#include <physmem.h>
+
+
+struct pagecache_mapping;
+
+
+/** Start write-back when the free physical pages go below this mark */
+#define PAGECACHE_LOW_WATERMARK 64
+
+/** Largest run of consecutive dirty pages written back at once */
+#define PAGECACHE_WRITEBACK_BATCH 16
+
+/** Percentage of the physical pages that may wait for write-back
+    before the flusher writes them all back */
+#define PAGECACHE_DIRTY_RATIO 10
+
+
+/**
+ * The functions used by the cache to transfer the pages from/to the
+ * underlying storage
+ */
+struct pagecache_ops
+{
+  /**
+   * Fill the given page (PAGE_SIZE bytes, kernel address) with the
+   * data of the file at page index 'index'. Holes and the part beyond
+   * the end of file must be reset.
+   */
+  int (*readpage)(struct pagecache_mapping * mapping,
+		  __u32 index, void * page);
+
+  /**
+   * Write back the given page of the file. NULL for the files that
+   * only live in memory: their pages are never released by the
+   * reclaim, only by pagecache_truncate(). Called with the cache
+   * unlocked: the page may be modified during the I/O, it is then
+   * dirty again
+   */
+  int (*writepage)(struct pagecache_mapping * mapping,
+		   __u32 index, const void * page);
+
+  /**
+   * Write back nb_pages consecutive pages of the file, from page index
+   * 'index'. Optional: used by pagecache_sync() to write the dirty
+   * pages in runs, in the order of the file
+   */
+  int (*writepages)(struct pagecache_mapping * mapping,
+		    __u32 index, __u32 nb_pages, const void ** pages);
+};
+
+
+int pagecache_subsystem_setup();
+
+
+/**
+ * Retrieve the cache of the given file, creating it if needed. The
+ * cache is kept as long as it is referenced or holds some pages.
+ */
+struct pagecache_mapping *
+pagecache_ref_mapping(void * host, unsigned long ino,
+		      struct pagecache_ops * ops);
+
+int pagecache_unref_mapping(struct pagecache_mapping * mapping);
+
+void * pagecache_get_host(struct pagecache_mapping * mapping);
+
+unsigned long pagecache_get_ino(struct pagecache_mapping * mapping);
+
+
+/**
+ * Return the physical address of the page at page index 'index' in
+ * the file, reading it from the storage when it is not cached yet
+ * (unless read_page is FALSE, for pages about to be overwritten).
+ *
+ * @note The page returned has an additional reference, to be released
+ * by way of physmem_unref_physpage() by the caller. Physical memory
+ * being identity-mapped in kernel space, the kernel accesses the
+ * page directly at its physical address.
+ *
+ * @return NULL on error
+ */
+__u32 pagecache_ref_page(struct pagecache_mapping * mapping,
+			 __u32 index, bool read_page);
+
+/** Mark the page as modified: it will be written back later */
+int pagecache_set_dirty(struct pagecache_mapping * mapping, __u32 index);
+
+/**
+ * Drop the page if it is clean and only referenced by the cache: the
+ * writer of a page not read first that could not fill it
+ *
+ * @return OK, -EBUSY if the page is kept
+ */
+int pagecache_discard_page(struct pagecache_mapping * mapping, __u32 index);
+
+/**
+ * Write back all the dirty pages of the file, in the order of the file
+ * and by runs of consecutive pages when the file system supports it.
+ * The pages already being written back are waited for first
+ */
+int pagecache_sync(struct pagecache_mapping * mapping);
+
+/** Write back all the dirty pages of the cache */
+int pagecache_sync_all();
+
+/**
+ * Write back the files dirtied more than 'age' clock ticks ago, all
+ * the files with dirty pages when 'age' is 0
+ */
+int pagecache_sync_older(__u32 age);
+
+/**
+ * Drop all the pages of the files of the given host, dirty or not:
+ * called once the host is gone (file system unmounted), after the
+ * pages to keep were written back
+ */
+void pagecache_invalidate_host(void * host);
+
+/** Number of dirty pages to write back in the whole cache */
+__u32 pagecache_get_nr_dirty();
+
+/** TRUE when more pages are dirty than PAGECACHE_DIRTY_RATIO allows */
+bool pagecache_over_dirty_limit();
+
+/**
+ * Drop the pages beyond the new size of the file, and reset the end
+ * of the last page
+ */
+int pagecache_truncate(struct pagecache_mapping * mapping, __u64 size);
+
+/**
+ * Release up to nb_pages least recently used clean pages that are not
+ * mapped anywhere. Registered in physmem as the reclaim function.
+ *
+ * @return The number of pages released
+ */
+__u32 pagecache_reclaim(__u32 nb_pages);
+
+#endif /* _PAGECACHE_H_ */
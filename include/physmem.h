@@ -79,6 +79,15 @@ int physmem_setup(size_t ram_size,
 				      /* out */__u32 *kernel_core_top);
 
 
+/**
+ * The kernel_core_top physmem_setup() will return for the given RAM
+ * size: the memory below is overwritten by the array of page
+ * descriptors. Used to move the data left there by the boot loader
+ * out of the way before the setup.
+ */
+__u32 physmem_get_core_top(size_t ram_size);
+
+
 /**
  * Retrieve the total number of pages, and the number of free pages
  *
@@ -126,6 +135,23 @@ int physmem_ref_physpage_at(__u32 ppage_paddr);
 int physmem_unref_physpage(__u32 ppage_paddr);
 
 
+/** Number of pages the reclaim function is asked for at a time */
+#define PHYSMEM_RECLAIM_BATCH 16
+
+/**
+ * Function called by physmem_ref_physpage_new() when there is no free
+ * page left: it should release up to nb_pages physical pages it does
+ * not really need, and return the number of pages released
+ */
+typedef __u32 (*physmem_reclaim_func_t)(__u32 nb_pages);
+
+/**
+ * Register the function used to reclaim physical pages under memory
+ * pressure (typically the page cache)
+ */
+int physmem_set_reclaim_func(physmem_reclaim_func_t func);
+
+
 /**
  * Return the reference count of the given page
  *
@@ -0,0 +1,33 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+#ifndef _PIC_H_
+#define _PIC_H_
+
+/*
+ * The legacy 8259 PICs: the master delivers the IRQs 0-7 at the
+ * vectors 0x20-0x27, the slave the IRQs 8-15 at 0x70-0x77
+ */
+#define PIC_MASTER_VECTOR 0x20
+#define PIC_SLAVE_VECTOR  0x70
+
+void init_pic(void);
+void pic_eoi(int irq);
+void pic_disable(void);
+
+#endif
@@ -5,12 +5,16 @@
 #include <types.h>
 #include <uvmm.h>
 #include <fd_types.h>
+#include <fpu.h>
 
 #define KERNELMODE 0
 #define USERMODE   1
 
 #define MAXPID	32
 
+/* Size of the kernel stack of each process */
+#define PROCESS_KSTACK_PAGES	2
+
 /* For  paging_pd_add_pt() */
 struct page_table{
         __u32* pt;
@@ -24,11 +28,10 @@ struct kslab_cache * cache_pt;
 struct process{
 	unsigned int pid;
 
+    /* Saved by switch_context() when the process leaves the CPU: the
+       rest of its state is on its kernel stack */
     struct {
-		__u32 eax, ecx, edx, ebx;
-		__u32 esp, ebp, esi, edi;
-		__u32 eip, eflags;
-		__u32 cs:16, ss:16, ds:16, es:16, fs:16, gs:16;
+		__u32 esp;
 		__u32 cr3;
 	} regs __attribute__ ((packed));
   
@@ -41,6 +44,9 @@ struct process{
   struct page_table * list_pt;
   open_file_descriptor* fd[FOPEN_MAX];
 
+  /* Save area of the FPU/SSE registers, NULL until the first use */
+  struct fpu_state *fpu;
+
   int state;
 
 } __attribute__ ((packed));
@@ -80,6 +86,14 @@ extern int num_proc;
 
 void load_task(char *str);
 
+/**
+ * Allocate the kernel stack of a new process, and prepare it so that
+ * the first switch_context() to the process returns to user mode at
+ * user_eip, with the user stack user_esp
+ */
+int process_init_context(struct process *proc,
+			 __u32 user_eip, __u32 user_esp);
+
 int process_set_address_space(struct process *proc,
 					struct uvmm_as *new_as);
 
@@ -0,0 +1,54 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+
+#ifndef _DRV_RAMDISK_H_
+#define _DRV_RAMDISK_H_
+
+/**
+ * @file ramdisk.h
+ *
+ * Block devices in memory (ram0, ram1, ...): to measure the VFS, the
+ * file systems and the block layer without the cost of a disk, or as
+ * fast scratch space
+ */
+
+#include <types.h>
+
+#define RAMDISK_BLK_SIZE 512
+
+/**
+ * Register a RAM disk of size_kb kB, with the given image at its
+ * start (image may be NULL). The disk is at least as large as the
+ * image. Its partitions are registered too (ram0p1, ...).
+ */
+int ramdisk_create(__u32 size_kb, const void *image, __u32 image_size);
+
+/**
+ * @return The size in kB given by "ramdisk=<kB>" on the kernel
+ * command line, 0 when none
+ */
+__u32 ramdisk_cmdline_size(const char *cmdline);
+
+/**
+ * @return TRUE when the command line of a multiboot module has the
+ * word "ramdisk": it is the initial content of the RAM disk
+ */
+bool ramdisk_cmdline_is_image(const char *cmdline);
+
+#endif
@@ -0,0 +1,79 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+#ifndef _SOFTIRQ_H_
+#define _SOFTIRQ_H_
+
+#include <types.h>
+
+/**
+ * @file softirq.h
+ *
+ * The deferred part of the interrupt handling (bottom halves). A
+ * softirq raised by an IRQ handler runs when the last nested IRQ
+ * returns, with the IRQs enabled, before the return to the
+ * interrupted code. A softirq cannot block.
+ *
+ * Tasklets are dynamic softirqs: a tasklet scheduled several times
+ * before it runs only runs once.
+ */
+
+enum {
+  SOFTIRQ_TIMER,
+  SOFTIRQ_BLOCK,
+  SOFTIRQ_TASKLET,
+  NR_SOFTIRQS
+};
+
+typedef void (*softirq_func_t)(void);
+
+int softirq_register(int nr, softirq_func_t func);
+
+/** Mark the softirq pending. Usually called with the IRQs disabled */
+void softirq_raise(int nr);
+
+/** Run the pending softirqs. Called by do_irq() */
+void do_softirq(void);
+
+/** TRUE while do_softirq() runs */
+bool in_softirq(void);
+
+/** Number of runs of each softirq */
+__u32 softirq_get_count(int nr);
+
+
+struct tasklet
+{
+  void (*func)(unsigned long data);
+  unsigned long data;
+
+  /** TRUE from tasklet_schedule() until it runs */
+  bool scheduled;
+
+  struct tasklet *prev, *next;
+};
+
+void tasklet_init(struct tasklet *t,
+		  void (*func)(unsigned long data), unsigned long data);
+
+/** Run the tasklet at the next softirq exit. Can be called anywhere */
+void tasklet_schedule(struct tasklet *t);
+
+void softirq_subsystem_setup(void);
+
+#endif
@@ -3,6 +3,18 @@
 
 #include <types.h>
 
+/*
+ * The system calls are reached by way of "int $0x80", or of SYSENTER
+ * when the processor supports it. The syscall number goes in %eax,
+ * the arguments in %ebx, %ecx, %edx, %esi, %edi and %ebp (see
+ * userland/crt.c), the result is returned in %eax.
+ */
+
+#define SYSCALL_ID_CONSOLE_WRITE  2
+#define SYSCALL_ID_EXIT           3
+#define SYSCALL_ID_GETPID        20
+#define SYSCALL_ID_SYNC          36
+
 #define SYSCALL_ID_EXEC         258 
 
 /*
@@ -13,8 +25,40 @@
 #define  SYSCALL_ID_READ        561 
 #define  SYSCALL_ID_WRITE       563 
 #define  SYSCALL_ID_BRK         303
+#define  SYSCALL_ID_FSYNC       118
+#define  SYSCALL_ID_FDATASYNC   148
+
+/*
+ * Memory mapping interface
+ */
+#define  SYSCALL_ID_MMAP        300
+#define  SYSCALL_ID_MUNMAP      301
+
+/** Size of the syscall table: greater than the largest ID above */
+#define NR_SYSCALLS             564
+
+/* Protection of the mappings */
+#define PROT_NONE   0
+#define PROT_READ   (1 << 0)
+#define PROT_WRITE  (1 << 1)
+#define PROT_EXEC   (1 << 2)
+
+/* Type of the mappings: exactly one of MAP_SHARED/MAP_PRIVATE */
+#define MAP_SHARED     (1 << 0)
+#define MAP_PRIVATE    (1 << 1)
+#define MAP_FIXED      (1 << 4)
+#define MAP_ANONYMOUS  (1 << 5)
 
 int sys_open( char *path , __u32 flags);
 int sys_read( __u32 fd,void *buf, __u32 c);
+int sys_mmap(__u32 *uaddr, __u32 size, __u32 prot, __u32 flags,
+	     __u32 fd, __u32 offset);
+int sys_munmap(__u32 uaddr, __u32 size);
+int sys_sync(void);
+int sys_fsync(__u32 fd, int datasync);
 void sys_exec(char * str, void const* argv );
+int sys_exit();
+
+/** Setup the SYSENTER entry point, when the processor supports it */
+void syscall_subsystem_setup(void);
 #endif
@@ -39,6 +39,15 @@ struct timeval {
 
 
 typedef long int time_t;
+
+/** Frequency of the timer IRQ (the PIT is left at its default rate) */
+#define CLOCK_HZ 18
+
+/** Number of timer IRQs since they were enabled */
+extern volatile __u32 clock_ticks;
+
+/** Register the timer IRQ handler and the timer softirq */
+void clock_irq_setup(void);
 typedef long int clock_t;
 
 #endif
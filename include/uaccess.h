@@ -0,0 +1,99 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+#ifndef _UACCESS_H_
+#define _UACCESS_H_
+
+/**
+ * Transfers between kernel and user space. The copies are done in
+ * place, without any intermediate buffer: the user pages are faulted
+ * in by the page fault handler as usual, and an access to an invalid
+ * user address is recovered by way of the exception table (the copy
+ * is then interrupted, instead of the kernel hanging in the page
+ * fault handler).
+ */
+
+#include <types.h>
+
+
+/**
+ * An entry of the exception table: when a page fault that cannot be
+ * resolved occurs at address 'insn' in kernel mode, execution
+ * resumes at address 'fixup'
+ */
+struct exception_table_entry
+{
+  __u32 insn;
+  __u32 fixup;
+};
+
+/**
+ * Return the fixup address for a fault at the given kernel address,
+ * or NULL when the instruction is not allowed to fault
+ */
+__u32 search_exception_table(__u32 eip);
+
+
+/**
+ * Copy size bytes from user space to kernel space
+ *
+ * @return The number of bytes successfully copied, or -EFAULT if the
+ * user range is invalid
+ */
+int copy_from_user(void * kernel_to, __u32 user_from, __u32 size);
+
+/**
+ * Copy size bytes from kernel space to user space
+ *
+ * @return The number of bytes successfully copied, or -EFAULT if the
+ * user range is invalid
+ */
+int copy_to_user(__u32 user_to, const void * kernel_from, __u32 size);
+
+/**
+ * Check that the range only covers user pages
+ */
+bool user_range_ok(__u32 uaddr, __u32 size);
+
+/**
+ * Copy to/from the buffer of a read()/write() on a file: a user buffer
+ * when it lies in user space, a kernel buffer below (the kernel itself
+ * reading a program or unpacking the initramfs). The system calls
+ * reject the user buffers that are not in user space.
+ *
+ * @return The number of bytes successfully copied, or -EFAULT
+ */
+int copy_to_buffer(void * to, const void * from, __u32 size);
+int copy_from_buffer(void * to, const void * from, __u32 size);
+
+/**
+ * Copy size bytes between two user addresses of the current address
+ * space
+ */
+int usercpy(__u32 dst_uaddr, __u32 src_uaddr, size_t size);
+
+/**
+ * Copy the user string into the kernel buffer, which is always
+ * terminated by '\0' (max_len includes this '\0')
+ *
+ * @return OK, or -EFAULT if the user string is not accessible
+ */
+int strzcpy_from_user(char *kernel_to, __u32 user_from,
+		      __u32 max_len);
+
+#endif /* _UACCESS_H_ */
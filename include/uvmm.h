@@ -118,6 +118,9 @@ int uvmm_map(struct uvmm_as * as,
 		 struct uvmm_mapped_resource * resource,
 		 __u64 offset_in_resource);
 
+int uvmm_unmap(struct uvmm_as * as,
+	       __u32 uaddr, __u32 size);
+
 struct uvmm_mapped_resource *uvmm_get_mapped_resource_of_arena(struct uvmm_arena * arena);
 
 __u32 uvmm_get_start_of_arena(struct uvmm_arena * arena);
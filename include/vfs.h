@@ -17,6 +17,7 @@ typedef struct {
 	int unique_inode; 
 	struct _fs_instance_t * (*mount) (open_file_descriptor*); 
 	void (*umount) (struct _fs_instance_t *); 
+	int (*sync) (struct _fs_instance_t *); /**< Write back the metadata kept in memory. */
 } file_system_t;
 
 
@@ -142,6 +143,22 @@ int vfs_readdir(open_file_descriptor * ofd, char * entries, size_t size);
 
 int vfs_close(open_file_descriptor *ofd);
 
+
+/**
+ * Write back the files dirtied more than 'age' clock ticks ago (all of
+ * them if 0), then the metadata of the mounted file systems.
+ */
+int vfs_writeback(__u32 age);
+
+
+int vfs_sync(void);
+
+
+/**
+ * Write back the data of the file, and its metadata too unless datasync.
+ */
+int vfs_fsync(open_file_descriptor *ofd, int datasync);
+
 void vfs_init();
 
 #endif
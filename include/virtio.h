@@ -0,0 +1,159 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+
+#ifndef _VIRTIO_H_
+#define _VIRTIO_H_
+
+#include <types.h>
+#include <macros.h>
+
+/**
+ * @file virtio.h
+ *
+ * Virtio 0.9.5 (legacy) PCI devices: the registers are in the I/O
+ * space of BAR0, and the requests go through split virtqueues in
+ * memory shared with the host.
+ *
+ * http://docs.oasis-open.org/virtio/virtio/v1.0/virtio-v1.0.html
+ */
+
+#define VIRTIO_PCI_VENDOR             0x1AF4
+
+/* Legacy PCI registers */
+#define VIRTIO_PCI_HOST_FEATURES      0x00
+#define VIRTIO_PCI_GUEST_FEATURES     0x04
+#define VIRTIO_PCI_QUEUE_PFN          0x08
+#define VIRTIO_PCI_QUEUE_NUM          0x0C
+#define VIRTIO_PCI_QUEUE_SEL          0x0E
+#define VIRTIO_PCI_QUEUE_NOTIFY       0x10
+#define VIRTIO_PCI_STATUS             0x12
+#define VIRTIO_PCI_ISR                0x13
+/** Device specific configuration (without MSI-X) */
+#define VIRTIO_PCI_CONFIG             0x14
+
+#define VIRTIO_STATUS_ACKNOWLEDGE     1
+#define VIRTIO_STATUS_DRIVER          2
+#define VIRTIO_STATUS_DRIVER_OK       4
+#define VIRTIO_STATUS_FAILED          128
+
+/** The legacy interface aligns the used ring on a page */
+#define VIRTIO_PCI_VRING_ALIGN        4096
+
+struct vring_desc
+{
+  __u64 addr;
+  __u32 len;
+  __u16 flags;
+  __u16 next;
+} __attribute__((packed));
+
+#define VRING_DESC_F_NEXT             1
+#define VRING_DESC_F_WRITE            2  /* written by the device */
+
+struct vring_avail
+{
+  __u16 flags;
+  __u16 idx;
+  __u16 ring[];
+} __attribute__((packed));
+
+struct vring_used_elem
+{
+  __u32 id;
+  __u32 len;
+} __attribute__((packed));
+
+struct vring_used
+{
+  __u16 flags;
+  __u16 idx;
+  struct vring_used_elem ring[];
+} __attribute__((packed));
+
+/** Set by the device when it does not need to be notified */
+#define VRING_USED_F_NO_NOTIFY        1
+
+/** Memory needed by a virtqueue of num entries */
+#define VRING_SIZE(num) \
+  (ALIGN_SUP(16*(num) + 2*(3 + (num)), VIRTIO_PCI_VRING_ALIGN) \
+   + ALIGN_SUP(2*3 + 8*(num), VIRTIO_PCI_VRING_ALIGN))
+
+/** One buffer of a request, identity mapped */
+struct virtqueue_buf
+{
+  void *addr;
+  __u32 len;
+};
+
+struct virtqueue
+{
+  __u16 io_base;
+  __u16 index;
+  __u16 num;
+
+  struct vring_desc *desc;
+  struct vring_avail *avail;
+  struct vring_used *used;
+
+  /* Free descriptors, chained by their next field */
+  __u16 free_head;
+  __u16 num_free;
+
+  /* Added to the avail ring since the last notification */
+  __u16 num_added;
+  __u16 last_used_idx;
+
+  /** The cookie of each request, indexed by its first descriptor */
+  void **cookies;
+};
+
+/**
+ * Set up the queue index of the device with the memory mem (page
+ * aligned, identity mapped, zeroed) of mem_size bytes
+ *
+ * @return -ENOSPC when the queue needs more memory
+ */
+int virtqueue_setup(struct virtqueue *vq, __u16 io_base, __u16 index,
+		    void *mem, __u32 mem_size);
+
+/**
+ * Make the request (nb_out buffers read by the device, then nb_in
+ * buffers written by it) available to the device. The device is
+ * only told with virtqueue_kick(), so that several requests can be
+ * submitted with one notification.
+ *
+ * @return -ENOSPC when the ring is full
+ */
+int virtqueue_add(struct virtqueue *vq, const struct virtqueue_buf *bufs,
+		  int nb_out, int nb_in, void *cookie);
+
+/** Notify the device of the new requests, unless it said it polls */
+void virtqueue_kick(struct virtqueue *vq);
+
+/**
+ * Next request completed by the device, its descriptors released
+ *
+ * @return Its cookie, NULL when none
+ */
+void *virtqueue_get_used(struct virtqueue *vq, __u32 *len);
+
+/** Reset the device, and acknowledge it: status ACKNOWLEDGE | DRIVER */
+void virtio_pci_reset(__u16 io_base);
+
+#endif
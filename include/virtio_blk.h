@@ -0,0 +1,39 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+
+#ifndef _DRV_VIRTIO_BLK_H_
+#define _DRV_VIRTIO_BLK_H_
+
+/**
+ * @file virtio_blk.h
+ *
+ * Virtio block devices (virtio-blk) of the virtual machines
+ */
+
+#include <types.h>
+
+#define VIRTIO_BLK_PCI_DEVICE 0x1001
+
+/**
+ * Take over the device found by pci_scan(), and register the disk
+ * and its partitions (vda, vda1, ...)
+ */
+int virtio_blk_pci_attach(__u8 bus, __u8 device, __u8 func, __u8 irq);
+
+#endif
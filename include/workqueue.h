@@ -0,0 +1,118 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+#ifndef _WORKQUEUE_H_
+#define _WORKQUEUE_H_
+
+#include <types.h>
+#include <kwaitq.h>
+
+/**
+ * @file workqueue.h
+ *
+ * Deferred work: functions queued by interrupt handlers or system
+ * calls, and run later by the worker kernel thread of a workqueue,
+ * in FIFO order. The worker may block (I/O, mutexes...).
+ */
+
+struct work;
+typedef void (*work_func_t)(struct work *work);
+
+/** A piece of work, usually embedded in a larger structure */
+struct work
+{
+  work_func_t func;
+
+  /** TRUE from queue_work() until the worker starts it */
+  bool pending;
+
+  struct work *prev, *next;
+};
+
+/** Work queued after a delay, counted in clock ticks */
+struct delayed_work
+{
+  struct work work;
+  struct workqueue *wq;
+  __u32 expires;
+
+  /** TRUE while the delay runs */
+  bool timer_pending;
+
+  struct delayed_work *prev, *next;
+};
+
+struct workqueue
+{
+  char name[KWQ_DEBUG_MAX_NAMELEN];
+
+  /** The work to run, and the worker waiting for it */
+  struct work *work_list;
+  struct kwaitq work_wait;
+
+  /** For flush_workqueue(): number of works queued and done */
+  __u32 queued, done;
+  struct kwaitq flush_wait;
+
+  int worker_pid;
+};
+
+/** The default workqueue */
+extern struct workqueue *kernel_wq;
+
+int workqueue_subsystem_setup(void);
+
+/** Create a workqueue and its worker thread */
+struct workqueue *workqueue_create(const char *name);
+
+void work_init(struct work *work, work_func_t func);
+void delayed_work_init(struct delayed_work *dwork, work_func_t func);
+
+/**
+ * Queue the work at the tail of the workqueue. Can be called from
+ * interrupt handlers.
+ *
+ * @return FALSE when the work was already pending
+ */
+bool queue_work(struct workqueue *wq, struct work *work);
+
+/**
+ * Queue the work after delay clock ticks (see CLOCK_HZ)
+ *
+ * @return FALSE when the work or its delay was already pending
+ */
+bool queue_delayed_work(struct workqueue *wq, struct delayed_work *dwork,
+			__u32 delay);
+
+/**
+ * Stop the delay of a delayed work that was not queued yet
+ *
+ * @return TRUE when the delay was running
+ */
+bool cancel_delayed_work(struct delayed_work *dwork);
+
+/**
+ * Wait until the work queued before the call is done. Must not be
+ * called by the worker of the workqueue.
+ */
+void flush_workqueue(struct workqueue *wq);
+
+/** Called by the timer softirq: queue the delayed works that expired */
+void workqueue_clock_tick(void);
+
+#endif
@@ -0,0 +1,53 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+#ifndef _WRITEBACK_H_
+#define _WRITEBACK_H_
+
+#include <types.h>
+#include <time.h>
+
+/**
+ * @file writeback.h
+ *
+ * Background write-back: the flusher thread writes back the files of
+ * the page cache dirtied for more than WRITEBACK_DIRTY_EXPIRE, or all
+ * of them when too many pages are dirty, and then the metadata of the
+ * mounted file systems. write() returns once the data is in the cache.
+ */
+
+/** Period of the flusher, in clock ticks */
+#define WRITEBACK_INTERVAL      (5 * CLOCK_HZ)
+
+/** Age of the dirty data written back by the flusher, in clock ticks */
+#define WRITEBACK_DIRTY_EXPIRE  (30 * CLOCK_HZ)
+
+/** Start the flusher thread */
+int writeback_subsystem_setup(void);
+
+/** Wake the flusher up now. Can be called anywhere */
+void writeback_kick(void);
+
+/**
+ * Serialize the write-backs: the flusher, sync() and fsync() do not
+ * write the same files and file system metadata at the same time
+ */
+void writeback_begin(void);
+void writeback_end(void);
+
+#endif
@@ -21,8 +21,14 @@
 #include <klibc.h>
 #include <types.h>
 #include <schedule.h>
+#include <process.h>
 #include <uvmm.h>
 #include <mm.h>
+#include <uaccess.h>
+#include <time.h>
+#include <workqueue.h>
+#include <irq.h>
+#include <softirq.h>
 
 
 
@@ -31,17 +37,31 @@ void isr_default_int(void)
 	kprintf("interrupt\n");
 }
 
-void isr_clock_int(void)
+volatile __u32 clock_ticks;
+
+static void isr_clock_int(int irq)
 {
 	static int tic = 0;
-	static int sec = 0;
-	tic++;
-	if (tic % 100 == 0) {
-		sec++;
+
+	clock_ticks++;
+	softirq_raise(SOFTIRQ_TIMER);
+
+	/* Timeslice: switch process at the exit of the IRQ */
+	if (++tic % 100 == 0) {
 		tic = 0;
-              schedule();
+		irq_set_need_resched();
 	}
-	
+}
+
+static void timer_softirq(void)
+{
+	workqueue_clock_tick();
+}
+
+void clock_irq_setup(void)
+{
+	softirq_register(SOFTIRQ_TIMER, timer_softirq);
+	irq_register(IRQ_TIMER, isr_clock_int);
 }
 
 
@@ -66,6 +86,18 @@ void isr_page_fault(void)
 					      errcode & (1 << 1),
 					      true)){
 
+        /* Invalid user address accessed by the kernel on behalf of
+           the process: resume at the recovery code of the copy */
+        if (! (errcode & (1 << 2)))
+          {
+            __u32 fixup = search_exception_table(eip);
+            if (fixup)
+              {
+                asm("movl %0, 60(%%ebp)"::"r"(fixup));
+                return;
+              }
+          }
+
 	kprintf("DEBUG: isr_PF_exc(): #PF on eip: %x. cr2: %x code: %x\n", eip, faulting_vaddr, errcode);
            while(1);
          }
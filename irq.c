@@ -0,0 +1,180 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+
+#include <types.h>
+#include <klibc.h>
+#include <io.h>
+#include <kerrno.h>
+#include <interrupt.h>
+#include <process.h>
+#include <schedule.h>
+#include <softirq.h>
+#include <irq.h>
+#include <pic.h>
+#include <apic.h>
+
+static irq_handler_t irq_handlers[NR_IRQS];
+static struct irq_stats irq_stats[NR_IRQS];
+
+/** Number of IRQs being handled (nested in the softirqs) */
+static int irq_nesting;
+
+static bool need_resched;
+
+
+static inline __u32 rdtsc32(void)
+{
+  __u32 low, high;
+
+  asm volatile("rdtsc" : "=a"(low), "=d"(high));
+  return low;
+}
+
+
+int irq_register(int irq, irq_handler_t handler)
+{
+  __u32 flags;
+  int retval = OK;
+
+  if (irq < 0 || irq >= NR_IRQS || ! handler)
+    return -EINVAL;
+
+  disable_IRQs(flags);
+  if (irq_handlers[irq])
+    retval = -EBUSY;
+  else
+    irq_handlers[irq] = handler;
+  restore_IRQs(flags);
+
+  return retval;
+}
+
+
+int irq_unregister(int irq)
+{
+  __u32 flags;
+
+  if (irq < 0 || irq >= NR_IRQS)
+    return -EINVAL;
+
+  disable_IRQs(flags);
+  irq_handlers[irq] = NULL;
+  restore_IRQs(flags);
+
+  return OK;
+}
+
+
+void irq_set_need_resched(void)
+{
+  need_resched = true;
+}
+
+
+static inline void irq_eoi(int irq)
+{
+  if (apic_enabled())
+    apic_eoi();
+  else
+    pic_eoi(irq);
+}
+
+
+int irq_set_affinity(int irq, __u8 apic_id)
+{
+  if (irq < 0 || irq >= NR_IRQS)
+    return -EINVAL;
+
+  return apic_set_irq_affinity(irq, apic_id);
+}
+
+
+static void irq_account(int irq, __u32 cycles)
+{
+  struct irq_stats *stats = & irq_stats[irq];
+  int bucket = 0;
+
+  while (bucket < IRQ_LATENCY_BUCKETS - 1 && (cycles >> (bucket + 7)))
+    bucket++;
+
+  stats->count++;
+  stats->latency[bucket]++;
+}
+
+
+void do_irq(int irq)
+{
+  __u32 start = rdtsc32();
+
+  irq_nesting++;
+
+  if (irq_handlers[irq])
+    irq_handlers[irq](irq);
+
+  irq_eoi(irq);
+  irq_account(irq, rdtsc32() - start);
+
+  irq_nesting--;
+
+  /* The softirqs and the scheduler run once, when we leave the
+     outermost IRQ */
+  if (irq_nesting > 0 || in_softirq())
+    return;
+
+  do_softirq();
+
+  if (need_resched)
+    {
+      need_resched = false;
+
+      /* Not while a blocked process waits for an interrupt */
+      if (current && current->state == PROC_RUNNING)
+	schedule();
+    }
+}
+
+
+const struct irq_stats *irq_get_stats(int irq)
+{
+  if (irq < 0 || irq >= NR_IRQS)
+    return NULL;
+
+  return & irq_stats[irq];
+}
+
+
+void irq_dump_stats(void)
+{
+  int irq, i;
+
+  for (irq = 0; irq < NR_IRQS; irq++)
+    {
+      if (! irq_stats[irq].count)
+	continue;
+
+      kprintf("irq %d: %d", irq, irq_stats[irq].count);
+      for (i = 0; i < IRQ_LATENCY_BUCKETS; i++)
+	if (irq_stats[irq].latency[i])
+	  kprintf(" <%d:%d", 128 << i, irq_stats[irq].latency[i]);
+      kprintf("\n");
+    }
+
+  for (i = 0; i < NR_SOFTIRQS; i++)
+    kprintf("softirq %d: %d\n", i, softirq_get_count(i));
+}
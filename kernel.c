@@ -35,10 +35,23 @@
 #include <process.h>
 #include <list.h>
 #include <uvmm.h>
+#include <pagecache.h>
 #include <ide.h>
+#include <block_dev.h>
 #include <vfs.h>
 #include <fs/devfs.h>
+#include <fs/tmpfs.h>
+#include <fs/initramfs.h>
+#include <ramdisk.h>
 #include <kfcntl.h>
+#include <syscall.h>
+#include <fpu.h>
+#include <apic.h>
+#include <workqueue.h>
+#include <writeback.h>
+#include <softirq.h>
+#include <time.h>
+#include <schedule.h>
 
 #define ok "...[OK]\n"
  /* Check if the bit BIT in FLAGS is set. */
@@ -49,10 +62,60 @@
      void main_kernel (unsigned long magic, unsigned long addr);
 
 
+/* The boot loader puts the modules right after the kernel, where
+   physmem_setup() stores the page descriptors: move them above */
+static void move_modules(multiboot_info_t *mbi, __u32 core_top, size_t ram_size)
+{
+	multiboot_module_t *mod = (multiboot_module_t *) mbi->mods_addr;
+	__u32 shift;
+	int i;
+
+	if (mod[0].mod_start >= core_top)
+		return;
+
+	shift = PAGE_ALIGN_SUP(core_top - mod[0].mod_start);
+	if (mod[mbi->mods_count - 1].mod_end + shift > ram_size)
+	{
+		kprintf("kernel: not enough memory for the modules\n");
+		mbi->mods_count = 0;
+		return;
+	}
+
+	/* They are loaded one after the other: move the last one first */
+	for (i = mbi->mods_count - 1; i >= 0; i--)
+	{
+		memmove((void *)(mod[i].mod_start + shift),
+			(void *) mod[i].mod_start,
+			mod[i].mod_end - mod[i].mod_start);
+		mod[i].mod_start += shift;
+		mod[i].mod_end += shift;
+	}
+}
+
+/* Keep (reserve) or give back (!reserve) the pages of the modules */
+static void ref_modules(multiboot_info_t *mbi, bool reserve)
+{
+	multiboot_module_t *mod = (multiboot_module_t *) mbi->mods_addr;
+	__u32 i, ppage;
+
+	for (i = 0; i < mbi->mods_count; i++)
+		for (ppage = PAGE_ALIGN_INF(mod[i].mod_start);
+		     ppage < mod[i].mod_end; ppage += PAGE_SIZE)
+		{
+			if (reserve)
+				physmem_ref_physpage_at(ppage);
+			else
+				physmem_unref_physpage(ppage);
+		}
+}
+
+
 void main_kernel (unsigned long magic, unsigned long addr)
      {
    
 	__u32 kernel_base_paddr,kernel_top_paddr;
+	__u32 ramdisk_kb = 0;
+	int ramdisk_mod = -1;
 	init_console();
        
 	multiboot_info_t *mbi;      
@@ -72,14 +135,40 @@ void main_kernel (unsigned long magic, unsigned long addr)
 	kprintf ("RAM detected : %uKiB (lower), %uKiB (upper)\n",
                  (unsigned) mbi->mem_lower, (unsigned) mbi->mem_upper);
 
+	klibc_setup();
+
 	kprintf("kernel: loading GDT ..................");
 	init_gdt();
 	kprintf(ok);
 
+	if (! CHECK_FLAG (mbi->flags, 3))
+		mbi->mods_count = 0;
+
+	/* RAM disk: its size on the command line, its initial content in
+	   a module (not the first one) with "ramdisk" on its command line.
+	   Read before physmem_setup() may overwrite the strings. */
+	if (CHECK_FLAG (mbi->flags, 2))
+		ramdisk_kb = ramdisk_cmdline_size((const char *) mbi->cmdline);
+	{
+		multiboot_module_t *mod = (multiboot_module_t *) mbi->mods_addr;
+		__u32 i;
+
+		for (i = 1; i < mbi->mods_count; i++)
+			if (mod[i].cmdline
+			    && ramdisk_cmdline_is_image((const char *) mod[i].cmdline))
+				ramdisk_mod = i;
+	}
+	if (mbi->mods_count > 0)
+		move_modules(mbi,
+			     physmem_get_core_top((mbi->mem_upper<<10)+ (1<<20)),
+			     (mbi->mem_upper<<10)+ (1<<20));
+
      if( physmem_setup((mbi->mem_upper<<10)+ (1<<20)  ,&kernel_base_paddr,
                                         &kernel_top_paddr))
             kprintf("Could not setup paged memory mode\n");
 
+	ref_modules(mbi, true);
+
 	paging_init();
 	kprintf("kernel: Paging enable\n");
 
@@ -102,20 +191,68 @@ void main_kernel (unsigned long magic, unsigned long addr)
 	asm("	movw $0x38, %ax; ltr %ax");
 	kprintf(ok);
 
+	syscall_subsystem_setup();
+
+	softirq_subsystem_setup();
+	clock_irq_setup();
+
 	kmalloc_setup();
 
+	fpu_subsystem_setup();
+
+	/* The PICs stay in use without APIC */
+	apic_subsystem_setup();
+
+	if (workqueue_subsystem_setup() != 0)
+		kprintf("kernel: no kernel workqueue\n");
+
 	kprintf("kernel: User virtual memory management");
 	uvmm_subsystem_setup();
 
         dev_zero_subsystem_setup();
+        pagecache_subsystem_setup();
         kprintf(ok);
 
+	if (writeback_subsystem_setup() != 0)
+		kprintf("kernel: no flusher thread\n");
+
 	kprintf("kernel: Initialize Virtual File System");
 	vfs_init();
 	kprintf(ok);
 	kprintf("kernel: Initialize devfs .............");
 	devfs_init();
+	blockdev_stats_setup();
 	kprintf(ok);
+
+	tmpfs_init();
+	// Scratch space in memory
+	vfs_mount(NULL, "tmp", "TMPFS");
+	if (ramdisk_kb || ramdisk_mod >= 0)
+	{
+		multiboot_module_t *mod = (multiboot_module_t *) mbi->mods_addr;
+
+		if (ramdisk_mod >= 0)
+			ramdisk_create(ramdisk_kb, (void *) mod[ramdisk_mod].mod_start,
+				       mod[ramdisk_mod].mod_end
+				       - mod[ramdisk_mod].mod_start);
+		else
+			ramdisk_create(ramdisk_kb, NULL, 0);
+	}
+	if (mbi->mods_count > 0)
+	{
+		multiboot_module_t *initrd = (multiboot_module_t *) mbi->mods_addr;
+
+		// The first module is the initramfs: the first programs are
+		// served from RAM, before the disks are probed
+		kprintf("kernel: Unpacking initramfs ..........");
+		vfs_mount(NULL, "initrd", "TMPFS");
+		if (initramfs_unpack("/initrd", (void *) initrd->mod_start,
+				     initrd->mod_end - initrd->mod_start) < 0)
+			kprintf("...[FAILED]\n");
+		else
+			kprintf(ok);
+		ref_modules(mbi, false);
+	}
 	
         // test kmalloc
 	pci_scan();
@@ -136,20 +273,28 @@ void main_kernel (unsigned long magic, unsigned long addr)
 
                 current = &p_list[0];
 		current->pid = 0;
-		current->state = PROC_READY;
+		current->state = PROC_RUNNING;
                 current->regs.cr3 = (__u32) page_directory;
 
 
 
 		
+ struct stat st;
  char *prog1_name = "/core/boot/myprog3";
+ if (mbi->mods_count > 0 && vfs_stat("/initrd/boot/myprog3", &st) == 0)
+	prog1_name = "/initrd/boot/myprog3";
  char *prog2_name = "myprog2";
 
  //sys_exec(prog2_name);
 
  sys_exec(prog1_name,NULL);
- 
- while(1);
+
+ /* The kernel process becomes the idle process: let the others
+    (user processes, kernel threads) run, else wait for an IRQ */
+ while(1) {
+	schedule();
+	asm volatile("hlt");
+ }
 
    sti;
 
@@ -19,44 +19,61 @@
 
 
 #include <klibc.h>
+#include <memops.h>
 #include <console.h>
 #include <kmalloc.h>
 
-void *memset (void * s, int c, int n) {
-    unsigned char* d = (unsigned char*) s;
+/** Set by klibc_setup() when the non-temporal stores are available */
+static bool klibc_has_sse2;
+
+
+void klibc_setup()
+{
+  __u32 eax, ebx, ecx, edx;
 
-    while (n--)
-        *d++ = (char)c;
-   return s;
+  asm volatile("cpuid"
+	       : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+	       : "a"(1));
+
+  klibc_has_sse2 = (edx & CPUID_EDX_SSE2) ? true : false;
+}
+
+
+void *memset (void * s, int c, int n) {
+    if (n <= 0)
+        return s;
+    return memops_set(s, c, n);
 }
 
 void *memmove(void *to, const void *from, int length){
-           
-  char *dstp;
-  const char *srcp;
-
-  srcp = from;
-  dstp = to;
-  if (srcp < dstp)
-    while (length-- != 0)
-      dstp[length] = srcp[length];
-  else
-    while (length-- != 0)
-      *dstp++ = *srcp++;
 
-  return to;
+  if (length <= 0)
+    return to;
 
+  return memops_move(to, from, length);
 }
 
 void *memcpy(void *dst0, const void *src0, register unsigned int size)
 {
-  char *dst;
-  const char *src;
-  for (dst = (char*)dst0, src = (const char*)src0 ;
-       size > 0 ;
-       dst++, src++, size--)
-    *dst = *src;
-  return dst0;
+  return memops_copy(dst0, src0, size);
+}
+
+void memzero_page(void *page)
+{
+  memops_set(page, 0, MEMOPS_PAGE_SIZE);
+}
+
+void memcpy_page(void *dst, const void *src)
+{
+  memops_copy(dst, src, MEMOPS_PAGE_SIZE);
+}
+
+void memzero_page_nocache(void *page)
+{
+  if (klibc_has_sse2)
+    memops_zero_page_nt(page);
+  else
+    memops_set(page, 0, MEMOPS_PAGE_SIZE);
 }
 
 char *strcpy(char *dest, const char *src)
@@ -104,6 +121,17 @@ char *strzcpy(register char *dst, register const char *src, register int len)
   return dst;
 }
 
+int memcmp(const void *s1, const void *s2, size_t n)
+{
+	const unsigned char *p1 = s1, *p2 = s2;
+
+	for ( ; n > 0; n--, p1++, p2++)
+		if (*p1 != *p2)
+			return *p1 - *p2;
+
+	return 0;
+}
+
 int strcmp(const char *dst,const char *src)
 {
 	int i = 0;
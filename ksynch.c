@@ -6,6 +6,7 @@
 #include <ksynch.h>
 #include <process.h>
 #include <kerrno.h>
+#include <list.h>
 #include <interrupt.h>
 
 int ksema_init(struct ksema *sema, const char *name,
@@ -210,7 +211,11 @@ int kmutex_unlock(struct kmutex *mutex)
     }
   else
     {
-     
+      /* The mutex goes to the first waiter right now: we must not take
+	 it back before it runs */
+      mutex->owner = list_get_head_named(mutex->kwaitq.waiting_list,
+					 prev_entry_in_kwaitq,
+					 next_entry_in_kwaitq)->proc;
 
       /* We wake up ONE thread ONLY */
       retval = kwaitq_wakeup(& mutex->kwaitq, 1, OK);
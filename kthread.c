@@ -0,0 +1,112 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+
+#include <types.h>
+#include <klibc.h>
+#include <process.h>
+#include <mm.h>
+#include <kvmm.h>
+#include <physmem.h>
+#include <kerrno.h>
+#include <interrupt.h>
+#include <schedule.h>
+#include <kthread.h>
+
+
+/*
+ * First code run by a new thread: switch_context() "returns" here,
+ * with func and arg on the stack as if we had been called
+ */
+static void kthread_start(kthread_func_t func, void *arg)
+{
+  /* schedule() switched to us with the IRQs disabled */
+  asm volatile("sti");
+
+  func(arg);
+  kthread_exit();
+}
+
+
+int kthread_create(kthread_func_t func, void *arg)
+{
+  struct process *proc = NULL;
+  __u32 kstack, *sp, flags;
+  int pid, i;
+
+  kstack = kvmm_alloc(PROCESS_KSTACK_PAGES, KVMM_MAP);
+  if (! kstack)
+    return -ENOMEM;
+
+  disable_IRQs(flags);
+  for (pid = 1; pid < MAXPID; pid++)
+    if (p_list[pid].state == PROC_STOPPED)
+      {
+	proc = &p_list[pid];
+	/* Reserve the slot until the thread is ready */
+	proc->state = PROC_BLOCKED;
+	num_proc++;
+	break;
+      }
+  restore_IRQs(flags);
+
+  if (! proc)
+    {
+      kvmm_free(kstack);
+      return -EAGAIN;
+    }
+
+  proc->pid = pid;
+  proc->address_space = NULL;
+  proc->list_pt = NULL;
+  proc->fpu = NULL;
+  memset(proc->fd, 0x0, sizeof(proc->fd));
+
+  proc->regs.cr3 = (__u32) page_directory;
+  proc->kstack.ss0 = 0x18;
+  proc->kstack.esp0 = kstack + PROCESS_KSTACK_PAGES * PAGE_SIZE;
+
+  sp = (__u32*) proc->kstack.esp0;
+  *--sp = (__u32) arg;
+  *--sp = (__u32) func;
+  *--sp = 0;			/* kthread_start() never returns */
+
+  /* What switch_context() pops */
+  *--sp = (__u32) kthread_start;
+  for (i = 0; i < 4; i++)	/* ebp, ebx, esi, edi */
+    *--sp = 0;
+  proc->regs.esp = (__u32) sp;
+
+  proc->state = PROC_READY;
+  return pid;
+}
+
+
+void kthread_exit(void)
+{
+  __u32 flags;
+
+  /* The stack is released by schedule(), once we left the CPU */
+  disable_IRQs(flags);
+  current->state = PROC_ZOMBIE;
+  schedule();
+
+  /* Never reached */
+  for (;;)
+    ;
+}
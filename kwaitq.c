@@ -21,6 +21,7 @@
 #include <debug.h>
 #include <kerrno.h>
 #include <interrupt.h>
+#include <schedule.h>
 
 #include <kwaitq.h>
 
@@ -91,7 +92,7 @@ _kwaitq_add_entry(struct kwaitq *kwq,
   int nb_entries;
 
   /* This entry is already added in the kwaitq ! */
-  if(NULL == kwq_entry->kwaitq)debug();
+  if(NULL != kwq_entry->kwaitq)debug();
 
   /* kwaitq_init_entry() has not been called ?! */
   if(NULL == kwq_entry->proc) debug();
@@ -172,6 +173,7 @@ int kwaitq_wait(struct kwaitq *kwq)
   retval = _kwaitq_add_entry(kwq, & kwq_entry);
 
  
+ /* Sleep until kwaitq_wakeup(): schedule() resumes us here */
  kwq_entry.proc->state = PROC_BLOCKED;
  schedule();
 
@@ -233,9 +235,8 @@ int kwaitq_wakeup(struct kwaitq *kwq,
 	}
       else
 	{
+	  /* No => it will run at the next schedule() */
           kwq_entry->proc->state = PROC_READY ;
-	  /* No => wake it up now. See schedule.c */
-           reschedule(kwq_entry->proc->pid);
 	}
 
       /* Remove this waitq entry */
@@ -0,0 +1,238 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+
+#include <klibc.h>
+#include <types.h>
+#include <mm.h>
+#include <physmem.h>
+#include <kmalloc.h>
+#include <kerrno.h>
+#include <debug.h>
+#include <uvmm.h>
+#include <pagecache.h>
+#include <filemap.h>
+
+
+/**
+ * A mapped file. One such resource is created for each call to
+ * filemap_map(): the pages are shared through the page cache, not
+ * through the resource.
+ */
+struct filemap_resource
+{
+  int ref_cnt;
+
+  /** The cache of the file */
+  struct pagecache_mapping * mapping;
+
+  /** Set when a shared writable arena maps the file */
+  bool may_dirty;
+
+  struct uvmm_mapped_resource mr;
+};
+
+
+/** Page index in the file of the given user address */
+static __u32 filemap_index_of(struct uvmm_arena * arena, __u32 uaddr)
+{
+  __u64 offset = PAGE_ALIGN_INF(uaddr)
+    - uvmm_get_start_of_arena(arena)
+    + uvmm_get_offset_in_resource(arena);
+
+  return (__u32)(offset >> PAGE_SHIFT);
+}
+
+
+/** Called after the arena has been inserted inside its address space */
+static void filemap_ref(struct uvmm_arena * arena)
+{
+  struct filemap_resource * fm_resource;
+  fm_resource
+    = (struct filemap_resource*)
+      uvmm_get_mapped_resource_of_arena(arena)->custom_data;
+
+  fm_resource->ref_cnt ++;
+  if ( (uvmm_get_flags_of_arena(arena) & ARENA_MAP_SHARED)
+       && (uvmm_get_prot_of_arena(arena) & P_WRITE) )
+    fm_resource->may_dirty = true;
+}
+
+
+/** Called when the arena is removed from its address space */
+static void filemap_unref(struct uvmm_arena * arena)
+{
+  struct filemap_resource * fm_resource;
+  fm_resource
+    = (struct filemap_resource*)
+      uvmm_get_mapped_resource_of_arena(arena)->custom_data;
+
+  fm_resource->ref_cnt --;
+  if (0 > fm_resource->ref_cnt) debug();
+
+  if (fm_resource->ref_cnt > 0)
+    return;
+
+  /* Last arena gone: write back what was modified through it */
+  if (fm_resource->may_dirty)
+    pagecache_sync(fm_resource->mapping);
+
+  pagecache_unref_mapping(fm_resource->mapping);
+  kfree((__u32)fm_resource);
+}
+
+
+/**
+ * Called when part of the arena is unmapped, before the pages are
+ * removed from the page tables. The shared pages written to by way of
+ * the mapping are marked dirty in the cache.
+ */
+static void filemap_unmap(struct uvmm_arena * arena,
+			  __u32 uaddr, __u32 size)
+{
+  struct filemap_resource * fm_resource;
+  __u32 vaddr;
+
+  if ( !(uvmm_get_flags_of_arena(arena) & ARENA_MAP_SHARED)
+       || !(uvmm_get_prot_of_arena(arena) & P_WRITE) )
+    return;
+
+  fm_resource
+    = (struct filemap_resource*)
+      uvmm_get_mapped_resource_of_arena(arena)->custom_data;
+
+  for (vaddr = PAGE_ALIGN_INF(uaddr) ;
+       vaddr < uaddr + size ;
+       vaddr += PAGE_SIZE)
+    if (paging_is_dirty(vaddr))
+      pagecache_set_dirty(fm_resource->mapping,
+			  filemap_index_of(arena, vaddr));
+}
+
+
+/** Called when a legitimate page fault is occuring in the arena */
+static int filemap_no_page(struct uvmm_arena * arena,
+			   __u32 uaddr,
+			   bool write_access)
+{
+  struct filemap_resource * fm_resource;
+  __u32 upage_uaddr = PAGE_ALIGN_INF(uaddr);
+  __u32 arena_prot  = uvmm_get_prot_of_arena(arena);
+  __u32 arena_flags = uvmm_get_flags_of_arena(arena);
+  __u32 index, cached_paddr, ppage_paddr;
+  int retval;
+
+  fm_resource
+    = (struct filemap_resource*)
+      uvmm_get_mapped_resource_of_arena(arena)->custom_data;
+
+  if (write_access && !(arena_prot & P_WRITE))
+    return -EFAULT;
+
+  index = filemap_index_of(arena, upage_uaddr);
+  cached_paddr = pagecache_ref_page(fm_resource->mapping, index, true);
+  if (! cached_paddr)
+    return -ENOMEM;
+
+  if (arena_flags & ARENA_MAP_SHARED)
+    {
+      /* The page of the cache is mapped with the rights of the
+	 arena. The subsequent writes are noticed at unmap time, by
+	 way of the dirty bit of the PTE */
+      retval = paging_map_prot(upage_uaddr, cached_paddr, true, arena_prot);
+      if ((OK == retval) && write_access)
+	pagecache_set_dirty(fm_resource->mapping, index);
+    }
+  else if (! write_access)
+    {
+      /* Private page only read so far: share the page of the cache
+	 until the COW duplicates it */
+      retval = paging_map_prot(upage_uaddr, cached_paddr, true, P_READ);
+    }
+  else
+    {
+      /* Private page being written: duplicate it right now */
+      ppage_paddr = physmem_ref_physpage_new(false);
+      if (! ppage_paddr)
+	retval = -ENOMEM;
+      else
+	{
+	  memcpy_page((void*)ppage_paddr, (void*)cached_paddr);
+	  retval = paging_map_prot(upage_uaddr, ppage_paddr, true, arena_prot);
+	  physmem_unref_physpage(ppage_paddr);
+	}
+    }
+
+  /* The PTE now holds its own reference on the page */
+  physmem_unref_physpage(cached_paddr);
+  return retval;
+}
+
+
+static struct uvmm_arena_ops filemap_ops = (struct uvmm_arena_ops)
+{
+  .ref     = filemap_ref,
+  .unref   = filemap_unref,
+  .unmap   = filemap_unmap,
+  .no_page = filemap_no_page
+};
+
+
+static __u32 filemap_mmap(struct uvmm_arena * arena)
+{
+  return uvmm_set_ops_of_arena(arena, &filemap_ops);
+}
+
+
+int filemap_map(struct uvmm_as * dest_as,
+		__u32 *uaddr,
+		__u32 size,
+		__u32 access_rights,
+		__u32 flags,
+		struct pagecache_mapping * mapping,
+		__u64 offset)
+{
+  int retval;
+  struct filemap_resource * fm_resource;
+
+  if (! IS_PAGE_ALIGNED(offset))
+    return -EINVAL;
+
+  fm_resource
+    = (struct filemap_resource*) kmalloc(sizeof(*fm_resource), 0);
+  if (! fm_resource)
+    return -ENOMEM;
+
+  memset(fm_resource, 0x0, sizeof(*fm_resource));
+  fm_resource->mapping            = mapping;
+  fm_resource->mr.allowed_access_rights
+    = P_READ | P_WRITE | P_USER;
+  fm_resource->mr.custom_data     = fm_resource;
+  fm_resource->mr.mmap            = filemap_mmap;
+
+  retval = uvmm_map(dest_as, uaddr, size,
+		    access_rights, flags,
+		    &fm_resource->mr, offset);
+  if (OK != retval)
+    {
+      kfree((__u32)fm_resource);
+      return retval;
+    }
+
+  return OK;
+}
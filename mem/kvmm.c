@@ -473,6 +473,24 @@ __u32 kvmm_alloc(__u32 nb_pages, __u32  flags)
 }
 
 
+__u32 kvmm_map_io(__u32 paddr, __u32 size)
+{
+  __u32 base_paddr = PAGE_ALIGN_INF(paddr);
+  __u32 nb_pages = (PAGE_ALIGN_SUP(paddr + size) - base_paddr) / PAGE_SIZE;
+  __u32 vaddr, i;
+
+  vaddr = kvmm_alloc(nb_pages, 0);
+  if (! vaddr)
+    return (__u32)NULL;
+
+  for (i = 0 ; i < nb_pages ; i++)
+    paging_map_prot(vaddr + i*PAGE_SIZE, base_paddr + i*PAGE_SIZE,
+		    false, P_READ | P_WRITE | P_NOCACHE);
+
+  return vaddr + (paddr - base_paddr);
+}
+
+
 int kvmm_free(__u32 vaddr)
 {
   struct kvmm_range *range = lookup_range(vaddr);
@@ -0,0 +1,1040 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+
+#include <klibc.h>
+#include <types.h>
+#include <list.h>
+#include <mm.h>
+#include <physmem.h>
+#include <kvmm_slab.h>
+#include <kmalloc.h>
+#include <kerrno.h>
+#include <debug.h>
+#include <pagecache.h>
+#include <writeback.h>
+#include <time.h>
+#include <ksynch.h>
+#include <kwaitq.h>
+#include <interrupt.h>
+#include <process.h>
+
+
+/* Dimensioning constants of the radix trees: each node indexes 6
+   bits of the page index, so that 6 levels cover 32 bits */
+#define RADIX_SHIFT      6
+#define RADIX_SLOTS      (1 << RADIX_SHIFT)
+#define RADIX_MASK       (RADIX_SLOTS - 1)
+#define RADIX_MAX_HEIGHT 6
+
+/** Number of buckets of the file hash table */
+#define PAGECACHE_HASH_SIZE 64
+
+
+/** A node of the radix tree of a file */
+struct radix_node
+{
+  /** Number of non-NULL slots */
+  __u32 count;
+
+  /** Sub-nodes, or pages for the leaves */
+  void * slots[RADIX_SLOTS];
+};
+
+
+/** A page of a file in the cache */
+struct pagecache_page
+{
+  struct pagecache_mapping * mapping;
+
+  /** Page index in the file */
+  __u32 index;
+
+  /** The cache owns one reference to this physical page */
+  __u32 ppage_paddr;
+
+  bool dirty;
+
+  /** Being written back, with the cache unlocked: the page must stay
+      in the cache until the I/O completes */
+  bool writeback;
+
+  /** The pages of a file are linked together */
+  struct pagecache_page *prev_in_mapping, *next_in_mapping;
+
+  /** Global LRU list: the head is the least recently used page */
+  struct pagecache_page *prev_lru, *next_lru;
+};
+
+
+/** The cache of a file */
+struct pagecache_mapping
+{
+  /** Identity of the file */
+  void * host;
+  unsigned long ino;
+
+  struct pagecache_ops * ops;
+
+  int ref_cnt;
+  __u32 nr_pages;
+
+  /** Dirty pages to write back: those of the memory-only files are
+      not counted, they have nowhere to go */
+  __u32 nr_dirty;
+
+  /** When the oldest dirty page was dirtied (clock ticks) */
+  __u32 dirtied_when;
+
+  /** Radix tree of the pages */
+  struct radix_node * root;
+  int height;
+
+  /** The list of pages, to scan them all */
+  struct pagecache_page * list_pages;
+
+  /** Other files in the same hash bucket */
+  struct pagecache_mapping *prev, *next;
+};
+
+
+static struct kslab_cache * cache_of_mappings;
+static struct kslab_cache * cache_of_pages;
+static struct kslab_cache * cache_of_radix_nodes;
+
+static struct pagecache_mapping * mapping_hash[PAGECACHE_HASH_SIZE];
+
+static struct pagecache_page * lru_pages;
+
+/** Statistics */
+static __u32 pagecache_nr_pages, pagecache_hits, pagecache_misses;
+
+/** Dirty pages to write back in the cache, and the number above which
+    the flusher writes them all back */
+static __u32 pagecache_nr_dirty, pagecache_dirty_limit;
+
+/** Protects all the structures of the cache. It is released during
+    the I/O, the pages being written back being marked as such */
+static struct kmutex pagecache_mutex;
+
+/** Where to wait for the end of a write-back */
+static struct kwaitq pagecache_writeback_wait;
+
+
+/*
+ * Radix tree helpers
+ */
+
+/** The largest index a tree of the given height can hold */
+static __u32 radix_max_index(int height)
+{
+  if (height * RADIX_SHIFT >= 32)
+    return 0xFFFFFFFF;
+  return (1 << (height * RADIX_SHIFT)) - 1;
+}
+
+
+static struct pagecache_page *
+radix_lookup(struct pagecache_mapping * mapping, __u32 index)
+{
+  struct radix_node * node = mapping->root;
+  int h;
+
+  if (! node || (index > radix_max_index(mapping->height)))
+    return NULL;
+
+  for (h = mapping->height ; h > 1 ; h--)
+    {
+      node = node->slots[(index >> ((h-1) * RADIX_SHIFT)) & RADIX_MASK];
+      if (! node)
+	return NULL;
+    }
+
+  return node->slots[index & RADIX_MASK];
+}
+
+
+static int radix_insert(struct pagecache_mapping * mapping, __u32 index,
+			struct pagecache_page * page)
+{
+  struct radix_node * node;
+  int h;
+
+  /* Grow the tree until it can hold the index */
+  while ((mapping->height == 0) || (index > radix_max_index(mapping->height)))
+    {
+      if (mapping->root)
+	{
+	  node = (struct radix_node*) kvmm_cache_alloc(cache_of_radix_nodes, 0);
+	  if (! node)
+	    return -ENOMEM;
+	  node->slots[0] = mapping->root;
+	  node->count    = 1;
+	  mapping->root  = node;
+	}
+      mapping->height ++;
+    }
+
+  if (! mapping->root)
+    {
+      mapping->root
+	= (struct radix_node*) kvmm_cache_alloc(cache_of_radix_nodes, 0);
+      if (! mapping->root)
+	return -ENOMEM;
+    }
+
+  node = mapping->root;
+  for (h = mapping->height ; h > 1 ; h--)
+    {
+      int slot = (index >> ((h-1) * RADIX_SHIFT)) & RADIX_MASK;
+      if (! node->slots[slot])
+	{
+	  node->slots[slot]
+	    = (void*) kvmm_cache_alloc(cache_of_radix_nodes, 0);
+	  if (! node->slots[slot])
+	    return -ENOMEM;
+	  node->count ++;
+	}
+      node = node->slots[slot];
+    }
+
+  if (node->slots[index & RADIX_MASK])
+    return -EEXIST;
+
+  node->slots[index & RADIX_MASK] = page;
+  node->count ++;
+  return OK;
+}
+
+
+static void radix_delete(struct pagecache_mapping * mapping, __u32 index)
+{
+  struct radix_node * path[RADIX_MAX_HEIGHT];
+  int slots[RADIX_MAX_HEIGHT];
+  struct radix_node * node = mapping->root;
+  int h, level;
+
+  if (! node || (index > radix_max_index(mapping->height)))
+    return;
+
+  /* Remember the path down to the leaf */
+  for (level = 0, h = mapping->height ; h >= 1 ; h--, level++)
+    {
+      path[level]  = node;
+      slots[level] = (index >> ((h-1) * RADIX_SHIFT)) & RADIX_MASK;
+      if (h > 1)
+	{
+	  node = node->slots[slots[level]];
+	  if (! node)
+	    return;
+	}
+    }
+
+  /* Clear the slot, and release the nodes that become empty */
+  for (level = mapping->height - 1 ; level >= 0 ; level--)
+    {
+      if (! path[level]->slots[slots[level]])
+	return;
+
+      path[level]->slots[slots[level]] = NULL;
+      path[level]->count --;
+      if (path[level]->count > 0)
+	return;
+
+      kvmm_cache_free((__u32)path[level]);
+    }
+
+  /* The whole tree is empty */
+  mapping->root   = NULL;
+  mapping->height = 0;
+}
+
+
+/*
+ * Mappings
+ */
+
+static int mapping_hash_of(void * host, unsigned long ino)
+{
+  return (((__u32)host >> 4) ^ ino) % PAGECACHE_HASH_SIZE;
+}
+
+
+/** Release the mapping once nobody uses it and it holds no page */
+static void mapping_try_release(struct pagecache_mapping * mapping)
+{
+  if ((mapping->ref_cnt > 0) || (mapping->nr_pages > 0))
+    return;
+
+  /* Not in the hash table anymore once its host is gone */
+  if (mapping->host)
+    list_delete(mapping_hash[mapping_hash_of(mapping->host, mapping->ino)],
+		mapping);
+  kvmm_cache_free((__u32)mapping);
+}
+
+
+/**
+ * Mark the page as being written back. It is clean from now on: the
+ * modifications made during the I/O dirty it again. The physical page
+ * stays referenced until the end of the I/O
+ */
+static void page_start_writeback(struct pagecache_page * page)
+{
+  page->dirty     = false;
+  page->writeback = true;
+  page->mapping->nr_dirty --;
+  pagecache_nr_dirty --;
+
+  physmem_ref_physpage_at(page->ppage_paddr);
+}
+
+
+/** The write-back of the page is over: dirty again if it failed */
+static void page_end_writeback(struct pagecache_page * page, int io_status)
+{
+  struct pagecache_mapping * mapping = page->mapping;
+
+  page->writeback = false;
+  if ((OK != io_status) && ! page->dirty)
+    {
+      page->dirty = true;
+      if (mapping->nr_dirty ++ == 0)
+	mapping->dirtied_when = clock_ticks;
+      pagecache_nr_dirty ++;
+    }
+
+  physmem_unref_physpage(page->ppage_paddr);
+  kwaitq_wakeup(& pagecache_writeback_wait, MAXPID, OK);
+}
+
+
+/**
+ * Wait for the end of a write-back. The cache is unlocked meanwhile:
+ * the caller must look up again whatever it found before
+ */
+static void pagecache_wait_writeback()
+{
+  __u32 flags;
+
+  disable_IRQs(flags);
+  kmutex_unlock(& pagecache_mutex);
+  kwaitq_wait(& pagecache_writeback_wait);
+  restore_IRQs(flags);
+
+  kmutex_lock(& pagecache_mutex);
+}
+
+
+/**
+ * Write the page back to the storage if needed. The cache is unlocked
+ * during the I/O, and locked again on return
+ */
+static int page_writeback(struct pagecache_page * page)
+{
+  struct pagecache_mapping * mapping = page->mapping;
+  int retval;
+
+  if (! page->dirty || page->writeback)
+    return OK;
+
+  /* Memory-only file: the page is its only copy, it stays dirty */
+  if (! mapping->ops->writepage)
+    return OK;
+
+  page_start_writeback(page);
+  kmutex_unlock(& pagecache_mutex);
+
+  retval = mapping->ops->writepage(mapping, page->index,
+				   (const void*)page->ppage_paddr);
+
+  kmutex_lock(& pagecache_mutex);
+  page_end_writeback(page, retval);
+  return retval;
+}
+
+
+/** Remove the page from the cache, dropping its modifications if any */
+static void page_evict(struct pagecache_page * page)
+{
+  struct pagecache_mapping * mapping = page->mapping;
+
+  radix_delete(mapping, page->index);
+  list_delete_named(mapping->list_pages, page,
+		    prev_in_mapping, next_in_mapping);
+  list_delete_named(lru_pages, page, prev_lru, next_lru);
+
+  if (page->dirty && mapping->ops->writepage)
+    {
+      mapping->nr_dirty --;
+      pagecache_nr_dirty --;
+    }
+  mapping->nr_pages --;
+  pagecache_nr_pages --;
+
+  physmem_unref_physpage(page->ppage_paddr);
+  kvmm_cache_free((__u32)page);
+
+  mapping_try_release(mapping);
+}
+
+
+/**
+ * Release up to nb_pages pages from the head of the LRU list. Pages
+ * still referenced by someone else than the cache (ie mapped in user
+ * space, in use by the kernel or being written back) are skipped, and
+ * so are the dirty pages unless they may be written back
+ */
+static __u32 pagecache_shrink(__u32 nb_pages, bool can_writeback)
+{
+  struct pagecache_page * page, * next;
+  __u32 nb_released = 0;
+  __u32 nb_scanned, nb_lru = pagecache_nr_pages;
+
+  page = list_get_head_named(lru_pages, prev_lru, next_lru);
+  for (nb_scanned = 0 ;
+       page && (nb_scanned < nb_lru) && (nb_released < nb_pages) ;
+       nb_scanned ++, page = next)
+    {
+      next = page->next_lru;
+
+      if (page->writeback
+	  || (physmem_get_physpage_refcount(page->ppage_paddr) > 1))
+	continue;
+
+      /* Nowhere to write the page back to */
+      if (! page->mapping->ops->writepage)
+	continue;
+
+      if (page->dirty)
+	{
+	  if (! can_writeback)
+	    continue;
+
+	  /* The storage fails: do not insist */
+	  if (OK != page_writeback(page))
+	    break;
+
+	  /* The cache was unlocked during the I/O: start again from the
+	     head of the LRU, where the page most probably still is */
+	  next = list_get_head_named(lru_pages, prev_lru, next_lru);
+	  continue;
+	}
+
+      if (next == page)
+	next = NULL;
+      page_evict(page);
+      nb_released ++;
+    }
+
+  return nb_released;
+}
+
+
+__u32 pagecache_reclaim(__u32 nb_pages)
+{
+  __u32 nb_released;
+
+  /* Called from within the cache itself: the lists are being
+     modified, give up. Before the first process, the owner of the
+     lock cannot be told apart from the others */
+  if (! current || (OK != kmutex_trylock(& pagecache_mutex)))
+    return 0;
+
+  nb_released = pagecache_shrink(nb_pages, false);
+  kmutex_unlock(& pagecache_mutex);
+
+  return nb_released;
+}
+
+
+int pagecache_subsystem_setup()
+{
+  __u32 total_ppages, nonfree_ppages;
+
+  cache_of_mappings
+    = kvmm_cache_create("Page cache files",
+			sizeof(struct pagecache_mapping),
+			1, 0,
+			KSLAB_CREATE_MAP | KSLAB_CREATE_ZERO);
+  cache_of_pages
+    = kvmm_cache_create("Page cache pages",
+			sizeof(struct pagecache_page),
+			1, 0,
+			KSLAB_CREATE_MAP | KSLAB_CREATE_ZERO);
+  cache_of_radix_nodes
+    = kvmm_cache_create("Page cache radix nodes",
+			sizeof(struct radix_node),
+			1, 0,
+			KSLAB_CREATE_MAP | KSLAB_CREATE_ZERO);
+  if (! cache_of_mappings || ! cache_of_pages || ! cache_of_radix_nodes)
+    {
+      debug();
+      return -ENOMEM;
+    }
+
+  kmutex_init(& pagecache_mutex, "Page cache");
+  kwaitq_init(& pagecache_writeback_wait, "Page cache write-back");
+
+  physmem_get_state(& total_ppages, & nonfree_ppages);
+  pagecache_dirty_limit = total_ppages / 100 * PAGECACHE_DIRTY_RATIO;
+
+  return physmem_set_reclaim_func(pagecache_reclaim);
+}
+
+
+struct pagecache_mapping *
+pagecache_ref_mapping(void * host, unsigned long ino,
+		      struct pagecache_ops * ops)
+{
+  struct pagecache_mapping * mapping;
+  int bucket = mapping_hash_of(host, ino);
+  int nb_elts;
+
+  kmutex_lock(& pagecache_mutex);
+  list_foreach(mapping_hash[bucket], mapping, nb_elts)
+    {
+      if ((mapping->host == host) && (mapping->ino == ino))
+	{
+	  mapping->ref_cnt ++;
+	  kmutex_unlock(& pagecache_mutex);
+	  return mapping;
+	}
+    }
+
+  mapping = (struct pagecache_mapping*) kvmm_cache_alloc(cache_of_mappings, 0);
+  if (mapping)
+    {
+      mapping->host    = host;
+      mapping->ino     = ino;
+      mapping->ops     = ops;
+      mapping->ref_cnt = 1;
+      list_add_head(mapping_hash[bucket], mapping);
+    }
+  kmutex_unlock(& pagecache_mutex);
+
+  return mapping;
+}
+
+
+int pagecache_unref_mapping(struct pagecache_mapping * mapping)
+{
+  kmutex_lock(& pagecache_mutex);
+  if (mapping->ref_cnt <= 0)
+    {
+      kmutex_unlock(& pagecache_mutex);
+      debug();
+      return -EINVAL;
+    }
+
+  mapping->ref_cnt --;
+  mapping_try_release(mapping);
+  kmutex_unlock(& pagecache_mutex);
+  return OK;
+}
+
+
+void * pagecache_get_host(struct pagecache_mapping * mapping)
+{
+  return mapping->host;
+}
+
+
+unsigned long pagecache_get_ino(struct pagecache_mapping * mapping)
+{
+  return mapping->ino;
+}
+
+
+__u32 pagecache_ref_page(struct pagecache_mapping * mapping,
+			 __u32 index, bool read_page)
+{
+  struct pagecache_page * page;
+  __u32 ppage_paddr, nonfree_ppages, total_ppages;
+  int retval;
+
+  kmutex_lock(& pagecache_mutex);
+
+ retry:
+  page = radix_lookup(mapping, index);
+  if (page)
+    {
+      pagecache_hits ++;
+
+      /* Most recently used page: move it at the tail of the LRU */
+      list_delete_named(lru_pages, page, prev_lru, next_lru);
+      list_add_tail_named(lru_pages, page, prev_lru, next_lru);
+
+      physmem_ref_physpage_at(page->ppage_paddr);
+      kmutex_unlock(& pagecache_mutex);
+      return page->ppage_paddr;
+    }
+
+  pagecache_misses ++;
+
+  /* Running out of memory: make some room before adding a page,
+     writing dirty pages back if needed */
+  physmem_get_state(& total_ppages, & nonfree_ppages);
+  if (total_ppages - nonfree_ppages < PAGECACHE_LOW_WATERMARK)
+    pagecache_shrink(PHYSMEM_RECLAIM_BATCH, true);
+
+  /* The page is read with the cache unlocked */
+  kmutex_unlock(& pagecache_mutex);
+
+  ppage_paddr = physmem_ref_physpage_new(false);
+  if (! ppage_paddr)
+    return (__u32)NULL;
+
+  if (read_page)
+    {
+      if (OK != mapping->ops->readpage(mapping, index, (void*)ppage_paddr))
+	{
+	  physmem_unref_physpage(ppage_paddr);
+	  return (__u32)NULL;
+	}
+    }
+  else
+    memzero_page((void*)ppage_paddr);
+
+  page = (struct pagecache_page*) kvmm_cache_alloc(cache_of_pages, 0);
+  if (! page)
+    {
+      physmem_unref_physpage(ppage_paddr);
+      return (__u32)NULL;
+    }
+
+  page->mapping     = mapping;
+  page->index       = index;
+  page->ppage_paddr = ppage_paddr;
+  page->dirty       = false;
+  page->writeback   = false;
+
+  kmutex_lock(& pagecache_mutex);
+  retval = radix_insert(mapping, index, page);
+  if (OK != retval)
+    {
+      physmem_unref_physpage(ppage_paddr);
+      kvmm_cache_free((__u32)page);
+
+      /* Somebody else added the page while we were reading it: that
+	 one is the page of the cache */
+      if (-EEXIST == retval)
+	goto retry;
+
+      kmutex_unlock(& pagecache_mutex);
+      return (__u32)NULL;
+    }
+
+  list_add_tail_named(mapping->list_pages, page,
+		      prev_in_mapping, next_in_mapping);
+  list_add_tail_named(lru_pages, page, prev_lru, next_lru);
+  mapping->nr_pages ++;
+  pagecache_nr_pages ++;
+
+  /* One reference for the cache, one for the caller */
+  physmem_ref_physpage_at(ppage_paddr);
+  kmutex_unlock(& pagecache_mutex);
+  return ppage_paddr;
+}
+
+
+int pagecache_set_dirty(struct pagecache_mapping * mapping, __u32 index)
+{
+  struct pagecache_page * page;
+  bool over_limit = false;
+
+  kmutex_lock(& pagecache_mutex);
+  page = radix_lookup(mapping, index);
+  if (! page)
+    {
+      kmutex_unlock(& pagecache_mutex);
+      return -ENOENT;
+    }
+
+  /* A page being written back gets dirty again: the data being
+     written may already be outdated. The pages of the memory-only
+     files stay dirty, they are left out of the limit */
+  if (! page->dirty)
+    {
+      page->dirty = true;
+      if (! mapping->ops->writepage)
+	goto out;
+
+      if (mapping->nr_dirty ++ == 0)
+	mapping->dirtied_when = clock_ticks;
+      pagecache_nr_dirty ++;
+      over_limit = (pagecache_nr_dirty > pagecache_dirty_limit);
+    }
+
+ out:
+  kmutex_unlock(& pagecache_mutex);
+
+  /* Too much data would be lost: do not wait for it to expire */
+  if (over_limit)
+    writeback_kick();
+
+  return OK;
+}
+
+
+int pagecache_discard_page(struct pagecache_mapping * mapping, __u32 index)
+{
+  struct pagecache_page * page;
+  int retval = OK;
+
+  kmutex_lock(& pagecache_mutex);
+  page = radix_lookup(mapping, index);
+  if (! page)
+    retval = -ENOENT;
+  else if (page->dirty || page->writeback
+	   || (physmem_get_physpage_refcount(page->ppage_paddr) > 1))
+    retval = -EBUSY;
+  else
+    page_evict(page);
+  kmutex_unlock(& pagecache_mutex);
+
+  return retval;
+}
+
+
+/** Sort the pages by index (Shell sort, with Knuth's gaps) */
+static void sort_pages_by_index(struct pagecache_page ** pages, __u32 nb)
+{
+  __u32 gap, i, j;
+
+  for (gap = 1 ; gap < nb / 3 ; gap = 3 * gap + 1)
+    continue;
+
+  for ( ; gap > 0 ; gap /= 3)
+    for (i = gap ; i < nb ; i++)
+      {
+	struct pagecache_page * page = pages[i];
+	for (j = i ; (j >= gap) && (pages[j - gap]->index > page->index) ;
+	     j -= gap)
+	  pages[j] = pages[j - gap];
+	pages[j] = page;
+      }
+}
+
+
+/**
+ * Write back the runs of consecutive pages of the sorted array, whose
+ * write-back was started. The cache is unlocked during the I/O
+ */
+static int writeback_runs(struct pagecache_mapping * mapping,
+			  struct pagecache_page ** pages, __u32 nb)
+{
+  const void * run[PAGECACHE_WRITEBACK_BATCH];
+  __u32 i, start, len;
+  int io_status, retval = OK;
+
+  for (start = 0 ; start < nb ; start += len)
+    {
+      for (len = 1 ;
+	   (start + len < nb) && (len < PAGECACHE_WRITEBACK_BATCH)
+	     && (pages[start + len]->index == pages[start]->index + len) ;
+	   len ++)
+	continue;
+
+      for (i = 0 ; i < len ; i++)
+	run[i] = (const void*)pages[start + i]->ppage_paddr;
+
+      kmutex_unlock(& pagecache_mutex);
+      io_status = mapping->ops->writepages(mapping, pages[start]->index,
+					   len, run);
+      kmutex_lock(& pagecache_mutex);
+
+      if (OK != io_status)
+	retval = -EIO;
+      for (i = 0 ; i < len ; i++)
+	page_end_writeback(pages[start + i], io_status);
+    }
+
+  return retval;
+}
+
+
+/** First dirty page of the mapping not being written back, if any */
+static struct pagecache_page *
+mapping_get_dirty_page(struct pagecache_mapping * mapping)
+{
+  struct pagecache_page * page;
+  int nb_elts;
+
+  list_foreach_named(mapping->list_pages, page, nb_elts,
+		     prev_in_mapping, next_in_mapping)
+    {
+      if (page->dirty && ! page->writeback)
+	return page;
+    }
+
+  return NULL;
+}
+
+
+int pagecache_sync(struct pagecache_mapping * mapping)
+{
+  struct pagecache_page * page;
+  struct pagecache_page ** dirty = NULL;
+  __u32 nb_dirty = 0, nr_dirty;
+  int nb_elts, retval = OK;
+
+  kmutex_lock(& pagecache_mutex);
+
+  /* Make sure the mapping is not released under our feet */
+  mapping->ref_cnt ++;
+
+  /* The pages being written back may be outdated already: wait for
+     them, so that all the data written so far reaches the storage */
+ rescan:
+  list_foreach_named(mapping->list_pages, page, nb_elts,
+		     prev_in_mapping, next_in_mapping)
+    {
+      if (page->writeback)
+	{
+	  pagecache_wait_writeback();
+	  goto rescan;
+	}
+    }
+
+  /* Memory-only file: the pages are their only copy */
+  nr_dirty = mapping->nr_dirty;
+  if ((nr_dirty == 0) || ! mapping->ops->writepage)
+    goto out;
+
+  /* Without room to sort them, the pages are written one by one */
+  if (mapping->ops->writepages)
+    dirty = (struct pagecache_page **)
+      kmalloc(nr_dirty * sizeof(struct pagecache_page *), 0);
+
+  if (dirty)
+    {
+      list_foreach_named(mapping->list_pages, page, nb_elts,
+			 prev_in_mapping, next_in_mapping)
+	{
+	  if (page->dirty && (nb_dirty < nr_dirty))
+	    {
+	      page_start_writeback(page);
+	      dirty[nb_dirty ++] = page;
+	    }
+	}
+
+      sort_pages_by_index(dirty, nb_dirty);
+      retval = writeback_runs(mapping, dirty, nb_dirty);
+      kfree((__u32)dirty);
+    }
+  else
+    {
+      /* The list may change during each I/O: look for the next page
+	 from its head. The pages that cannot be written stay dirty,
+	 hence the bound */
+      for ( ; nr_dirty > 0 ; nr_dirty --)
+	{
+	  page = mapping_get_dirty_page(mapping);
+	  if (! page)
+	    break;
+	  if (OK != page_writeback(page))
+	    retval = -EIO;
+	}
+    }
+
+ out:
+  mapping->ref_cnt --;
+  mapping_try_release(mapping);
+  kmutex_unlock(& pagecache_mutex);
+  return retval;
+}
+
+
+int pagecache_sync_all()
+{
+  return pagecache_sync_older(0);
+}
+
+
+/** Whether the mapping has pages dirty for at least age clock ticks */
+static bool mapping_needs_sync(struct pagecache_mapping * mapping,
+			       __u32 age)
+{
+  if (mapping->nr_dirty == 0)
+    return false;
+  return (! age) || (clock_ticks - mapping->dirtied_when >= age);
+}
+
+
+int pagecache_sync_older(__u32 age)
+{
+  struct pagecache_mapping * mapping;
+  struct pagecache_mapping ** to_sync;
+  __u32 nb_to_sync = 0, nb_max = 0, i;
+  int bucket, nb_elts, retval = OK;
+
+  kmutex_lock(& pagecache_mutex);
+  for (bucket = 0 ; bucket < PAGECACHE_HASH_SIZE ; bucket ++)
+    list_foreach(mapping_hash[bucket], mapping, nb_elts)
+      {
+	if (mapping_needs_sync(mapping, age))
+	  nb_max ++;
+      }
+
+  if (nb_max == 0)
+    {
+      kmutex_unlock(& pagecache_mutex);
+      return OK;
+    }
+
+  to_sync = (struct pagecache_mapping **)
+    kmalloc(nb_max * sizeof(struct pagecache_mapping *), 0);
+  if (! to_sync)
+    {
+      kmutex_unlock(& pagecache_mutex);
+      return -ENOMEM;
+    }
+
+  /* The hash table may change while the files are written: keep them
+     in the array, referenced */
+  for (bucket = 0 ; bucket < PAGECACHE_HASH_SIZE ; bucket ++)
+    list_foreach(mapping_hash[bucket], mapping, nb_elts)
+      {
+	if (mapping_needs_sync(mapping, age) && (nb_to_sync < nb_max))
+	  {
+	    mapping->ref_cnt ++;
+	    to_sync[nb_to_sync ++] = mapping;
+	  }
+      }
+  kmutex_unlock(& pagecache_mutex);
+
+  for (i = 0 ; i < nb_to_sync ; i++)
+    if (OK != pagecache_sync(to_sync[i]))
+      retval = -EIO;
+
+  kmutex_lock(& pagecache_mutex);
+  for (i = 0 ; i < nb_to_sync ; i++)
+    {
+      to_sync[i]->ref_cnt --;
+      mapping_try_release(to_sync[i]);
+    }
+  kmutex_unlock(& pagecache_mutex);
+
+  kfree((__u32)to_sync);
+  return retval;
+}
+
+
+void pagecache_invalidate_host(void * host)
+{
+  struct pagecache_mapping * mapping;
+  int bucket, nb_elts;
+
+  kmutex_lock(& pagecache_mutex);
+  for (bucket = 0 ; bucket < PAGECACHE_HASH_SIZE ; bucket ++)
+    {
+    rescan:
+      list_foreach(mapping_hash[bucket], mapping, nb_elts)
+	{
+	  if (mapping->host != host)
+	    continue;
+
+	  /* Out of the hash table: a new host at the same address does
+	     not find it. Its users keep it until they release it */
+	  list_delete(mapping_hash[bucket], mapping);
+	  mapping->host = NULL;
+
+	  mapping->ref_cnt ++;
+	  while (mapping->list_pages)
+	    {
+	      if (mapping->list_pages->writeback)
+		pagecache_wait_writeback();
+	      else
+		page_evict(mapping->list_pages);
+	    }
+	  mapping->ref_cnt --;
+	  mapping_try_release(mapping);
+
+	  /* The list changed under the iterator */
+	  goto rescan;
+	}
+    }
+  kmutex_unlock(& pagecache_mutex);
+}
+
+
+__u32 pagecache_get_nr_dirty()
+{
+  return pagecache_nr_dirty;
+}
+
+
+bool pagecache_over_dirty_limit()
+{
+  return pagecache_nr_dirty > pagecache_dirty_limit;
+}
+
+
+int pagecache_truncate(struct pagecache_mapping * mapping, __u64 size)
+{
+  struct pagecache_page * page, * next;
+  __u32 first_dropped = (size + PAGE_SIZE - 1) >> PAGE_SHIFT;
+  __u32 nb_pages;
+  __u32 i;
+
+  kmutex_lock(& pagecache_mutex);
+
+  /* Make sure the mapping is not released under our feet */
+  mapping->ref_cnt ++;
+
+ rescan:
+  nb_pages = mapping->nr_pages;
+  page = list_get_head_named(mapping->list_pages,
+			     prev_in_mapping, next_in_mapping);
+  for (i = 0 ; page && (i < nb_pages) ; i++, page = next)
+    {
+      next = page->next_in_mapping;
+      if (next == page)
+	next = NULL;
+
+      /* Reset the end of the last page */
+      if ((size & PAGE_MASK) && (page->index == (size >> PAGE_SHIFT)))
+	{
+	  __u32 in_page = size & PAGE_MASK;
+	  memset((void*)(page->ppage_paddr + in_page), 0x0,
+		 PAGE_SIZE - in_page);
+	  continue;
+	}
+
+      if (page->index < first_dropped)
+	continue;
+
+      /* The I/O uses the page: wait for it, the list may change
+	 meanwhile */
+      if (page->writeback)
+	{
+	  pagecache_wait_writeback();
+	  goto rescan;
+	}
+
+      /* Pages still mapped in user space stay out of the cache, their
+	 mappers keep their own reference */
+      page_evict(page);
+    }
+
+  mapping->ref_cnt --;
+  mapping_try_release(mapping);
+  kmutex_unlock(& pagecache_mutex);
+  return OK;
+}
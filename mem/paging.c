@@ -28,6 +28,7 @@
 #include <debug.h>
 #include <process.h>
 #include <list.h>
+#include <kerrno.h>
 
 /** Structure of the x86 CR3 register: the Page Directory Base
     Register. See Intel x86 doc Vol 3 section 2.5 */
@@ -78,13 +79,18 @@ void paging_init()
                 1: \n \
                 movl $2f, %%eax\n \
                 jmp *%%eax\n \
-                2:\n" :: "m"(page_directory), "i" (PAGING_FLAG) , "i"(PSE_FLAG));
+                2:\n" :: "m"(page_directory), "i" (PAGING_FLAG | WP_FLAG) , "i"(PSE_FLAG));
 
 
              
 }
 
 __u32 paging_map(__u32 virtual, __u32 physical, bool user)
+{
+  return paging_map_prot(virtual, physical, user, P_READ | P_WRITE);
+}
+
+__u32 paging_map_prot(__u32 virtual, __u32 physical, bool user, __u32 prot)
 {
 
 
@@ -110,14 +116,60 @@ __u32 paging_map(__u32 virtual, __u32 physical, bool user)
 
 	/* Changing the entry in the page table */
 	pte = (__u32 *) (0xFFC00000 | (((__u32) virtual & 0xFFFFF000) >> 10));
-	*pte = ((__u32) physical) | 1 | 2 | (user ? 4: 0);
+	*pte = ((__u32) physical) | P_PRESENT
+	  | ((prot & P_WRITE) ? P_WRITE : 0) | (user ? P_USER : 0)
+	  | (prot & P_NOCACHE);
+	flush_tlb_single(virtual);
 
+       return 0;
+}
 
+int paging_try_resolve_COW(__u32 uaddr)
+{
+  __u32 *pde;
+  __u32 *pte;
+  __u32 ppage_paddr, new_ppage_paddr;
 
-              
-       
- 
-       return 0;
+  uaddr = PAGE_ALIGN_INF(uaddr);
+
+  pde = (__u32 *) (0xFFFFF000 | ((uaddr & 0xFFC00000) >> 20));
+  if ((*pde & P_PRESENT) == 0)
+    return -EFAULT;
+
+  pte = (__u32 *) (0xFFC00000 | ((uaddr & 0xFFFFF000) >> 10));
+  if ((*pte & P_PRESENT) == 0)
+    return -EFAULT;
+
+  /* Already writable: another fault resolved it before us */
+  if (*pte & P_WRITE)
+    return OK;
+
+  ppage_paddr = *pte & 0xFFFFF000;
+
+  /* We are the only user of the page: no need to copy it */
+  if ((ppage_paddr != zero_page)
+      && (physmem_get_physpage_refcount(ppage_paddr) == 1))
+    {
+      *pte |= P_WRITE;
+      flush_tlb_single(uaddr);
+      return OK;
+    }
+
+  /* Shared page: duplicate it. The reference returned by
+     physmem_ref_physpage_new() is the one owned by the PTE */
+  new_ppage_paddr = physmem_ref_physpage_new(false);
+  if (! new_ppage_paddr)
+    return -ENOMEM;
+
+  /* Physical memory is identity-mapped in kernel space */
+  memcpy_page((void*)new_ppage_paddr, (void*)uaddr);
+
+  *pte = new_ppage_paddr | (*pte & (P_USER | P_ACCESSED))
+    | P_PRESENT | P_WRITE;
+  flush_tlb_single(uaddr);
+
+  physmem_unref_physpage(ppage_paddr);
+  return OK;
 }
 
 __u32 paging_unmap(__u32 virtual)
@@ -131,6 +183,10 @@ __u32 phys = paging_virtual_to_physical(page_directory,virtual);
         kprintf("Virtual address not page-aligned\n");
           return 1;
           }
+
+        /* Nothing mapped here (the page table itself may be absent) */
+        if (! phys)
+          return 1;
   	
 		pte = (__u32 *) (0xFFC00000 | (((__u32) virtual & 0xFFFFF000) >> 10));
 		*pte = (*pte & (~P_PRESENT));
@@ -179,6 +235,20 @@ __u32 paging_virtual_to_physical(__u32* page_directory, __u32 virtual){
 
 
 
+bool paging_is_dirty(__u32 vaddr)
+{
+  __u32 *pde;
+  __u32 *pte;
+
+  pde = (__u32 *) (0xFFFFF000 | ((vaddr & 0xFFC00000) >> 20));
+  if ((*pde & P_PRESENT) == 0)
+    return false;
+
+  pte = (__u32 *) (0xFFC00000 | ((vaddr & 0xFFFFF000) >> 10));
+  return ((*pte & (P_PRESENT | P_DIRTY)) == (P_PRESENT | P_DIRTY));
+}
+
+
 __u32*  paging_get_current_PD()
 {
   __u32 * pd;
@@ -232,7 +302,7 @@ int paging_pd_add_pt(char *vaddr, __u32 *pd)
     debug();
     return -3;
     }
-  memset((void*)pg_vaddr, 0x0, PAGE_SIZE);
+  memzero_page((void*)pg_vaddr);
 
   
   /* Keep a reference to the underlying pphysical page... */
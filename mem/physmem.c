@@ -61,6 +61,17 @@ static __u32   physmem_base, physmem_top;
 /** We store the number of pages used/free */
 static __u32  physmem_total_pages, physmem_used_pages;
 
+/** Called when the free list is empty to give some pages back */
+static physmem_reclaim_func_t physmem_reclaim_func;
+
+__u32 physmem_get_core_top(size_t ram_size)
+{
+  ram_size = PAGE_ALIGN_INF(ram_size);
+  return PAGE_DESCR_ARRAY_ADDR
+    + PAGE_ALIGN_SUP(  (ram_size >> PAGE_SHIFT)
+		       * sizeof(struct physical_page_descr));
+}
+
 int  physmem_setup(size_t ram_size,
 			    /* out */__u32   *kernel_core_base,
 			    /* out */__u32   *kernel_core_top)
@@ -81,10 +92,7 @@ int  physmem_setup(size_t ram_size,
   /* Make sure that there is enough memory to store the array of page
      descriptors */
   *kernel_core_base = PAGE_ALIGN_INF((__u32  )(& __b_kernel));
-  *kernel_core_top
-    = PAGE_DESCR_ARRAY_ADDR
-      + PAGE_ALIGN_SUP(  (ram_size >> PAGE_SHIFT)
-			    * sizeof(struct physical_page_descr));
+  *kernel_core_top = physmem_get_core_top(ram_size);
   if (*kernel_core_top > ram_size)
     return -3;
 
@@ -176,6 +184,10 @@ __u32   physmem_ref_physpage_new(bool can_block)
 {
   struct physical_page_descr *ppage_descr;
  
+  /* Out of memory: ask the caches to release some of their pages */
+  if (!free_ppage && physmem_reclaim_func)
+    physmem_reclaim_func(PHYSMEM_RECLAIM_BATCH);
+
  if(!free_ppage)
           return (__u32  )NULL;
 
@@ -278,6 +290,35 @@ int physmem_unref_physpage(__u32   ppage_paddr)
   return retval;
 }
 
+int physmem_get_state(/* out */__u32 *total_ppages,
+		      /* out */__u32 *nonfree_ppages)
+{
+  if (total_ppages)
+    *total_ppages = physmem_total_pages;
+  if (nonfree_ppages)
+    *nonfree_ppages = physmem_used_pages;
+  return 0;
+}
+
+
+int physmem_set_reclaim_func(physmem_reclaim_func_t func)
+{
+  physmem_reclaim_func = func;
+  return 0;
+}
+
+
+int physmem_get_physpage_refcount(__u32 ppage_paddr)
+{
+  struct physical_page_descr *ppage_descr
+    = get_page_descr_at_paddr(ppage_paddr);
+
+  if (! ppage_descr)
+    return -1;
+
+  return ppage_descr->ref_cnt;
+}
+
 struct kvmm_range* physmem_get_kvmm_range(__u32 ppage_paddr)
 {
   struct physical_page_descr *ppage_descr
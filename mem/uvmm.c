@@ -35,6 +35,7 @@ struct uvmm_as
 
 
   /* Page fault counters */
+  __u32 pgflt_cow;
   __u32 pgflt_page_in;
   __u32 pgflt_invalid;
 };
@@ -198,13 +199,15 @@ int uvmm_delete_as(struct uvmm_as * as)
 
       /* Signal to the underlying arena mapper that the mapping is
 	 suppressed */
-      if (arena->ops)
-	{
-	  if (arena->ops->unmap)
-	    arena->ops->unmap(arena, arena->start, arena->size);
-	  if (arena->ops->unref)
-	    arena->ops->unref(arena);
-	}
+      if (arena->ops && arena->ops->unmap)
+	arena->ops->unmap(arena, arena->start, arena->size);
+
+      /* Release the pages mapped by the arena. The address space is
+	 the current one: we are either exiting, or building it */
+      as->phys_total -= paging_unmap_interval(arena->start, arena->size);
+
+      if (arena->ops && arena->ops->unref)
+	arena->ops->unref(arena);
 
       kvmm_cache_free((__u32)arena);
     }
@@ -452,7 +455,7 @@ int uvmm_unmap(struct uvmm_as * as,
 	  
 	  /* Signal unmapping */
 	  if (arena->ops && arena->ops->unmap)
-	    arena->ops->unmap(arena, uaddr + size,
+	    arena->ops->unmap(arena, arena->start - translation,
 			   translation);
 	  
 	  /* Account for change in arenas */
@@ -494,9 +497,8 @@ int uvmm_unmap(struct uvmm_as * as,
 
     
 
+    /* The pages never touched are not mapped: nothing to release */
     __u32 sz_unmapped = paging_unmap_interval(uaddr, size);
-
-    if( 0 >= sz_unmapped) debug();
     as->phys_total -= sz_unmapped;
       
 
@@ -1111,6 +1113,27 @@ int uvmm_lazy_loading(__u32 uaddr,
     }
 
 
+  /* Write access to a page already present: this is either a
+     copy-on-write page, or a real protection violation */
+  if (write_access
+      && paging_virtual_to_physical(page_directory, uaddr))
+    {
+      if (! (arena->access_rights & P_WRITE))
+	{
+	  as->pgflt_invalid ++;
+	  return -EFAULT;
+	}
+
+      if (OK != paging_try_resolve_COW(uaddr))
+	{
+	  as->pgflt_invalid ++;
+	  return -ENOMEM;
+	}
+
+      as->pgflt_cow ++;
+      return OK;
+    }
+
   /* Ask the underlying resource to resolve the page fault */
   if ( 0 != arena->ops->no_page(arena, uaddr, write_access))
     {
@@ -44,3 +44,18 @@ void init_pic(void)
 }
 
 
+// Acknowledge the IRQ: the lines 8-15 are on the slave, cascaded on line 2
+void pic_eoi(int irq)
+{
+	if (irq >= 8)
+		outb(0xA0, 0x20);
+	outb(0x20, 0x20);
+}
+
+
+// Mask all the lines, when the IRQs are routed through the IOAPIC
+void pic_disable(void)
+{
+	outb(0xA1, 0xFF);
+	outb(0x21, 0xFF);
+}
@@ -22,8 +22,14 @@
 #include <process.h>
 #include <klibc.h>
 #include <uvmm.h>
+#include <kvmm.h>
+#include <physmem.h>
+#include <kerrno.h>
 #include <debug.h>
 
+/* sched.S */
+void process_user_entry(void);
+
 
 int  process_set_address_space(struct process *proc,
 					struct uvmm_as *new_as)
@@ -56,4 +62,37 @@ int process_get_state(const struct process *proc){
 }
 
 
-
+int process_init_context(struct process *proc,
+			 __u32 user_eip, __u32 user_esp)
+{
+  __u32 kstack, *sp;
+  int i;
+
+  kstack = kvmm_alloc(PROCESS_KSTACK_PAGES, KVMM_MAP);
+  if (! kstack)
+    return -ENOMEM;
+
+  proc->kstack.ss0 = 0x18;
+  proc->kstack.esp0 = kstack + PROCESS_KSTACK_PAGES * PAGE_SIZE;
+
+  sp = (__u32*) proc->kstack.esp0;
+
+  /* The frame of an interrupt from user mode, see SAVE_REGS */
+  *--sp = 0x33;			/* ss */
+  *--sp = user_esp;
+  *--sp = 0x200;		/* eflags: IRQs enabled */
+  *--sp = 0x23;			/* cs */
+  *--sp = user_eip;
+  for (i = 0; i < 8; i++)	/* pushal */
+    *--sp = 0;
+  for (i = 0; i < 4; i++)	/* ds, es, fs, gs */
+    *--sp = 0x2B;
+
+  /* What switch_context() pops */
+  *--sp = (__u32) process_user_entry;
+  for (i = 0; i < 4; i++)	/* ebp, ebx, esi, edi */
+    *--sp = 0;
+
+  proc->regs.esp = (__u32) sp;
+  return OK;
+}
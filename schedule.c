@@ -21,206 +21,104 @@
 #include <gdt.h>
 #include <process.h>
 #include <mm.h>
+#include <kvmm.h>
+#include <physmem.h>
+#include <interrupt.h>
+#include <schedule.h>
+#include <fpu.h>
 
-void switch_to_task(int n, int mode)
+/* sched.S */
+void switch_context(struct process *prev, struct process *next);
+
+
+/*
+ * A process that exits still runs on its kernel stack and its page
+ * directory until it leaves the CPU: they are released here, by the
+ * next call to schedule()
+ */
+static void reap_zombies(void)
 {
-        __u32 kesp, eflags;
-        __u16 kss, ss, cs;
-
-        current = &p_list[n];
-        current->state = PROC_RUNNING;
-
-        /* load tss */
-        default_tss.ss0 = current->kstack.ss0;
-        default_tss.esp0 = current->kstack.esp0;
-              
-        /*
-         Stacks ss register, esp, eflags, cs and eip has the necessary
-         switching. Then the do_switch () function restores
-         registers, the page table of the new process and switches
-         with iret.
-         */
-        ss = current->regs.ss;
-        cs = current->regs.cs;
-        eflags = (current->regs.eflags | 0x200) & 0xFFFFBFFF;
-
-        if (mode == USERMODE) {
-                kss = current->kstack.ss0;
-                kesp = current->kstack.esp0;
-        } else {                /*KERNELMODE */
-                kss = current->regs.ss;
-                kesp = current->regs.esp;
-        }
+        int i;
 
-        asm("   mov %0, %%ss; \
-                mov %1, %%esp; \
-                cmp %[KMODE], %[mode]; \
-                je next; \
-                push %2; \
-                push %3; \
-                next: \
-                push %4; \
-                push %5; \
-                push %6; \
-                push %7; \
-                ljmp $0x08, $do_switch"
-                :: \
-                "m"(kss), \
-                "m"(kesp), \
-                "m"(ss), \
-                "m"(current->regs.esp), \
-                "m"(eflags), \
-                "m"(cs), \
-                "m"(current->regs.eip), \
-                "m"(current), \
-                [KMODE] "i"(KERNELMODE), \
-                [mode] "g"(mode)
-            );
+        for (i = 1; i < MAXPID; i++) {
+                struct process *p = &p_list[i];
+
+                if (p->state != PROC_ZOMBIE || p == current)
+                        continue;
+
+                kvmm_free(p->kstack.esp0 - PROCESS_KSTACK_PAGES * PAGE_SIZE);
+                /* The kernel threads use the kernel page directory */
+                if (p->regs.cr3 != (__u32) page_directory)
+                        physmem_unref_physpage(p->regs.cr3);
+                p->state = PROC_STOPPED;
+                num_proc--;
+        }
 }
 
 
-void schedule(void) 
+/*
+ * Round robin over the ready processes, starting after the current
+ * one. The kernel process (pid 0) only runs when no other can.
+ */
+static struct process *pick_next(void)
 {
-         struct process *p;         
-	__u32* stack_ptr;
-        int i,newpid ;
-
-	asm("mov (%%ebp), %%eax; mov %%eax, %0" : "=m" (stack_ptr) : );
-
-        current->state = PROC_READY;
-
-	if (!num_proc) {
-		return;
-	}
-
-	/* If there is a single process, let it run */
-	else if (num_proc == 1 && current->pid != 0) {
-		return;
-	}
-
-	/* If there are at least two processes, moves following */
-	else {
-		/* Save the registers of the current process*/
-		current->regs.eflags = stack_ptr[16];
-                current->regs.cs = stack_ptr[15];
-                current->regs.eip = stack_ptr[14];
-                current->regs.eax = stack_ptr[13];
-                current->regs.ecx = stack_ptr[12];
-                current->regs.edx = stack_ptr[11];
-                current->regs.ebx = stack_ptr[10];
-                current->regs.ebp = stack_ptr[8];
-                current->regs.esi = stack_ptr[7];
-                current->regs.edi = stack_ptr[6];
-                current->regs.ds = stack_ptr[5];
-                current->regs.es = stack_ptr[4];
-                current->regs.fs = stack_ptr[3];
-                current->regs.gs = stack_ptr[2];
-
-		current->regs.esp = stack_ptr[17];
-		current->regs.ss = stack_ptr[18];
-		
-		
-	        if (current->regs.cs != 0x08) {
-                        current->regs.esp = stack_ptr[17];
-                        current->regs.ss = stack_ptr[18];
-                } else {        /* Interruption during a system call */
-                        current->regs.esp = stack_ptr[9] + 12;
-                        current->regs.ss = default_tss.ss0;
-                }
-
-                /* Save tss */
-                current->kstack.ss0 = default_tss.ss0;
-                current->kstack.esp0 = default_tss.esp0;
-                
-	}
-
-        newpid = 0;
-	for (i = current->pid + 1; i < MAXPID && newpid == 0; i++) {
-		if (p_list[i].state == PROC_READY )
-			newpid = i;
-	}
-
-	if (!newpid) {
-		for (i = 1; i < current->pid && newpid == 0; i++) {
-			if (p_list[i].state == PROC_READY)
-				newpid = i;
-		}
-	}
-
-	p = &p_list[newpid];
-
-
-	if (p->regs.cs != 0x08)
-		switch_to_task(p->pid, USERMODE);
-	else
-		switch_to_task(p->pid, KERNELMODE);
-
-                        
+        int i;
+
+        for (i = 1; i <= MAXPID; i++) {
+                int pid = (current->pid + i) % MAXPID;
+
+                if (pid != 0 && p_list[pid].state == PROC_READY)
+                        return &p_list[pid];
+        }
+
+        if (p_list[0].state == PROC_READY)
+                return &p_list[0];
+
+        return NULL;
 }
 
 
-void reschedule(int pid) 
+void schedule(void)
 {
+        struct process *prev = current;
+        struct process *next;
+        __u32 flags;
+
+        /* Too early: the kernel process is not set up */
+        if (!current)
+                return;
+
+        disable_IRQs(flags);
+
+        reap_zombies();
+
+        if (prev->state == PROC_RUNNING)
+                prev->state = PROC_READY;
+
+        /* The current process blocked and nothing else is ready:
+           wait for the interrupt that will wake somebody up */
+        while ((next = pick_next()) == NULL)
+                asm volatile("sti; hlt; cli");
+
+        next->state = PROC_RUNNING;
+
+        if (next != prev) {
+                current = next;
+
+                /* load tss */
+                default_tss.ss0 = next->kstack.ss0;
+                default_tss.esp0 = next->kstack.esp0;
+
+                /* load page table */
+                if (next->regs.cr3 != prev->regs.cr3)
+                        asm volatile("mov %0, %%cr3"::"r"(next->regs.cr3)
+                                     :"memory");
+
+                /* FPU/SSE registers: saved at the next use, if needed */
+                fpu_switch(next);
+
+                switch_context(prev, next);
+        }
 
-          struct process *p;         
-	__u32* stack_ptr;
-	
-  
-
-	asm("mov (%%ebp), %%eax; mov %%eax, %0" : "=m" (stack_ptr) : );
-
-
-	if (!num_proc) {
-		return;
-	}
-
-	/* If there is a single process, let it run */
-	else if (num_proc == 1 && current->pid != 0) {
-		return;
-	}
-
-	/* If there are at least two processes, moves following */
-	else {
-		/* Save the registers of the current process*/
-		current->regs.eflags = stack_ptr[16];
-                current->regs.cs = stack_ptr[15];
-                current->regs.eip = stack_ptr[14];
-                current->regs.eax = stack_ptr[13];
-                current->regs.ecx = stack_ptr[12];
-                current->regs.edx = stack_ptr[11];
-                current->regs.ebx = stack_ptr[10];
-                current->regs.ebp = stack_ptr[8];
-                current->regs.esi = stack_ptr[7];
-                current->regs.edi = stack_ptr[6];
-                current->regs.ds = stack_ptr[5];
-                current->regs.es = stack_ptr[4];
-                current->regs.fs = stack_ptr[3];
-                current->regs.gs = stack_ptr[2];
-
-		current->regs.esp = stack_ptr[17];
-		current->regs.ss = stack_ptr[18];
-		
-		
-	        if (current->regs.cs != 0x08) {
-                        current->regs.esp = stack_ptr[17];
-                        current->regs.ss = stack_ptr[18];
-                } else {        /* Interruption during a system call */
-                        current->regs.esp = stack_ptr[9] + 12;
-                        current->regs.ss = default_tss.ss0;
-                }
-
-                /* Save tss */
-                current->kstack.ss0 = default_tss.ss0;
-                current->kstack.esp0 = default_tss.esp0;
-
-           }
-
-
-        p = &p_list[pid];
-
-
-	if (p->regs.cs != 0x08)
-		switch_to_task(p->pid, USERMODE);
-	else
-		switch_to_task(p->pid, KERNELMODE);
+        restore_IRQs(flags);
 }
@@ -0,0 +1,159 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+
+#include <types.h>
+#include <klibc.h>
+#include <kerrno.h>
+#include <list.h>
+#include <interrupt.h>
+#include <softirq.h>
+
+/* Restarts of do_softirq() when softirqs are raised while it runs.
+   The rest waits for the next IRQ. */
+#define MAX_SOFTIRQ_RESTART 8
+
+static softirq_func_t softirq_funcs[NR_SOFTIRQS];
+static __u32 softirq_counts[NR_SOFTIRQS];
+
+static volatile __u32 softirq_pending;
+static bool softirq_running;
+
+/** The scheduled tasklets */
+static struct tasklet *tasklet_list;
+
+
+int softirq_register(int nr, softirq_func_t func)
+{
+  if (nr < 0 || nr >= NR_SOFTIRQS)
+    return -EINVAL;
+
+  softirq_funcs[nr] = func;
+  return OK;
+}
+
+
+void softirq_raise(int nr)
+{
+  __u32 flags;
+
+  disable_IRQs(flags);
+  softirq_pending |= (1 << nr);
+  restore_IRQs(flags);
+}
+
+
+bool in_softirq(void)
+{
+  return softirq_running;
+}
+
+
+__u32 softirq_get_count(int nr)
+{
+  if (nr < 0 || nr >= NR_SOFTIRQS)
+    return 0;
+
+  return softirq_counts[nr];
+}
+
+
+/* Called with the IRQs disabled, returns with the IRQs disabled */
+void do_softirq(void)
+{
+  int restart = MAX_SOFTIRQ_RESTART;
+  __u32 pending;
+
+  if (softirq_running || ! softirq_pending)
+    return;
+
+  softirq_running = true;
+
+  while (restart-- > 0 && (pending = softirq_pending) != 0)
+    {
+      int nr;
+
+      softirq_pending = 0;
+
+      /* The IRQs can be handled in the meantime */
+      asm volatile("sti");
+      for (nr = 0; nr < NR_SOFTIRQS; nr++)
+	if ((pending & (1 << nr)) && softirq_funcs[nr])
+	  {
+	    softirq_counts[nr]++;
+	    softirq_funcs[nr]();
+	  }
+      asm volatile("cli");
+    }
+
+  softirq_running = false;
+}
+
+
+void tasklet_init(struct tasklet *t,
+		  void (*func)(unsigned long data), unsigned long data)
+{
+  memset(t, 0x0, sizeof(struct tasklet));
+  t->func = func;
+  t->data = data;
+}
+
+
+void tasklet_schedule(struct tasklet *t)
+{
+  __u32 flags;
+
+  disable_IRQs(flags);
+  if (! t->scheduled)
+    {
+      t->scheduled = true;
+      list_add_tail(tasklet_list, t);
+      softirq_pending |= (1 << SOFTIRQ_TASKLET);
+    }
+  restore_IRQs(flags);
+}
+
+
+static void tasklet_softirq(void)
+{
+  struct tasklet *list;
+  __u32 flags;
+
+  /* The tasklets scheduled from here run at the next softirq */
+  disable_IRQs(flags);
+  list = tasklet_list;
+  tasklet_list = NULL;
+  restore_IRQs(flags);
+
+  while (! list_is_empty(list))
+    {
+      struct tasklet *t = list_pop_head(list);
+
+      disable_IRQs(flags);
+      t->scheduled = false;
+      restore_IRQs(flags);
+
+      t->func(t->data);
+    }
+}
+
+
+void softirq_subsystem_setup(void)
+{
+  softirq_register(SOFTIRQ_TASKLET, tasklet_softirq);
+}
@@ -63,8 +63,6 @@ void sys_exec(char * str, void const **argv )
      
         struct uvmm_as *new_as;
 
-        __u32 kstack = kvmm_alloc(1, KVMM_MAP);
-         
 
          pid = 1;
 	while (p_list[pid].state != PROC_STOPPED && pid++ < MAXPID);
@@ -106,27 +104,12 @@ process_set_address_space(&p_list[pid], new_as);
 
 
 
-	p_list[pid].regs.ss = 0x33;
-	p_list[pid].regs.esp =  ustack  ;
-	p_list[pid].regs.cs = 0x23;
-	p_list[pid].regs.eip = start_uaddr;
-	p_list[pid].regs.ds = 0x2B;
-        p_list[pid].regs.es = 0x2B;
-        p_list[pid].regs.fs = 0x2B;
-        p_list[pid].regs.gs = 0x2B;
         p_list[pid].regs.cr3 = (__u32) pd;
-        p_list[pid].regs.eflags = 0x0;
-        p_list[pid].kstack.ss0 = 0x18;
-        p_list[pid].kstack.esp0 = kstack  + PAGE_SIZE  ;
-
-        p_list[pid].regs.eax = 0;
-        p_list[pid].regs.ecx = 0;
-        p_list[pid].regs.edx = 0;
-        p_list[pid].regs.ebx = 0;
-
-        p_list[pid].regs.ebp = 0;
-        p_list[pid].regs.esi = 0;
-        p_list[pid].regs.edi = 0;
+        if (process_init_context(&p_list[pid], start_uaddr, ustack) != 0) {
+		kprintf("PANIC: no kernel stack for process %d\n", pid);
+		return;
+	}
+
         p_list[pid].state = PROC_READY;
 
      return;
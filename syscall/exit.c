@@ -2,15 +2,24 @@
 #include <debug.h>
 #include <list.h>
 #include <physmem.h>
+#include <uvmm.h>
+#include <interrupt.h>
+#include <schedule.h>
+#include <fpu.h>
 
 int sys_exit(){
 
        int nb_pt ;
-        __u32 pd_paddr, kstack ;
+        __u32 flags ;
        struct page_table * pt_to_del ;
 
-        kstack = paging_virtual_to_physical(page_directory, current->kstack.esp0 - PAGE_SIZE);
-        physmem_unref_physpage(kstack);
+        /* Release the arenas while the address space is still the
+           current one: the mapped files write back their pages */
+        if (current->address_space)
+          {
+            uvmm_delete_as(current->address_space);
+            current->address_space = NULL;
+          }
 
        list_foreach_named(current->list_pt, pt_to_del , nb_pt, prev, next)
        {
@@ -26,14 +35,17 @@ int sys_exit(){
        kvmm_free((__u32) struct_pt);
 
      }
-     /*Delete directory of pages*/
-     pd_paddr = current->regs.cr3 ;
-      physmem_unref_physpage(pd_paddr);
- 
 
+        fpu_release(current);
 
-        current->state = PROC_STOPPED ;
-        switch_to_task(0, KERNELMODE);
+        /* The kernel stack and the directory of pages are still in
+           use: schedule() releases them once we left the CPU */
+        disable_IRQs(flags);
+        current->state = PROC_ZOMBIE ;
+        schedule();
+
+        /* Never reached */
+        restore_IRQs(flags);
 
 
        return 0 ;
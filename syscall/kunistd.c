@@ -3,6 +3,12 @@
 #include <debug.h>
 #include <process.h>
 #include <vfs.h>
+#include <kfcntl.h>
+#include <kerrno.h>
+#include <syscall.h>
+#include <mm.h>
+#include <uvmm.h>
+#include <zero.h>
 
 int sys_write( __u32 fd, const void *buf, __u32 c) {
 	struct process     *process = current ;
@@ -98,4 +104,71 @@ int sys_stat(const char *path, struct stat *buf, int *ret) {
 }
 
 
+int sys_mmap(__u32 *uaddr, __u32 size, __u32 prot, __u32 flags,
+	     __u32 fd, __u32 offset) {
+	struct process     *process = current ;
+	struct uvmm_as *as = process_get_address_space(process);
+	__u32 access_rights = P_USER;
+	__u32 arena_flags = 0;
+	open_file_descriptor *ofd;
+
+	if (! as)
+		return -EFAULT;
+
+	// exactly one of MAP_SHARED and MAP_PRIVATE
+	if (!(flags & MAP_SHARED) == !(flags & MAP_PRIVATE))
+		return -EINVAL;
+
+	if (prot & (PROT_READ | PROT_EXEC))
+		access_rights |= P_READ;
+	if (prot & PROT_WRITE)
+		access_rights |= P_WRITE;
+	if (flags & MAP_SHARED)
+		arena_flags |= ARENA_MAP_SHARED;
+	if (flags & MAP_FIXED)
+		arena_flags |= ARENA_MAP_FIXED;
+
+	if (flags & MAP_ANONYMOUS)
+		return dev_zero_map(as, uaddr, size, access_rights, arena_flags);
+
+	if (fd >= FOPEN_MAX || ! process->fd[fd])
+		return -EBADF;
+	ofd = process->fd[fd];
+
+	if (ofd->f_ops->mmap == NULL) {
+		debug("No \"mmap\" method for this device.");
+		return -ENODEV;
+	}
+
+	// the modifications of a shared mapping go to the file
+	if ((flags & MAP_SHARED) && (prot & PROT_WRITE)
+	    && (ofd->flags & O_ACCMODE) == O_RDONLY)
+		return -EACCES;
+
+	return ofd->f_ops->mmap(ofd, as, uaddr, size, access_rights,
+				arena_flags, offset);
+}
 
+int sys_munmap(__u32 uaddr, __u32 size) {
+	struct process     *process = current ;
+	struct uvmm_as *as = process_get_address_space(process);
+
+	if (! as)
+		return -EFAULT;
+
+	return uvmm_unmap(as, uaddr, size);
+}
+
+int sys_sync(void) {
+	return vfs_sync();
+}
+
+/* Write back the data of the file, and its metadata unless datasync */
+int sys_fsync(__u32 fd, int datasync) {
+	struct process     *process = current ;
+
+	if (fd >= FOPEN_MAX || ! process->fd[fd])
+		return -EBADF;
+
+	return vfs_fsync(process->fd[fd], datasync);
+}
@@ -3,43 +3,41 @@
 #include <cpu_context.h>
 #include <kmalloc.h>
 #include <mm.h>
+#include <gdt.h>
 #include <process.h>
 #include <debug.h>
 #include <list.h>
 #include <syscall.h>
 #include <kerrno.h>
+#include <uaccess.h>
 
 
-int do_syscalls(int syscall_id,const struct cpu_state *user_ctxt)
-{
-
-
-     int ret ;
-
-       
-  switch(syscall_id)
-    {
+/*
+ * The system calls: each one retrieves its arguments from the user
+ * context, and returns the value given back to user space in %eax
+ */
+typedef int (*syscall_handler_t)(const struct cpu_state *user_ctxt);
 
 
-        case SYSCALL_ID_EXEC:{
-                   
+static int syscall_exec(const struct cpu_state *user_ctxt)
+{
            __u32 user_str, len , argc ;
           __u32  len_args;
            char **src_argaddr;
            char **ap;
-           char **param;
+           char **param = NULL;
            char * str;
-           int i;
+           int i, ret;
           /* Get the user arguments */
 	ret = syscall_get4args(user_ctxt, & user_str, & len,
-				      & src_argaddr, & len_args);
+				      (unsigned int *) & src_argaddr, & len_args);
 
             if (ret != 0 )
-	          break;
+	          return ret;
         ap = src_argaddr;
 	argc = 0;
- 
-         while (*ap++) 
+
+         while (*ap++)
 		argc++;
 
          if (argc) {
@@ -55,111 +53,110 @@ int do_syscalls(int syscall_id,const struct cpu_state *user_ctxt)
           str =(char*) kmalloc(len +1, 0);
 
           if (! str)
-	  {
-	    ret = -3;
-	    break;
-	  }
-   
+	    return -3;
+
          ret = strzcpy_from_user(str,user_str,len + 1);
 
           if (0 > ret)
 	  {
 	    kfree((__u32)str);
-	    break;
-	  } 
+	    return ret;
+	  }
 
-           sys_exec(str, param );
+           sys_exec(str, (void const *) param );
 
          struct process     *proc = current ;
          asm("mov %0, %%eax; mov %%eax, %%cr3"::"m"(proc->regs.cr3));
-             
-      }
 
-      break;
-    
-         case 2:{
+         return ret;
+}
+
+
+static int syscall_console_write(const struct cpu_state *user_ctxt)
+{
            __u32 u_str, len ;
-           
-           
            char * str;
-               
+           int ret;
+
           ret = syscall_get2args(user_ctxt, & u_str, & len);
 
             if (ret != 0 )
-	          break;
-          
+	          return ret;
+
 
           str =(char*) kmalloc(len +1, 0);
 
           if (! str)
-	  {
-	    ret = -3;
-	    break;
-	  }
-   
+	    return -3;
+
          ret = strzcpy_from_user(str,u_str,len + 1);
 
           if (0 > ret)
 	  {
 	    kfree((__u32)str);
-	    break;
-	  } 
+	    return ret;
+	  }
 
 
           kprintf("%s",(char*)str);
 
- 
-      
-     kfree((__u32)str); 
-
-          
-              
-      }
-      break;
+     kfree((__u32)str);
+     return ret;
+}
 
 
-case 3:{
-       
+static int syscall_exit(const struct cpu_state *user_ctxt __attribute__((unused)))
+{
        sys_exit();
-              
-      }
-      break;
- 
-case SYSCALL_ID_MOUNT :{
-        
-         __u32 user_src;
-	size_t srclen;
+       return 0;
+}
+
+
+/* The null system call: used to measure the cost of the entry/exit */
+static int syscall_getpid(const struct cpu_state *user_ctxt __attribute__((unused)))
+{
+       return current->pid;
+}
+
+
+static int syscall_mount(const struct cpu_state *user_ctxt)
+{
+	__u32 user_src;
 	char * kernel_src = NULL;
 	__u32 user_target;
-	size_t target_len;
 	char * kernel_target;
 	__u32 mountflags;
 	__u32 user_fstype;
 	char * kernel_fstype;
 	__u32 user_args;
 	char * kernel_args = NULL;
+	int ret;
 
+	ret = syscall_get5args( user_ctxt ,&user_src ,&user_target,
+				&user_fstype, &mountflags, &user_args);
+	if (OK != ret)
+	  return ret;
 
-      
-         ret = syscall_get7args( user_ctxt ,&user_src ,&srclen,
-				      &user_target , &target_len , &user_fstype,
-				      &mountflags,&user_args);
-
-          
-          if (user_src != (__u32)NULL)
+	if (user_src != (__u32)NULL)
 	  {
-            kernel_src =(char*) kmalloc(srclen +1 , 0);
-            ret = strzcpy_from_user(kernel_src,user_src,srclen + 1);
+            kernel_src =(char*) kmalloc(256 , 0);
+            ret = strzcpy_from_user(kernel_src,user_src,256);
+	    if (OK != ret)
+	      {
+		kfree((__u32)kernel_src);
+		return ret;
+	      }
 	 }
 
-            kernel_target =(char*) kmalloc(target_len + 1 , 0);
-            ret = strzcpy_from_user(kernel_target,user_target,target_len  + 1);
+            kernel_target =(char*) kmalloc(256 , 0);
+            ret = strzcpy_from_user(kernel_target,user_target,256);
 
 	if ( OK != ret)
 	  {
 	    if (kernel_src)
 	      kfree((__u32)kernel_src);
-	    break;
+	    kfree((__u32)kernel_target);
+	    return ret;
 	  }
 
           kernel_fstype =(char*) kmalloc(256 , 0);
@@ -170,7 +167,8 @@ case SYSCALL_ID_MOUNT :{
 	    if (kernel_src)
 	    kfree((__u32)kernel_src);
 	    kfree((__u32)kernel_target);
-	    break;
+	    kfree((__u32)kernel_fstype);
+	    return ret;
 	  }
 
 	if (user_args != (__u32)NULL)
@@ -184,22 +182,24 @@ case SYSCALL_ID_MOUNT :{
 		kfree((__u32)kernel_src);
 		kfree((__u32)kernel_target);
 		kfree((__u32)kernel_fstype);
-		break;
+		kfree((__u32)kernel_args);
+		return ret;
 	      }
 	  }
 
           vfs_mount(kernel_src, kernel_target, kernel_fstype );
-  
-              
-      }
-      break;
 
-case SYSCALL_ID_OPEN :{
-        
+          return ret;
+}
+
+
+static int syscall_open(const struct cpu_state *user_ctxt)
+{
         __u32 user_str;
 	__u32  len;
 	__u32  open_flags;
 	char * path;
+	int ret;
 
       ret = syscall_get3args(user_ctxt,
 				  &user_str, &len,&open_flags);
@@ -208,53 +208,62 @@ case SYSCALL_ID_OPEN :{
            ret = strzcpy_from_user(path,user_str,len + 1);
 
        if (OK != ret)
-	break;
+	{
+	  kfree((__u32)path);
+	  return ret;
+	}
 
         ret = sys_open( path , open_flags);
           kfree((__u32)path);
-             
-      }
-      break;
+        return ret;
+}
+
 
-case SYSCALL_ID_WRITE :{
-        
+static int syscall_write(const struct cpu_state *user_ctxt)
+{
         __u32 uaddr_buf;
 	__u32 buflen;
+	__u32 fd;
+	int ret;
 
-	int fd;
             ret = syscall_get3args(user_ctxt,
 				     &fd,&uaddr_buf,&buflen);
         if (OK != ret)
-	  break;
+	  return ret;
 
-         ret=sys_write(fd,(void*)uaddr_buf,buflen);
+	/* The file systems copy to/from any buffer in kernel space */
+	if (! user_range_ok(uaddr_buf, buflen))
+	  return -EFAULT;
 
-              
-      }
-      break;
+         return sys_write(fd,(void*)uaddr_buf,buflen);
+}
 
 
-case SYSCALL_ID_READ:{
+static int syscall_read(const struct cpu_state *user_ctxt)
+{
         __u32 uaddr_buf;
 	__u32 buflen;
+	__u32 fd;
+	int ret;
 
-	int fd;
             ret = syscall_get3args(user_ctxt,
 				     &fd,&uaddr_buf,&buflen);
         if (OK != ret)
-	  break;
+	  return ret;
 
-         ret=sys_read(fd,(void*)uaddr_buf,buflen);
-              
-      }
-      break;
+	if (! user_range_ok(uaddr_buf, buflen))
+	  return -EFAULT;
+
+         return sys_read(fd,(void*)uaddr_buf,buflen);
+}
 
 
-case SYSCALL_ID_BRK:
-      {
+static int syscall_brk(const struct cpu_state *user_ctxt)
+{
 	__u32 new_top_heap;
 	struct uvmm_as * as;
         struct process     *process = current ;
+	int ret;
 
 	as = process_get_address_space(process);
         if (! as)
@@ -265,25 +274,173 @@ case SYSCALL_ID_BRK:
 
 	ret = syscall_get1arg(user_ctxt,&new_top_heap);
 	if (OK != ret)
-	  break;
+	  return ret;
 
-	ret = uvmm_brk(as, new_top_heap);
+	return uvmm_brk(as, new_top_heap);
+}
 
-      }
-      break;
 
+static int syscall_mmap(const struct cpu_state *user_ctxt)
+{
+	__u32 ptr_hint_uaddr;
+	__u32 hint_uaddr;
+	__u32 size, prot, flags, fd, offset;
+	int ret;
+
+	ret = syscall_get6args(user_ctxt, &ptr_hint_uaddr, &size, &prot,
+			       &flags, &fd, &offset);
+	if (OK != ret)
+	  return ret;
 
-      default:
+	/* The address is an in/out parameter */
+	if (copy_from_user(&hint_uaddr, ptr_hint_uaddr, sizeof(hint_uaddr))
+	    != sizeof(hint_uaddr))
+	  return -EFAULT;
+
+	ret = sys_mmap(&hint_uaddr, size, prot, flags, fd, offset);
+	if (OK != ret)
+	  return ret;
+
+	if (copy_to_user(ptr_hint_uaddr, &hint_uaddr, sizeof(hint_uaddr))
+	    != sizeof(hint_uaddr))
+	  return -EFAULT;
+
+	return OK;
+}
+
+
+static int syscall_munmap(const struct cpu_state *user_ctxt)
+{
+	__u32 uaddr, size;
+	int ret;
+
+	ret = syscall_get2args(user_ctxt, &uaddr, &size);
+	if (OK != ret)
+	  return ret;
+
+	return sys_munmap(uaddr, size);
+}
+
+
+static int syscall_sync(const struct cpu_state *user_ctxt __attribute__((unused)))
+{
+	return sys_sync();
+}
+
+
+static int syscall_fsync(const struct cpu_state *user_ctxt)
+{
+	__u32 fd;
+	int ret;
+
+	ret = syscall_get1arg(user_ctxt, &fd);
+	if (OK != ret)
+	  return ret;
+
+	return sys_fsync(fd, 0);
+}
+
+
+static int syscall_fdatasync(const struct cpu_state *user_ctxt)
+{
+	__u32 fd;
+	int ret;
+
+	ret = syscall_get1arg(user_ctxt, &fd);
+	if (OK != ret)
+	  return ret;
+
+	return sys_fsync(fd, 1);
+}
+
+
+/** The system calls, indexed by their ID (see syscall.h) */
+static syscall_handler_t syscall_table[NR_SYSCALLS] = {
+  [SYSCALL_ID_CONSOLE_WRITE] = syscall_console_write,
+  [SYSCALL_ID_EXIT]          = syscall_exit,
+  [SYSCALL_ID_GETPID]        = syscall_getpid,
+  [SYSCALL_ID_EXEC]          = syscall_exec,
+  [SYSCALL_ID_MOUNT]         = syscall_mount,
+  [SYSCALL_ID_OPEN]          = syscall_open,
+  [SYSCALL_ID_READ]          = syscall_read,
+  [SYSCALL_ID_WRITE]         = syscall_write,
+  [SYSCALL_ID_BRK]           = syscall_brk,
+  [SYSCALL_ID_MMAP]          = syscall_mmap,
+  [SYSCALL_ID_MUNMAP]        = syscall_munmap,
+  [SYSCALL_ID_SYNC]          = syscall_sync,
+  [SYSCALL_ID_FSYNC]         = syscall_fsync,
+  [SYSCALL_ID_FDATASYNC]     = syscall_fdatasync,
+};
+
+
+int do_syscalls(int syscall_id,const struct cpu_state *user_ctxt)
+{
+  if ((syscall_id < 0) || (syscall_id >= NR_SYSCALLS)
+      || ! syscall_table[syscall_id])
+    {
       kprintf("unknown syscall %d\n", syscall_id);
-      break;
+      return -ENOSYS;
+    }
+
+  return syscall_table[syscall_id](user_ctxt);
+}
+
+
+/** Called by the SYSENTER entry (init.S) */
+int do_sysenter(int syscall_id, struct cpu_state *user_ctxt)
+{
+  /* No way back to user space without the return address */
+  if (OK != syscall_sysenter_frame(user_ctxt))
+    {
+      kprintf("sysenter: bad user stack, process %d killed\n", current->pid);
+      sys_exit();
     }
-  
- 
-  return 0 ;
 
-	
+  return do_syscalls(syscall_id, user_ctxt);
+}
+
+
+/*
+ * SYSENTER/SYSEXIT: the processor takes the kernel entry point from
+ * MSRs, and computes the segments from the kernel code selector: SS
+ * is the next descriptor, and SYSEXIT loads the 3rd and 4th ones for
+ * user space (see init_gdt())
+ */
+#define MSR_SYSENTER_CS   0x174
+#define MSR_SYSENTER_ESP  0x175
+#define MSR_SYSENTER_EIP  0x176
+
+#define CPUID_FEATURE_SEP (1 << 11)
+
+void _asm_sysenter(void);
+
+/* Only used until the entry code loads the kernel stack of the process */
+static __u32 sysenter_stack[16];
+
+static inline void wrmsr(__u32 msr, __u32 value)
+{
+  asm volatile("wrmsr" :: "c"(msr), "a"(value), "d"(0));
 }
 
+void syscall_subsystem_setup(void)
+{
+  __u32 eax, ebx, ecx, edx;
 
+  asm volatile("cpuid"
+	       : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+	       : "a"(1));
 
+  /* The first Pentium Pro report SEP but do not support it */
+  if (! (edx & CPUID_FEATURE_SEP)
+      || (((eax >> 8) & 0xf) == 6 && ((eax >> 4) & 0xf) < 3
+	  && (eax & 0xf) < 3))
+    {
+      kprintf("kernel: no SYSENTER, system calls through int 0x80\n");
+      return;
+    }
 
+  wrmsr(MSR_SYSENTER_CS, SYSENTER_KERNEL_CS);
+  wrmsr(MSR_SYSENTER_ESP,
+	(__u32) & sysenter_stack[sizeof(sysenter_stack)/sizeof(__u32)]);
+  wrmsr(MSR_SYSENTER_EIP, (__u32) _asm_sysenter);
+}
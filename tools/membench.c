@@ -0,0 +1,262 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+
+/*
+ * Host micro-benchmark of the memory primitives of klibc.c
+ * (include/memops.h), against the former byte loops and the host C
+ * library, for several sizes and misalignments.
+ *
+ * Build and run on any x86 host (32 or 64 bits):
+ *   gcc -O2 -I include tools/membench.c -o membench && ./membench
+ *
+ * The results are given in processor cycles per call (rdtsc), best of
+ * several runs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memops.h"
+
+
+#define NB_RUNS   16
+#define NB_CALLS  256
+
+/* Large enough for the biggest size plus misalignment */
+#define BUF_SIZE  (64 * 1024 + 64)
+
+/* Larger than the caches */
+#define COLD_AREA_SIZE (64 << 20)
+
+
+static inline unsigned long long rdtsc(void)
+{
+  unsigned int lo, hi;
+  asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((unsigned long long)hi << 32) | lo;
+}
+
+
+/* The former klibc implementations, for reference */
+static void *byte_memcpy(void *dst0, const void *src0, unsigned int size)
+{
+  volatile char *dst;
+  const char *src;
+  for (dst = (char*)dst0, src = (const char*)src0 ;
+       size > 0 ;
+       dst++, src++, size--)
+    *dst = *src;
+  return dst0;
+}
+
+static void *byte_memset(void *s, int c, unsigned int n)
+{
+  volatile unsigned char *d = (unsigned char*) s;
+  while (n--)
+    *d++ = (char)c;
+  return s;
+}
+
+
+typedef void (*copy_func_t)(void *dst, const void *src, unsigned int n);
+
+static void copy_byte(void *d, const void *s, unsigned int n)
+{ byte_memcpy(d, s, n); }
+static void copy_memops(void *d, const void *s, unsigned int n)
+{ memops_copy(d, s, n); }
+static void copy_libc(void *d, const void *s, unsigned int n)
+{ memcpy(d, s, n); }
+static void set_byte(void *d, const void *s, unsigned int n)
+{ byte_memset(d, 0, n); }
+static void set_memops(void *d, const void *s, unsigned int n)
+{ memops_set(d, 0, n); }
+static void set_libc(void *d, const void *s, unsigned int n)
+{ memset(d, 0, n); }
+static void move_memops(void *d, const void *s, unsigned int n)
+{ memops_move(d, s, n); }
+static void move_libc(void *d, const void *s, unsigned int n)
+{ memmove(d, s, n); }
+static void zero_page_nt(void *d, const void *s, unsigned int n)
+{ memops_zero_page_nt(d); }
+static void copy_page_nt(void *d, const void *s, unsigned int n)
+{ memops_copy_page_nt(d, s); }
+
+
+static unsigned long long bench(copy_func_t f, char *dst, const char *src,
+				unsigned int n)
+{
+  unsigned long long best = ~0ULL;
+  int run, i;
+
+  for (run = 0 ; run < NB_RUNS ; run++)
+    {
+      unsigned long long t0 = rdtsc();
+      for (i = 0 ; i < NB_CALLS ; i++)
+	f(dst, src, n);
+      t0 = rdtsc() - t0;
+      if (t0 < best)
+	best = t0;
+    }
+
+  return best / NB_CALLS;
+}
+
+
+/* Clear every page of a large area once: cycles per page */
+static unsigned long long bench_cold(copy_func_t f, char *pages)
+{
+  unsigned long long t0;
+  unsigned int offset;
+
+  t0 = rdtsc();
+  for (offset = 0 ; offset < COLD_AREA_SIZE ; offset += MEMOPS_PAGE_SIZE)
+    f(pages + offset, NULL, MEMOPS_PAGE_SIZE);
+  t0 = rdtsc() - t0;
+
+  return t0 / (COLD_AREA_SIZE / MEMOPS_PAGE_SIZE);
+}
+
+
+/* Check the result of the function against the host C library */
+static int check(copy_func_t f, char *dst, const char *src, unsigned int n,
+		 int is_set)
+{
+  char *ref = malloc(n + 8);
+  int ok;
+
+  memset(dst - 4, 0x5a, n + 8);
+  memset(ref, 0x5a, n + 8);
+  if (is_set)
+    memset(ref + 4, 0, n);
+  else
+    memcpy(ref + 4, src, n);
+
+  f(dst, src, n);
+  ok = (memcmp(dst - 4, ref, n + 8) == 0);
+  free(ref);
+  return ok;
+}
+
+
+static char *aligned_alloc_buf(void)
+{
+  char *p = malloc(BUF_SIZE + 2 * MEMOPS_PAGE_SIZE);
+  return (char*)(((unsigned long)p + MEMOPS_PAGE_SIZE)
+		 & ~(unsigned long)(MEMOPS_PAGE_SIZE - 1));
+}
+
+
+int main(void)
+{
+  static const unsigned int sizes[] = { 7, 16, 24, 32, 48, 64, 128, 256, 1024, 4096, 65536 };
+  static const unsigned int misalign[] = { 0, 1, 3 };
+  static const unsigned int distances[] = { 3, 100, 1000 };
+  struct { const char *name; copy_func_t f; int is_set; } funcs[] = {
+    { "memcpy  byte",   copy_byte,   0 },
+    { "memcpy  memops", copy_memops, 0 },
+    { "memcpy  libc",   copy_libc,   0 },
+    { "memset  byte",   set_byte,    1 },
+    { "memset  memops", set_memops,  1 },
+    { "memset  libc",   set_libc,    1 },
+  };
+  char *src = aligned_alloc_buf();
+  char *dst = aligned_alloc_buf();
+  unsigned int s, a, f;
+  int errors = 0;
+
+  for (s = 0 ; s < BUF_SIZE ; s++)
+    src[s] = (char)(s * 7 + 1);
+
+  printf("%-16s %8s %6s %10s\n", "function", "size", "align", "cycles");
+  for (f = 0 ; f < sizeof(funcs)/sizeof(funcs[0]) ; f++)
+    for (s = 0 ; s < sizeof(sizes)/sizeof(sizes[0]) ; s++)
+      for (a = 0 ; a < sizeof(misalign)/sizeof(misalign[0]) ; a++)
+	{
+	  char *d = dst + 8 + misalign[a];
+	  if (! check(funcs[f].f, d, src + 8, sizes[s], funcs[f].is_set))
+	    {
+	      printf("%-16s %8u %6u    MISMATCH\n", funcs[f].name,
+		     sizes[s], misalign[a]);
+	      errors ++;
+	      continue;
+	    }
+	  printf("%-16s %8u %6u %10llu\n", funcs[f].name, sizes[s],
+		 misalign[a], bench(funcs[f].f, d, src + 8, sizes[s]));
+	}
+
+  /* Overlapping moves, destination above the source: the "align"
+     column gives the distance between them */
+  for (s = 0 ; s < sizeof(sizes)/sizeof(sizes[0]) ; s++)
+    for (a = 0 ; a < sizeof(distances)/sizeof(distances[0]) ; a++)
+      {
+	unsigned int n = sizes[s], dist = distances[a];
+	char *ref = malloc(n + dist);
+	memcpy(ref, src, n + dist);
+	memmove(ref + dist, ref, n);
+	memcpy(dst, src, n + dist);
+	memops_move(dst + dist, dst, n);
+	if (memcmp(dst, ref, n + dist))
+	  {
+	    printf("%-16s %8u %6u    MISMATCH\n", "memmove memops", n, dist);
+	    errors ++;
+	  }
+	else
+	  {
+	    printf("%-16s %8u %6u %10llu\n", "memmove memops", n, dist,
+		   bench(move_memops, dst + dist, dst, n));
+	    printf("%-16s %8u %6u %10llu\n", "memmove libc", n, dist,
+		   bench(move_libc, dst + dist, dst, n));
+	  }
+	free(ref);
+      }
+
+  /* Whole pages, hot in the cache */
+  printf("%-16s %8u %6u %10llu\n", "page zero memops", MEMOPS_PAGE_SIZE, 0,
+	 bench(set_memops, dst, src, MEMOPS_PAGE_SIZE));
+  printf("%-16s %8u %6u %10llu\n", "page zero nt", MEMOPS_PAGE_SIZE, 0,
+	 bench(zero_page_nt, dst, src, MEMOPS_PAGE_SIZE));
+  printf("%-16s %8u %6u %10llu\n", "page copy memops", MEMOPS_PAGE_SIZE, 0,
+	 bench(copy_memops, dst, src, MEMOPS_PAGE_SIZE));
+  printf("%-16s %8u %6u %10llu\n", "page copy nt", MEMOPS_PAGE_SIZE, 0,
+	 bench(copy_page_nt, dst, src, MEMOPS_PAGE_SIZE));
+  if (memcmp(dst, src, MEMOPS_PAGE_SIZE))
+    {
+      printf("page copy nt: MISMATCH\n");
+      errors ++;
+    }
+
+  /* Whole pages, each touched once, as the pages handed out by the
+     kernel */
+  {
+    char *area = malloc(COLD_AREA_SIZE + MEMOPS_PAGE_SIZE);
+    char *pages = (char*)(((unsigned long)area + MEMOPS_PAGE_SIZE - 1)
+			  & ~(unsigned long)(MEMOPS_PAGE_SIZE - 1));
+
+    printf("%-16s %8u %6s %10llu\n", "cold zero byte", MEMOPS_PAGE_SIZE, "-",
+	   bench_cold(set_byte, pages));
+    printf("%-16s %8u %6s %10llu\n", "cold zero memops", MEMOPS_PAGE_SIZE, "-",
+	   bench_cold(set_memops, pages));
+    printf("%-16s %8u %6s %10llu\n", "cold zero nt", MEMOPS_PAGE_SIZE, "-",
+	   bench_cold(zero_page_nt, pages));
+    free(area);
+  }
+
+  return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -1,70 +1,203 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
 
 #include <types.h>
+#include <klibc.h>
 #include <mm.h>
 #include <debug.h>
 #include <kerrno.h>
-#include <kmalloc.h>
+#include <uaccess.h>
+
+
+/* Bounds of the exception table, defined by the linker script */
+extern struct exception_table_entry __start___ex_table[];
+extern struct exception_table_entry __stop___ex_table[];
+
 
-int usercpy(__u32 dst_uaddr,__u32 src_uaddr, size_t size)
+/**
+ * Record that the instruction at label 'from' may fault on a user
+ * address, execution resuming at label 'to'
+ */
+#define EX_TABLE(from,to) \
+  ".section __ex_table,\"a\"\n" \
+  "	.align 4\n" \
+  "	.long " #from "," #to "\n" \
+  ".previous\n"
+
+
+__u32 search_exception_table(__u32 eip)
 {
-  __u32 kern_addr;
-  int retval;
+  struct exception_table_entry * ex;
 
-  if (size <= 0)
-    return 0;
+  for (ex = __start___ex_table ; ex < __stop___ex_table ; ex++)
+    if (ex->insn == eip)
+      return ex->fixup;
+
+  return (__u32)NULL;
+}
 
-  /* Make sure user is trying to access user space */
-  if (! PAGING_IS_USER_AREA(src_uaddr, size) )
-    return -EPERM;
-  if (! PAGING_IS_USER_AREA(dst_uaddr, size) )
-    return -EPERM;
 
-  kern_addr = kmalloc(size, 0);
-  if (! kern_addr)
-    return -ENOMEM;
+/** Check that the range only covers user pages (the page tables of
+    the mirroring are not user pages) */
+bool user_range_ok(__u32 uaddr, __u32 size)
+{
+  if (! PAGING_IS_USER_AREA(uaddr, size))
+    return false;
+  if (uaddr + size < uaddr)
+    return false;
+  return (uaddr + size <= PAGE_TABLE_MAP);
+}
 
-  memcpy(kern_addr, src_uaddr,size);
-  memcpy(dst_uaddr, kern_addr,size);
 
-  kfree((__u32)kern_addr);
+/**
+ * The copy itself: 32-bit words, then the remaining bytes. The
+ * registers hold the state of the copy at any time, so that a fault
+ * only has to compute what is left to copy.
+ *
+ * @return The number of bytes NOT copied
+ */
+static __u32 copy_nocheck(void * to, const void * from, __u32 size)
+{
+  int d0, d1, d2;
+
+  asm volatile("0:	rep; movsl\n"
+	       "	movl %3,%0\n"
+	       "1:	rep; movsb\n"
+	       "2:\n"
+	       ".section .fixup,\"ax\"\n"
+	       "3:	lea 0(%3,%0,4),%0\n"
+	       "	jmp 2b\n"
+	       ".previous\n"
+	       EX_TABLE(0b,3b)
+	       EX_TABLE(1b,2b)
+	       : "=&c"(size), "=&D"(d0), "=&S"(d1), "=&r"(d2)
+	       : "3"(size & 3), "0"(size / 4), "1"(to), "2"(from)
+	       : "memory");
 
   return size;
 }
 
 
+int copy_from_user(void * kernel_to, __u32 user_from, __u32 size)
+{
+  if (! user_range_ok(user_from, size))
+    return -EFAULT;
+
+  return size - copy_nocheck(kernel_to, (const void*)user_from, size);
+}
+
+
+int copy_to_user(__u32 user_to, const void * kernel_from, __u32 size)
+{
+  if (! user_range_ok(user_to, size))
+    return -EFAULT;
+
+  return size - copy_nocheck((void*)user_to, kernel_from, size);
+}
 
-static int nocheck_user_strzcpy(char *dst, const char *src,
-				      __u32 len)
+
+int copy_to_buffer(void * to, const void * from, __u32 size)
 {
+  /* The kernel itself reading a file */
+  if ((__u32)to < USER_OFFSET)
+    {
+      memcpy(to, from, size);
+      return size;
+    }
 
-  unsigned int i;
- 
+  return copy_to_user((__u32)to, from, size);
+}
 
 
-  for (i = 0; i < len; i++)
+int copy_from_buffer(void * to, const void * from, __u32 size)
+{
+  if ((__u32)from < USER_OFFSET)
     {
-      dst[i] = src[i];
-      if(src[i] == '\0')
-        break;
+      memcpy(to, from, size);
+      return size;
     }
-  
-  dst[len-1] = '\0'; 
 
+  return copy_from_user(to, (__u32)from, size);
+}
+
+
+int usercpy(__u32 dst_uaddr, __u32 src_uaddr, size_t size)
+{
+  if (size <= 0)
+    return 0;
 
-  return 0;
+  /* Make sure user is trying to access user space */
+  if (! user_range_ok(src_uaddr, size) )
+    return -EPERM;
+  if (! user_range_ok(dst_uaddr, size) )
+    return -EPERM;
 
+  /* Both buffers are mapped in the current address space */
+  return size - copy_nocheck((void*)dst_uaddr, (const void*)src_uaddr,
+			     size);
 }
 
 
 int strzcpy_from_user(char *kernel_to, __u32 user_from,
-				__u32 max_len)
+		      __u32 max_len)
 {
+  int retval;
+  int d0, d1, d2;
+  __u32 len = max_len;
 
   /* Don't allow invalid max_len */
   if ( (max_len < 1) || (max_len > PAGING_USER_SPACE_SIZE) ){
      debug();
-    return -1;
+    return -EFAULT;
    }
 
-  return nocheck_user_strzcpy(kernel_to, (const char*)user_from, max_len);
+  if (! user_range_ok(user_from, 1))
+    return -EFAULT;
+
+  /* The page tables are mirrored right after the user space, and can
+     be read without faulting: stop before */
+  if (len > PAGE_TABLE_MAP - user_from)
+    len = PAGE_TABLE_MAP - user_from;
+
+  /* Copy up to len bytes, stopping after the '\0'. Reading an
+     unmapped user page faults, and is caught as well */
+  asm volatile("0:	lodsb\n"
+	       "	stosb\n"
+	       "	testb %%al,%%al\n"
+	       "	jz 1f\n"
+	       "	decl %0\n"
+	       "	jnz 0b\n"
+	       "1:\n"
+	       ".section .fixup,\"ax\"\n"
+	       "2:	movl %7,%1\n"
+	       "	jmp 1b\n"
+	       ".previous\n"
+	       EX_TABLE(0b,2b)
+	       : "=&c"(d0), "=&r"(retval), "=&S"(d1), "=&D"(d2)
+	       : "0"(len), "1"(OK), "2"(user_from), "i"(-EFAULT),
+		 "3"(kernel_to)
+	       : "eax", "memory");
+
+  /* Cut by the end of the user space */
+  if ((OK == retval) && (d0 == 0) && (len < max_len))
+    retval = -EFAULT;
+
+  kernel_to[max_len-1] = '\0';
+  return retval;
 }
@@ -1,38 +1,113 @@
 
 #include <libc.h>
+#include <crt.h>
 #include <syscall.h>
 
-inline
-int _syscall3(int id,
+/*
+ * The system call entries: the ID goes in %eax, the arguments in
+ * %ebx, %ecx, %edx, %esi, %edi and %ebp. SYSENTER does not save the
+ * user stack nor the return address: the stub gives its stack in
+ * %ebp, with the return address and the 6th argument on top of it
+ */
+asm(".text\n"
+    ".globl _syscall_int80\n"
+    "_syscall_int80:\n"
+    "  pushl %ebx\n"
+    "  pushl %esi\n"
+    "  pushl %edi\n"
+    "  pushl %ebp\n"
+    "  movl 20(%esp),%eax\n"
+    "  movl 24(%esp),%ebx\n"
+    "  movl 28(%esp),%ecx\n"
+    "  movl 32(%esp),%edx\n"
+    "  movl 36(%esp),%esi\n"
+    "  movl 40(%esp),%edi\n"
+    "  movl 44(%esp),%ebp\n"
+    "  int  $0x80\n"
+    "  popl %ebp\n"
+    "  popl %edi\n"
+    "  popl %esi\n"
+    "  popl %ebx\n"
+    "  ret\n"
+    ".globl _syscall_sysenter\n"
+    "_syscall_sysenter:\n"
+    "  pushl %ebx\n"
+    "  pushl %esi\n"
+    "  pushl %edi\n"
+    "  pushl %ebp\n"
+    "  movl 20(%esp),%eax\n"
+    "  movl 24(%esp),%ebx\n"
+    "  movl 28(%esp),%ecx\n"
+    "  movl 32(%esp),%edx\n"
+    "  movl 36(%esp),%esi\n"
+    "  movl 40(%esp),%edi\n"
+    "  pushl 44(%esp)\n"
+    "  pushl $1f\n"
+    "  movl %esp,%ebp\n"
+    "  sysenter\n"
+    "1:addl $8,%esp\n"
+    "  popl %ebp\n"
+    "  popl %edi\n"
+    "  popl %esi\n"
+    "  popl %ebx\n"
+    "  ret\n");
+
+typedef int (*syscall_entry_t)(int id,
+			       unsigned int arg1,
+			       unsigned int arg2,
+			       unsigned int arg3,
+			       unsigned int arg4,
+			       unsigned int arg5,
+			       unsigned int arg6);
+
+/* Chosen at the first system call, like the kernel does at boot */
+static syscall_entry_t syscall_entry;
+
+int _syscall_sysenter_supported(void)
+{
+  unsigned int eax, ebx, ecx, edx;
+
+  asm volatile("cpuid"
+	       : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+	       : "a"(1));
+
+  /* SEP flag, wrong on the first Pentium Pro */
+  return (edx & (1 << 11))
+    && ! (((eax >> 8) & 0xf) == 6 && ((eax >> 4) & 0xf) < 3
+	  && (eax & 0xf) < 3);
+}
+
+static syscall_entry_t syscall_select_entry(void)
+{
+  if (! _syscall_sysenter_supported())
+    return _syscall_int80;
+
+  return _syscall_sysenter;
+}
+
+int _syscall6(int id,
 		  unsigned int arg1,
 		  unsigned int arg2,
-		  unsigned int arg3)
+		  unsigned int arg3,
+		  unsigned int arg4,
+		  unsigned int arg5,
+		  unsigned int arg6)
 {
-   int ret;
-
-  asm volatile("movl %1,%%eax \n"
-	       "movl %2,%%ebx \n"
-	       "movl %3,%%ecx \n"
-	       "movl %4,%%edx \n"
-	       "int  %5\n"
-	       "movl %%eax, %0"
-	       :"=g"(ret)
-	       :"g"(id),"g"(arg1),"g"(arg2),"g"(arg3)
-	        ,"i"(0x80)
-	       :"eax","ebx","ecx","edx","memory");
+  if (! syscall_entry)
+    syscall_entry = syscall_select_entry();
 
-  return ret;
+  return syscall_entry(id, arg1, arg2, arg3, arg4, arg5, arg6);
 }
 
 int _syscall0(int id)
 {
-  return _syscall3(id, 0, 0, 0);
+  return _syscall6(id, 0, 0, 0, 0, 0, 0);
 }
 
 int _syscall1(int id,
 	     unsigned int arg1)
 {
-  return _syscall3(id, arg1, 0, 0);
+  return _syscall6(id, arg1, 0, 0, 0, 0, 0);
 }
 
 
@@ -40,7 +115,15 @@ int _syscall2(int id,
 		  unsigned int arg1,
 		  unsigned int arg2)
 {
-  return _syscall3(id, arg1, arg2, 0);
+  return _syscall6(id, arg1, arg2, 0, 0, 0, 0);
+}
+
+int _syscall3(int id,
+		  unsigned int arg1,
+		  unsigned int arg2,
+		  unsigned int arg3)
+{
+  return _syscall6(id, arg1, arg2, arg3, 0, 0, 0);
 }
 
 int _syscall4(int id,
@@ -49,37 +132,38 @@ int _syscall4(int id,
 		  unsigned int arg3,
 		  unsigned int arg4)
 {
-  unsigned int args[] = { arg3, arg4 };
-  return _syscall3(id, arg1, arg2, (unsigned)args);
+  return _syscall6(id, arg1, arg2, arg3, arg4, 0, 0);
 }
 
 
-int _syscall7(int id,
+int _syscall5(int id,
 		  unsigned int arg1,
 		  unsigned int arg2,
 		  unsigned int arg3,
 		  unsigned int arg4,
-		  unsigned int arg5,
-		  unsigned int arg6,
-		  unsigned int arg7)
+		  unsigned int arg5)
 {
-  unsigned int args[] = { arg3, arg4, arg5, arg6, arg7 };
-  return _syscall3(id, arg1, arg2, (unsigned)args);
+  return _syscall6(id, arg1, arg2, arg3, arg4, arg5, 0);
 }
 
 
 void _exit()
 {
-  _syscall0(0x03);
+  _syscall0(SYSCALL_ID_EXIT);
   
   /* Never reached ! */
   for ( ; ; )
     ;
 }
 
+int _getpid(void)
+{
+  return _syscall0(SYSCALL_ID_GETPID);
+}
+
 int _console_write(char * str)
 {
-  return _syscall2(0x02, str,
+  return _syscall2(SYSCALL_ID_CONSOLE_WRITE, (unsigned int)str,
 		       strlen(str));
 }
 
@@ -90,9 +174,9 @@ int _mount(const char *source, const char *target,
   if (!target || !filesystemtype)
     return -1;
 
-  return  _syscall7( SYSCALL_ID_MOUNT,
-		       (unsigned int)source, source?strlen(source):0,
-		       (unsigned int)target, strlen(target),
+  return  _syscall5( SYSCALL_ID_MOUNT,
+		       (unsigned int)source,
+		       (unsigned int)target,
 		       (unsigned int)filesystemtype,
 		       mountflags,
 		       (unsigned int)args);
@@ -130,6 +214,40 @@ void * _brk(void * new_top_address)
 			      (unsigned)new_top_address);
 }
 
+void * _mmap(void * start, __u32 length, int prot, int flags,
+	     int fd, __u32 offset)
+{
+  void * uaddr = start;
+  int retval;
+
+  retval = _syscall6(SYSCALL_ID_MMAP, (unsigned int)&uaddr,
+		     length, prot, flags, fd, offset);
+  if (retval < 0)
+    return NULL;
+
+  return uaddr;
+}
+
+int _munmap(void * start, __u32 length)
+{
+  return _syscall2(SYSCALL_ID_MUNMAP, (unsigned int)start, length);
+}
+
+int _sync(void)
+{
+  return _syscall0(SYSCALL_ID_SYNC);
+}
+
+int _fsync(int fd)
+{
+  return _syscall1(SYSCALL_ID_FSYNC, fd);
+}
+
+int _fdatasync(int fd)
+{
+  return _syscall1(SYSCALL_ID_FDATASYNC, fd);
+}
+
 int _exec(const char * prog,
 	      void const* args,
 	      size_t arglen)
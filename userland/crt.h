@@ -3,8 +3,29 @@
 
 #include <types.h>
 
+/**
+ * The two ways into the kernel, with the system call ID and its 6
+ * arguments. The other functions choose the fastest one supported
+ * by the processor.
+ */
+int _syscall_int80(int id, unsigned int arg1, unsigned int arg2,
+		   unsigned int arg3, unsigned int arg4,
+		   unsigned int arg5, unsigned int arg6);
+
+int _syscall_sysenter(int id, unsigned int arg1, unsigned int arg2,
+		      unsigned int arg3, unsigned int arg4,
+		      unsigned int arg5, unsigned int arg6);
+
+/**
+ * TRUE when _syscall_sysenter() may be used: the same test as the
+ * kernel, which otherwise does not set SYSENTER up
+ */
+int _syscall_sysenter_supported(void);
+
 int _console_write(char * str);
 
+int _getpid(void);
+
 void _exit () __attribute__((noreturn));
 
 int _mount(const char *source, const char *target,
@@ -32,5 +53,29 @@ int _exec(const char * prog,
  * Syscall to get/set heap top address
  */
 void * _brk(void * new_top_address);
+
+/**
+ * Syscall to map a file (or anonymous memory, with MAP_ANONYMOUS) in
+ * the address space of the current process. See PROT_* and MAP_* in
+ * syscall.h
+ *
+ * @return The address of the mapping, NULL on error
+ */
+void * _mmap(void * start, __u32 length, int prot, int flags,
+	     int fd, __u32 offset);
+
+/**
+ * Syscall to unmap the given range of the address space
+ */
+int _munmap(void * start, __u32 length);
+
+/**
+ * Syscalls to write the dirty data back to the disks: of all the
+ * files, of one file with its metadata, of one file without the
+ * metadata not needed to read it back
+ */
+int _sync(void);
+int _fsync(int fd);
+int _fdatasync(int fd);
 #endif
 
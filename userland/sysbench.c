@@ -0,0 +1,71 @@
+#include <libc.h>
+#include <crt.h>
+#include <types.h>
+#include <syscall.h>
+
+/*
+ * Cost of a null system call (getpid), through "int $0x80" and
+ * through SYSENTER/SYSEXIT, in processor cycles per call (rdtsc),
+ * best of several runs.
+ */
+
+#define NB_RUNS   8
+#define NB_CALLS  1000
+
+static unsigned long long rdtsc(void)
+{
+  unsigned long long tsc;
+  asm volatile("rdtsc" : "=A"(tsc));
+  return tsc;
+}
+
+static void print_number(unsigned int n)
+{
+  char buf[12];
+  int i = sizeof(buf) - 1;
+
+  buf[i] = '\0';
+  do {
+    buf[--i] = '0' + n % 10;
+    n /= 10;
+  } while (n);
+
+  _console_write(&buf[i]);
+}
+
+static unsigned int bench(int (*entry)(int, unsigned int, unsigned int,
+				       unsigned int, unsigned int,
+				       unsigned int, unsigned int))
+{
+  unsigned long long best = ~0ULL;
+  int run, i;
+
+  for (run = 0 ; run < NB_RUNS ; run++)
+    {
+      unsigned long long start = rdtsc();
+      for (i = 0 ; i < NB_CALLS ; i++)
+	entry(SYSCALL_ID_GETPID, 0, 0, 0, 0, 0, 0);
+      start = rdtsc() - start;
+      if (start < best)
+	best = start;
+    }
+
+  return (unsigned int)(best / NB_CALLS);
+}
+
+int main(int argc, char *argv[])
+{
+  _console_write("sysbench: getpid, int 0x80 : ");
+  print_number(bench(_syscall_int80));
+  _console_write(" cycles\n");
+
+  if (_syscall_sysenter_supported())
+    {
+      _console_write("sysbench: getpid, sysenter : ");
+      print_number(bench(_syscall_sysenter));
+      _console_write(" cycles\n");
+    }
+
+  _exit();
+  return 0;
+}
@@ -27,6 +27,8 @@
 #include <klibc.h>
 #include <fd_types.h>
 #include <debug.h>
+#include <pagecache.h>
+#include <writeback.h>
 
 #define LOOKUP_PARENT 1 
 
@@ -252,12 +254,54 @@ int vfs_close(open_file_descriptor *ofd) {
 	klog("d_pdentry: %d", ofd->dentry->d_pdentry);
 */
 	ofd->dentry->d_inode->i_count--;
+
+	if (ofd->f_ops && ofd->f_ops->close) {
+		ofd->f_ops->close(ofd);
+	}
 	
 	kfree((__u32) ofd->pathname);
 	kfree((__u32) ofd);
 	return 0;
 }
 
+int vfs_writeback(__u32 age) {
+	mounted_fs_t *aux;
+	int ret = 0;
+
+	writeback_begin();
+	if (pagecache_sync_older(age) != 0) {
+		ret = -EIO;
+	}
+	for (aux = mount_list; aux != NULL; aux = aux->next) {
+		if (aux->instance->fs && aux->instance->fs->sync && aux->instance->fs->sync(aux->instance) != 0) {
+			ret = -EIO;
+		}
+	}
+	writeback_end();
+	return ret;
+}
+
+int vfs_sync(void) {
+	return vfs_writeback(0);
+}
+
+int vfs_fsync(open_file_descriptor *ofd, int datasync) {
+	int ret;
+
+	if (ofd == NULL) {
+		return -EBADF;
+	}
+	// Nothing kept in memory.
+	if (ofd->f_ops == NULL || ofd->f_ops->fsync == NULL) {
+		return 0;
+	}
+
+	writeback_begin();
+	ret = ofd->f_ops->fsync(ofd, datasync);
+	writeback_end();
+	return ret;
+}
+
 void vfs_mount(const char *device, const char *mountpoint, const char *type) {
 	available_fs_t *aux = fs_list;
 	open_file_descriptor* ofd = NULL;
@@ -283,18 +327,28 @@ void vfs_mount(const char *device, const char *mountpoint, const char *type) {
 
 int vfs_umount(const char *mountpoint) {
 	mounted_fs_t *aux = mount_list;
+	mounted_fs_t **prev = &mount_list;
 	while (aux != NULL) {
 		if (strcmp(aux->name, mountpoint) == 0) {
+			// The flusher must not see it anymore.
+			writeback_begin();
+			*prev = aux->next;
 			if (aux->instance->fs->umount != NULL) {
+				/* The instance is released by umount */
+				open_file_descriptor *device = aux->instance->device;
 				aux->instance->fs->umount(aux->instance);
 				/* Close the device ofd. */
-				if (aux->instance->device != NULL && aux->instance->device->f_ops->close) {
-					aux->instance->device->f_ops->close(aux->instance->device);
+				if (device != NULL && device->f_ops->close) {
+					device->f_ops->close(device);
 				}
 			}
+			writeback_end();
 			root_vfs.d_inode->i_nlink--;
+			kfree((__u32) aux->name);
+			kfree((__u32) aux);
 			return 0;
 		}
+		prev = &aux->next;
 		aux = aux->next;
 	}
 	return 1;
@@ -0,0 +1,227 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+
+#include <types.h>
+#include <klibc.h>
+#include <kmalloc.h>
+#include <list.h>
+#include <debug.h>
+#include <interrupt.h>
+#include <time.h>
+#include <kthread.h>
+#include <workqueue.h>
+
+struct workqueue *kernel_wq;
+
+/** The delayed works whose delay runs, of all the workqueues */
+static struct delayed_work *timer_list;
+
+
+/* Called with the IRQs disabled */
+static bool _queue_work(struct workqueue *wq, struct work *work)
+{
+  if (work->pending)
+    return false;
+
+  work->pending = true;
+  list_add_tail(wq->work_list, work);
+  wq->queued++;
+
+  kwaitq_wakeup(& wq->work_wait, 1, OK);
+  return true;
+}
+
+
+static void worker_thread(void *arg)
+{
+  struct workqueue *wq = (struct workqueue*) arg;
+  __u32 flags;
+
+  for (;;)
+    {
+      struct work *work;
+
+      disable_IRQs(flags);
+      while (list_is_empty(wq->work_list))
+	kwaitq_wait(& wq->work_wait);
+
+      work = list_pop_head(wq->work_list);
+      work->pending = false;
+      restore_IRQs(flags);
+
+      /* The work may queue itself again from here */
+      work->func(work);
+
+      disable_IRQs(flags);
+      wq->done++;
+      if (! kwaitq_is_empty(& wq->flush_wait))
+	kwaitq_wakeup(& wq->flush_wait, MAXPID, OK);
+      restore_IRQs(flags);
+    }
+}
+
+
+struct workqueue *workqueue_create(const char *name)
+{
+  struct workqueue *wq;
+
+  wq = (struct workqueue*) kmalloc(sizeof(struct workqueue), 0);
+  if (! wq)
+    return NULL;
+
+  memset(wq, 0x0, sizeof(struct workqueue));
+  strzcpy(wq->name, name, KWQ_DEBUG_MAX_NAMELEN);
+  kwaitq_init(& wq->work_wait, name);
+  kwaitq_init(& wq->flush_wait, name);
+
+  wq->worker_pid = kthread_create(worker_thread, wq);
+  if (wq->worker_pid < 0)
+    {
+      debug("cannot create the worker of %s", name);
+      kfree((__u32) wq);
+      return NULL;
+    }
+
+  return wq;
+}
+
+
+void work_init(struct work *work, work_func_t func)
+{
+  memset(work, 0x0, sizeof(struct work));
+  work->func = func;
+}
+
+
+void delayed_work_init(struct delayed_work *dwork, work_func_t func)
+{
+  memset(dwork, 0x0, sizeof(struct delayed_work));
+  dwork->work.func = func;
+}
+
+
+bool queue_work(struct workqueue *wq, struct work *work)
+{
+  __u32 flags;
+  bool retval;
+
+  disable_IRQs(flags);
+  retval = _queue_work(wq, work);
+  restore_IRQs(flags);
+
+  return retval;
+}
+
+
+bool queue_delayed_work(struct workqueue *wq, struct delayed_work *dwork,
+			__u32 delay)
+{
+  __u32 flags;
+  bool retval = true;
+
+  disable_IRQs(flags);
+  if (dwork->timer_pending || dwork->work.pending)
+    retval = false;
+  else if (delay == 0)
+    retval = _queue_work(wq, & dwork->work);
+  else
+    {
+      dwork->wq = wq;
+      dwork->expires = clock_ticks + delay;
+      dwork->timer_pending = true;
+      list_add_tail(timer_list, dwork);
+    }
+  restore_IRQs(flags);
+
+  return retval;
+}
+
+
+bool cancel_delayed_work(struct delayed_work *dwork)
+{
+  __u32 flags;
+  bool retval = false;
+
+  disable_IRQs(flags);
+  if (dwork->timer_pending)
+    {
+      list_delete(timer_list, dwork);
+      dwork->timer_pending = false;
+      retval = true;
+    }
+  restore_IRQs(flags);
+
+  return retval;
+}
+
+
+void flush_workqueue(struct workqueue *wq)
+{
+  __u32 flags, target;
+
+  disable_IRQs(flags);
+  target = wq->queued;
+
+  /* The works are run in order: wait for the last one queued */
+  while ((int)(wq->done - target) < 0)
+    kwaitq_wait(& wq->flush_wait);
+
+  restore_IRQs(flags);
+}
+
+
+void workqueue_clock_tick(void)
+{
+  struct delayed_work *dwork;
+  int nb_dwork;
+  bool expired;
+  __u32 flags;
+
+  disable_IRQs(flags);
+
+  /* Several delays may expire at the same tick */
+  do
+    {
+      expired = false;
+      list_foreach(timer_list, dwork, nb_dwork)
+	{
+	  if ((int)(clock_ticks - dwork->expires) >= 0)
+	    {
+	      list_delete(timer_list, dwork);
+	      dwork->timer_pending = false;
+	      _queue_work(dwork->wq, & dwork->work);
+	      expired = true;
+	      break;
+	    }
+	}
+    }
+  while (expired);
+
+  restore_IRQs(flags);
+}
+
+
+int workqueue_subsystem_setup(void)
+{
+  kernel_wq = workqueue_create("kernel_wq");
+  if (! kernel_wq)
+    return -ENOMEM;
+
+  return OK;
+}
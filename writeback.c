@@ -0,0 +1,95 @@
+/* Copyright (C) 2004,2005  The DESIROS Team
+    desiros.dev@gmail.com
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307,
+   USA.
+ */
+
+#include <types.h>
+#include <debug.h>
+#include <interrupt.h>
+#include <kwaitq.h>
+#include <workqueue.h>
+#include <pagecache.h>
+#include <vfs.h>
+#include <writeback.h>
+
+static struct workqueue *flush_wq;
+static struct delayed_work flush_periodic;
+static struct work flush_now;
+
+/** Set while somebody writes back, the others wait in writeback_wait */
+static bool writeback_busy;
+static struct kwaitq writeback_wait;
+
+
+void writeback_begin(void)
+{
+  __u32 flags;
+
+  disable_IRQs(flags);
+  while (writeback_busy)
+    kwaitq_wait(& writeback_wait);
+  writeback_busy = true;
+  restore_IRQs(flags);
+}
+
+
+void writeback_end(void)
+{
+  __u32 flags;
+
+  disable_IRQs(flags);
+  writeback_busy = false;
+  if (! kwaitq_is_empty(& writeback_wait))
+    kwaitq_wakeup(& writeback_wait, 1, OK);
+  restore_IRQs(flags);
+}
+
+
+/* Run by the worker of flush_wq: the flusher thread */
+static void flush_work(struct work *work __attribute__((unused)))
+{
+  /* Above the dirty limit, everything goes: the pages of each file
+     are written in the order of the file */
+  if (pagecache_over_dirty_limit())
+    vfs_writeback(0);
+  else
+    vfs_writeback(WRITEBACK_DIRTY_EXPIRE);
+
+  queue_delayed_work(flush_wq, & flush_periodic, WRITEBACK_INTERVAL);
+}
+
+
+void writeback_kick(void)
+{
+  if (flush_wq)
+    queue_work(flush_wq, & flush_now);
+}
+
+
+int writeback_subsystem_setup(void)
+{
+  kwaitq_init(& writeback_wait, "writeback");
+  delayed_work_init(& flush_periodic, flush_work);
+  work_init(& flush_now, flush_work);
+
+  flush_wq = workqueue_create("flush");
+  if (! flush_wq)
+    return -ENOMEM;
+
+  queue_delayed_work(flush_wq, & flush_periodic, WRITEBACK_INTERVAL);
+  return OK;
+}